@@ -70,4 +70,6 @@ struct Music : public IAudio {
 	private:
 		// SDL_mixer object
 		void* music = nullptr; // Mix_Music*
+		// Content streamed by the music
+		void* file = nullptr; // ScarabVFS::File*
 };
@@ -4,8 +4,10 @@
 #include "scarablib/components/boundingbox.hpp"
 #include "scarablib/components/materialcomponent.hpp"
 #include "scarablib/components/physicscomponent.hpp"
+#include "scarablib/opengl/geometrypool.hpp"
 #include "scarablib/opengl/resourcesmanager.hpp"
 #include "scarablib/opengl/vertexarray.hpp"
+#include "scarablib/opengl/vertexpuller.hpp"
 
 // Basic data for 3D and 2D shapes
 class Mesh {
@@ -14,8 +16,11 @@ class Mesh {
 		std::shared_ptr<VertexArray> vertexarray = nullptr;
 		// This is kinda wrong, because each instance of a Mesh will have copied bundle (but same VAO at least)
 
+		// Range inside a GeometryPool. Used instead of `vertexarray` when set
+		std::shared_ptr<GeometryRange> geometry = nullptr;
+
 		// Material of this mesh
-		std::shared_ptr<Material> material = std::make_shared<Material>();
+		std::shared_ptr<Material> material = (Mesh::spawn_material != nullptr) ? Mesh::spawn_material : std::make_shared<Material>();
 		// Since material can be shared i need to be a pointer so a double delete is not done
 
 		// Bounding box
@@ -46,6 +51,24 @@ class Mesh {
 		template <typename T, typename U>
 		void set_geometry(const std::vector<T>& vertices, const std::vector<U>& indices);
 
+		// VAO used to draw this mesh.
+		// Meshes inside the same GeometryPool share it
+		inline uint32 get_vaoid() const noexcept {
+			if(this->vertex_pulling) {
+				return VertexPuller::empty_vao();
+			}
+			if(this->geometry != nullptr) {
+				return this->geometry->pool->get_vaoid();
+			}
+			return this->vertexarray->get_vaoid();
+		}
+
+		// Shader program used to draw this mesh.
+		// It is the material's, unless the mesh is drawn with vertex pulling
+		inline const std::shared_ptr<ShaderProgram>& get_shader() const noexcept {
+			return (this->vertex_pulling) ? this->pull_shader : this->material->shader;
+		}
+
 		inline glm::mat4 get_model_matrix() const noexcept {
 			return this->model;
 		}
@@ -73,10 +96,18 @@ class Mesh {
 		virtual void update_model_matrix() noexcept = 0;
 
 	protected:
+		friend class Scene;
+		// Given to meshes constructed while set instead of making a new material (see `Scene::spawn_many`)
+		static inline thread_local std::shared_ptr<Material> spawn_material = nullptr;
+
 		// Matrix
 		glm::mat4 model = glm::mat4(1.0f);
 		bool isdirty = true;
 		bool dynamic_bounding = false;
+		// Draws using VertexPuller instead of a VAO
+		bool vertex_pulling = false;
+		// Used instead of the material's shader while drawing with vertex pulling, so a shared material is not changed
+		std::shared_ptr<ShaderProgram> pull_shader = nullptr;
 
 		// This bitfield uses less memory
 		// 1 byte shared to both members (if bool, both would be 2 bytes)
@@ -1,11 +1,13 @@
 #pragma once
 
 #include "scarablib/geometry/mesh.hpp"
+#include "scarablib/geometry/modelasset.hpp"
 #include "scarablib/geometry/submesh.hpp"
 #include "scarablib/geometry/triangle.hpp"
 #include "scarablib/proper/dirtyproxy.hpp"
 #include "scarablib/typedef.hpp"
 #include "scarablib/geometry/vertex.hpp"
+#include "scarablib/utils/model.hpp"
 
 // An object used for as a base for 3D Shapes
 class Model : public Mesh {
@@ -22,13 +24,39 @@ class Model : public Mesh {
 		// Vertices and Indices will be used to gerate VBO and EBO in this VAO
 		template <typename T>
 		Model(const std::vector<Vertex>& vertices, const std::vector<T>& indices) noexcept;
-		// Make a model using a wavefront .obj file
-		Model(const char* path);
+		// Make a model using a wavefront .obj file.
+		// The file is loaded once and shared by all models made from it (see `ModelAsset::load`).
+		// - `format`: (Default: Float) How vertices are stored on the GPU.
+		//   Packed formats use less memory, but TexUV must be inside [0, 1] (Float is used otherwise)
+		Model(const char* path, const VertexFormat format = VertexFormat::Float);
+		// Make a model drawing a loaded asset. Only the transform and bounding box are its own.
+		// Throws ScarabError if `asset` is nullptr
+		Model(std::shared_ptr<ModelAsset> asset);
+		// Make a model using data already uploaded (e.g., from `ScarabModel::load_obj` or AssetLoader).
+		// The format of the vertices is `data.format`
+		Model(ScarabModel::ModelData&& data);
 
 		// TODO: Remove shader from paramters and get from material
 		// This method does not draw the model to the screen, as it does not bind the VAO and Shader (batch rendering)
 		virtual void draw_logic() noexcept override;
 
+		// Draws the model using vertex pulling (see `VertexPuller`) instead of its GeometryPool's VAO.
+		// While enabled it is drawn with `VertexPuller::default_shader()` instead of the material's shader.
+		// The material is not changed, so meshes sharing it and its shader are kept.
+		// Only models loaded from a file can use it.
+		// Throws ScarabError if the model has no GeometryRange or vertex pulling is not supported
+		void set_vertex_pulling(const bool value);
+
+		// Returns the asset this model draws, nullptr if not made from one
+		inline const std::shared_ptr<ModelAsset>& get_asset() const noexcept {
+			return this->asset;
+		}
+
+		// Returns true if the model is drawn using vertex pulling
+		inline bool is_vertex_pulling() const noexcept {
+			return this->vertex_pulling;
+		}
+
 		// Returns current angle
 		inline float get_angle() const noexcept {
 			return this->angle;
@@ -48,12 +76,17 @@ class Model : public Mesh {
 		// - `axis`: (must be normalized) Which axis the angle will be applied
 		void set_orientation(const float angle, const vec3<float>& axis) noexcept;
 
-		// Returns a vector of triangles from the model
+		// Returns a vector of triangles from the model.
+		// Uses the triangles of its ModelAsset if it is loaded, otherwise only reads the file (no upload).
 		// - `transform`: (Optional) Transform applied to the model
 		static std::vector<MeshTriangle> get_obj_triangles(const char* path, const glm::mat4& transform = glm::mat4(1.0f));
 
 	protected:
 		std::vector<SubMesh> submeshes;
+		// Keeps the submeshes' textures alive
+		std::vector<std::shared_ptr<Texture>> textures;
+		// Shared geometry, submeshes and textures. Used instead of `submeshes` and `textures` when set
+		std::shared_ptr<ModelAsset> asset;
 		// Need to have at least one axis to work, even if angle is 0.0
 		vec3<float> axis        = vec3<float>(1.0f, 0.0f, 0.0f);
 		// Rotation based on orientation
@@ -62,8 +95,18 @@ class Model : public Mesh {
 		float orient_angle      = 0.0f;
 		// Rotation
 		float angle             = 0.0f;
+		// Converts packed vertex positions to local space, applied after the model's transformation
+		glm::mat4 dequantize    = glm::mat4(1.0f);
+		// How vertices are stored in `geometry`
+		VertexFormat format     = VertexFormat::Float;
 
 		void update_model_matrix() noexcept override;
+
+	private:
+		// Draws `count` indices starting at `first`, from the GeometryPool or the VertexArray
+		void draw_elements(const uint32 count, const uint32 first) const noexcept;
+		// Makes the bounding box from bounds already known
+		void init_bounds(const vec3<float>& min, const vec3<float>& max) noexcept;
 };
 
 
@@ -74,8 +117,5 @@ Model::Model(const std::vector<Vertex>& vertices, const std::vector<T>& indices)
 	this->vertexarray->add_attribute<float>(3, false);
 	this->vertexarray->add_attribute<float>(2, true);
 
-	this->material->shader = ResourcesManager::get_instance().load_shader_program({
-		{ .source = Shaders::DEFAULT_VERTEX,   .type = Shader::Type::Vertex },
-		{ .source = Shaders::DEFAULT_FRAGMENT, .type = Shader::Type::Fragment },
-	});
+	this->material->shader = ResourcesManager::get_instance().builtin_program(ResourcesManager::Program::Default);
 }
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "scarablib/geometry/triangle.hpp"
+#include "scarablib/opengl/resourcecache.hpp"
+#include "scarablib/utils/model.hpp"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A model file loaded once and shared by all Models made from it.
+// Holds the uploaded geometry, submeshes, textures and bounds, and the triangles if requested.
+// Assets are cached by path, modification time and format, so spawning the same model again does not read the file.
+// Can be loaded from any thread, the file is read on the calling thread and uploaded by the OpenGL thread
+class ModelAsset {
+	public:
+		// Use `ModelAsset::load` instead, it uses the cache
+		ModelAsset(const char* path, ScarabModel::ModelData&& data, const VertexFormat format) noexcept;
+
+		// Delete copy
+		ModelAsset(const ModelAsset&) = delete;
+		ModelAsset& operator=(const ModelAsset&) = delete;
+
+		// Returns the asset of a wavefront-obj file, loading and uploading it if it is not cached or the file changed.
+		// A worker calling it waits until the OpenGL thread uploads the model (next frame).
+		// Throws ScarabError if the file is invalid or a texture is missing.
+		// - `format`: (Default: Float) How vertices are stored on the GPU
+		// - `keep_triangles`: (Default: false) Makes the triangles from the same read, see `get_triangles`
+		static std::shared_ptr<ModelAsset> load(const char* path, const VertexFormat format = VertexFormat::Float, const bool keep_triangles = false);
+
+		// Returns the cached asset of a file in any format, or nullptr if it is not loaded or the file changed
+		static std::shared_ptr<ModelAsset> find(const char* path) noexcept;
+
+		// Returns the cached asset of a file loaded with `format`, or nullptr if it is not loaded or the file changed.
+		// `format` is the one asked when loading, the asset may store its vertices as Float (see `get_format`)
+		static std::shared_ptr<ModelAsset> find(const char* path, const VertexFormat format) noexcept;
+
+		// Caches an asset made from a model read somewhere else (e.g., by AssetLoader).
+		// Returns the cached one if another thread stored the same model first
+		static std::shared_ptr<ModelAsset> store(const char* path, const ScarabModel::ObjSource& source, const VertexFormat format);
+
+		// Assets not used by any Model are kept for a while, evicted when over 128MB of VRAM
+		static ResourceCache<ModelAsset>& get_cache() noexcept;
+
+		// Releases all cached assets.
+		// WARNING: This is called inside Window destructor, DO NOT call it manually
+		static void cleanup() noexcept;
+
+		// Returns the uploaded submeshes, textures, geometry and bounds
+		inline const ScarabModel::ModelData& get_data() const noexcept {
+			return this->data;
+		}
+
+		// Returns how the vertices are stored on the GPU.
+		// May be Float even if a packed format was asked (see `ScarabModel::upload_mesh`)
+		inline VertexFormat get_format() const noexcept {
+			return this->data.format;
+		}
+
+		// Returns the path of the file
+		inline const std::string& get_path() const noexcept {
+			return this->path;
+		}
+
+		// Returns the triangles in local space, made on first use and kept.
+		// If not made while loading, the file is read again (from its binary mesh cache if it exists)
+		const std::vector<MeshTriangle>& get_triangles();
+
+		// Returns the triangles with a transform applied
+		std::vector<MeshTriangle> get_triangles(const glm::mat4& transform);
+
+	private:
+		std::string path;
+		ScarabModel::ModelData data;
+		// Format asked when loading, part of the cache key
+		VertexFormat format;
+		std::vector<MeshTriangle> triangles;
+		bool has_triangles = false;
+		// Triangles are made once, even if two threads ask for them
+		std::mutex triangles_mutex;
+
+		// Cache key of a file and format, 0 if the file does not exist
+		static size_t key(const char* path, const VertexFormat format) noexcept;
+};
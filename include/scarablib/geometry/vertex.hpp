@@ -1,8 +1,10 @@
 #pragma once
 
 #include "gtc/epsilon.hpp"
+#include "scarablib/geometry/vertexlayout.hpp"
 #include "scarablib/typedef.hpp"
 #include "scarablib/utils/hash.hpp"
+#include <cstring>
 #include <functional>
 
 // Mesh data uploaded to the GPU
@@ -19,6 +21,11 @@ struct VertexBase {
 	// Normalized texture coordinates
 	vec2<float> texuv = vec2<float>(0.0f);
 
+	static constexpr VertexLayout<2> LAYOUT = make_vertex_layout(
+		VertexAttribute{ GL_FLOAT, static_cast<uint32>(T::length()) },
+		VertexAttribute{ GL_FLOAT, 2 }
+	);
+
 	bool operator==(const VertexBase& other) const noexcept {
 		return glm::all(glm::epsilonEqual(position, other.position, 0.0001f)) &&
 			glm::all(glm::epsilonEqual(texuv, other.texuv, 0.0001f));
@@ -34,20 +41,35 @@ namespace std {
 	template <typename T>
 	struct hash<VertexBase<T>> {
 		size_t operator()(const VertexBase<T>& vertex) const {
-			size_t seed = 0;
-
-			ScarabHash::hash_combine(seed, vertex.position.x);
-			ScarabHash::hash_combine(seed, vertex.position.y);
-			if constexpr (std::is_same_v<vec3<float>, T>) {
-				ScarabHash::hash_combine(seed, vertex.position.z);
-			}
-
-			ScarabHash::hash_combine(seed, vertex.texuv.x);
-			ScarabHash::hash_combine(seed, vertex.texuv.y);
-
-			return seed;
+			return static_cast<size_t>(ScarabHash::hash_bytes(&vertex, sizeof(VertexBase<T>)));
 		}
 	};
 }
 
+// Hashes the exact bits of a vertex.
+// Faster than `std::hash<Vertex>` and consistent with `VertexBitwiseEqual`,
+// use both together (e.g., `FlatMap<Vertex, uint32, VertexBitwiseHash, VertexBitwiseEqual>`)
+struct VertexBitwiseHash {
+	template <typename T>
+	size_t operator()(const VertexBase<T>& vertex) const noexcept {
+		static_assert(sizeof(VertexBase<T>) % sizeof(uint32) == 0, "Vertex must be made of 32 bits values");
+		uint32 words[sizeof(VertexBase<T>) / sizeof(uint32)];
+		std::memcpy(words, &vertex, sizeof(words));
 
+		uint64 hash = 0;
+		for(const uint32 word : words) {
+			hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+			hash ^= hash >> 32;
+		}
+		return static_cast<size_t>(hash);
+	}
+};
+
+// Compares the exact bits of two vertices.
+// Unlike `operator==` there is no epsilon, so it is consistent with any hash
+struct VertexBitwiseEqual {
+	template <typename T>
+	bool operator()(const VertexBase<T>& a, const VertexBase<T>& b) const noexcept {
+		return std::memcmp(&a, &b, sizeof(VertexBase<T>)) == 0;
+	}
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "scarablib/typedef.hpp"
+#include <array>
+
+// Storage of a 16 bits float (IEEE 754 half).
+// Only used to move data to the GPU, convert using `ScarabQuantize`
+struct half16 {
+	uint16 bits = 0;
+};
+
+// One attribute inside a vertex
+struct VertexAttribute {
+	// Component type (e.g., GL_FLOAT, GL_SHORT, GL_HALF_FLOAT)
+	GLenum type;
+	// Number of components (e.g., 3 for a vec3)
+	uint32 count;
+	// Integer types are converted to [0, 1] (unsigned) or [-1, 1] (signed) floats
+	bool normalized = false;
+	// Offset of the attribute inside the vertex, set by `make_vertex_layout`
+	uint32 offset = 0;
+};
+
+// Compile time description of a vertex.
+// Attribute `i` is bound to shader location `i`
+template <size_t N>
+struct VertexLayout {
+	std::array<VertexAttribute, N> attributes;
+	// Size of a vertex in bytes
+	uint32 stride = 0;
+};
+
+// Returns the size of a component type in bytes
+inline constexpr uint32 vertex_type_size(const GLenum type) noexcept {
+	switch(type) {
+		case GL_BYTE:
+		case GL_UNSIGNED_BYTE:
+			return 1;
+		case GL_SHORT:
+		case GL_UNSIGNED_SHORT:
+		case GL_HALF_FLOAT:
+			return 2;
+		case GL_DOUBLE:
+			return 8;
+		default:
+			return 4;
+	}
+}
+
+// Makes a layout with the attributes packed in the order they are passed.
+// Usage example: `make_vertex_layout(VertexAttribute{ GL_FLOAT, 3 }, VertexAttribute{ GL_FLOAT, 2 })`
+template <typename... Attributes>
+constexpr VertexLayout<sizeof...(Attributes)> make_vertex_layout(const Attributes&... attributes) noexcept {
+	VertexLayout<sizeof...(Attributes)> layout{ { attributes... }, 0 };
+	for(VertexAttribute& attribute : layout.attributes) {
+		attribute.offset = layout.stride;
+		layout.stride += attribute.count * vertex_type_size(attribute.type);
+	}
+	return layout;
+}
+
+// Types that can describe themselves using a VertexLayout
+template <typename T>
+concept HasVertexLayout = requires {
+	T::LAYOUT.stride;
+	T::LAYOUT.attributes;
+};
+
+// Precision used when storing vertices on the GPU
+enum class VertexFormat : uint8 {
+	// 20 bytes. Position and TexUV as 32 bits floats (`Vertex`)
+	Float,
+	// 12 bytes. Position as half floats relative to the mesh bounds, TexUV as unorm16 (`VertexPackedHalf`)
+	Half,
+	// 12 bytes. Position as snorm16 relative to the mesh bounds, TexUV as unorm16 (`VertexPacked`)
+	Snorm16
+};
+
+// Packed vertices store positions relative to the mesh bounds (in [-1, 1]),
+// the dequantization is done by the model matrix (see `ScarabQuantize::dequantize_matrix`).
+// TexUV is stored as unorm16, so it must be inside [0, 1] (meshes with TexUV outside are uploaded as Float instead)
+
+// 12 bytes
+struct VertexPacked {
+	// Position as snorm16. `w` is padding and always 0
+	vec4<int16> position;
+	// TexUV as unorm16
+	vec2<uint16> texuv;
+
+	static constexpr VertexLayout<2> LAYOUT = make_vertex_layout(
+		VertexAttribute{ GL_SHORT, 4, true },
+		VertexAttribute{ GL_UNSIGNED_SHORT, 2, true }
+	);
+};
+
+// 12 bytes
+struct VertexPackedHalf {
+	// Position as half floats. `w` is padding and always 0
+	vec4<uint16> position;
+	// TexUV as unorm16
+	vec2<uint16> texuv;
+
+	static constexpr VertexLayout<2> LAYOUT = make_vertex_layout(
+		VertexAttribute{ GL_HALF_FLOAT, 4, false },
+		VertexAttribute{ GL_UNSIGNED_SHORT, 2, true }
+	);
+};
+
+// 16 bytes
+struct VertexPackedNormal {
+	// Position as snorm16. `w` is padding and always 0
+	vec4<int16> position;
+	// TexUV as unorm16
+	vec2<uint16> texuv;
+	// Octahedral encoded normal as snorm16, decode it in the shader
+	vec2<int16> normal;
+
+	static constexpr VertexLayout<3> LAYOUT = make_vertex_layout(
+		VertexAttribute{ GL_SHORT, 4, true },
+		VertexAttribute{ GL_UNSIGNED_SHORT, 2, true },
+		VertexAttribute{ GL_SHORT, 2, true }
+	);
+};
+
+static_assert(sizeof(VertexPacked) == VertexPacked::LAYOUT.stride, "VertexPacked does not match its layout");
+static_assert(sizeof(VertexPackedHalf) == VertexPackedHalf::LAYOUT.stride, "VertexPackedHalf does not match its layout");
+static_assert(sizeof(VertexPackedNormal) == VertexPackedNormal::LAYOUT.stride, "VertexPackedNormal does not match its layout");
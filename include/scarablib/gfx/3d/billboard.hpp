@@ -53,6 +53,7 @@ struct Billboard : public Model {
 	// - When a texture is flagged for flipping, a mirrored version is automatically generated.
 	//   The flipped texture is then placed at the symmetrical position relative to the FRONT.
 	//   For example, if texture at index 2 is marked to flip (LEFT), its mirrored version will be placed at index 6 (RIGHT).
+	//   Each file is decoded once (on worker threads), the mirrored version is made from the same pixels.
 	//
 	// Example usage:
 	//     set_directional_textures({"front.png", "frontright.png", "right.png", ...}, FRONTRIGHT | RIGHT);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "scarablib/gfx/compressedimage.hpp"
+#include "scarablib/gfx/cubemap.hpp"
 #include "scarablib/opengl/resourcesmanager.hpp"
 #include "scarablib/opengl/shaders.hpp"
 #include "scarablib/opengl/vertexarray.hpp"
@@ -11,6 +13,15 @@ struct Skybox {
 	// Uses a vector of 6 image paths as faces.
 	// The order must be the following: Right, Left, Top, Bottom, Back and Front
 	Skybox(const Camera& camera, const std::array<const char*, 6>& faces);
+	// Uses one equirectangular or cross image, converted to 6 faces on worker threads.
+	// The converted cubemap is cached next to the image (see `Cubemap::load_cached`), so later loads skip the conversion.
+	// - `layout`: (Default: Auto) How the faces are laid out in the image
+	// - `face_size`: (Default: 0) Size of each face. 0 keeps the resolution of the image
+	Skybox(const Camera& camera, const char* path, const Cubemap::Layout layout = Cubemap::Layout::Auto, const uint32 face_size = 0);
+	// Uses a cubemap already decoded, uploading all its mipmap levels
+	Skybox(const Camera& camera, const Cubemap& cubemap);
+	// Uses a block compressed cubemap (e.g., a DDS or KTX2 cubemap), uploading all its mipmap levels
+	Skybox(const Camera& camera, const CompressedImage& cubemap);
 	~Skybox() noexcept = default;
 
 	// Draw the skybox
@@ -21,9 +32,10 @@ struct Skybox {
 		std::shared_ptr<VertexArray> vertexarray;
 		uint32 texid;
 
-		std::shared_ptr<ShaderProgram> shader = ResourcesManager::get_instance().load_shader_program({
-			// Default vertex and fragment shader source
-			{ .source = Shaders::SKYBOX_VERTEX,   .type = Shader::Type::Vertex },
-			{ .source = Shaders::SKYBOX_FRAGMENT, .type = Shader::Type::Fragment },
-		});
+		// Creates the cube vertices. Used by the constructors
+		void init_cube();
+		// Sets the cubemap filter and wrap. Used by the constructors
+		void init_sampler(const bool mipmaps);
+
+		std::shared_ptr<ShaderProgram> shader = ResourcesManager::get_instance().builtin_program(ResourcesManager::Program::Skybox);
 };
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "scarablib/typedef.hpp"
+#include "scarablib/utils/vfs.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <vector>
+
+// S3TC is an extension, not part of core OpenGL
+#define SCARAB_GL_COMPRESSED_RGBA_S3TC_DXT1       0x83F1
+#define SCARAB_GL_COMPRESSED_RGBA_S3TC_DXT5       0x83F3
+#define SCARAB_GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1 0x8C4D
+#define SCARAB_GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5 0x8C4F
+
+// Block compressed image, made of 4x4 pixel blocks the GPU reads without decompressing.
+// Holds all mipmap levels and layers (6 layers if it is a cubemap).
+// Loaded from DDS or KTX2 files, or made by `ScarabBC::encode`
+struct CompressedImage {
+	enum class Format : uint8 {
+		// RGB and 1 bit alpha, 8 bytes per block
+		BC1,
+		// RGBA, 16 bytes per block
+		BC3,
+		// One channel (e.g., roughness or height), 8 bytes per block
+		BC4,
+		// Two channels (e.g., normal maps XY), 16 bytes per block
+		BC5,
+		// High quality RGBA, 16 bytes per block. Can only be loaded
+		BC7
+	};
+
+	Format format = Format::BC1;
+	// Colors are in sRGB space. Only BC1, BC3 and BC7
+	bool srgb     = false;
+	bool cubemap  = false;
+	uint32 width  = 0;
+	uint32 height = 0;
+	// Number of mipmap levels
+	uint32 levels = 1;
+	// Number of layers. Always 6 for cubemaps, in the order: Right, Left, Top, Bottom, Back and Front
+	uint32 layers = 1;
+
+	CompressedImage() noexcept = default;
+	// Loads a DDS or KTX2 file.
+	// Throws ScarabError if the file does not exist or is not a supported format
+	CompressedImage(const char* path);
+	// Uses already compressed data.
+	// `data` must have all levels of layer 0, then all levels of layer 1 and so on (same as DDS)
+	CompressedImage(const Format format, const uint32 width, const uint32 height,
+			const uint32 levels, const uint32 layers, std::vector<uint8>&& data);
+
+	// Delete copy, surfaces point inside the loaded file
+	CompressedImage(const CompressedImage&) = delete;
+	CompressedImage& operator=(const CompressedImage&) = delete;
+
+	CompressedImage(CompressedImage&&) noexcept = default;
+	CompressedImage& operator=(CompressedImage&&) noexcept = default;
+
+	// Returns the data of a mipmap level of a layer
+	inline const uint8* surface(const uint32 level, const uint32 layer = 0) const noexcept {
+		return this->payload + this->offsets[layer * this->levels + level];
+	}
+
+	// Returns the size in bytes of one surface of a mipmap level
+	inline size_t surface_size(const uint32 level) const noexcept {
+		return CompressedImage::surface_size(this->format, this->level_width(level), this->level_height(level));
+	}
+
+	inline uint32 level_width(const uint32 level) const noexcept {
+		return std::max<uint32>(this->width >> level, 1);
+	}
+
+	inline uint32 level_height(const uint32 level) const noexcept {
+		return std::max<uint32>(this->height >> level, 1);
+	}
+
+	// Returns true if there is no data
+	inline bool empty() const noexcept {
+		return this->payload == nullptr;
+	}
+
+	// Writes the image as a DDS file (with DX10 header).
+	// Returns false if it could not be written
+	bool save_dds(const std::filesystem::path& path) const noexcept;
+
+	// Returns the OpenGL internal format
+	uint32 gl_format() const noexcept;
+
+	// Returns the size of one 4x4 block
+	static constexpr size_t block_size(const Format format) noexcept {
+		return (format == Format::BC1 || format == Format::BC4) ? 8 : 16;
+	}
+
+	// Returns the size in bytes of a `width`x`height` surface
+	static constexpr size_t surface_size(const Format format, const uint32 width, const uint32 height) noexcept {
+		return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * CompressedImage::block_size(format);
+	}
+
+	// Returns true if the path has a DDS or KTX2 extension
+	static bool is_compressed_file(const char* path) noexcept;
+
+	private:
+		// Used when loaded from a file
+		ScarabVFS::File file;
+		// Used when encoded
+		std::vector<uint8> buffer;
+		// Start of the data, inside `file` or `buffer`
+		const uint8* payload = nullptr;
+		// Offset of each surface from `payload`, index is `layer * levels + level`
+		std::vector<size_t> offsets;
+
+		void load_dds(const char* path);
+		void load_ktx2(const char* path);
+};
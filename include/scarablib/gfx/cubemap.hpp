@@ -0,0 +1,115 @@
+#pragma once
+
+#include "scarablib/gfx/image.hpp"
+#include "scarablib/gfx/mipchain.hpp"
+#include "scarablib/utils/vfs.hpp"
+#include "scarablib/typedef.hpp"
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <vector>
+
+// Six faces of a cubemap with all their mipmap levels, ready to upload.
+// Faces are in OpenGL order: Right, Left, Top, Bottom, Back and Front (+X, -X, +Y, -Y, +Z, -Z).
+// Can be made from 6 images or converted from one equirectangular or cross image
+struct Cubemap {
+	// How the faces are laid out in a single image
+	enum class Layout : uint8 {
+		// Detected from the aspect ratio: 2:1 is equirectangular, 4:3 a horizontal cross and 3:4 a vertical cross
+		Auto,
+		// Longitude and latitude map (e.g., HDRI panoramas). The center of the image is the front (-Z)
+		Equirectangular,
+		// 4x3 cells. Top row: Top. Middle row: Left, Front, Right, Back. Bottom row: Bottom
+		HorizontalCross,
+		// 3x4 cells. Same as the horizontal cross, with Back under Bottom (upside down)
+		VerticalCross
+	};
+
+	// Width and height of each face
+	uint32 size = 0;
+	// 1 (grayscale) or 4 (RGBA)
+	uint8 channels = 4;
+	// Number of mipmap levels of each face, down to 1x1
+	uint32 levels = 1;
+	// Colors were averaged in linear space
+	bool srgb = true;
+
+	Cubemap() noexcept = default;
+	// Decodes 6 face images on worker threads and generates their mipmaps.
+	// The order must be the following: Right, Left, Top, Bottom, Back and Front.
+	// Throws ScarabError if an image was not found or the faces have different sizes
+	Cubemap(const std::array<const char*, 6>& faces);
+	// Converts one image to 6 faces, rows split between worker threads.
+	// Each face texel averages 4 bilinear samples of the image.
+	// Throws ScarabError if the image has no data or the layout could not be detected.
+	// - `layout`: (Default: Auto) How the faces are laid out in the image
+	// - `face_size`: (Default: 0) Size of each face. 0 keeps the resolution of the image (e.g., width / 4 for equirectangular)
+	Cubemap(const Image& image, const Layout layout = Layout::Auto, const uint32 face_size = 0);
+	// Loads a cubemap written by `save`.
+	// Throws ScarabError if the file does not exist or is invalid
+	Cubemap(const char* path);
+
+	// Delete copy, levels may point inside the loaded file
+	Cubemap(const Cubemap&) = delete;
+	Cubemap& operator=(const Cubemap&) = delete;
+
+	Cubemap(Cubemap&&) noexcept = default;
+	Cubemap& operator=(Cubemap&&) noexcept = default;
+
+	// Returns the pixels of a mipmap level of a face
+	inline const uint8* level(const uint32 face, const uint32 level) const noexcept {
+		if(this->payload == nullptr) {
+			return this->faces[face].level(level);
+		}
+		return this->payload + face * this->face_stride + this->offsets[level];
+	}
+
+	// Returns the size in bytes of a mipmap level of one face
+	inline size_t level_size(const uint32 level) const noexcept {
+		const size_t width = this->level_width(level);
+		return width * width * this->channels;
+	}
+
+	// Width and height of a mipmap level
+	inline uint32 level_width(const uint32 level) const noexcept {
+		return std::max<uint32>(this->size >> level, 1);
+	}
+
+	// Returns the size in bytes of all levels of all faces
+	inline size_t total_size() const noexcept {
+		return this->face_stride * 6;
+	}
+
+	// Returns true if there is no data
+	inline bool empty() const noexcept {
+		return this->size == 0;
+	}
+
+	// Writes all faces and levels to one file, read back with `Cubemap(path)`.
+	// Returns false if it could not be written
+	bool save(const std::filesystem::path& path) const noexcept;
+
+	// Loads a cubemap converted from one image, using a cache stored next to the file (e.g., `sky.hdr.auto.cube`).
+	// The image is decoded and converted, and the cache written, only if the cache is missing or older than the image.
+	// Throws ScarabError if the image could not be loaded or converted
+	static Cubemap load_cached(const char* path, const Layout layout = Layout::Auto, const uint32 face_size = 0);
+
+	// Returns the layout of an image with this size, or Auto if it is not one of the layouts
+	static Layout detect_layout(const uint32 width, const uint32 height) noexcept;
+
+	private:
+		// Used when generated
+		std::array<MipChain, 6> faces;
+		// Used when loaded from a file
+		ScarabVFS::File file;
+		// Start of the first face inside `file`, nullptr if generated
+		const uint8* payload = nullptr;
+		// Offset of each level from the start of a face
+		std::vector<size_t> offsets;
+		// Bytes of all levels of one face
+		size_t face_stride = 0;
+
+		void compute_offsets() noexcept;
+		// Takes the size of the faces, checking they are all the same
+		void init_from_faces();
+};
@@ -1,44 +1,118 @@
 #pragma once
 
 #include "scarablib/camera/camera2d.hpp"
-#include "scarablib/components/materialcomponent.hpp"
-#include "scarablib/opengl/vertexarray.hpp"
+#include "scarablib/geometry/vertexlayout.hpp"
+#include "scarablib/gfx/color.hpp"
+#include "scarablib/gfx/glyphcache.hpp"
 #include "scarablib/typedef.hpp"
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 // Forward declaration to avoid exporting stb_truetype header with the library
 struct STBTruetype;
+class TextBatch;
 
+// Vertex of a glyph quad.
+// Has its own color, so texts with different colors are drawn together
+struct TextVertex {
+	vec2<float> position;
+	// z is the page of the glyph cache
+	vec3<float> texuv;
+	Color color;
 
-// Font object used to draw text on the screen
-// WARNING: NOT FINISHED YET. STILL DONT WORKING PROPERLY
+	static constexpr VertexLayout<3> LAYOUT = make_vertex_layout(
+		VertexAttribute{ GL_FLOAT, 2 },
+		VertexAttribute{ GL_FLOAT, 3 },
+		VertexAttribute{ GL_UNSIGNED_BYTE, 4, true }
+	);
+};
+
+
+// Font object used to draw text on the screen.
+// Text is UTF-8. ASCII glyphs are made when the font is loaded, the rest the first time they are used,
+// kept in a `GlyphCache` with a bounded number of pages.
+// For labels that rarely change use `Text`, and `TextBatch` to draw many of them at once
 class Font {
 	public:
+		// How glyphs are stored in the atlas
+		enum class Type : uint8 {
+			// Coverage baked at `size` pixels. Blurry when scaled
+			Bitmap,
+			// Signed distance field made at `size` pixels, sharp at any scale.
+			// ASCII glyphs are cached next to the font file (`<path>.<size>.sfont`)
+			SDF
+		};
+
 		// Build a font object passing a path to a .ttf file.
-		// Also pass font's text, size and color
-		Font(const Camera2D& camera, const char* path, const uint16 size = 24);
+		// - `size`: (Default: 24) Pixel height of the glyphs. For SDF fonts 32 to 64 is enough for any scale
+		// - `type`: (Default: Bitmap) How glyphs are stored in the atlas
+		// - `max_pages`: (Default: 8) Pages of the glyph cache, see `GlyphCache`
+		Font(const Camera2D& camera, const char* path, const uint16 size = 24, const Font::Type type = Font::Type::Bitmap, const uint16 max_pages = 8);
 		~Font() noexcept;
 
 		// Disable copying to prevent double-free pointer bugs
 		Font(const Font&) = delete;
 		Font& operator=(const Font&) = delete;
 
-		// Add text to batch rendering
+		// Draws a text right away, laying it out again on every call.
+		// Fine for text that changes every frame, use `Text` for the rest
 		void draw_text(const std::string& text, const vec2<float>& pos, const float scale = 1.0f, const Color& color = Colors::WHITE) noexcept;
 
+		// Appends the glyph quads of a UTF-8 text to `out`, 6 vertices per glyph.
+		// Positions start at (0, 0) on the baseline of the first line, with scale 1. `\n` starts a new line.
+		// Glyphs not cached yet are made now. Glyphs that do not fit in the cache are skipped.
+		// `min` and `max` are set to the bounds of the quads (both 0 if there is none)
+		void layout(std::string_view text, const Color& color, std::vector<TextVertex>& out,
+				vec2<float>& min, vec2<float>& max);
+
+		// Returns the texture with all glyphs, one layer per page
+		inline const TextureArray& get_atlas() const noexcept {
+			return this->glyphs->get_texture();
+		}
+
+		inline const GlyphCache& get_glyph_cache() const noexcept {
+			return *this->glyphs;
+		}
+
+		// Changes every time glyphs are evicted, layouts made before must be made again
+		inline uint64 get_generation() const noexcept {
+			return this->glyphs->get_generation();
+		}
+
+		// Returns the distance between two lines
+		inline float get_line_height() const noexcept {
+			return this->size;
+		}
+
+		inline const Camera2D& get_camera() const noexcept {
+			return this->camera;
+		}
+
+		inline Font::Type get_type() const noexcept {
+			return this->type;
+		}
+
+		// SDF fonts are drawn with a different shader
+		inline bool is_sdf() const noexcept {
+			return this->type == Font::Type::SDF;
+		}
+
 	private:
-		static constexpr int ATLAS_WIDTH  = 512;
-		static constexpr int ATLAS_HEIGHT = 512;
+		// Distance, in pixels, covered by the SDF around each glyph
+		static constexpr int SDF_PADDING = 6;
 
 		const Camera2D& camera;
 
 		// Font
 		STBTruetype* data; // Hidden STB data
-		Vertex2D* buffer_data = nullptr;
-		size_t buffer_capacity = 0;
+		float size;
+		Font::Type type;
+		std::unique_ptr<GlyphCache> glyphs;
+		// Used by `draw_text`
+		std::unique_ptr<TextBatch> batch;
 
-		std::shared_ptr<Material> material = std::make_shared<Material>();
-		std::shared_ptr<VertexArray> vertexarray;
+		// Returns a glyph, making it if it is not cached. Returns nullptr if it does not fit
+		const GlyphCache::Glyph* glyph(const uint32 codepoint);
 };
-
-
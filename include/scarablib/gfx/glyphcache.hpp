@@ -0,0 +1,121 @@
+#pragma once
+
+#include "scarablib/gfx/texture_array.hpp"
+#include "scarablib/typedef.hpp"
+#include "scarablib/utils/flatmap.hpp"
+#include <memory>
+#include <vector>
+
+// Glyphs rasterized on demand, packed into the pages (layers) of a texture array.
+// Each page is packed in shelves, rows as tall as the first glyph placed in them.
+// When all pages are full the least recently used page is emptied, except pinned pages and pages used since `begin_use`.
+// Glyphs are found through a flat codepoint -> slot map, so memory stays bounded by the number of pages.
+// Must be used on the OpenGL thread
+class GlyphCache {
+	public:
+		// Page of glyphs without pixels (e.g., space)
+		static constexpr uint16 NO_PAGE = UINT16_MAX;
+
+		struct Glyph {
+			uint32 codepoint;
+			// Distance to the next glyph
+			float advance;
+			// Position inside the page, in pixels
+			uint16 x, y;
+			uint16 width, height;
+			// Distance from the pen position to the top left corner
+			int16 xoff, yoff;
+			// Layer of the texture, `NO_PAGE` if the glyph is empty
+			uint16 page;
+		};
+
+		struct Stats {
+			uint32 glyphs    = 0;
+			uint32 pages     = 0;
+			// Pages emptied to make space
+			uint32 evictions = 0;
+			// Glyphs that could not be added
+			uint32 misses    = 0;
+		};
+
+		// - `page_size`: (Default: 1024) Width and height of a page. Each page uses page_size² bytes
+		// - `max_pages`: (Default: 8) Pages kept at most, clamped to the limit of the driver
+		GlyphCache(const uint16 page_size = 1024, const uint16 max_pages = 8);
+
+		// Delete copy
+		GlyphCache(const GlyphCache&) = delete;
+		GlyphCache& operator=(const GlyphCache&) = delete;
+
+		// Returns the glyph of a codepoint, or nullptr if it is not cached.
+		// The pointer is valid until the next `insert`
+		const Glyph* find(const uint32 codepoint) noexcept;
+
+		// Packs and uploads a glyph, returns it.
+		// Returns nullptr if it is larger than a page, or all pages are full and none can be evicted.
+		// - `pixels`: width * height bytes, one channel. Null (or 0 size) for empty glyphs
+		// - `pinned`: (Default: false) The page of this glyph is never evicted
+		const Glyph* insert(const uint32 codepoint, const uint8* pixels, const uint16 width, const uint16 height,
+				const int16 xoff, const int16 yoff, const float advance, const bool pinned = false);
+
+		// Pages used after this are not evicted until the next call.
+		// Called before laying out a text, so the text never evicts its own glyphs
+		inline void begin_use() noexcept {
+			this->tick++;
+		}
+
+		// Changes every time a page is evicted. Glyphs found before may point to other pixels
+		inline uint64 get_generation() const noexcept {
+			return this->generation;
+		}
+
+		inline const TextureArray& get_texture() const noexcept {
+			return *this->texture;
+		}
+
+		inline uint16 get_page_size() const noexcept {
+			return this->page_size;
+		}
+
+		inline const Stats& get_stats() const noexcept {
+			return this->stats;
+		}
+
+	private:
+		struct Shelf {
+			uint16 x;
+			uint16 y;
+			uint16 height;
+		};
+
+		struct Page {
+			std::vector<Shelf> shelves;
+			// Top of the space without shelves
+			uint16 bottom   = 0;
+			uint64 last_use = 0;
+			bool pinned     = false;
+			// Slots of the glyphs inside
+			std::vector<uint32> slots;
+		};
+
+		uint16 page_size;
+		uint16 max_pages;
+		std::unique_ptr<TextureArray> texture;
+		std::vector<Page> pages;
+
+		// Codepoint -> index in `glyphs`
+		FlatMap<uint32, uint32> slots;
+		std::vector<Glyph> glyphs;
+		std::vector<uint32> free_slots;
+
+		uint64 tick = 1;
+		uint64 generation = 0;
+		Stats stats;
+
+		// Finds space in a page for a rect, returns false if full
+		bool pack(Page& page, const uint16 width, const uint16 height, uint16& x, uint16& y) noexcept;
+		// Returns a page with space for the rect, adding or evicting one if needed. Returns -1 if there is none
+		int find_page(const uint16 width, const uint16 height, uint16& x, uint16& y);
+		// Removes all glyphs of a page
+		void evict(const uint32 index) noexcept;
+		uint32 store(const Glyph& glyph);
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "scarablib/gfx/image.hpp"
+#include "scarablib/utils/vfs.hpp"
+#include "scarablib/typedef.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <vector>
+
+// All mipmap levels of an image, generated on the CPU and ready to upload.
+// Colors are averaged in linear space, so smaller levels don't get darker like with `glGenerateMipmap`
+struct MipChain {
+	uint32 width  = 0;
+	uint32 height = 0;
+	// 1 (grayscale) or 4 (RGBA). Images with 2 or 3 channels are expanded to RGBA
+	uint8 channels = 4;
+	// Number of mipmap levels, down to 1x1
+	uint32 levels = 1;
+	// Colors were averaged in linear space
+	bool srgb = true;
+
+	MipChain() noexcept = default;
+	// Generates all mipmap levels of an image. Rows of each level are split between worker threads.
+	// Throws ScarabError if the image has no data.
+	// - `srgb`: (Default: true) Colors are in sRGB (most color textures). Use false for data (e.g., normal maps)
+	// - `max_levels`: (Default: 0) Levels generated, from the biggest. 0 generates all of them
+	MipChain(const Image& image, const bool srgb = true, const uint32 max_levels = 0);
+	// Loads a chain written by `save`.
+	// Throws ScarabError if the file does not exist or is invalid
+	MipChain(const char* path);
+
+	// Delete copy, levels may point inside the loaded file
+	MipChain(const MipChain&) = delete;
+	MipChain& operator=(const MipChain&) = delete;
+
+	MipChain(MipChain&&) noexcept = default;
+	MipChain& operator=(MipChain&&) noexcept = default;
+
+	// Returns the pixels of a mipmap level
+	inline const uint8* level(const uint32 level) const noexcept {
+		return this->payload + this->offsets[level];
+	}
+
+	// Returns the size in bytes of a mipmap level
+	inline size_t level_size(const uint32 level) const noexcept {
+		return static_cast<size_t>(this->level_width(level)) * this->level_height(level) * this->channels;
+	}
+
+	inline uint32 level_width(const uint32 level) const noexcept {
+		return std::max<uint32>(this->width >> level, 1);
+	}
+
+	inline uint32 level_height(const uint32 level) const noexcept {
+		return std::max<uint32>(this->height >> level, 1);
+	}
+
+	// Returns true if there is no data
+	inline bool empty() const noexcept {
+		return this->payload == nullptr;
+	}
+
+	// Writes all levels to a file, read back with `MipChain(path)`.
+	// Returns false if it could not be written
+	bool save(const std::filesystem::path& path) const noexcept;
+
+	// Loads the mipmap chain of an image, using a cache stored next to the file (e.g., `wall.png.srgb.mips`).
+	// The image is decoded, the levels generated and the cache written only if the cache is missing or older than the image.
+	// Flips work the same as `Assets::load`.
+	// Throws ScarabError if the image could not be loaded
+	static MipChain load_cached(const char* path, const bool flip_v = false, const bool flip_h = false, const bool srgb = true);
+
+	// Returns the number of levels of a full chain
+	static uint32 count_levels(const uint32 width, const uint32 height) noexcept;
+
+	private:
+		// Used when loaded from a file
+		ScarabVFS::File file;
+		// Used when generated
+		std::vector<uint8> buffer;
+		// Start of the data, inside `file` or `buffer`
+		const uint8* payload = nullptr;
+		// Offset of each level from `payload`
+		std::vector<size_t> offsets;
+
+		void compute_offsets() noexcept;
+};
@@ -0,0 +1,267 @@
+#pragma once
+
+#include "scarablib/gfx/font.hpp"
+#include "scarablib/typedef.hpp"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class VertexArray;
+
+// A text laid out once and kept.
+// Glyph quads are only made again when the content changes, moving, scaling or coloring it just updates the cached vertices.
+// Can be drawn alone or added to a `TextBatch` to draw many texts together.
+// The font must outlive the text
+class Text {
+	public:
+		// Build a text using a font.
+		// - `content`: (Default: empty) Text to show. `\n` starts a new line
+		// - `position`: (Default: 0) Top left corner of the text, in pixels
+		// - `scale`: (Default: 1) Scale of the glyphs
+		// - `color`: (Default: white) Color of the glyphs
+		Text(Font& font, std::string_view content = {}, const vec2<float>& position = vec2<float>(0.0f),
+			const float scale = 1.0f, const Color& color = Colors::WHITE) noexcept;
+		~Text() noexcept;
+
+		// Delete copy
+		Text(const Text&) = delete;
+		Text& operator=(const Text&) = delete;
+
+		// Draws the text alone, uploading its vertices only if they changed since the last draw.
+		// To draw many texts prefer `TextBatch`
+		void draw() noexcept;
+
+		// SETTERS //
+
+		// Changes the content. Does nothing if it is the same
+		void set_text(std::string_view content) noexcept;
+
+		// Changes the top left corner of the text, in pixels
+		void set_position(const vec2<float>& position) noexcept;
+
+		// Changes the scale of the glyphs
+		void set_scale(const float scale) noexcept;
+
+		// Changes the color of the glyphs
+		void set_color(const Color& color) noexcept;
+
+		// Hidden texts are not drawn, and skipped by `TextBatch`
+		inline void set_visible(const bool visible) noexcept {
+			this->visible = visible;
+		}
+
+		// GETTERS //
+
+		inline const std::string& get_text() const noexcept {
+			return this->content;
+		}
+
+		inline const vec2<float>& get_position() const noexcept {
+			return this->position;
+		}
+
+		inline float get_scale() const noexcept {
+			return this->scale;
+		}
+
+		inline const Color& get_color() const noexcept {
+			return this->color;
+		}
+
+		inline bool is_visible() const noexcept {
+			return this->visible;
+		}
+
+		inline Font& get_font() const noexcept {
+			return this->font;
+		}
+
+		// Returns the glyph quads in pixels, 6 vertices per glyph.
+		// Made again only if something changed since the last call
+		const std::vector<TextVertex>& get_vertices() const noexcept;
+
+		// Returns the bounds of the glyphs in pixels
+		void get_bounds(vec2<float>& min, vec2<float>& max) const noexcept;
+
+		// Returns the width and height of the text in pixels
+		vec2<float> get_size() const noexcept;
+
+		// Returns false if glyphs used by the text were evicted from the font since it was laid out.
+		// The vertices are made again on the next `get_vertices`
+		inline bool is_current() const noexcept {
+			return this->generation == this->font.get_generation();
+		}
+
+		// Unique number of this text, never reused
+		inline uint64 get_id() const noexcept {
+			return this->id;
+		}
+
+		// Changes every time the vertices change.
+		// Call `get_vertices` before to update the layout if the font evicted its glyphs
+		inline uint64 get_version() const noexcept {
+			return this->version;
+		}
+
+	private:
+		Font& font;
+		std::string content;
+		vec2<float> position;
+		float scale;
+		Color color;
+		bool visible = true;
+
+		uint64 id;
+		mutable uint64 version = 0;
+
+		// Layout at (0, 0) with scale 1, only made again when the content changes or the glyphs are evicted
+		mutable std::vector<TextVertex> local;
+		mutable vec2<float> local_min = vec2<float>(0.0f);
+		mutable vec2<float> local_max = vec2<float>(0.0f);
+		// Generation of the font when laid out
+		mutable uint64 generation = 0;
+
+		// Layout moved and scaled
+		mutable std::vector<TextVertex> vertices;
+		mutable bool dirty = true;
+
+		// Used by `draw`
+		std::unique_ptr<VertexArray> vertexarray;
+		size_t vertexarray_capacity = 0;
+		uint64 uploaded_version = UINT64_MAX;
+
+		// Lays out the content again
+		void layout() const noexcept;
+		// Lays out again if the font evicted glyphs
+		inline void refresh() const noexcept {
+			if(!this->is_current()) {
+				this->layout();
+			}
+		}
+};
+
+
+// Draws many texts with one buffer upload and one draw call for each font atlas.
+// All vertices of a draw are written into a ring of 3 buffer segments, so the GPU can still read the last frames while a new one is written.
+// The buffer never reallocates while drawing, only at the start of `draw` when the texts do not fit.
+// If the same texts (and versions) are drawn again, nothing is uploaded.
+// Like any object using OpenGL, it must be used on the OpenGL thread
+class TextBatch {
+	public:
+		// Numbers of the last `draw`
+		struct Stats {
+			// Texts added (and not culled)
+			uint32 texts = 0;
+			// Texts outside the screen
+			uint32 culled = 0;
+			uint32 vertices = 0;
+			uint32 draw_calls = 0;
+			// False if the vertices of the draw before were reused
+			bool uploaded = false;
+		};
+
+		// - `camera`: Camera used to draw and cull the texts
+		// - `capacity`: (Default: 4096) Glyphs of one segment, grows if needed
+		TextBatch(const Camera2D& camera, const size_t capacity = 4096) noexcept;
+		~TextBatch() noexcept;
+
+		// Delete copy
+		TextBatch(const TextBatch&) = delete;
+		TextBatch& operator=(const TextBatch&) = delete;
+
+		// Adds a text to the next draw.
+		// Hidden texts and texts outside the screen are skipped.
+		// The text must live until `draw` is called
+		void add(const Text& text) noexcept;
+
+		// Adds a text laid out now, for text that changes every frame
+		void add(Font& font, std::string_view text, const vec2<float>& position,
+			const float scale = 1.0f, const Color& color = Colors::WHITE) noexcept;
+
+		// Draws all texts added and clears the batch.
+		// Texts are drawn in the order they were added, grouped by font atlas
+		void draw() noexcept;
+
+		// Removes all texts added without drawing them
+		void clear() noexcept;
+
+		inline const Stats& get_stats() const noexcept {
+			return this->stats;
+		}
+
+	private:
+		static constexpr uint32 SEGMENTS = 3;
+
+		// A text waiting to be drawn
+		struct Entry {
+			const TextureBase* atlas;
+			bool sdf;
+			// Texts made with `add(const Text&)`
+			const Text* text = nullptr;
+			// For the rest, laid out again if the font evicts glyphs before the draw
+			Font* font = nullptr;
+			// Vertices inside `immediate`
+			uint32 first = 0;
+			uint32 count = 0;
+			// Content inside `immediate_text`
+			uint32 text_first  = 0;
+			uint32 text_length = 0;
+			vec2<float> position = vec2<float>(0.0f);
+			float scale = 1.0f;
+			Color color = Colors::WHITE;
+			uint64 generation = 0;
+		};
+
+		// Text id and version, used to know if the vertices changed
+		struct Key {
+			uint64 id;
+			uint64 version;
+
+			inline bool operator==(const Key& other) const noexcept = default;
+		};
+
+		const Camera2D& camera;
+		std::vector<Entry> entries;
+		std::vector<TextVertex> immediate;
+		std::string immediate_text;
+		// All vertices of a draw, sorted by atlas
+		std::vector<TextVertex> staging;
+		// Texts culled since the last draw
+		uint32 culled = 0;
+
+		// Draws of the last upload, reused if the keys are the same
+		std::vector<Key> keys;
+		std::vector<Key> last_keys;
+		struct Range {
+			const TextureBase* atlas;
+			bool sdf;
+			uint32 first;
+			uint32 count;
+		};
+		std::vector<Range> ranges;
+
+		// Buffer
+		GLuint vao_id = 0;
+		GLuint vbo_id = 0;
+		TextVertex* mapped = nullptr;
+		GLsync fences[SEGMENTS] = {};
+		// Vertices of one segment
+		size_t segment_size;
+		uint32 current = 0;
+		size_t used    = 0;
+
+		Stats stats;
+
+		// Makes the buffer and vertex array with `segment_size` vertices in each segment
+		void create_buffer() noexcept;
+		void delete_buffer() noexcept;
+		// Lays out an immediate text at the end of `immediate`, `min` and `max` are its bounds in pixels
+		void layout(Entry& entry, vec2<float>& min, vec2<float>& max) noexcept;
+		// Lays out texts again if the font evicted their glyphs
+		void refresh() noexcept;
+		// Returns true if the bounds are inside the screen
+		bool on_screen(const vec2<float>& min, const vec2<float>& max) const noexcept;
+		// Returns the first vertex where `count` vertices can be written, moving to the next segment if needed
+		size_t reserve(const size_t count) noexcept;
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "scarablib/gfx/compressedimage.hpp"
+#include "scarablib/gfx/mipchain.hpp"
 #include "scarablib/gfx/texturebase.hpp"
 
 // Texture object used for shapes (2D and 3D)
@@ -8,10 +10,22 @@ class Texture : public TextureBase {
 		// Create a solid white texture
 		Texture() noexcept;
 
-		// Create a new texture out of an image
+		// Create a new texture out of an image.
+		// All mipmap levels are generated on the CPU, see `MipChain`
 		Texture(const Image& image);
 
+		// Create a texture out of CPU generated mipmaps, uploading all levels
+		Texture(const MipChain& mips);
+
 		Texture(const uint8* data, const uint32 width, const uint32 height, const uint8 channels);
 
+		// Create a texture out of a block compressed image, uploading all its mipmap levels.
+		// The image must have only one layer
+		Texture(const CompressedImage& image);
+
+		// Create a texture with storage but no data, to be filled later (e.g., by AssetLoader).
+		// - `mipmaps`: Allocates all mipmap levels
+		Texture(const uint32 width, const uint32 height, const uint8 channels, const bool mipmaps);
+
 		~Texture() noexcept = default;
 };
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "scarablib/gfx/compressedimage.hpp"
+#include "scarablib/gfx/mipchain.hpp"
 #include "scarablib/gfx/texturebase.hpp"
 #include "scarablib/typedef.hpp"
 #include <vector>
@@ -21,42 +23,87 @@ class TextureArray : public TextureBase {
 		};
 
 		// Creates a texture array. All layers added to the array must have the same dimensions.
+		// The array grows when full, up to the limit of the driver (see `reserve`).
 		// - `width`: Width of all layers
 		// - `height`: Height of all layers
-		// - `max_layers`: Desired limit of layers. Automatically clamped to 0-2048
+		// - `capacity`: Layers allocated at first. Automatically clamped to 1 and the limit of the driver (at least 256)
 		// - `channels`: (Default: 4) Number of channels
 		//    + 1: Grayscale
 		//    + 3: RGB (e.g. JPEG or PNG without alpha)
 		//    + 4: RGBA (e.g. PNG with alpha)
-		TextureArray(const uint16 width, const uint16 height, const uint16 max_layers, const uint8 channels = 4);
+		// - `mipmaps`: (Default: true) Allocate all mipmap levels. Without them the filter is linear
+		TextureArray(const uint16 width, const uint16 height, const uint16 capacity, const uint8 channels = 4, const bool mipmaps = true);
 
-		// Make texture from array of images
+		// Make texture from array of images.
+		// Mipmaps of all images are generated on worker threads, then uploaded
 		TextureArray(const std::vector<Image>& images);
 
+		// Make texture from block compressed images, uploading all their mipmap levels.
+		// Each layer of an image is a layer of the array.
+		// All images must have the same dimensions, format and number of levels.
+		// Uncompressed textures can't be added later and the array can't grow
+		TextureArray(const std::vector<CompressedImage>& images);
+
 		~TextureArray() noexcept = default;
 
 		// Adds or replaces a layer of the texture array and returns its index.
 		// All layers must have the same width and height.
-		// Does not generate mipmap automatically
+		// The mipmap levels of the array are generated on the CPU and uploaded, see `MipChain`.
+		// - `layer`: (Default: -1) Layer to replace. -1 uses a removed layer or the next one, growing the array if full
 		uint16 add_texture(const char* path, const bool flip_v = false, const bool flip_h = false, const int layer = -1);
 
-		// Adds or replaces a layer of the texture array and returns its index.
-		// All layers must have the same width and height.
-		// Generates mipmap automatically
-		uint16 add_textures(const std::vector<TextureArray::Layer>& paths);
+		// Adds or replaces a layer with mipmaps already generated and returns its index.
+		// Must have the same width and height as the array. Levels the array does not have are not uploaded.
+		// - `layer`: (Default: -1) Layer to replace. -1 uses a removed layer or the next one, growing the array if full
+		uint16 add_texture(const MipChain& mips, const int layer = -1);
+
+		// Adds a layer without uploading anything and returns its index.
+		// Its pixels are undefined until filled with `update_region`.
+		// - `layer`: (Default: -1) Layer to use. -1 uses a removed layer or the next one, growing the array if full
+		uint16 add_empty(const int layer = -1);
+
+		// Uploads pixels to a part of the first level of a layer, rows tightly packed.
+		// Other mipmap levels are not updated
+		void update_region(const uint16 layer, const uint32 x, const uint32 y,
+				const uint32 width, const uint32 height, const uint8* data) const noexcept;
+
+		// Adds many layers and returns their indices, in the same order.
+		// All images are decoded and their mipmaps generated on worker threads.
+		// Then the array grows once (if needed) and all layers are uploaded.
+		// Throws ScarabError before adding any layer if an image is missing or does not match
+		std::vector<uint16> add_textures(const std::vector<TextureArray::Layer>& paths);
+
+		// Frees a layer so the next texture added uses it. Its pixels are kept until replaced.
+		// Returns false if the layer is not in use
+		bool remove_texture(const uint16 layer) noexcept;
 
-		// Returns the current number of layers in the array
+		// Returns true if a texture was added to the layer and not removed
+		inline bool has_texture(const uint16 layer) const noexcept {
+			return layer < this->used.size() && this->used[layer];
+		}
+
+		// Grows the array to hold at least `layers` layers.
+		// Allocates new storage and copies the layers on the GPU, the id of the texture changes.
+		// Throws ScarabError if over the limit of the driver, if the array is compressed, or with BUILD_OPGL30 (needs OpenGL 4.3+)
+		void reserve(const uint32 layers);
+
+		// Returns the current number of layers in use
 		inline uint32 get_num_layers() const noexcept {
 			return this->num_layers;
 		}
 
-		// Returns the limit of layers that can be added
+		// Returns the number of layers allocated
+		inline uint32 get_capacity() const noexcept {
+			return this->capacity;
+		}
+
+		// Returns the limit of layers the array can grow to
 		inline uint32 get_max_layers() const noexcept {
 			return this->max_layers;
 		}
 
-		// Generates mipmaps for all textures.
-		// You must call this after adding all desired textures
+		// Generates mipmaps for all textures on the GPU.
+		// Not needed for layers added with `add_texture`, they already have all levels
 		inline void generate_mipmap() const noexcept {
 		#if !defined(BUILD_OPGL30)
 			glGenerateTextureMipmap(this->id);
@@ -69,8 +116,26 @@ class TextureArray : public TextureBase {
 		// NOTE: here and not in TextureBase because only TextureArray needs this
 
 	private:
-		uint16 num_layers = 0; // Current number of layers
-		uint16 next_layer = 0; // Next layer number to add
-		uint16 max_layers;     // Limit of layers
+		uint16 num_layers = 0; // Layers in use
+		uint16 next_layer = 0; // Layers below it were used, the ones removed are in `free_layers`
+		uint16 capacity   = 0; // Layers allocated
+		uint16 max_layers = 0; // Limit of layers of the driver
+		uint32 levels     = 1; // Mipmap levels allocated
 		uint8 channels;        // Desired number of channels
+		bool compressed = false; // Made from compressed images
+		// Removed layers, used again before growing
+		std::vector<uint16> free_layers;
+		// Layers in use, one for each allocated layer
+		std::vector<bool> used;
+
+		// Creates a texture with storage for `layers` layers and returns its id
+		GLuint create_storage(const uint32 layers) const noexcept;
+		// Returns the layer a texture will be added to, growing the array if needed, and marks it as used
+		uint16 acquire_layer(const int layer);
+		// Throws ScarabError if the image can't be a layer of this array
+		void validate(const Image& image, const char* path) const;
+		// Uploads the mipmap levels of a layer, at most `levels`
+		void upload_layer(const MipChain& mips, const uint32 layer);
+		// Sets the driver limit and the initial capacity
+		void init_layers(const uint32 capacity) noexcept;
 };
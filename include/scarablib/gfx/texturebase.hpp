@@ -9,7 +9,11 @@ class TextureBase {
 		// Texture filtering type
 		enum class Filter : uint32 {
 			NEAREST =  GL_NEAREST,
-			LINEAR  = GL_LINEAR
+			LINEAR  = GL_LINEAR,
+			// Pixelated up close, smooth far away. Needs mipmaps
+			NEAREST_MIPMAP = GL_NEAREST_MIPMAP_LINEAR,
+			// Trilinear. Needs mipmaps
+			LINEAR_MIPMAP  = GL_LINEAR_MIPMAP_LINEAR
 		};
 
 		// Texture wrapping type
@@ -38,6 +42,11 @@ class TextureBase {
 			return this->height;
 		}
 
+		// Returns the estimated VRAM used by the texture in bytes, including mipmaps
+		inline constexpr size_t get_byte_size() const noexcept {
+			return this->byte_size;
+		}
+
 		// Bind the texture for use in rendering
 		inline void bind(const uint8 unit = 0) const noexcept {
 		#if !defined(BUILD_OPGL30)
@@ -53,7 +62,8 @@ class TextureBase {
 			glBindTexture(this->texturetype, 0);
 		}
 
-		// Changes the filtering mode
+		// Changes the filtering mode.
+		// Mipmap filters only change minification, magnification uses the same base filter
 		void set_filter(const TextureBase::Filter filter) const noexcept;
 
 		// Changes the wrapping mode
@@ -64,6 +74,10 @@ class TextureBase {
 		// Returns 0 if invalid format.
 		static uint32 extract_format(const uint8 num_channels, const bool internal);
 
+		// Returns the estimated VRAM used by one uncompressed layer with `levels` mipmap levels.
+		// RGB is counted as RGBA, drivers pad it
+		static size_t storage_size(const uint32 width, const uint32 height, const uint8 channels, const uint32 levels) noexcept;
+
 		inline constexpr bool operator==(const TextureBase& other) const noexcept {
 			return this->id == other.id;
 		}
@@ -75,6 +89,8 @@ class TextureBase {
 		GLuint id;
 		uint16 width;
 		uint16 height;
+		// Estimated VRAM in bytes, set by the derived class
+		size_t byte_size = 0;
 	private:
 		GLint texturetype;
 };
@@ -0,0 +1,230 @@
+#pragma once
+
+#include "scarablib/geometry/model.hpp"
+#include "scarablib/gfx/3d/skybox.hpp"
+#include "scarablib/gfx/texture.hpp"
+#include "scarablib/typedef.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Asset being loaded by AssetLoader.
+// Handles are only updated inside `AssetLoader::update`, so only use them on the OpenGL thread
+template <typename T>
+class AssetHandle {
+	friend class AssetLoader;
+	public:
+		enum class State : uint8 {
+			Loading,
+			Ready,
+			Failed
+		};
+
+		// Empty handle, always Failed
+		AssetHandle() noexcept = default;
+
+		inline State get_state() const noexcept {
+			return (this->shared != nullptr) ? this->shared->state : State::Failed;
+		}
+
+		inline bool is_ready() const noexcept {
+			return this->get_state() == State::Ready;
+		}
+
+		// Returns the asset.
+		// Returns the placeholder while loading or if loading failed (e.g., `Assets::default_texture()`, nullptr for models)
+		inline std::shared_ptr<T> get() const noexcept {
+			if(this->shared == nullptr) {
+				return nullptr;
+			}
+			return (this->shared->state == State::Ready) ? this->shared->asset : this->shared->placeholder;
+		}
+
+		// Returns why loading failed. Empty if not failed
+		inline const std::string& get_error() const noexcept {
+			static const std::string empty;
+			return (this->shared != nullptr) ? this->shared->error : empty;
+		}
+
+		// Calls `callback` on the OpenGL thread when the asset is ready.
+		// Called right away if it is already ready, never called if loading fails.
+		// Usage example: `handle.on_ready([material](const std::shared_ptr<Texture>& texture) { material->texture = texture; })`
+		void on_ready(std::function<void(const std::shared_ptr<T>&)> callback) {
+			if(this->shared == nullptr) {
+				return;
+			}
+			if(this->shared->state == State::Ready) {
+				callback(this->shared->asset);
+			} else if(this->shared->state == State::Loading) {
+				this->shared->callbacks.push_back(std::move(callback));
+			}
+		}
+
+	private:
+		struct Shared {
+			State state = State::Loading;
+			std::shared_ptr<T> asset;
+			std::shared_ptr<T> placeholder;
+			std::string error;
+			std::vector<std::function<void(const std::shared_ptr<T>&)>> callbacks;
+		};
+		std::shared_ptr<Shared> shared;
+
+		explicit AssetHandle(std::shared_ptr<T> placeholder) : shared(std::make_shared<Shared>()) {
+			this->shared->placeholder = std::move(placeholder);
+		}
+
+		void resolve(std::shared_ptr<T> asset) {
+			this->shared->asset = std::move(asset);
+			this->shared->state = State::Ready;
+			for(auto& callback : this->shared->callbacks) {
+				callback(this->shared->asset);
+			}
+			this->shared->callbacks.clear();
+		}
+
+		void fail(std::string error) {
+			this->shared->error = std::move(error);
+			this->shared->state = State::Failed;
+			this->shared->callbacks.clear();
+		}
+};
+
+
+// Loads assets without blocking the OpenGL thread.
+// Files are read and decoded on worker threads. `update` uploads the decoded data through a pixel buffer object,
+// never more than `upload_budget` bytes per call, so big textures are uploaded over a few frames.
+// Usage example:
+// ```
+// AssetLoader loader;
+// loader.load_texture("wall.png").on_ready([material](const std::shared_ptr<Texture>& texture) {
+// 	material->texture = texture; // Uses Assets::default_texture() until here
+// });
+// // Every frame
+// loader.update();
+// ```
+class AssetLoader {
+	public:
+		// Default max bytes uploaded per `update`
+		static constexpr size_t DEFAULT_UPLOAD_BUDGET = 4 * 1024 * 1024;
+
+		// - `upload_budget`: (Default: 4MB) Max bytes uploaded to the GPU on each `update`.
+		// - `threads`: (Default: 0) Worker threads used to decode. 0 uses one less than the number of cores
+		AssetLoader(const size_t upload_budget = DEFAULT_UPLOAD_BUDGET, const uint32 threads = 0);
+		// Stops the workers. Assets not loaded yet fail, on the OpenGL thread (their `on_ready` callbacks are never called)
+		~AssetLoader() noexcept;
+
+		// Delete copy
+		AssetLoader(const AssetLoader&) = delete;
+		AssetLoader& operator=(const AssetLoader&) = delete;
+		// Delete move
+		AssetLoader(AssetLoader&&) = delete;
+		AssetLoader& operator=(AssetLoader&&) = delete;
+
+		// Loads a texture in the background, using the same cache as `Assets::load`.
+		// The handle returns `Assets::default_texture()` until the texture is uploaded
+		AssetHandle<Texture> load_texture(const char* path, const bool flip_v = false, const bool flip_h = false);
+
+		// Loads a wavefront-obj model (and its textures) in the background.
+		// The handle returns nullptr until the model is uploaded.
+		// - `format`: (Default: Float) How vertices are stored on the GPU
+		AssetHandle<Model> load_model(const char* path, const VertexFormat format = VertexFormat::Float);
+
+		// Loads a skybox from one equirectangular or cross image in the background, using the same cache as `Skybox(camera, path)`.
+		// The handle returns nullptr until the skybox is uploaded.
+		// `camera` must live as long as the skybox.
+		// - `layout`: (Default: Auto) How the faces are laid out in the image
+		// - `face_size`: (Default: 0) Size of each face. 0 keeps the resolution of the image
+		AssetHandle<Skybox> load_skybox(const Camera& camera, const char* path,
+				const Cubemap::Layout layout = Cubemap::Layout::Auto, const uint32 face_size = 0);
+
+		// Uploads decoded assets, at most `upload_budget` bytes, and calls the `on_ready` callbacks.
+		// Call it once per frame on the OpenGL thread
+		void update();
+
+		// Blocks until all queued assets are loaded, ignoring the upload budget (e.g., on a loading screen).
+		// Must be called on the OpenGL thread
+		void finish();
+
+		// Number of assets not ready or failed yet
+		inline size_t get_pending() const noexcept {
+			return this->pending;
+		}
+
+		inline size_t get_upload_budget() const noexcept {
+			return this->upload_budget;
+		}
+
+		// Changes how many bytes are uploaded on each `update`
+		inline void set_upload_budget(const size_t budget) noexcept {
+			this->upload_budget = std::max<size_t>(budget, 1);
+		}
+
+		// Ring of persistently mapped pixel buffer objects, defined in assetloader.cpp
+		class StagingBuffer;
+
+		// Upload state of the current `update`.
+		// Only used by the upload steps
+		struct Frame {
+			// Bytes that can still be uploaded
+			size_t budget;
+			// Budget at the start of the update. A step bigger than it can run when nothing was uploaded yet
+			size_t full;
+			// Pixel buffer object used to upload, may be nullptr
+			StagingBuffer* staging;
+		};
+
+	private:
+		// Step of a main thread upload. Returns true when done
+		using Upload = std::function<bool(Frame& frame)>;
+		// Fails the handle of an asset, called if the loader is destroyed before loading it
+		using Cancel = std::function<void()>;
+
+		// Decoding done by a worker, returns the upload step
+		struct Job {
+			std::function<Upload()> decode;
+			Cancel cancel;
+		};
+
+		struct Step {
+			Upload upload;
+			Cancel cancel;
+		};
+
+		std::vector<std::thread> workers;
+		// Guarded by `mutex`
+		std::deque<Job> jobs;
+		// Guarded by `mutex`, made by the workers
+		std::deque<Step> decoded;
+		// Only used on the OpenGL thread
+		std::deque<Step> uploads;
+
+		std::mutex mutex;
+		std::condition_variable job_condition;
+		std::condition_variable decoded_condition;
+		bool stopping = false;
+
+		std::unique_ptr<StagingBuffer> staging;
+		size_t upload_budget;
+		size_t pending = 0;
+
+		void worker_loop();
+		void enqueue(std::function<Upload()> decode, Cancel cancel);
+		// Called by the workers when a job is done
+		void push_decoded(Step step);
+		// Runs uploads until `budget` is used
+		void process(const size_t budget);
+
+		// Returns the Cancel of an asset being loaded
+		template <typename T>
+		static Cancel cancel(AssetHandle<T> handle) {
+			return [handle]() mutable {
+				handle.fail("Asset loader was destroyed before loading it");
+			};
+		}
+};
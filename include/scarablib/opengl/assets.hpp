@@ -2,8 +2,10 @@
 
 #include "scarablib/gfx/texture.hpp"
 #include "scarablib/gfx/texture_array.hpp"
+#include "scarablib/opengl/resourcecache.hpp"
+#include <atomic>
 #include <memory>
-#include <unordered_map>
+#include <mutex>
 
 // REMEMBER: I would make a system that when loading textures for a Texture Array
 // The code would look up to see if each individual texture was already allocated
@@ -11,34 +13,82 @@
 // But this isnt possible, because Texture Array does not store individual textures
 
 
-// Texture and Texture Array manager
+// Texture and Texture Array manager.
+// Textures can be loaded from any thread: files are decoded on the calling thread and uploaded by the OpenGL thread
+// (see `ScarabOpenGL::run_sync`), so a worker waits until the next frame for its texture
 class Assets {
 	public:
 		// Returns a default solid white texture
-		static std::shared_ptr<Texture> default_texture() noexcept {
-			// static std::shared_ptr<Texture> def_tex = std::make_shared<Texture>(white_pixel, 1, 1, 4);
-			static std::shared_ptr<Texture> def_tex = std::make_shared<Texture>();
-			return def_tex;
-		}
+		static std::shared_ptr<Texture> default_texture() noexcept;
 
 		// static std::shared_ptr<Texture> load_texture(path, other stuff);
 		// static std::shared_ptr<TextureArray> load_texturearray(textures);
 
+		// Loads a texture from a file.
+		// DDS and KTX2 files are uploaded block compressed as they are, flips are ignored for them
 		static std::shared_ptr<Texture> load(const char* path, const bool flip_v = false, const bool flip_h = false) noexcept;
 		static std::shared_ptr<Texture> load(const Image& image) noexcept;
 
+		// Loads an image compressed in a GPU block format, using 4-8 times less memory.
+		// The compressed image is cached next to the file, see `ScarabBC::load_cached`
+		static std::shared_ptr<Texture> load(const char* path, const CompressedImage::Format format,
+				const bool flip_v = false, const bool flip_h = false) noexcept;
+
+		// Stores the mipmaps generated for image files next to them, so they are not generated again.
+		// See `MipChain::load_cached`. Disabled by default
+		static inline void set_mipmap_cache(const bool enabled) noexcept {
+			Assets::instance.mipmap_cache.store(enabled, std::memory_order_relaxed);
+		}
+
+		// Returns true if generated mipmaps are stored next to the image files
+		static inline bool get_mipmap_cache() noexcept {
+			return Assets::instance.mipmap_cache.load(std::memory_order_relaxed);
+		}
+
+		// Returns the texture of a file if it is already loaded, using the same parameters as `load`.
+		// Returns nullptr if not found
+		static std::shared_ptr<Texture> find(const char* path, const bool flip_v = false, const bool flip_h = false) noexcept;
+
+		// Caches a texture made outside of Assets (e.g., by AssetLoader) as if it was loaded with `load`
+		static void store(const char* path, const bool flip_v, const bool flip_h, const std::shared_ptr<Texture>& texture);
+
+		// Pinned textures stay loaded when not used (e.g., textures of the HUD shown between scenes).
+		// Returns false if the texture of the file is not loaded
+		static bool set_pinned(const char* path, const bool pinned, const bool flip_v = false, const bool flip_h = false) noexcept;
+
+		// Textures not used anymore are kept for a while, evicted when over 256MB of VRAM.
+		// Use it to change the policy or read the stats
+		static inline ResourceCache<Texture>& get_texture_cache() noexcept {
+			return Assets::instance.tex_cache;
+		}
+
+		static inline ResourceCache<TextureArray>& get_texturearray_cache() noexcept {
+			return Assets::instance.texarr_cache;
+		}
+
+		// Evicts unused textures following the policy of each cache.
+		// Call it after a scene change
+		static void trim() noexcept;
+
 		// Cleans up all maps;
 		// WARNING: This is called inside Window destructor, DO NOT call it manually
 		static void cleanup() noexcept;
 
 	private:
 		struct Instance {
-			std::unordered_map<size_t, std::weak_ptr<Texture>> tex_cache;
-			std::unordered_map<size_t, std::weak_ptr<TextureArray>> texarr_cache;
+			ResourceCache<Texture> tex_cache = ResourceCache<Texture>({ .budget = 256 * 1024 * 1024 });
+			ResourceCache<TextureArray> texarr_cache = ResourceCache<TextureArray>({ .budget = 256 * 1024 * 1024 });
 			std::shared_ptr<Texture> def_tex;
+			std::mutex def_mutex;
+			std::atomic<bool> mipmap_cache = false;
 		};
 		static Instance instance;
+		// Makes a texture on the OpenGL thread
+		template <typename Source>
+		static std::shared_ptr<Texture> upload(const Source& source);
 		static std::shared_ptr<Texture> get_tex(const size_t hash);
+		// Hash of a texture loaded from a file
+		static size_t file_hash(const char* path, const bool flip_v, const bool flip_h) noexcept;
 };
 
 	// TODO:
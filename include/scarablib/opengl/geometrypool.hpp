@@ -0,0 +1,204 @@
+#pragma once
+
+#include "scarablib/geometry/vertexlayout.hpp"
+#include "scarablib/typedef.hpp"
+#include "scarablib/utils/flatmap.hpp"
+#include <memory>
+#include <vector>
+
+class GeometryPool;
+
+// Vertices and indices of one mesh inside a GeometryPool.
+// Offsets change when the pool grows or is defragmented, so always read them at draw time
+struct GeometryRange {
+	// Pool owning this range. nullptr if the pool was destroyed
+	GeometryPool* pool  = nullptr;
+	// First vertex inside the vertex buffer, used as `basevertex` in glDrawElementsBaseVertex
+	uint32 base_vertex  = 0;
+	uint32 vertex_count = 0;
+	// Offset in bytes of the first index inside the index buffer
+	size_t index_offset = 0;
+	uint32 index_count  = 0;
+	// Size of one index. 1, 2 or 4
+	uint32 index_size   = 0;
+	// The type of indices as GLenum
+	GLenum index_type   = GL_UNSIGNED_INT;
+	// 0 if not cached
+	size_t hash = 0;
+
+	// Calculates the indices offset of `first` to be used in glDrawElements*
+	inline void* index_pointer(const uint32 first = 0) const noexcept {
+		return (void*)(uintptr_t)(this->index_offset + static_cast<size_t>(first) * this->index_size);
+	}
+
+	private:
+		friend class GeometryPool;
+		// Position inside the pool's list of live ranges
+		size_t slot = 0;
+		// Next range released by another thread, waiting for the OpenGL thread
+		GeometryRange* next_released = nullptr;
+};
+
+// Stores the geometry of many meshes in one vertex buffer and one index buffer, sharing a single VAO.
+// Meshes draw with `glDrawElementsBaseVertex` using their GeometryRange, without switching VAOs.
+// All meshes in a pool must use the same vertex layout, index types can be mixed.
+// Ranges are given by a free list (best fit). When there is no block big enough
+// all ranges are moved to new buffers with `glCopyNamedBufferSubData`, packed and with more space if needed.
+// WARNING: Needs OpenGL 3.2 (or ARB_copy_buffer and ARB_draw_elements_base_vertex) when using BUILD_OPGL30
+class GeometryPool {
+	public:
+		// Default vertices allocated when the pool is created
+		static constexpr size_t DEFAULT_VERTEX_CAPACITY = 1 << 16;
+		// Default bytes of indices allocated when the pool is created
+		static constexpr size_t DEFAULT_INDEX_CAPACITY  = 1 << 18;
+
+		// Creates an empty pool.
+		// - `layout`: Layout of all vertices stored in this pool (e.g., `Vertex::LAYOUT`).
+		// - `vertex_capacity`: Vertices allocated at start.
+		// - `index_capacity`: Bytes of indices allocated at start
+		template <size_t N>
+		GeometryPool(const VertexLayout<N>& layout,
+				const size_t vertex_capacity = DEFAULT_VERTEX_CAPACITY,
+				const size_t index_capacity = DEFAULT_INDEX_CAPACITY);
+		~GeometryPool() noexcept;
+
+		// Delete copy
+		GeometryPool(const GeometryPool&) = delete;
+		GeometryPool& operator=(const GeometryPool&) = delete;
+		// Delete move
+		GeometryPool(GeometryPool&&) = delete;
+		GeometryPool& operator=(GeometryPool&&) = delete;
+
+		// Copies vertices and indices to the pool or returns an existing range with the same hash.
+		// The range is released when the last reference is destroyed.
+		// - `vertices`: Vertex data, using the pool's layout.
+		// - `vertex_count`: Number of vertices.
+		// - `indices`: Index data, relative to the first vertex of the mesh.
+		// - `index_count`: Number of indices.
+		// - `index_size`: Size of one index. Must be 1, 2 or 4.
+		// - `hash`: (Default: 0) The hash identification. 0 disables caching
+		std::shared_ptr<GeometryRange> allocate(const void* vertices, const size_t vertex_count,
+				const void* indices, const size_t index_count, const uint32 index_size, const size_t hash = 0);
+
+		// Returns a range using its hash.
+		// Returns nullptr if not found
+		std::shared_ptr<GeometryRange> get_range(const size_t hash) noexcept;
+
+		// Moves all ranges to the start of the buffers, joining the free space in one block
+		void defragment();
+
+		// Activates the pool's VAO in the OpenGL context
+		inline void bind() const noexcept {
+			glBindVertexArray(this->vao_id);
+		}
+
+		// Get id from the VAO buffer
+		inline uint32 get_vaoid() const noexcept {
+			return this->vao_id;
+		}
+		// Get id from the VBO buffer. Changes when the pool grows or is defragmented
+		inline uint32 get_vboid() const noexcept {
+			return this->vbo_id;
+		}
+		// Get id from the EBO buffer. Changes when the pool grows or is defragmented
+		inline uint32 get_eboid() const noexcept {
+			return this->ebo_id;
+		}
+
+		// The size of one vertex
+		inline uint32 get_vertex_size() const noexcept {
+			return this->stride;
+		}
+
+		// Number of vertices the vertex buffer can hold
+		inline size_t vertex_capacity() const noexcept {
+			return this->vertex_free.capacity();
+		}
+		// Size in bytes of the index buffer
+		inline size_t index_capacity() const noexcept {
+			return this->index_free.capacity();
+		}
+		// Number of vertices in use
+		inline size_t used_vertices() const noexcept {
+			return this->vertex_free.capacity() - this->vertex_free.free_space();
+		}
+		// Bytes of indices in use
+		inline size_t used_index_bytes() const noexcept {
+			return this->index_free.capacity() - this->index_free.free_space();
+		}
+		// Number of live ranges
+		inline size_t range_count() const noexcept {
+			return this->ranges.size();
+		}
+
+	private:
+		// Free blocks of a buffer, sorted by offset. Adjacent blocks are joined when freed
+		class FreeList {
+			public:
+				// Makes a single free block [used, capacity)
+				void reset(const size_t capacity, const size_t used) noexcept;
+				// Returns the offset of the smallest block that fits `size`.
+				// Returns SIZE_MAX if there is no block big enough
+				size_t allocate(const size_t size) noexcept;
+				// Gives a block back. Never allocates if `reserve` was called with enough blocks
+				void free(const size_t offset, const size_t size) noexcept;
+				// Makes room for `count` blocks, so `free` never allocates
+				inline void reserve(const size_t count) {
+					this->blocks.reserve(count);
+				}
+
+				inline size_t capacity() const noexcept {
+					return this->total;
+				}
+				inline size_t free_space() const noexcept {
+					return this->available;
+				}
+
+			private:
+				struct Block {
+					size_t offset;
+					size_t size;
+				};
+				std::vector<Block> blocks;
+				size_t total     = 0;
+				size_t available = 0;
+		};
+
+		std::vector<VertexAttribute> attributes;
+		uint32 stride = 0;
+
+		GLuint vao_id = 0;
+		GLuint vbo_id = 0;
+		GLuint ebo_id = 0;
+
+		// In vertices
+		FreeList vertex_free;
+		// In bytes, blocks are aligned to 4 bytes
+		FreeList index_free;
+
+		// All live ranges
+		std::vector<GeometryRange*> ranges;
+		FlatMap<size_t, std::weak_ptr<GeometryRange>> range_cache;
+
+		// Creates the VAO and buffers. Called by the constructor
+		void init(const size_t vertex_capacity, const size_t index_capacity);
+		// Links the layout and buffers to the VAO
+		void link_buffers() const noexcept;
+		// Moves all ranges to new buffers with the given capacities, packing them at the start
+		void relocate(const size_t vertex_capacity, const size_t index_capacity);
+		// Returns a range's space to the free lists
+		void release(GeometryRange* range) noexcept;
+		// Deleter for the shared_ptr given by `allocate`.
+		// Never allocates, ranges released by other threads are linked in a list the OpenGL thread destroys
+		static void destroy_range(GeometryRange* range) noexcept;
+		// Destroys the ranges released by other threads. Must be called on the OpenGL thread
+		static void destroy_released() noexcept;
+};
+
+
+template <size_t N>
+GeometryPool::GeometryPool(const VertexLayout<N>& layout, const size_t vertex_capacity, const size_t index_capacity)
+	: attributes(layout.attributes.begin(), layout.attributes.end()), stride(layout.stride) {
+
+	this->init(vertex_capacity, index_capacity);
+}
@@ -0,0 +1,423 @@
+#pragma once
+
+#include "scarablib/typedef.hpp"
+#include "scarablib/utils/flatmap.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Cache of shared resources (e.g., textures, vertex arrays and shaders) that keeps them loaded after they stop being used,
+// so the next scene needing them does not load or compile them again.
+// Unused resources are kept for a grace period. After it, they are evicted least recently used first
+// while the cache is over its byte budget (or after `max_idle`). Pinned resources are never evicted.
+// A resource is unused when the cache has the only reference to it.
+// Thread safe. Entries are split in shards by hash, each with its own lock, so threads looking up
+// different resources rarely wait for each other
+template <typename T>
+class ResourceCache {
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		// Number of shards. Power of two
+		static constexpr size_t SHARDS = 16;
+		// Inserts between two full trims, so `max_idle` is applied without calling `trim`
+		static constexpr uint32 TRIM_INTERVAL = 64;
+
+		// How long unused resources are kept
+		struct Policy {
+			// Max bytes (GPU and CPU) before unused resources are evicted. SIZE_MAX never evicts by size.
+			// Resources in use or inside the grace period are never evicted, so the cache may stay over it
+			size_t budget = SIZE_MAX;
+			// Seconds an unused resource is kept no matter the budget (e.g., between two scenes).
+			// Counted from the last time it was found or seen in use by a trim (`Window::swap_buffers` trims every second)
+			float grace = 5.0f;
+			// Seconds after which an unused resource is evicted even under the budget. 0 keeps it
+			float max_idle = 0.0f;
+		};
+
+		// Estimated memory used by a resource
+		struct Usage {
+			size_t gpu = 0;
+			size_t cpu = 0;
+		};
+
+		// Counters for tuning the policy
+		struct Stats {
+			uint64 hits      = 0;
+			uint64 misses    = 0;
+			uint64 evictions = 0;
+			size_t entries   = 0;
+			size_t gpu_bytes = 0;
+			size_t cpu_bytes = 0;
+		};
+
+		ResourceCache(const Policy& policy = Policy()) noexcept : policy(policy), budget(policy.budget) {}
+
+		// Returns a cached resource, or nullptr if not found.
+		// Counts a hit or a miss
+		std::shared_ptr<T> find(const size_t hash) noexcept {
+			Shard& shard = this->shard_of(hash);
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			auto it = shard.entries.find(hash);
+			if(it == shard.entries.end()) {
+				this->misses.fetch_add(1, std::memory_order_relaxed);
+				return nullptr;
+			}
+
+			this->hits.fetch_add(1, std::memory_order_relaxed);
+			Entry& entry    = it->second;
+			entry.in_use    = true;
+			entry.last_used = Clock::now();
+			return entry.resource;
+		}
+
+		// Returns true if the resource is cached, without counting a hit or a miss
+		inline bool contains(const size_t hash) const noexcept {
+			const Shard& shard = this->shard_of(hash);
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			return shard.entries.contains(hash);
+		}
+
+		// Adds a resource, replacing the one with the same hash.
+		// Evicts unused resources of its shard if the cache is over the budget.
+		// - `usage`: (Default: {}) Estimated memory used by the resource
+		// - `pinned`: (Default: false) Never evicts it
+		void insert(const size_t hash, std::shared_ptr<T> resource, const Usage usage = Usage(), const bool pinned = false) {
+			std::shared_ptr<T> replaced; // Destroyed after unlocking
+			{
+				Shard& shard = this->shard_of(hash);
+				std::lock_guard<std::mutex> lock(shard.mutex);
+				auto it = shard.entries.find(hash);
+				if(it != shard.entries.end()) {
+					this->remove_usage(it->second.usage);
+					replaced = std::move(it->second.resource);
+					shard.entries.erase(it);
+				}
+				this->emplace(shard, hash, std::move(resource), usage, pinned);
+			}
+			this->trim_after_insert(hash);
+		}
+
+		// Adds a resource if no other thread cached one with the same hash first.
+		// Returns the resource that is cached, which may not be the one given.
+		// Used when two threads may load the same resource at the same time
+		std::shared_ptr<T> try_insert(const size_t hash, std::shared_ptr<T> resource, const Usage usage = Usage(), const bool pinned = false) {
+			std::shared_ptr<T> result;
+			{
+				Shard& shard = this->shard_of(hash);
+				std::lock_guard<std::mutex> lock(shard.mutex);
+				auto it = shard.entries.find(hash);
+				if(it != shard.entries.end()) {
+					it->second.in_use    = true;
+					it->second.last_used = Clock::now();
+					result = it->second.resource;
+				} else {
+					result = resource;
+					this->emplace(shard, hash, std::move(resource), usage, pinned);
+				}
+			}
+			// The one not cached is destroyed here, outside the lock
+			resource.reset();
+			this->trim_after_insert(hash);
+			return result;
+		}
+
+		// Changes the memory used by a resource (e.g., a texture array that grew).
+		// Returns false if not found
+		bool set_usage(const size_t hash, const Usage usage) noexcept {
+			Shard& shard = this->shard_of(hash);
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			auto it = shard.entries.find(hash);
+			if(it == shard.entries.end()) {
+				return false;
+			}
+			this->remove_usage(it->second.usage);
+			it->second.usage = usage;
+			this->add_usage(usage);
+			return true;
+		}
+
+		// Pinned resources are never evicted (e.g., assets used by every scene).
+		// Returns false if not found
+		bool set_pinned(const size_t hash, const bool pinned) noexcept {
+			Shard& shard = this->shard_of(hash);
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			auto it = shard.entries.find(hash);
+			if(it == shard.entries.end()) {
+				return false;
+			}
+			it->second.pinned = pinned;
+			return true;
+		}
+
+		// Removes a resource from the cache. It stays alive while it is used.
+		// Returns false if not found
+		bool erase(const size_t hash) noexcept {
+			std::shared_ptr<T> erased; // Destroyed after unlocking
+			Shard& shard = this->shard_of(hash);
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			auto it = shard.entries.find(hash);
+			if(it == shard.entries.end()) {
+				return false;
+			}
+			this->remove_usage(it->second.usage);
+			erased = std::move(it->second.resource);
+			shard.entries.erase(it);
+			return true;
+		}
+
+		// Evicts unused resources following the policy.
+		// Call it after a scene change to free memory without loading anything
+		void trim() noexcept {
+			std::lock_guard<std::mutex> trim_lock(this->policy_mutex);
+			this->trim_shards(0, SHARDS);
+		}
+
+		// Evicts all unused resources that are not pinned, ignoring the policy (e.g., when memory is low).
+		// If memory runs out it stops, keeping what was not evicted yet.
+		// Returns how many were evicted
+		size_t evict_unused() noexcept {
+			// Destroyed after unlocking the shards
+			std::vector<std::shared_ptr<T>> evicted;
+			std::vector<size_t> unused;
+			try {
+				for(Shard& shard : this->shards) {
+					std::lock_guard<std::mutex> lock(shard.mutex);
+					unused.clear();
+					for(const auto& [hash, entry] : shard.entries) {
+						if(!entry.pinned && entry.resource.use_count() == 1) {
+							unused.push_back(hash);
+						}
+					}
+					evicted.reserve(evicted.size() + unused.size());
+
+					// Erasing invalidates the iterators, done after
+					for(const size_t hash : unused) {
+						auto it = shard.entries.find(hash);
+						this->remove_usage(it->second.usage);
+						evicted.push_back(std::move(it->second.resource)); // Reserved, never throws
+						shard.entries.erase(it);
+					}
+				}
+			} catch(...) {
+				// Out of memory while listing a shard, the ones before it were evicted
+			}
+			this->evictions.fetch_add(evicted.size(), std::memory_order_relaxed);
+			return evicted.size();
+		}
+
+		// Removes all resources. Counters are kept
+		void clear() noexcept {
+			for(Shard& shard : this->shards) {
+				FlatMap<size_t, Entry> entries;
+				{
+					std::lock_guard<std::mutex> lock(shard.mutex);
+					std::swap(entries, shard.entries);
+					for(const auto& [hash, entry] : entries) {
+						this->remove_usage(entry.usage);
+					}
+				}
+			}
+		}
+
+		inline Policy get_policy() const noexcept {
+			std::lock_guard<std::mutex> lock(this->policy_mutex);
+			return this->policy;
+		}
+
+		// Changes the policy, evicting what the new one does not keep
+		inline void set_policy(const Policy& policy) noexcept {
+			{
+				std::lock_guard<std::mutex> lock(this->policy_mutex);
+				this->policy = policy;
+				this->budget.store(policy.budget, std::memory_order_relaxed);
+			}
+			this->trim();
+		}
+
+		// Counters are read one by one, they may be a bit off while other threads use the cache
+		Stats get_stats() const noexcept {
+			Stats result;
+			result.hits      = this->hits.load(std::memory_order_relaxed);
+			result.misses    = this->misses.load(std::memory_order_relaxed);
+			result.evictions = this->evictions.load(std::memory_order_relaxed);
+			result.gpu_bytes = this->gpu_bytes.load(std::memory_order_relaxed);
+			result.cpu_bytes = this->cpu_bytes.load(std::memory_order_relaxed);
+			for(const Shard& shard : this->shards) {
+				std::lock_guard<std::mutex> lock(shard.mutex);
+				result.entries += shard.entries.size();
+			}
+			return result;
+		}
+
+		// Sets hits, misses and evictions to 0
+		inline void reset_stats() noexcept {
+			this->hits.store(0, std::memory_order_relaxed);
+			this->misses.store(0, std::memory_order_relaxed);
+			this->evictions.store(0, std::memory_order_relaxed);
+		}
+
+	private:
+		struct Entry {
+			std::shared_ptr<T> resource;
+			Usage usage;
+			// Last time it was found or seen in use
+			Clock::time_point last_used;
+			bool pinned = false;
+			// Was in use the last time it was checked
+			bool in_use = true;
+		};
+
+		// Aligned so two shards never share a cache line
+		struct alignas(64) Shard {
+			mutable std::mutex mutex;
+			FlatMap<size_t, Entry> entries;
+		};
+
+		// Unused entry that may be evicted by `trim`
+		struct Candidate {
+			Clock::time_point last_used;
+			size_t hash;
+		};
+
+		std::array<Shard, SHARDS> shards;
+		// Guards the policy and `candidates`, and makes only one thread trim at a time
+		mutable std::mutex policy_mutex;
+		Policy policy;
+		// Copy of `policy.budget`, read by inserts without locking
+		std::atomic<size_t> budget;
+		std::atomic<uint32> inserts = 0;
+		// Kept between trims so its memory is reused
+		std::vector<Candidate> candidates;
+
+		std::atomic<uint64> hits      = 0;
+		std::atomic<uint64> misses    = 0;
+		std::atomic<uint64> evictions = 0;
+		std::atomic<size_t> gpu_bytes = 0;
+		std::atomic<size_t> cpu_bytes = 0;
+
+		// Hashes are already mixed, but the low bits of some (e.g., combined with small numbers) are not.
+		// The high half is folded in before picking the shard
+		inline Shard& shard_of(const size_t hash) noexcept {
+			return this->shards[(hash ^ (hash >> 32)) & (SHARDS - 1)];
+		}
+
+		inline const Shard& shard_of(const size_t hash) const noexcept {
+			return this->shards[(hash ^ (hash >> 32)) & (SHARDS - 1)];
+		}
+
+		// Must be called with the shard locked
+		inline void emplace(Shard& shard, const size_t hash, std::shared_ptr<T>&& resource, const Usage usage, const bool pinned) {
+			Entry entry;
+			entry.resource  = std::move(resource);
+			entry.usage     = usage;
+			entry.last_used = Clock::now();
+			entry.pinned    = pinned;
+			shard.entries.emplace(hash, std::move(entry));
+			this->add_usage(usage);
+		}
+
+		// Checks the budget without locking anything.
+		// Over it, only the shard of the new resource is trimmed, the rest every `TRIM_INTERVAL` inserts.
+		// Skipped if another thread is trimming, so loader threads never wait for each other here
+		void trim_after_insert(const size_t hash) noexcept {
+			const bool full = this->inserts.fetch_add(1, std::memory_order_relaxed) % TRIM_INTERVAL == TRIM_INTERVAL - 1;
+			const bool over = this->gpu_bytes.load(std::memory_order_relaxed) + this->cpu_bytes.load(std::memory_order_relaxed)
+				> this->budget.load(std::memory_order_relaxed);
+			if(!full && !over) {
+				return;
+			}
+
+			std::unique_lock<std::mutex> trim_lock(this->policy_mutex, std::try_to_lock);
+			if(!trim_lock.owns_lock()) {
+				return;
+			}
+			if(full) {
+				this->trim_shards(0, SHARDS);
+			} else {
+				this->trim_shards(static_cast<size_t>(&this->shard_of(hash) - this->shards.data()), 1);
+			}
+		}
+
+		// Evicts unused resources of `count` shards starting at `first`, oldest first.
+		// Must be called with `policy_mutex` locked.
+		// If memory runs out it stops, keeping what was not evicted yet
+		void trim_shards(const size_t first, const size_t count) noexcept {
+			// Destroyed after unlocking the shards, resources may take their time (or other locks) to be released
+			std::vector<std::shared_ptr<T>> evicted;
+			try {
+				const Clock::time_point now = Clock::now();
+
+				this->candidates.clear();
+				for(size_t i = first; i < first + count; i++) {
+					Shard& shard = this->shards[i];
+					std::lock_guard<std::mutex> lock(shard.mutex);
+					for(auto& [hash, entry] : shard.entries) {
+						if(entry.resource.use_count() > 1) {
+							entry.in_use    = true;
+							entry.last_used = now;
+							continue;
+						}
+						// Released since the last check. The grace period started when it was last found or seen in use,
+						// not now, or a trim under pressure would restart it for everything released by a scene change
+						entry.in_use = false;
+						if(!entry.pinned && seconds(now - entry.last_used) >= this->policy.grace) {
+							this->candidates.push_back(Candidate { entry.last_used, hash });
+						}
+					}
+				}
+				if(this->candidates.empty()) {
+					return;
+				}
+				std::sort(this->candidates.begin(), this->candidates.end(), [](const Candidate& a, const Candidate& b) {
+					return a.last_used < b.last_used;
+				});
+				evicted.reserve(this->candidates.size());
+
+				size_t total = this->gpu_bytes.load(std::memory_order_relaxed) + this->cpu_bytes.load(std::memory_order_relaxed);
+				for(const Candidate& candidate : this->candidates) {
+					const bool idle = this->policy.max_idle > 0.0f && seconds(now - candidate.last_used) >= this->policy.max_idle;
+					if(total <= this->policy.budget && !idle) {
+						continue;
+					}
+
+					// Another thread may have found, replaced or erased it since it was checked
+					Shard& shard = this->shard_of(candidate.hash);
+					std::lock_guard<std::mutex> lock(shard.mutex);
+					auto it = shard.entries.find(candidate.hash);
+					if(it == shard.entries.end() || it->second.pinned || it->second.in_use
+						|| it->second.last_used != candidate.last_used || it->second.resource.use_count() > 1) {
+						continue;
+					}
+
+					total -= std::min(total, it->second.usage.gpu + it->second.usage.cpu);
+					this->remove_usage(it->second.usage);
+					evicted.push_back(std::move(it->second.resource)); // Reserved, never throws
+					shard.entries.erase(it);
+					this->evictions.fetch_add(1, std::memory_order_relaxed);
+				}
+			} catch(...) {
+				// Out of memory while listing the candidates, try again on the next trim
+			}
+		}
+
+		inline void add_usage(const Usage& usage) noexcept {
+			this->gpu_bytes.fetch_add(usage.gpu, std::memory_order_relaxed);
+			this->cpu_bytes.fetch_add(usage.cpu, std::memory_order_relaxed);
+		}
+
+		inline void remove_usage(const Usage& usage) noexcept {
+			this->gpu_bytes.fetch_sub(usage.gpu, std::memory_order_relaxed);
+			this->cpu_bytes.fetch_sub(usage.cpu, std::memory_order_relaxed);
+		}
+
+		static inline float seconds(const Clock::duration duration) noexcept {
+			return std::chrono::duration<float>(duration).count();
+		}
+};
@@ -1,18 +1,24 @@
 #pragma once
 
+#include "scarablib/opengl/geometrypool.hpp"
+#include "scarablib/opengl/resourcecache.hpp"
 #include "scarablib/opengl/shader.hpp"
 #include "scarablib/opengl/shader_program.hpp"
 #include "scarablib/opengl/uniformbuffer.hpp"
 #include "scarablib/opengl/vertexarray.hpp"
 #include "scarablib/proper/error.hpp"
 #include "scarablib/proper/log.hpp"
+#include "scarablib/utils/opengl.hpp"
 #include <algorithm>
 #include <memory>
-#include <unordered_map>
+#include <mutex>
 
 #include "scarablib/opengl/shaders.hpp"
 
-// Manages OpenGL elements, such as Vertex Array, Shader and Shader Program
+// Manages OpenGL elements, such as Vertex Array, Shader and Shader Program.
+// Vertex Arrays, Shaders and Shader Programs can be acquired from any thread: the caches are thread safe
+// and the OpenGL objects are made by the OpenGL thread (see `ScarabOpenGL::run_sync`), blocking the worker until the next frame.
+// Uniform buffers and geometry pools are only used on the OpenGL thread
 class ResourcesManager {
 	public:
 		// Shader information to pass to program.
@@ -50,14 +56,34 @@ class ResourcesManager {
 			return ubo;
 		}
 
+		// Returns Uniform Buffer for vertex pulling draws
+		static inline UniformBuffer* u_pull() noexcept {
+			static UniformBuffer* ubo = new UniformBuffer(sizeof(Shaders::PullUniformBuffer), 3);
+			return ubo;
+		}
+
+		// Shader programs made only of built-in sources (see `Shaders`)
+		enum class Program : uint8 {
+			// DEFAULT_VERTEX and DEFAULT_FRAGMENT, used by models
+			Default,
+			// DEFAULT_VERTEX2D and DEFAULT_FRAGMENT, used by sprites
+			Default2D,
+			// PULL_VERTEX and DEFAULT_FRAGMENT, used by models drawn with vertex pulling. Needs OpenGL 4.3+
+			VertexPull,
+			// SKYBOX_VERTEX and SKYBOX_FRAGMENT
+			Skybox,
+			// BILLBOARD_VERTEX and DEFAULT_FRAGMENT
+			Billboard,
+			// TEXT_VERTEX and FONT_FRAGMENT, used by Text and TextBatch
+			Text,
+			// TEXT_VERTEX and FONT_SDF_FRAGMENT, used for SDF fonts
+			TextSDF,
+			COUNT
+		};
+
 		// Returns a default shader
 		static inline std::shared_ptr<ShaderProgram> default_shader() noexcept {
-			static std::shared_ptr<ShaderProgram> shader = ResourcesManager::get_instance().load_shader_program({
-				// Default vertex and fragment shader source
-				{ .source = Shaders::DEFAULT_VERTEX2D,   .type = Shader::Type::Vertex },
-				{ .source = Shaders::DEFAULT_FRAGMENT, .type = Shader::Type::Fragment },
-			});
-			return shader;
+			return ResourcesManager::get_instance().builtin_program(Program::Default2D);
 		}
 
 		// -- VERTEX ARRAY
@@ -81,16 +107,41 @@ class ResourcesManager {
 		std::shared_ptr<VertexArray> acquire_vertexarray(const void* data, const size_t capacity,
 				const size_t vertex_size, const size_t hash, const bool dynamic = false) noexcept;
 
+		// Creates a static Vertex Array from raw memory or returns an existing one with the same hash.
+		// Used when the data is already in its final layout (e.g., memory mapped from a file).
+		// - `vertices`: Vertex data.
+		// - `vertex_count`: Number of vertices.
+		// - `vertex_size`: Vertex size being used (e.g., `sizeof(Vertex)`).
+		// - `indices`: Index data. Pass nullptr to not make EBO.
+		// - `index_count`: Number of indices.
+		// - `index_size`: Size of one index. Must be 1, 2 or 4.
+		// - `hash`: The hash identification
+		std::shared_ptr<VertexArray> acquire_vertexarray(const void* vertices, const size_t vertex_count,
+				const size_t vertex_size, const void* indices, const size_t index_count,
+				const uint32 index_size, const size_t hash) noexcept;
+
 		// Returns an entry of a VAO using its hash.
 		// Returns nullptr if not found
 		std::shared_ptr<VertexArray> get_vertexarray(const size_t hash) noexcept;
 
+		// -- GEOMETRY POOL
+
+		// Returns the shared pool for a vertex format, created on first use.
+		// All models loaded with the same format are stored in this pool and share its VAO.
+		// Must be called on the OpenGL thread
+		GeometryPool& geometry_pool(const VertexFormat format);
+
 		// -- SHADERS
 
 		// Uploads vertex and fragment shader code to the manager.
 		// Returns: A pointer to the existing shader, or a pointer to a newly created shader if it didn't exist.
 		std::shared_ptr<ShaderProgram> load_shader_program(const std::vector<ResourcesManager::ShaderInfo>& infos);
 
+		// Returns a built-in shader program, compiled on first use.
+		// The handle is kept until `cleanup`, so it is not looked up again and the hashes of the sources are constants.
+		// Throws ScarabError if the program is not supported (e.g., VertexPull with BUILD_OPGL30)
+		const std::shared_ptr<ShaderProgram>& builtin_program(const Program program);
+
 		// Returns an existing or new compiled shader
 		std::shared_ptr<Shader> get_or_compile_shader(const char* source, Shader::Type type);
 
@@ -102,15 +153,51 @@ class ResourcesManager {
 		// Returns nullptr if not found
 		std::shared_ptr<ShaderProgram> get_program(const size_t hash) noexcept;
 
+		// -- CACHES
+
+		// Vertex Arrays not used anymore are kept for a while, evicted when over 64MB of VRAM.
+		// Use it to pin, change the policy or read the stats
+		inline ResourceCache<VertexArray>& get_vertexarray_cache() noexcept {
+			return this->vertexarray_cache;
+		}
+
+		// Compiled shaders are small, they are never evicted by size
+		inline ResourceCache<Shader>& get_shader_cache() noexcept {
+			return this->shader_cache;
+		}
+
+		inline ResourceCache<ShaderProgram>& get_program_cache() noexcept {
+			return this->program_cache;
+		}
+
+		// Evicts unused Vertex Arrays, Shaders and Shader Programs following the policy of each cache.
+		// Call it after a scene change
+		void trim() noexcept;
 
 		// Cleans up all maps;
 		// WARNING: This is called inside Window destructor, DO NOT call it manually
 		void cleanup() noexcept;
 
 	private:
-		std::unordered_map<size_t, std::weak_ptr<VertexArray>> vertexarray_cache;
-		std::unordered_map<size_t, std::weak_ptr<Shader>> shader_cache;
-		std::unordered_map<size_t, std::weak_ptr<ShaderProgram>> program_cache;
+		ResourceCache<VertexArray> vertexarray_cache = ResourceCache<VertexArray>({ .budget = 64 * 1024 * 1024 });
+		ResourceCache<Shader> shader_cache;
+		ResourceCache<ShaderProgram> program_cache;
+		// One pool for each VertexFormat
+		std::unique_ptr<GeometryPool> geometry_pools[3];
+		std::shared_ptr<ShaderProgram> builtin_programs[static_cast<uint8>(Program::COUNT)];
+		std::mutex builtin_mutex;
+
+		// Source of a shader with its hash already made
+		struct HashedSource {
+			const char* source;
+			Shader::Type type;
+			size_t hash;
+		};
+
+		// Returns the cached program made of these sources, or compiles and links it
+		std::shared_ptr<ShaderProgram> load_shader_program(const HashedSource* sources, const size_t count);
+
+		std::shared_ptr<Shader> get_or_compile_shader(const char* source, const Shader::Type type, const size_t hash);
 
 		// Helper method for making a single hash out of the vectors for vertices and indices
 		template <typename T, typename U>
@@ -123,7 +210,7 @@ class ResourcesManager {
 template <typename T, typename U>
 std::shared_ptr<VertexArray> ResourcesManager::acquire_vertexarray(
 		const std::vector<T>& vertices, const std::vector<U>& indices, const bool dynamic, const size_t chash) {
-	static_assert(std::is_base_of_v<Vertex, T> || std::is_base_of_v<Vertex2D, T>, "T must derive from Vertex or Vertex2D");
+	static_assert(HasVertexLayout<T>, "T must be a vertex type with a LAYOUT (e.g., Vertex, Vertex2D or VertexPacked)");
 	static_assert(std::is_unsigned_v<U>, "U must be an unsigned integer type");
 
 	if(vertices.empty()) {
@@ -144,56 +231,56 @@ std::shared_ptr<VertexArray> ResourcesManager::acquire_vertexarray(
 	LOG_DEBUG("Hash %zu not found. Creating new VAO.", hash);
 #endif
 
-	if(indices.empty()) {
-		vertexarray = std::make_shared<VertexArray>(vertices, std::vector<uint8>{}, dynamic);
+	// Uploaded by the OpenGL thread if called by a worker
+	vertexarray = ScarabOpenGL::run_sync([&]() {
+		std::shared_ptr<VertexArray> made;
+		if(indices.empty()) {
+			made = std::make_shared<VertexArray>(vertices, std::vector<uint8>{}, dynamic);
 
-	// -- CREATE VAO WITH THE SMALLEST POSSIBLE TYPE FOR INDICES
-	} else {
-	
-		// Counting vertices is possible to know what type to use
-		// Example: if have 100 vertices, indices can only go from 0 to 100
-		const size_t v_count = vertices.size();
-
-		// UINT8_MAX + 1 = 256. If v_count is 256, max index is 255 (fits in uint8)
-		if(v_count <= (UINT8_MAX + 1)) {
-			vertexarray = std::make_shared<VertexArray>(vertices, ScarabOpenGL::convert_to<uint8>(indices), dynamic);
-		#if defined(SCARAB_DEBUG_VERTEXARRAY_MANAGER)
-			LOG_DEBUG("Converted indices to uint8");
-		#endif
-		} else if(v_count <= (UINT16_MAX + 1)) {
-			vertexarray = std::make_shared<VertexArray>(vertices, ScarabOpenGL::convert_to<uint16>(indices), dynamic);
-		#if defined(SCARAB_DEBUG_VERTEXARRAY_MANAGER)
-			LOG_DEBUG("Converted indices to uint16");
-		#endif
+		// -- CREATE VAO WITH THE SMALLEST POSSIBLE TYPE FOR INDICES
 		} else {
-		#if defined(SCARAB_DEBUG_VERTEXARRAY_MANAGER)
-			LOG_DEBUG("Converted indices to uint32");
-		#endif
-			// No conversion needed. Move the existing vector to avoid a massive copy
-			vertexarray = std::make_shared<VertexArray>(vertices, std::move(indices), dynamic);
+	
+			// Counting vertices is possible to know what type to use
+			const uint32 index_size = ScarabOpenGL::narrowest_index_size(vertices.size());
+
+			if(index_size == sizeof(uint8)) {
+				made = std::make_shared<VertexArray>(vertices, ScarabOpenGL::convert_to<uint8>(indices), dynamic);
+			#if defined(SCARAB_DEBUG_VERTEXARRAY_MANAGER)
+				LOG_DEBUG("Converted indices to uint8");
+			#endif
+			} else if(index_size == sizeof(uint16)) {
+				made = std::make_shared<VertexArray>(vertices, ScarabOpenGL::convert_to<uint16>(indices), dynamic);
+			#if defined(SCARAB_DEBUG_VERTEXARRAY_MANAGER)
+				LOG_DEBUG("Converted indices to uint16");
+			#endif
+			} else {
+			#if defined(SCARAB_DEBUG_VERTEXARRAY_MANAGER)
+				LOG_DEBUG("Converted indices to uint32");
+			#endif
+				// No conversion needed. Move the existing vector to avoid a massive copy
+				made = std::make_shared<VertexArray>(vertices, std::move(indices), dynamic);
+			}
 		}
-	}
 
-#if defined(SCARAB_DEBUG_VERTEXARRAY_MANAGER)
-	LOG_DEBUG("VAO ID made: %zu", vertexarray->get_vaoid());
-	GL_CHECK();
-#endif
+	#if defined(SCARAB_DEBUG_VERTEXARRAY_MANAGER)
+		LOG_DEBUG("VAO ID made: %zu", made->get_vaoid());
+		GL_CHECK();
+	#endif
+		return made;
+	});
 
 	vertexarray->hash = hash;
-	this->vertexarray_cache[hash] = vertexarray;
-	return vertexarray;
+	// Another thread may have made the same one meanwhile
+	return this->vertexarray_cache.try_insert(hash, vertexarray, { .gpu = vertices.size() * sizeof(T) + indices.size() * vertexarray->get_index_stride() });
 }
 
 
 template <typename T, typename U>
 std::size_t ResourcesManager::compute_hash(const std::vector<T>& vertices, const std::vector<U>& indices) const noexcept {
-	size_t hash = 0;
-	for(const T& vertex : vertices) {
-		ScarabHash::hash_combine(hash, vertex);
-	}
-	for(const U& index : indices) {
-		ScarabHash::hash_combine(hash, index);
-	}
-	return hash;
+	// Vertices and indices are plain data, hash them as bytes
+	ScarabHash::Hasher hasher;
+	hasher.update(vertices.data(), vertices.size() * sizeof(T));
+	hasher.update(indices.data(), indices.size() * sizeof(U));
+	return static_cast<size_t>(hasher.digest());
 }
 
@@ -1,21 +1,26 @@
 #pragma once
 
 #include "ext/matrix_float4x4.hpp"
+#include <cstdint>
 
 // Shaders in this namespace:
 // - DEFAULT_VERTEX: Default vertex shader for meshes
 // - DEFAULT_FRAGMENT: Default fragment shader for meshes
+// - PULL_VERTEX: Vertex shader for meshes drawn with vertex pulling (OpenGL 4.3+)
 //
 // - SKYBOX_VERTEX: Vertex shader for skybox
 // - SKYBOX_FRAGMENT: Fragment shader for skybox
 //
 // - BILLBOARD_VERTEX: Vertex shader for billboards
 //
+// - TEXT_VERTEX: Vertex shader for text, with a color for each vertex
 // - FONT_FRAGMENT: Fragment shader for fonts
+// - FONT_SDF_FRAGMENT: Fragment shader for fonts with a signed distance field atlas
 //
 // Uniforms in this namespace:
 // - Camera: view and proj matrices
 // - Mesh: Model matrix and color vector
+// - Pull: Where the vertices of a draw are, when using vertex pulling
 namespace Shaders {
 	struct alignas(16) CameraUniformBuffer {
 		glm::mat4 view;
@@ -31,8 +36,19 @@ namespace Shaders {
 		glm::vec4 params; // x = mixamount, y = texlayer
 	};
 
+	struct alignas(16) PullUniformBuffer {
+		// First vertex of the mesh
+		uint32_t base_vertex;
+		// First index, counted from the start of the index buffer
+		uint32_t first_index;
+		// 1, 2 or 4. 0 if not using indices
+		uint32_t index_size;
+		// `VertexPuller::Layout`
+		uint32_t layout;
+	};
+
 #if !defined(BUILD_OPGL30)
-	const char* const DEFAULT_VERTEX = R"glsl(
+	constexpr const char* DEFAULT_VERTEX = R"glsl(
 		#version 420 core
 
 		layout (location = 0) in vec3 aPos;
@@ -55,7 +71,7 @@ namespace Shaders {
 		}
 	)glsl";
 #else
-	const char* const DEFAULT_VERTEX = R"glsl(
+	constexpr const char* DEFAULT_VERTEX = R"glsl(
 		#version 330 core
 
 		layout (location = 0) in vec3 aPos;
@@ -79,7 +95,93 @@ namespace Shaders {
 	)glsl";
 #endif
 
-	const char* const DEFAULT_VERTEX2D = R"glsl(
+#if !defined(BUILD_OPGL30)
+	// Reads vertices and indices from storage buffers using gl_VertexID.
+	// Buffers are read as uint words, so one shader works for all layouts and index types
+	constexpr const char* PULL_VERTEX = R"glsl(
+		#version 430 core
+
+		layout(std430, binding = 0) readonly buffer PullVertices {
+			uint vdata[];
+		};
+
+		layout(std430, binding = 1) readonly buffer PullIndices {
+			uint idata[];
+		};
+
+		out vec2 texuv;
+
+		layout(std140, binding = 0) uniform Camera {
+			mat4 view;
+			mat4 proj;
+		};
+
+		layout(std140, binding = 1) uniform Transform {
+			mat4 model;
+		};
+
+		layout(std140, binding = 3) uniform Pull {
+			uint base_vertex;
+			uint first_index;
+			uint index_size;
+			uint layout_id;
+		};
+
+		// Smaller indices are packed inside the words
+		uint fetch_index(uint i) {
+			if(index_size == 4u) {
+				return idata[i];
+			}
+			if(index_size == 2u) {
+				return (idata[i >> 1u] >> ((i & 1u) * 16u)) & 0xFFFFu;
+			}
+			if(index_size == 1u) {
+				return (idata[i >> 2u] >> ((i & 3u) * 8u)) & 0xFFu;
+			}
+			return i; // Not using indices
+		}
+
+		void main() {
+			uint vertex = base_vertex + fetch_index(first_index + uint(gl_VertexID));
+			vec3 position;
+
+			switch(layout_id) {
+				// Vertex: 5 floats
+				case 0u: {
+					uint base = vertex * 5u;
+					position = vec3(uintBitsToFloat(vdata[base]), uintBitsToFloat(vdata[base + 1u]), uintBitsToFloat(vdata[base + 2u]));
+					texuv    = vec2(uintBitsToFloat(vdata[base + 3u]), uintBitsToFloat(vdata[base + 4u]));
+					break;
+				}
+				// VertexPackedHalf: 4 halfs and 2 unorm16
+				case 1u: {
+					uint base = vertex * 3u;
+					position = vec3(unpackHalf2x16(vdata[base]), unpackHalf2x16(vdata[base + 1u]).x);
+					texuv    = unpackUnorm2x16(vdata[base + 2u]);
+					break;
+				}
+				// VertexPacked: 4 snorm16 and 2 unorm16
+				case 2u: {
+					uint base = vertex * 3u;
+					position = vec3(unpackSnorm2x16(vdata[base]), unpackSnorm2x16(vdata[base + 1u]).x);
+					texuv    = unpackUnorm2x16(vdata[base + 2u]);
+					break;
+				}
+				// Vertex2D: 4 floats
+				default: {
+					uint base = vertex * 4u;
+					position = vec3(uintBitsToFloat(vdata[base]), uintBitsToFloat(vdata[base + 1u]), 0.0);
+					texuv    = vec2(uintBitsToFloat(vdata[base + 2u]), uintBitsToFloat(vdata[base + 3u]));
+					break;
+				}
+			}
+
+			gl_Position = proj * view * model * vec4(position, 1.0);
+		}
+	)glsl";
+#endif
+
+	constexpr const char* DEFAULT_VERTEX2D = R"glsl(
 		#version 330 core
 
 		layout (location = 0) in vec2 aPos;
@@ -95,7 +197,7 @@ namespace Shaders {
 		}
 	)glsl";
 
-	const char* const DEFAULT_FRAGMENT = R"glsl(
+	constexpr const char* DEFAULT_FRAGMENT = R"glsl(
 		#version 420 core
 
 		in  vec2  texuv;
@@ -169,7 +271,7 @@ namespace Shaders {
 	// 	}
 	// )glsl";
 
-	const char* const SKYBOX_VERTEX = R"glsl(
+	constexpr const char* SKYBOX_VERTEX = R"glsl(
 		#version 330 core
 
 		layout (location = 0) in vec3 aPos;
@@ -188,7 +290,7 @@ namespace Shaders {
 	)glsl";
 
 
-	const char* const SKYBOX_FRAGMENT = R"glsl(
+	constexpr const char* SKYBOX_FRAGMENT = R"glsl(
 		#version 330
 
 		out vec4 fragcolor;
@@ -201,7 +303,7 @@ namespace Shaders {
 		}
 	)glsl";
 
-	const char* const BILLBOARD_VERTEX = R"glsl(
+	constexpr const char* BILLBOARD_VERTEX = R"glsl(
 		#version 330 core
 
 		layout (location = 0) in vec3 aPos;
@@ -226,18 +328,57 @@ namespace Shaders {
 		}
 	)glsl";
 
-	const char* const FONT_FRAGMENT = R"glsl(
+	constexpr const char* TEXT_VERTEX = R"glsl(
 		#version 330 core
 
-		in vec2 texuv;
+		layout (location = 0) in vec2 aPos;
+		layout (location = 1) in vec3 aTex;
+		layout (location = 2) in vec4 aColor;
+
+		out vec3 texuv;
+		out vec4 color;
+
+		uniform mat4 mvp;
+
+		void main() {
+			gl_Position = mvp * vec4(aPos, 0.0, 1.0);
+			texuv       = aTex;
+			color       = aColor;
+		}
+	)glsl";
+
+	constexpr const char* FONT_FRAGMENT = R"glsl(
+		#version 330 core
+
+		in vec3 texuv;
+		in vec4 color;
+		out vec4 fragcolor;
+
+		// Each page of the glyph cache is a layer
+		uniform sampler2DArray texSampler;
+
+		void main() {
+			// Red channel is the glyph coverage
+			fragcolor = vec4(color.rgb, color.a * texture(texSampler, texuv).r);
+		}
+	)glsl";
+
+	constexpr const char* FONT_SDF_FRAGMENT = R"glsl(
+		#version 330 core
+
+		in vec3 texuv;
+		in vec4 color;
+		out vec4 fragcolor;
 
-		uniform vec4 shapeColor;
-		uniform sampler2D texSampler;
+		// Each page of the glyph cache is a layer
+		uniform sampler2DArray texSampler;
 
 		void main() {
-			// Sample red channel (glyph alpha)
-			vec4 tex = vec4(texture(texSampler, texuv).r);
-			gl_FragColor = vec4(tex * shapeColor);
+			// 0.5 is the glyph edge, fwidth keeps the edge about one pixel wide at any scale
+			float dist  = texture(texSampler, texuv).r;
+			float width = max(fwidth(dist), 0.0001);
+			float alpha = smoothstep(0.5 - width, 0.5 + width, dist);
+			fragcolor = vec4(color.rgb, color.a * alpha);
 		}
 	)glsl";
 };
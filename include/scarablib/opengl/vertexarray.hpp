@@ -21,6 +21,16 @@ class VertexArray {
 		VertexArray(const std::vector<T>& vertices, const std::vector<U>& indices = {}, const bool dynamic = false) noexcept;
 		// Manually creates a Vertex Array
 		VertexArray(const void* data, const size_t capacity, const size_t vertex_size, const bool dynamic = false) noexcept;
+		// Creates a static Vertex Array from raw memory.
+		// Data is uploaded straight to immutable buffers, without intermediate copies.
+		// - `vertices`: Vertex data.
+		// - `vertex_count`: Number of vertices.
+		// - `vertex_size`: Vertex size being used (e.g., `sizeof(Vertex)`).
+		// - `indices`: Index data. Pass nullptr to not make EBO.
+		// - `index_count`: Number of indices.
+		// - `index_size`: Size of one index. Must be 1, 2 or 4
+		VertexArray(const void* vertices, const size_t vertex_count, const size_t vertex_size,
+				const void* indices, const size_t index_count, const uint32 index_size) noexcept;
 		~VertexArray() noexcept;
 
 		// Delete copy
@@ -130,6 +140,11 @@ class VertexArray {
 		template <typename T>
 		void add_attribute(const uint32 count, const bool normalized) noexcept;
 
+		// Links all attributes from a layout, replacing any attribute added before.
+		// Usage example: `vertexarray->set_layout(VertexPacked::LAYOUT)`
+		template <size_t N>
+		void set_layout(const VertexLayout<N>& layout) noexcept;
+
 		// Links a vertex attribute to the VBO, telling OpenGL how to interpret the vertex data.
 		// - `T`: attribute type.
 		// - `index`: The index of the vertex attribute in the shader (e.g., the 'location' in 'layout(location=index)').
@@ -141,6 +156,13 @@ class VertexArray {
 		void link_attrib(const uint32 index, const uint32 count,
 				const uint32 stride, const uint32 offset, const bool normalized = false) const noexcept;
 
+		// Links a vertex attribute to the VBO using a runtime type.
+		// Integer types that are not normalized are read as integers in the shader.
+		// - `index`: The index of the vertex attribute in the shader.
+		// - `attribute`: Type, components and offset of the attribute.
+		// - `stride`: The total size (in bytes) of a single vertex
+		void link_attrib(const uint32 index, const VertexAttribute& attribute, const uint32 stride) const noexcept;
+
 		// Update the data inside the VertexArray using Sub Data.
 		// VertexArray must have be created with `dynamic` set to true
 		void update_data(const void* data, size_t size) noexcept;
@@ -172,7 +194,7 @@ template <typename T, typename U>
 VertexArray::VertexArray(const std::vector<T>& vertices, const std::vector<U>& indices, const bool dynamic) noexcept
 	: vsize(sizeof(T)), indexstride(sizeof(U)), length(vertices.size()) {
 
-	static_assert(std::is_base_of_v<Vertex, T> || std::is_base_of_v<Vertex2D, T>, "T must derive from Vertex or Vertex2D");
+	static_assert(HasVertexLayout<T>, "T must be a vertex type with a LAYOUT (e.g., Vertex, Vertex2D or VertexPacked)");
 	static_assert(std::is_unsigned_v<U>, "U must be an unsigned integer type");
 
 #if !defined(BUILD_OPGL30)
@@ -224,43 +246,26 @@ template <typename T>
 void VertexArray::link_attrib(const uint32 index, const uint32 count,
 		const uint32 stride, const uint32 offset, const bool normalized) const noexcept {
 
-#if !defined(BUILD_OPGL30)
-	// Initialize
-	glVertexArrayVertexBuffer(this->vao_id, index, this->vbo_id, 0, stride);
-	glEnableVertexArrayAttrib(this->vao_id, index); // Enable index
-	if constexpr (std::is_integral_v<T>) {
-		glVertexArrayAttribIFormat(this->vao_id, index, static_cast<GLint>(count),
-			ScarabOpenGL::gl_type<T>(), static_cast<GLuint>(offset)
-		);
-	} else {
-		glVertexArrayAttribFormat(this->vao_id, index, static_cast<GLint>(count),
-			ScarabOpenGL::gl_type<T>(), normalized, static_cast<GLuint>(offset)
-		);
-	}
-	// Attach VBO to VAO
-	glVertexArrayAttribBinding(this->vao_id, index, index);
-
-#else
-	glBindVertexArray(this->vao_id);
-	glBindBuffer(GL_ARRAY_BUFFER, this->vbo_id);
-
-	glEnableVertexAttribArray(index);
-	if constexpr (std::is_integral_v<T>) {
-		glVertexAttribIPointer(index, static_cast<GLint>(count), ScarabOpenGL::gl_type<T>(),
-				static_cast<GLsizei>(stride), reinterpret_cast<void*>(offset));
-	} else {
-		glVertexAttribPointer(index, static_cast<GLint>(count), ScarabOpenGL::gl_type<T>(), normalized,
-				static_cast<GLsizei>(stride), reinterpret_cast<void*>(offset));
-	}
-
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-#endif
+	this->link_attrib(index, VertexAttribute{
+		.type       = ScarabOpenGL::gl_type<T>(),
+		.count      = count,
+		.normalized = normalized,
+		.offset     = offset
+	}, stride);
 }
 
 template <typename T>
 void VertexArray::add_attribute(const uint32 count, const bool normalized) noexcept {
-	static_assert(std::is_arithmetic_v<T>, "Type must be an arithmetic value");
+	static_assert(std::is_arithmetic_v<T> || std::is_same_v<T, half16>, "Type must be an arithmetic value or half16");
 	this->link_attrib<T>(this->index++, count, this->vsize, this->stride, normalized);
 	this->stride += count * sizeof(T);
 }
+
+template <size_t N>
+void VertexArray::set_layout(const VertexLayout<N>& layout) noexcept {
+	for(uint32 i = 0; i < N; i++) {
+		this->link_attrib(i, layout.attributes[i], layout.stride);
+	}
+	this->index  = N;
+	this->stride = layout.stride;
+}
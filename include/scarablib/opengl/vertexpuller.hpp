@@ -0,0 +1,73 @@
+#pragma once
+
+#include "scarablib/geometry/vertexlayout.hpp"
+#include "scarablib/opengl/shader_program.hpp"
+#include "scarablib/typedef.hpp"
+#include <memory>
+
+// Draws meshes by reading vertices and indices straight from storage buffers (vertex pulling).
+// The vertex shader (`Shaders::PULL_VERTEX`) fetches them using gl_VertexID and the draw's offsets,
+// so one empty VAO serves every mesh and meshes with different layouts are drawn without changing VAO or format state.
+// Any buffer can be pulled from, e.g., the buffers of a GeometryPool or a VertexArray.
+// WARNING: Needs OpenGL 4.3+ and is not available when using BUILD_OPGL30
+class VertexPuller {
+	public:
+		// Vertex layouts the pull shader can read
+		enum class Layout : uint32 {
+			Vertex           = 0,
+			VertexPackedHalf = 1,
+			VertexPacked     = 2,
+			Vertex2D         = 3
+		};
+
+		// Returns the layout of a VertexFormat
+		static constexpr Layout layout_of(const VertexFormat format) noexcept {
+			switch(format) {
+				case VertexFormat::Half:
+					return Layout::VertexPackedHalf;
+				case VertexFormat::Snorm16:
+					return Layout::VertexPacked;
+				default:
+					return Layout::Vertex;
+			}
+		}
+
+		// Returns true if vertex pulling can be used in this build
+		static constexpr bool supported() noexcept {
+		#if !defined(BUILD_OPGL30)
+			return true;
+		#else
+			return false;
+		#endif
+		}
+
+		// Returns the empty VAO bound when drawing with vertex pulling
+		static uint32 empty_vao() noexcept;
+
+		// Returns the shader program made of `Shaders::PULL_VERTEX` and `Shaders::DEFAULT_FRAGMENT`
+		static std::shared_ptr<ShaderProgram> default_shader();
+
+		// Draws triangles pulling from `vertices` and `indices`.
+		// The empty VAO and a shader using `Shaders::PULL_VERTEX` must be bound.
+		// - `vertices`: Buffer with the vertices.
+		// - `indices`: Buffer with the indices. 0 to draw without indices.
+		// - `layout`: Layout of the vertices.
+		// - `base_vertex`: Added to each index (first vertex if not using indices).
+		// - `first_index`: First index, counted from the start of `indices`.
+		// - `index_size`: Size of one index. 1, 2 or 4. Ignored if not using indices.
+		// - `count`: Number of indices (or vertices) to draw
+		static void draw(const uint32 vertices, const uint32 indices, const Layout layout,
+				const uint32 base_vertex, const uint32 first_index, const uint32 index_size, const uint32 count) noexcept;
+
+		// Forgets the storage buffers bound by `draw`.
+		// Call it after deleting a buffer that may be bound, its ID can be reused
+		static inline void reset_bindings() noexcept {
+			VertexPuller::bound_vertices = 0;
+			VertexPuller::bound_indices  = 0;
+		}
+
+	private:
+		// Storage buffers currently bound to binding 0 and 1
+		static inline uint32 bound_vertices = 0;
+		static inline uint32 bound_indices  = 0;
+};
@@ -52,8 +52,9 @@ class RenderPipeline {
 		// Sorting and drawing phase
 		void flush(const Camera& camera);
 
-		void drawmeshes(const std::vector<std::unique_ptr<Mesh>>& meshes) noexcept;
-		void bind_material(Material& material) noexcept;
+		void drawmeshes(const std::vector<Scene::MeshPtr>& meshes) noexcept;
+		// - `shader`: Program of the mesh (see `Mesh::get_shader`)
+		void bind_material(Material& material, const std::shared_ptr<ShaderProgram>& shader) noexcept;
 
 
 };
@@ -3,17 +3,45 @@
 #include "scarablib/camera/camera.hpp"
 #include "scarablib/geometry/mesh.hpp"
 #include "scarablib/proper/error.hpp"
+#include "scarablib/utils/flatmap.hpp"
 #include <iterator>
+#include <new>
+#include <span>
 #include <string_view>
 #include <utility>
 
 class Scene {
 	public:
+		// Deletes meshes made by `add`.
+		// Meshes made by `spawn_many` are only destroyed, their memory belongs to the scene
+		struct MeshDeleter {
+			bool pooled = false;
+
+			inline void operator()(Mesh* mesh) const noexcept {
+				if(this->pooled) {
+					mesh->~Mesh();
+				} else {
+					delete mesh;
+				}
+			}
+		};
+		using MeshPtr = std::unique_ptr<Mesh, MeshDeleter>;
+
 		// Add a Mesh to the Scene.
 		// Throws error if key already exists
 		template<typename T, typename... Args>
 		T& add(const std::string_view key, Args&&... args);
 
+		// Adds `count` meshes of the same type, all constructed with the same `args` and sharing one material.
+		// They are allocated in one block and inserted in the draw order at once, so spawning
+		// thousands of meshes does not allocate or sort for each one.
+		// `init` is called for each mesh as `init(T& mesh, size_t index)` (e.g., to set its position), after all of them are constructed.
+		// Changing the shared material (e.g., `meshes[0].material->texture`) changes all of them.
+		// Spawned meshes have no key, their memory is freed with the Scene.
+		// Returns the meshes, valid while the Scene exists
+		template<typename T, typename Init, typename... Args>
+		std::span<T> spawn_many(const size_t count, Init&& init, const Args&... args);
+
 		// Remove a Mesh from the Scene.
 		// Returns `false` if key was found
 		bool remove(const std::string_view key) noexcept;
@@ -46,15 +74,41 @@ class Scene {
 		inline size_t size() const noexcept {
 			return this->meshes.size();
 		}
+	private:
+		// Frees a block of `spawn_many`
+		struct BlockDeleter {
+			std::align_val_t alignment;
+
+			inline void operator()(void* memory) const noexcept {
+				::operator delete(memory, this->alignment);
+			}
+		};
+		// Memory of spawned meshes. Declared before `meshes` so it is freed after they are destroyed
+		std::vector<std::unique_ptr<void, BlockDeleter>> blocks;
+
 	public:
 		Camera* active_camera;
-		std::vector<std::unique_ptr<Mesh>> meshes;
+		// Sorted by shader and texture
+		std::vector<MeshPtr> meshes;
 
 	private:
 		// Used to look up for a mesh
-		std::unordered_map<std::string_view, size_t> lookup;
+		FlatMap<std::string_view, size_t> lookup;
 		// Value is size_t so the deletion and get are more optimized
 
+		// Draw order: by shader, then by texture
+		static inline bool draw_order(const Mesh& a, const Mesh& b) noexcept {
+			const uint32 sa = a.get_shader()->get_programid();
+			const uint32 sb = b.get_shader()->get_programid();
+
+			// Secondary sort key
+			if(sa != sb) {
+				// Compare even if one is nullptr
+				return std::less<const uint32>()(sa, sb);
+			}
+
+			return a.material->texture->get_id() < b.material->texture->get_id();
+		}
 };
 
 template<typename T, typename... Args>
@@ -66,21 +120,12 @@ T& Scene::add(const std::string_view key, Args&&... args) {
 		throw ScarabError("Scene already contains mesh with this key");
 	}
 
-	std::unique_ptr<Mesh> mesh = std::make_unique<T>(std::forward<Args>(args)...);
+	MeshPtr mesh = MeshPtr(new T(std::forward<Args>(args)...));
 
 	// Find insertion point
 	auto it = std::lower_bound(this->meshes.begin(), this->meshes.end(), mesh,
-	[](const std::unique_ptr<Mesh>& a, const std::unique_ptr<Mesh>& b) {
-		const uint32 sa = a->material->shader->get_programid();
-		const uint32 sb = b->material->shader->get_programid();
-
-		// Secondary sort key
-		if(sa != sb) {
-			// Compare even if one is nullptr
-			return std::less<const uint32>()(sa, sb);
-		}
-
-		return a->material->texture->get_id() < b->material->texture->get_id();
+	[](const MeshPtr& a, const MeshPtr& b) {
+		return Scene::draw_order(*a, *b);
 	});
 
 	// Get index of the inserted mesh
@@ -97,6 +142,76 @@ T& Scene::add(const std::string_view key, Args&&... args) {
 	return static_cast<T&>(*this->meshes[index]);
 }
 
+template<typename T, typename Init, typename... Args>
+std::span<T> Scene::spawn_many(const size_t count, Init&& init, const Args&... args) {
+	static_assert(std::is_base_of_v<Mesh, T>, "Object must derive from Mesh");
+	static_assert(std::is_invocable_v<Init&, T&, size_t>, "Init must be callable as init(T& mesh, size_t index)");
+
+	if(count == 0) {
+		return std::span<T>();
+	}
+
+	// -- ALLOCATE ONE BLOCK
+	const std::align_val_t alignment = std::align_val_t(alignof(T));
+	std::unique_ptr<void, BlockDeleter> block(::operator new(count * sizeof(T), alignment), BlockDeleter { alignment });
+	T* first = static_cast<T*>(block.get());
+	this->blocks.push_back(std::move(block));
+
+	// -- CONSTRUCT
+	std::vector<MeshPtr> spawned;
+	size_t made = 0;
+	try {
+		spawned.reserve(count);
+		this->meshes.reserve(this->meshes.size() + count);
+
+		// All meshes take this material instead of making one each
+		Mesh::spawn_material = std::make_shared<Material>();
+		for(; made < count; made++) {
+			T* mesh = new(first + made) T(args...);
+			spawned.emplace_back(mesh, MeshDeleter { .pooled = true });
+		}
+		Mesh::spawn_material = nullptr;
+
+		// After all constructors, they set up the shared material and would undo what `init` changes in it.
+		// Meshes made inside `init` get their own material
+		for(size_t i = 0; i < count; i++) {
+			init(first[i], i);
+		}
+	} catch(...) {
+		Mesh::spawn_material = nullptr;
+		spawned.clear();
+		this->blocks.pop_back();
+		throw;
+	}
+
+	// -- MERGE IN DRAW ORDER
+	// `init` may have changed materials, sort the new ones before merging
+	std::stable_sort(spawned.begin(), spawned.end(), [](const MeshPtr& a, const MeshPtr& b) {
+		return Scene::draw_order(*a, *b);
+	});
+
+	std::vector<MeshPtr> merged;
+	merged.reserve(this->meshes.size() + count);
+	// New index of each mesh already in the scene, to fix the lookup
+	std::vector<size_t> moved(this->meshes.size());
+	size_t old_index = 0;
+	size_t new_index = 0;
+	while(old_index < this->meshes.size() || new_index < spawned.size()) {
+		if(new_index == spawned.size() || (old_index < this->meshes.size() && !Scene::draw_order(*spawned[new_index], *this->meshes[old_index]))) {
+			moved[old_index] = merged.size();
+			merged.push_back(std::move(this->meshes[old_index++]));
+		} else {
+			merged.push_back(std::move(spawned[new_index++]));
+		}
+	}
+	this->meshes = std::move(merged);
+
+	for(auto& [key, index] : this->lookup) {
+		index = moved[index];
+	}
+	return std::span<T>(first, count);
+}
+
 template<typename T>
 T* Scene::get_as(const std::string_view key) {
 	static_assert(std::is_base_of_v<Mesh, T>, "Type must derive from Mesh");
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "scarablib/types/raycast.hpp"
+#include <vector>
+
+// Bounding volume hierarchy of triangles, used for raycasts and shape queries against static geometry.
+// Built once with binned SAH (surface area heuristic), large nodes and subtrees are built on worker threads.
+// Unlike `UniformGrid` it does not depend on the size of the world or how uneven the triangles are spread.
+// Triangles are reordered when built, indices returned by queries refer to `get_triangles`
+class TriangleBVH {
+	public:
+		// 32 bytes, two nodes per cache line
+		struct Node {
+			vec3<float> min;
+			// Leaf: first triangle. Inner node: left child, the right child is the next node
+			uint32 first;
+			vec3<float> max;
+			// Triangles of a leaf, 0 for inner nodes
+			uint32 count;
+
+			inline bool is_leaf() const noexcept {
+				return this->count != 0;
+			}
+		};
+
+		// Builds the tree from a list of triangles
+		TriangleBVH(const std::vector<MeshTriangle>& triangles);
+		// Builds the tree from a model.
+		// - `transform`: (Optional) Transform applied to the model
+		TriangleBVH(const char* path, const glm::mat4& transform = glm::mat4(1.0f));
+
+		// Returns the closest triangle hit by the ray
+		Raycast::Rayhit raycast(const Raycast::Ray& ray) const noexcept;
+
+		// Returns true if the ray hits any triangle closer than `max_distance`.
+		// Stops at the first hit, use it for shadows and line of sight.
+		// Distance is in units of the ray direction, like `Rayhit::distance`
+		bool raycast_any(const Raycast::Ray& ray, const float max_distance = std::numeric_limits<float>::max()) const noexcept;
+
+		// Appends to `out` the index of each triangle touching the sphere, returns how many were added
+		size_t query_sphere(const vec3<float>& center, const float radius, std::vector<uint32>& out) const;
+
+		// Appends to `out` the index of each triangle touching the box, returns how many were added
+		size_t query_aabb(const vec3<float>& min, const vec3<float>& max, std::vector<uint32>& out) const;
+
+		// Triangles in the order of the tree
+		inline const std::vector<MeshTriangle>& get_triangles() const noexcept {
+			return this->triangles;
+		}
+
+		inline const std::vector<TriangleBVH::Node>& get_nodes() const noexcept {
+			return this->nodes;
+		}
+
+		// Returns the bytes used by the nodes and triangles
+		size_t get_memory_usage() const noexcept;
+
+	private:
+		// Data of a triangle used by the ray test, made once when built
+		struct Edges {
+			vec3<float> v0;
+			vec3<float> edge1;
+			vec3<float> edge2;
+		};
+
+		std::vector<Node> nodes;
+		std::vector<MeshTriangle> triangles;
+		std::vector<Edges> edges;
+
+		void build(const std::vector<MeshTriangle>& source);
+		// Walks the nodes hit by the ray, returns the index of the triangle hit or `UINT32_MAX`.
+		// `distance` is the farthest hit accepted, set to the distance of the hit.
+		// - `ANY`: Returns the first triangle hit instead of the closest
+		template <bool ANY>
+		uint32 intersect(const Raycast::Ray& ray, float& distance) const noexcept;
+};
+
+static_assert(sizeof(TriangleBVH::Node) == 32, "TriangleBVH::Node must be 32 bytes");
@@ -3,21 +3,42 @@
 #include "scarablib/types/raycast.hpp"
 #include <vector>
 
+// Splits a box of the world into cells, so a ray only tests the triangles of the cells it passes through.
+// Built in two steps: triangles are added with `add_triangle`, then `build` packs them into the cells.
+// Each triangle is stored once, cells only keep 32-bit indices to them (one offset array and one index array),
+// and one bit per cell marks which cells have triangles, so rays cross empty space without reading the cells
 class UniformGrid {
 	public:
 		// Creates a grid from a model.
-		// Automatically calculates and adds the triangles to the grid
+		// Automatically calculates the bounds, adds the triangles to the grid and builds it
 		UniformGrid(const char* path, const vec3<uint32>& griddims, const glm::mat4& transform = glm::mat4(1.0f)) noexcept;
 		UniformGrid(const vec3<float>& worldmin, const vec3<float>& worldmax, const vec3<uint32>& griddims) noexcept;
 
-		// Adds a triangle to the grid. It calculates which cells the triangle
-		// overlaps and adds it to all of them.
+		// Adds a triangle to the grid.
+		// It is not inside any cell until `build` is called
 		void add_triangle(const MeshTriangle& tri) noexcept;
 
+		// Packs all triangles added into the cells they overlap.
+		// Must be called after adding triangles, before using `raycast`
+		void build() noexcept;
+
 		// Performs an optimized raycast against the grid.
-		// It only checks for intersections with triangles in the cells the ray passes through
+		// It only checks for intersections with triangles in the cells the ray passes through.
+		// Returns no hit if the grid was not built after the last `add_triangle`
 		Raycast::Rayhit raycast(const Raycast::Ray& ray) const noexcept;
 
+		// Returns false if triangles were added after the last `build`
+		inline bool is_built() const noexcept {
+			return this->built;
+		}
+
+		inline const std::vector<MeshTriangle>& get_triangles() const noexcept {
+			return this->triangles;
+		}
+
+		// Returns the bytes used by the triangles and the cells
+		size_t get_memory_usage() const noexcept;
+
 	private:
 		vec3<float> worldmin;
 		vec3<float> worldsize;
@@ -25,8 +46,22 @@ class UniformGrid {
 		vec3<uint32> griddims;
 		vec3<float> cellsize;
 
-		std::vector<std::vector<MeshTriangle>> cells;
+		std::vector<MeshTriangle> triangles;
+		// Triangles of cell `i` are `cell_triangles[cell_offsets[i]]` up to `cell_triangles[cell_offsets[i + 1]]`
+		std::vector<uint32> cell_offsets;
+		std::vector<uint32> cell_triangles;
+		// One bit per cell, set if the cell has triangles
+		std::vector<uint64> occupancy;
+		bool built = false;
 
 		// Returns the index of the cell the point is in
 		vec3<uint32> get_cell_index(const vec3<float>& pos) const noexcept;
+
+		inline size_t get_cell_count() const noexcept {
+			return (size_t)this->griddims.x * this->griddims.y * this->griddims.z;
+		}
+
+		inline bool is_occupied(const size_t cell) const noexcept {
+			return (this->occupancy[cell >> 6] >> (cell & 63)) & 1;
+		}
 };
@@ -37,5 +37,9 @@ class Raycast {
 		// - `triangle`: The triangle to test against.
 		// - `out_distance`: The distance from the ray origin to the intersection point.
 		static bool intersects_triangle(const Ray& ray, const MeshTriangle& triangle, float& out_distance);
+
+		// Same as above, using the first vertex and the edges of the triangle (`v1 - v0` and `v2 - v0`).
+		// Faster when the edges are computed once and kept
+		static bool intersects_triangle(const Ray& ray, const vec3<float>& v0, const vec3<float>& edge1, const vec3<float>& edge2, float& out_distance);
 	private:
 };
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "scarablib/gfx/compressedimage.hpp"
+#include "scarablib/gfx/image.hpp"
+#include "scarablib/typedef.hpp"
+
+// Helper namespace to compress images in GPU block formats (BC1, BC3, BC4 and BC5).
+// Blocks are split between worker threads
+namespace ScarabBC {
+	// Compresses an image and, optionally, all its mipmap levels.
+	// - `image`: Image with 1, 3 or 4 channels. BC4 uses the red channel and BC5 red and green.
+	// - `format`: Block format. BC7 can not be encoded.
+	// - `mipmaps`: (Default: true) Makes and compresses all mipmap levels.
+	// - `srgb`: (Default: false) Marks the colors as sRGB. Only used by BC1 and BC3
+	CompressedImage encode(const Image& image, const CompressedImage::Format format, const bool mipmaps = true, const bool srgb = false);
+
+	// Loads an image compressed, using a DDS cache stored next to the file (e.g., `wall.png.bc1.dds`).
+	// The image is decoded, compressed and the cache written only if the cache is missing or older than the image.
+	// Flips work the same as `Assets::load`.
+	// Throws ScarabError if the image could not be loaded.
+	// - `format`: Block format to use.
+	// - `mipmaps`: (Default: true) Makes and compresses all mipmap levels
+	CompressedImage load_cached(const char* path, const CompressedImage::Format format,
+			const bool flip_v = false, const bool flip_h = false, const bool mipmaps = true);
+};
@@ -1,7 +1,13 @@
 #pragma once
 
 #include "scarablib/typedef.hpp"
+#include <cstdio>
 #include <filesystem>
+#include <functional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
 #include <vector>
 
 // std::filesystem::path(path).lexically_normal().string()
@@ -11,6 +17,128 @@
 #define THIS_FILE_DIR std::filesystem::path(__FILE__).parent_path().string()
 
 namespace ScarabFile {
+	// How a mapped file will be read, so the OS knows what to load ahead
+	enum class Access : uint8 {
+		// Default read ahead
+		Normal,
+		// Read once from start to end (e.g., images and models), reads ahead more
+		Sequential,
+		// Read in no order (e.g., archives), does not read ahead
+		Random,
+		// All of it is read soon (e.g., caches uploaded to the GPU), starts loading it now
+		WillNeed
+	};
+
+	// Read-only view of a whole file.
+	// The file is memory mapped when possible, otherwise it is read to a buffer
+	class MappedFile {
+		public:
+			MappedFile() noexcept = default;
+			// Maps the file. Use `is_open()` to check if it succeeded.
+			// - `access`: (Default: Normal) How the file will be read
+			MappedFile(const std::filesystem::path& path, const Access access = Access::Normal) noexcept;
+			~MappedFile() noexcept;
+
+			// Delete copy
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+			MappedFile(MappedFile&& other) noexcept;
+			MappedFile& operator=(MappedFile&& other) noexcept;
+
+			// Returns the content of the file
+			inline const uint8* data() const noexcept {
+				return this->bytes;
+			}
+
+			// Returns the size of the file in bytes
+			inline size_t size() const noexcept {
+				return this->length;
+			}
+
+			// Returns true if the file was opened and is not empty
+			inline bool is_open() const noexcept {
+				return this->bytes != nullptr;
+			}
+
+			// Returns the content of the file
+			inline std::span<const uint8> span() const noexcept {
+				return std::span<const uint8>(this->bytes, this->length);
+			}
+
+			// Returns the content as text
+			inline std::string_view text() const noexcept {
+				return std::string_view(reinterpret_cast<const char*>(this->bytes), this->length);
+			}
+
+			// Changes how a part of the file will be read (e.g., an entry of an archive).
+			// Does nothing if the file is not memory mapped
+			// - `offset`: (Default: 0) Start of the part
+			// - `size`: (Default: SIZE_MAX) Size of the part, clamped to the file
+			void advise(const Access access, const size_t offset = 0, const size_t size = SIZE_MAX) const noexcept;
+
+		private:
+			const uint8* bytes = nullptr;
+			size_t length = 0;
+			// Not null if memory mapped
+			void* mapped = nullptr;
+			// Used if the file could not be mapped
+			std::vector<uint8> buffer;
+
+			void release() noexcept;
+	};
+
+	// Reads a file in chunks, for files too big to have in memory at once.
+	// Each chunk is read to the same buffer, so memory used does not grow with the file
+	class FileReader {
+		public:
+			FileReader() noexcept = default;
+			// Opens the file. Use `is_open()` to check if it succeeded
+			// - `chunk_size`: (Default: 1MB) Max size of each chunk
+			FileReader(const std::filesystem::path& path, const size_t chunk_size = 1 << 20) noexcept;
+			~FileReader() noexcept;
+
+			// Delete copy
+			FileReader(const FileReader&) = delete;
+			FileReader& operator=(const FileReader&) = delete;
+
+			FileReader(FileReader&& other) noexcept;
+			FileReader& operator=(FileReader&& other) noexcept;
+
+			// Reads the next chunk.
+			// Returns an empty span at the end of the file or on errors.
+			// The span is valid until the next call
+			std::span<const uint8> next() noexcept;
+
+			// Returns true if the file was opened
+			inline bool is_open() const noexcept {
+				return this->file != nullptr;
+			}
+
+			// Returns the size of the file in bytes
+			inline uint64 size() const noexcept {
+				return this->length;
+			}
+
+			// Returns how many bytes were read
+			inline uint64 position() const noexcept {
+				return this->offset;
+			}
+
+		private:
+			std::FILE* file = nullptr;
+			std::vector<uint8> buffer;
+			uint64 length = 0;
+			uint64 offset = 0;
+
+			void close() noexcept;
+	};
+
+	// Reads part of a file to `dst`, without allocating.
+	// Returns how many bytes were read, 0 if the file does not exist
+	// - `offset`: (Default: 0) Where to start reading
+	size_t read_into(const std::filesystem::path& path, std::span<uint8> dst, const uint64 offset = 0) noexcept;
+
 	// Return the content of a file.
 	// Returns an empty string if the file does not exist
 	std::string read_file(const std::filesystem::path& path) noexcept;
@@ -24,6 +152,16 @@ namespace ScarabFile {
 	// Returns an empty vector if the file does not exist
 	std::vector<uint8> read_binary_file(const std::filesystem::path& path) noexcept;
 
+	// Writes a file so it is never seen half written.
+	// The content goes to a temporary file with a unique name, then it is renamed to `path`.
+	// Threads (or processes) writing the same path at the same time never share the temporary file, the last rename wins.
+	// - `write`: Writes the content to the stream. Exceptions thrown inside are re-thrown after the temporary file is removed.
+	// Returns false if the file could not be written
+	bool write_atomic(const std::filesystem::path& path, const std::function<void(std::ostream&)>& write);
+
+	// Writes `bytes` to a file, see the function above
+	bool write_atomic(const std::filesystem::path& path, std::span<const uint8> bytes) noexcept;
+
 	// Returns a vector containing all files inside a directory.
 	// Returns an empty vector if the directory does not exist
 	std::vector<std::string> list_files(const std::filesystem::path&, const bool sort) noexcept;
@@ -0,0 +1,274 @@
+#pragma once
+
+#include "scarablib/typedef.hpp"
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Open addressing hash map using Robin Hood hashing with linear probing.
+// All entries live in one array, so lookups touch very few cache lines.
+// Has the same interface as `std::unordered_map` for the most used methods.
+// WARNING: Iterators and references are invalidated by any insertion or erase.
+// Do NOT modify the key (`first`) of an entry
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename Equal = std::equal_to<Key>>
+class FlatMap {
+	public:
+		using value_type = std::pair<Key, Value>;
+
+		template <bool IsConst>
+		class Iterator {
+			friend class FlatMap;
+			public:
+				using map_type  = std::conditional_t<IsConst, const FlatMap, FlatMap>;
+				using reference = std::conditional_t<IsConst, const value_type&, value_type&>;
+				using pointer   = std::conditional_t<IsConst, const value_type*, value_type*>;
+
+				Iterator(map_type* map, const size_t index) noexcept : map(map), index(index) {
+					this->skip_empty();
+				}
+
+				// Allows iterator -> const_iterator
+				operator Iterator<true>() const noexcept requires (!IsConst) {
+					return Iterator<true>(this->map, this->index);
+				}
+
+				inline reference operator*() const noexcept {
+					return this->map->slots[this->index];
+				}
+
+				inline pointer operator->() const noexcept {
+					return &this->map->slots[this->index];
+				}
+
+				inline Iterator& operator++() noexcept {
+					this->index++;
+					this->skip_empty();
+					return *this;
+				}
+
+				inline bool operator==(const Iterator& other) const noexcept {
+					return this->index == other.index;
+				}
+
+			private:
+				map_type* map;
+				size_t index;
+
+				inline void skip_empty() noexcept {
+					while(this->index < this->map->distances.size() && this->map->distances[this->index] == 0) {
+						this->index++;
+					}
+				}
+		};
+
+		using iterator       = Iterator<false>;
+		using const_iterator = Iterator<true>;
+
+		FlatMap() noexcept = default;
+
+		inline iterator begin() noexcept {
+			return iterator(this, 0);
+		}
+		inline iterator end() noexcept {
+			return iterator(this, this->distances.size());
+		}
+		inline const_iterator begin() const noexcept {
+			return const_iterator(this, 0);
+		}
+		inline const_iterator end() const noexcept {
+			return const_iterator(this, this->distances.size());
+		}
+
+		// Number of entries
+		inline size_t size() const noexcept {
+			return this->count;
+		}
+
+		inline bool empty() const noexcept {
+			return this->count == 0;
+		}
+
+		// Allocates space for at least `capacity` entries without rehashing
+		void reserve(const size_t capacity) {
+			size_t slots = MIN_CAPACITY;
+			while(slots * MAX_LOAD_NUM < capacity * MAX_LOAD_DEN) {
+				slots *= 2;
+			}
+			if(slots > this->distances.size()) {
+				this->rehash(slots);
+			}
+		}
+
+		// Removes all entries. Memory is kept
+		void clear() noexcept {
+			for(size_t i = 0; i < this->distances.size(); i++) {
+				if(this->distances[i] != 0) {
+					this->slots[i] = value_type();
+					this->distances[i] = 0;
+				}
+			}
+			this->count = 0;
+		}
+
+		inline iterator find(const Key& key) noexcept {
+			return iterator(this, this->find_index(key));
+		}
+
+		inline const_iterator find(const Key& key) const noexcept {
+			return const_iterator(this, this->find_index(key));
+		}
+
+		inline bool contains(const Key& key) const noexcept {
+			return this->find_index(key) != this->distances.size();
+		}
+
+		// Inserts if the key does not exist, `args` are used to construct the value.
+		// Returns the entry and true if it was inserted
+		template <typename... Args>
+		std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+			const size_t found = this->find_index(key);
+			if(found != this->distances.size()) {
+				return { iterator(this, found), false };
+			}
+			return { iterator(this, this->insert_new(value_type(key, Value(std::forward<Args>(args)...)))), true };
+		}
+
+		// Same as `try_emplace`
+		template <typename... Args>
+		inline std::pair<iterator, bool> emplace(const Key& key, Args&&... args) {
+			return this->try_emplace(key, std::forward<Args>(args)...);
+		}
+
+		// Returns the value of the key, inserting a default value if it does not exist
+		inline Value& operator[](const Key& key) {
+			return this->try_emplace(key).first->second;
+		}
+
+		// Removes an entry.
+		// Returns an iterator to the next entry
+		iterator erase(const_iterator it) noexcept {
+			size_t index = it.index;
+			const size_t mask = this->distances.size() - 1;
+
+			// Backward shift, entries after this one move closer to their ideal slot
+			size_t next = (index + 1) & mask;
+			while(this->distances[next] > 1) {
+				this->slots[index]     = std::move(this->slots[next]);
+				this->distances[index] = this->distances[next] - 1;
+				index = next;
+				next  = (next + 1) & mask;
+			}
+			this->slots[index]     = value_type();
+			this->distances[index] = 0;
+			this->count--;
+
+			return iterator(this, it.index);
+		}
+
+		// Removes the key.
+		// Returns true if it was found
+		bool erase(const Key& key) noexcept {
+			const size_t index = this->find_index(key);
+			if(index == this->distances.size()) {
+				return false;
+			}
+			this->erase(const_iterator(this, index));
+			return true;
+		}
+
+	private:
+		static constexpr size_t MIN_CAPACITY = 16;
+		// Max load factor is 7/8
+		static constexpr size_t MAX_LOAD_NUM = 7;
+		static constexpr size_t MAX_LOAD_DEN = 8;
+
+		std::vector<value_type> slots;
+		// 0 is empty, otherwise distance from the ideal slot + 1
+		std::vector<uint32> distances;
+		size_t count = 0;
+		// Bits used as index
+		uint32 shift = 64;
+
+		[[no_unique_address]] Hash hasher;
+		[[no_unique_address]] Equal equal;
+
+		// Fibonacci hashing, spreads weak hashes (e.g., std::hash<size_t> is identity) over the table
+		inline size_t ideal_index(const Key& key) const noexcept {
+			return static_cast<size_t>((static_cast<uint64>(this->hasher(key)) * 0x9E3779B97F4A7C15ull) >> this->shift);
+		}
+
+		// Returns `distances.size()` if not found
+		size_t find_index(const Key& key) const noexcept {
+			if(this->count == 0) {
+				return this->distances.size();
+			}
+
+			const size_t mask = this->distances.size() - 1;
+			size_t index = this->ideal_index(key);
+			// Robin Hood invariant: stop when an entry is closer to its ideal slot than the key would be
+			for(uint32 distance = 1; this->distances[index] >= distance; distance++) {
+				if(this->equal(this->slots[index].first, key)) {
+					return index;
+				}
+				index = (index + 1) & mask;
+			}
+			return this->distances.size();
+		}
+
+		// Inserts a key that does not exist. Returns its index
+		size_t insert_new(value_type&& entry) {
+			if(this->distances.empty() || (this->count + 1) * MAX_LOAD_DEN > this->distances.size() * MAX_LOAD_NUM) {
+				this->rehash(std::max(MIN_CAPACITY, this->distances.size() * 2));
+			}
+			this->count++;
+			return this->place(std::move(entry));
+		}
+
+		// Places an entry using Robin Hood swaps, the table must have an empty slot.
+		// Returns the index of the entry
+		size_t place(value_type&& entry) noexcept {
+			const size_t mask = this->distances.size() - 1;
+			size_t index  = this->ideal_index(entry.first);
+			size_t result = this->distances.size();
+			uint32 distance = 1;
+
+			while(true) {
+				if(this->distances[index] == 0) {
+					this->slots[index]     = std::move(entry);
+					this->distances[index] = distance;
+					return (result == this->distances.size()) ? index : result;
+				}
+
+				// Rich entry gives the slot to the poor one and the poor one keeps looking
+				if(this->distances[index] < distance) {
+					std::swap(entry, this->slots[index]);
+					std::swap(distance, this->distances[index]);
+					if(result == this->distances.size()) {
+						result = index;
+					}
+				}
+
+				index = (index + 1) & mask;
+				distance++;
+			}
+		}
+
+		void rehash(const size_t capacity) {
+			std::vector<value_type> oldslots = std::move(this->slots);
+			std::vector<uint32> olddistances = std::move(this->distances);
+
+			this->slots.clear();
+			this->slots.resize(capacity);
+			this->distances.assign(capacity, 0);
+			this->shift = 64 - static_cast<uint32>(std::countr_zero(capacity));
+
+			for(size_t i = 0; i < olddistances.size(); i++) {
+				if(olddistances[i] != 0) {
+					this->place(std::move(oldslots[i]));
+				}
+			}
+		}
+};
@@ -2,6 +2,8 @@
 
 #include "scarablib/typedef.hpp"
 #include <functional>
+#include <string_view>
+#include <type_traits>
 
 namespace ScarabHash {
 	// Makes a hash out of a value and return it.
@@ -27,9 +29,66 @@ namespace ScarabHash {
 		seed ^= h(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
 	}
 
-	// Fast, deterministic, non-cryptographic hash for raw bytes.
-	// Use this for asset caching (textures, shaders, files).
-	// WARNING: Do NOT use for security or long-term persistent IDs
+	// Streaming version of `hash_bytes`.
+	// Data can be passed in any number of pieces, the result is the same as hashing it all at once.
+	// Usage example: `Hasher hasher; hasher.update(data, size); hasher.update(width); uint64 hash = hasher.digest();`
+	class Hasher {
+		public:
+			Hasher(const uint64 seed = 0) noexcept;
+
+			// Adds bytes to the hash
+			void update(const void* data, const size_t size) noexcept;
+
+			// Adds the content of a string to the hash
+			inline void update(const std::string_view str) noexcept {
+				this->update(str.data(), str.size());
+			}
+
+			// Adds the bytes of a value to the hash.
+			// WARNING: Do NOT use pointers, the address would be hashed instead of the content
+			template <typename T>
+			inline void update(const T& value) noexcept {
+				static_assert(std::is_trivially_copyable_v<T> && !std::is_pointer_v<T>, "T must be a trivially copyable value");
+				this->update(&value, sizeof(T));
+			}
+
+			// Returns the hash of all data added so far.
+			// More data can still be added after this
+			uint64 digest() const noexcept;
+
+		private:
+			// Accumulators, one per 8 bytes of a stripe
+			alignas(16) uint64 acc[8];
+			// Incomplete stripe
+			alignas(16) uint8 buffer[64];
+			// Total bytes added
+			uint64 length = 0;
+			// Bytes inside `buffer`
+			uint32 buffered = 0;
+			// Stripe index inside the current block
+			uint32 stripe = 0;
+	};
+
+	// Fast, deterministic, non-cryptographic hash for raw bytes (XXH3 style, not compatible with XXH3).
+	// Processes 64 bytes at time using SSE2 when available.
+	// Use this for asset caching (textures, shaders, files, meshes).
+	// WARNING: Do NOT use for security
+	uint64 hash_bytes(const void* data, const size_t size, const uint64 seed = 0) noexcept;
+
+	// Hash of a string that can be made at compile time (64-bit FNV-1a).
+	// Used for built-in shader sources, so their hashes are constants.
+	// Slower than `hash_bytes`, use it only when the hash must be the same as a constexpr one
+	constexpr uint64 hash_const(const std::string_view str) noexcept {
+		uint64 hash = 14695981039346656037ull;
+		for(const char c : str) {
+			hash ^= static_cast<uint8>(c);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// Deprecated, use `hash_bytes`.
+	// Byte at time FNV-1a
 	inline size_t hash_bytes_fnv1a(const void* data, const size_t size) noexcept {
 		const uint8* bytes = static_cast<const uint8*>(data);
 		uint64 hash = 14695981039346656037ull; // 64-bit offset basis
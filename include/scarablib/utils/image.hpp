@@ -0,0 +1,82 @@
+#pragma once
+
+#include "scarablib/typedef.hpp"
+#include <array>
+
+// Helper namespace with pixel kernels used when loading images.
+// Kernels use SSE2, AVX2 or NEON, the best one supported by the CPU is chosen at runtime.
+// All kernels give the same result on every instruction set
+namespace ScarabImage {
+	enum class SIMD : uint8 {
+		Scalar,
+		SSE2,
+		AVX2,
+		NEON
+	};
+
+	// How an image uses its alpha channel
+	enum class AlphaCoverage : uint8 {
+		// All pixels have alpha 255
+		Opaque,
+		// Alpha is only 0 or 255 (e.g., foliage). Works with alpha testing and BC1
+		Cutout,
+		// Any other alpha, needs blending
+		Blended
+	};
+
+	// Returns the best instruction set supported by this CPU
+	SIMD detect_simd() noexcept;
+
+	// Returns the instruction set used by the kernels
+	SIMD get_simd() noexcept;
+
+	// Changes the instruction set used by the kernels (e.g., to compare results).
+	// Falls back to the best supported one if `simd` is not supported.
+	// WARNING: Do not call while kernels are running on other threads
+	void set_simd(const SIMD simd) noexcept;
+
+	// Flips the rows of an image
+	void flip_vertical(uint8* data, const uint32 width, const uint32 height, const uint32 channels) noexcept;
+
+	// Mirrors the pixels of each row of an image
+	void flip_horizontal(uint8* data, const uint32 width, const uint32 height, const uint32 channels) noexcept;
+
+	// Converts RGB pixels to RGBA.
+	// - `src`: `count` * 3 bytes.
+	// - `dst`: `count` * 4 bytes. Must not overlap `src`.
+	// - `alpha`: (Default: 255) Alpha of all pixels
+	void rgb_to_rgba(const uint8* src, uint8* dst, const size_t count, const uint8 alpha = 255) noexcept;
+
+	// Converts pixels with 1 (gray), 2 (gray and alpha), 3 or 4 channels to RGBA.
+	// `dst` must have `count` * 4 bytes and not overlap `src`
+	void to_rgba(const uint8* src, const uint32 channels, uint8* dst, const size_t count) noexcept;
+
+	// Reorders the channels of RGBA pixels.
+	// `order[i]` is the channel copied to channel `i` (e.g., `{ 2, 1, 0, 3 }` converts RGBA to BGRA)
+	void swizzle(uint8* data, const size_t count, const std::array<uint8, 4>& order) noexcept;
+
+	// Multiplies the color of RGBA pixels by their alpha (rounded, as `c * a / 255`)
+	void premultiply_alpha(uint8* data, const size_t count) noexcept;
+
+	// Converts sRGB pixels to linear floats in [0, 1].
+	// Alpha is not a color, so it is only normalized (last channel of 2 and 4 channels pixels)
+	void srgb_to_linear(const uint8* src, float* dst, const size_t count, const uint32 channels) noexcept;
+
+	// Converts linear floats to sRGB pixels, rounded to the nearest value.
+	// Alpha is not a color, so it is only scaled (last channel of 2 and 4 channels pixels)
+	void linear_to_srgb(const float* src, uint8* dst, const size_t count, const uint32 channels) noexcept;
+
+	// Checks how the alpha channel is used.
+	// Images with 1 or 3 channels are always opaque
+	AlphaCoverage alpha_coverage(const uint8* data, const size_t count, const uint32 channels) noexcept;
+
+	// Halves an image averaging 2x2 pixels.
+	// `dst` must have `max(width / 2, 1)` * `max(height / 2, 1)` pixels
+	void downscale_box(const uint8* src, const uint32 width, const uint32 height, const uint32 channels, uint8* dst) noexcept;
+
+	// Resizes an image with a Lanczos (a = 3) filter. Rows are split between worker threads.
+	// Sharper than `downscale_box` and works with any size.
+	// `dst` must have `dst_width` * `dst_height` pixels
+	void resize_lanczos(const uint8* src, const uint32 width, const uint32 height, const uint32 channels,
+			uint8* dst, const uint32 dst_width, const uint32 dst_height);
+};
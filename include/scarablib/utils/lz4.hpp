@@ -0,0 +1,22 @@
+#pragma once
+
+#include "scarablib/typedef.hpp"
+#include <vector>
+
+// Helper namespace to compress data in the LZ4 block format.
+// Output can be read by any LZ4 block decoder (e.g., `LZ4_decompress_safe`).
+// Decompressing is much faster than reading the data from disk, so it is used by archives
+namespace ScarabLZ4 {
+	// Returns the maximum size `compress` can return for `size` bytes
+	constexpr size_t compress_bound(const size_t size) noexcept {
+		return size + (size / 255) + 16;
+	}
+
+	// Compresses `size` bytes and returns them as an LZ4 block
+	std::vector<uint8> compress(const uint8* data, const size_t size);
+
+	// Decompresses an LZ4 block.
+	// Returns false if the block is invalid or does not decompress to exactly `dst_size` bytes.
+	// - `dst`: Where to write, must have `dst_size` bytes
+	bool decompress(const uint8* src, const size_t src_size, uint8* dst, const size_t dst_size) noexcept;
+};
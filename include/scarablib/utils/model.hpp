@@ -1,18 +1,215 @@
 #pragma once
 
 #include "scarablib/geometry/submesh.hpp"
+#include "scarablib/geometry/triangle.hpp"
+#include "scarablib/gfx/texture.hpp"
+#include "scarablib/opengl/geometrypool.hpp"
 #include "scarablib/opengl/vertexarray.hpp"
+#include "scarablib/utils/vfs.hpp"
+#include <cfloat>
 #include <filesystem>
+#include <string>
 #include <vector>
 
 namespace ScarabModel {
-	// Load a wavefront-obj file and return all submeshes and a VAO from submeshes
-	std::pair<std::vector<SubMesh>, std::shared_ptr<VertexArray>> load_obj(const char* path);
+	// Material information read from a MTL file
+	struct ObjMaterial {
+		std::string name;
+		std::string diffuse_texname;
+		std::string specular_texname;
+		std::string bump_texname;
+		std::string normal_texname;
+	};
+
+	// Indices of a single face corner (0-based).
+	// -1 means the attribute is not present
+	struct ObjIndex {
+		int32 vertex   = -1;
+		int32 texcoord = -1;
+		int32 normal   = -1;
+	};
+
+	// Raw content of a wavefront-obj file.
+	// Faces are already triangulated
+	struct ObjData {
+		// Positions as xyz
+		std::vector<float> vertices;
+		// Texture coordinates as uv
+		std::vector<float> texcoords;
+		// Normals as xyz
+		std::vector<float> normals;
+		// Three indices per triangle
+		std::vector<ObjIndex> indices;
+		// One material per triangle. -1 is "no material"
+		std::vector<int32> material_ids;
+		// All materials from all MTL files referenced
+		std::vector<ObjMaterial> materials;
+		// Path of all MTL files referenced
+		std::vector<std::string> mtllibs;
+	};
+
+	// CPU-side geometry of a model, ready to be uploaded
+	struct MeshData {
+		std::vector<Vertex> vertices;
+		std::vector<uint32> indices;
+		// `textureid` is not set here, use `texnames`
+		std::vector<SubMesh> submeshes;
+		// Diffuse texture of each submesh, relative to the model's directory.
+		// Empty if the submesh has no texture
+		std::vector<std::string> texnames;
+		// Local space bounds
+		vec3<float> min = vec3<float>(FLT_MAX);
+		vec3<float> max = vec3<float>(-FLT_MAX);
+	};
+
+	// Everything needed to draw a loaded model
+	struct ModelData {
+		std::vector<SubMesh> submeshes;
+		// Textures used by the submeshes, keeps them alive while the model exists
+		std::vector<std::shared_ptr<Texture>> textures;
+		// Vertices and indices inside the pool of the format used
+		std::shared_ptr<GeometryRange> geometry;
+		// Local space bounds
+		vec3<float> min = vec3<float>(FLT_MAX);
+		vec3<float> max = vec3<float>(-FLT_MAX);
+		// Converts the positions stored in `geometry` to local space.
+		// Identity unless a packed format is used
+		glm::mat4 dequantize = glm::mat4(1.0f);
+		// How `geometry` is stored. Float if a packed format was asked but a TexUV is outside [0, 1]
+		VertexFormat format = VertexFormat::Float;
+	};
+
+	// Geometry of a model read from disk and not uploaded yet.
+	// Does not use OpenGL, so it can be made on any thread
+	struct ObjSource {
+		// Binary mesh cache, `vertices` and `indices` point inside it if it was used
+		ScarabVFS::File file;
+		// Parsed geometry, `vertices` and `indices` point inside it if the cache was not used
+		MeshData mesh;
+
+		const Vertex* vertices = nullptr;
+		size_t vertex_count    = 0;
+		const void* indices    = nullptr;
+		size_t index_count     = 0;
+		uint32 index_size      = sizeof(uint32);
+
+		// `textureid` is not set here, use `texpaths`
+		std::vector<SubMesh> submeshes;
+		// Diffuse texture of each submesh, with the model's directory.
+		// Empty if the submesh has no texture
+		std::vector<std::string> texpaths;
+		// Local space bounds
+		vec3<float> min = vec3<float>(FLT_MAX);
+		vec3<float> max = vec3<float>(-FLT_MAX);
+		// Hash of the source files
+		uint64 hash = 0;
+	};
+
+	// Load a wavefront-obj file and return all submeshes and a VAO from submeshes.
+	// Same as `upload_obj(read_obj(path, use_cache), format)`.
+	// - `use_cache`: (Default: true) Use a binary mesh cache (`<path>.smesh`) stored next to the file.
+	//   The cache is written on the first load and used while the source files do not change.
+	// - `format`: (Default: Float) How vertices are stored on the GPU
+	ModelData load_obj(const char* path, const bool use_cache = true, const VertexFormat format = VertexFormat::Float);
+
+	// Reads a wavefront-obj file (or its binary mesh cache) without uploading anything.
+	// Safe to call from any thread.
+	// Throws ScarabError if the file is invalid or a texture is missing.
+	// - `use_cache`: (Default: true) Use a binary mesh cache (`<path>.smesh`) stored next to the file
+	ObjSource read_obj(const char* path, const bool use_cache = true);
+
+	// Uploads a model read by `read_obj` and loads its textures.
+	// Can be called by any thread, the geometry is uploaded by the OpenGL thread (see `ScarabOpenGL::run_sync`).
+	// - `format`: (Default: Float) How vertices are stored on the GPU
+	ModelData upload_obj(const ObjSource& source, const VertexFormat format = VertexFormat::Float);
+
+	// Returns the triangles of a model read by `read_obj` (e.g., for collision, a UniformGrid or a TriangleBVH).
+	// Safe to call from any thread.
+	// - `transform`: (Default: identity) Transform applied to the vertices
+	std::vector<MeshTriangle> make_triangles(const ObjSource& source, const glm::mat4& transform = glm::mat4(1.0f));
+
+	// Uploads vertices and indices to the GeometryPool of `format` and sets `out.geometry`, `out.dequantize` and `out.format`.
+	// `out.min` and `out.max` must be already set if using a packed format.
+	// Packed formats fall back to Float (with a warning) if a TexUV is outside [0, 1].
+	// - `indices`: Index data, narrowed to the smallest type possible if `index_size` is 4.
+	// - `index_size`: Size of one index. Must be 1, 2 or 4.
+	// - `hash`: The hash identification, the format is added to it
+	void upload_mesh(ModelData& out, const Vertex* vertices, const size_t vertex_count,
+			const void* indices, const size_t index_count, const uint32 index_size,
+			const VertexFormat format, const size_t hash);
+
+	// Deduplicates the vertices of a parsed wavefront-obj file and groups them by material.
+	// Each group is reordered with `optimize`
+	MeshData build_obj(const ObjData& obj);
 
 	// Load a wavefront-obj file and return the overall Vertices and Indices
 	// Deprecated
 	std::pair<std::vector<Vertex>, std::vector<uint32>> load_obj_old(const char* path);
 
+	// Parses a wavefront-obj file and all MTL files referenced by it.
+	// The file is memory mapped and split in chunks that are parsed in parallel,
+	// the chunks are merged in file order, so the result is always the same.
+	// Throws ScarabError if the file can't be read or contains invalid indices
+	ObjData parse_obj(const char* path);
+
+	// Parses a MTL file.
+	// Returns an empty vector if the file does not exist
+	std::vector<ObjMaterial> parse_mtl(const std::filesystem::path& path);
+
+	// Returns the hash of a model's source files (OBJ and MTL content).
+	// Used to check if a binary mesh cache is still valid
+	uint64 source_hash(const char* path, const std::vector<std::string>& dependencies) noexcept;
+
+	// Writes a binary mesh cache (.smesh).
+	// Indices are stored using the narrowest type possible.
+	// - `dependencies`: Files (besides the source) used to make the mesh (e.g. MTL files).
+	// Returns false if the file could not be written
+	bool save_smesh(const std::filesystem::path& path, const MeshData& mesh,
+			const uint64 hash, const std::vector<std::string>& dependencies) noexcept;
+
+	// Loads a binary mesh cache (.smesh) made from `source`.
+	// The file is memory mapped and its buffers are uploaded straight to the GPU when using Float format.
+	// Returns false if the cache does not exist, is invalid or is outdated
+	// - `format`: How vertices are stored on the GPU. Packed formats are made while loading
+	bool load_smesh(const std::filesystem::path& path, const char* source, ModelData& out,
+			const VertexFormat format = VertexFormat::Float);
+
+	// Reads a binary mesh cache (.smesh) made from `source` without uploading it.
+	// The file is opened with `ScarabVFS` and kept inside `out.file`.
+	// Returns false if the cache does not exist, is invalid or is outdated.
+	// Throws ScarabError if a texture is missing
+	bool read_smesh(const std::filesystem::path& path, const char* source, ObjSource& out);
+
+	// Post-transform vertex cache efficiency of an index buffer
+	struct CacheStats {
+		// Average cache miss ratio, vertices transformed per triangle.
+		// 0.5 is the best possible for big meshes, 3.0 is the worst
+		float acmr = 0.0f;
+		// Average transform to vertex ratio, vertices transformed per unique vertex.
+		// 1.0 is the best possible
+		float atvr = 0.0f;
+	};
+
+	// Cache efficiency before and after `optimize`
+	struct OptimizeStats {
+		CacheStats before;
+		CacheStats after;
+	};
+
+	// Simulates a FIFO vertex cache and returns how efficient the index buffer is.
+	// - `cache_size`: (Default: 16) Entries of the simulated cache. 16 is a good guess for most GPUs
+	CacheStats analyze_vertex_cache(const std::vector<uint32>& indices, const size_t vertex_count, const uint32 cache_size = 16);
+
+	// Reorders a triangle list for rendering, the mesh is the same but draws faster.
+	// 1. Triangles are reordered for the post-transform vertex cache (Tom Forsyth's algorithm).
+	// 2. Triangles are split in clusters and clusters facing outwards are drawn first, to reduce overdraw.
+	// 3. Vertices are reordered by first use in the index buffer, for vertex fetch locality.
+	// Unused vertices are removed.
+	// - `vertices`: Vertices of the mesh, it will be reordered.
+	// - `indices`: Triangle list indexing `vertices`, it will be reordered.
+	// Returns the cache efficiency before and after the optimization
+	OptimizeStats optimize(std::vector<Vertex>& vertices, std::vector<uint32>& indices);
+
 	// Sometimes the texname inside MTL contains a "/" at the start
 	inline std::filesystem::path treat_texname(const std::filesystem::path& path) {
 		return (path.is_absolute()) ? path.relative_path() : path;
@@ -1,7 +1,11 @@
 #pragma once
 
+#include "scarablib/geometry/vertexlayout.hpp"
 #include "scarablib/typedef.hpp"
 #include <algorithm>
+#include <functional>
+#include <future>
+#include <type_traits>
 #include <vector>
 
 namespace ScarabOpenGL {
@@ -19,6 +23,28 @@ namespace ScarabOpenGL {
 		return output;
 	}
 
+	// Returns the smallest index size (in bytes) able to address `vertex_count` vertices.
+	// Example: if have 100 vertices, indices can only go from 0 to 100
+	inline constexpr uint32 narrowest_index_size(const size_t vertex_count) noexcept {
+		// UINT8_MAX + 1 = 256. If vertex_count is 256, max index is 255 (fits in uint8)
+		if(vertex_count <= (UINT8_MAX + 1)) {
+			return sizeof(uint8);
+		} else if(vertex_count <= (UINT16_MAX + 1)) {
+			return sizeof(uint16);
+		}
+		return sizeof(uint32);
+	}
+
+	// Returns the GLenum of an index type using its size in bytes.
+	// Sizes other than 1 and 2 are treated as 4
+	inline constexpr GLenum index_type(const uint32 index_size) noexcept {
+		switch(index_size) {
+			case 1:  return GL_UNSIGNED_BYTE;
+			case 2:  return GL_UNSIGNED_SHORT;
+			default: return GL_UNSIGNED_INT;
+		}
+	}
+
 	// Helper function to pad a size to the required alignment
 	inline size_t align_size(const size_t original_size, const GLint alignment) {
 		return (original_size + alignment - 1) & ~(alignment - 1);
@@ -26,6 +52,43 @@ namespace ScarabOpenGL {
 
 	// Used on GL_CHECK macro
 	void check_gl_error(const char* file, int line);
+
+	// -- CONTEXT THREAD
+	// OpenGL can only be used on the thread owning the context.
+	// Other threads send their OpenGL calls to it through a command queue
+
+	// Marks the calling thread as the one owning the OpenGL context.
+	// Called by Window after creating the context
+	void set_context_thread() noexcept;
+
+	// Returns true if called on the thread owning the OpenGL context, or if there is no context yet
+	bool is_context_thread() noexcept;
+
+	// Runs a command on the OpenGL thread.
+	// Runs it right away if called on it, otherwise it is queued and this returns without waiting (e.g., deleting a texture).
+	// Queued commands must not throw
+	void submit(std::function<void()> command);
+
+	// Runs the queued commands. Called by Window on every `swap_buffers`.
+	// Returns how many ran
+	size_t run_commands() noexcept;
+
+	// Runs `func` on the OpenGL thread and returns its result, blocking the calling thread until it ran.
+	// Exceptions are thrown again on the calling thread.
+	// WARNING: The OpenGL thread must not be waiting for the calling thread, or both will wait forever
+	template <typename F>
+	auto run_sync(F&& func) -> std::invoke_result_t<F&> {
+		using R = std::invoke_result_t<F&>;
+		if(is_context_thread()) {
+			return func();
+		}
+
+		// Lives until the future is ready, the command only keeps a pointer to it
+		std::packaged_task<R()> task(std::ref(func));
+		std::future<R> result = task.get_future();
+		submit([&task]() { task(); });
+		return result.get();
+	}
 };
 
 #define GL_CHECK() ScarabOpenGL::check_gl_error(__FILE__, __LINE__)
@@ -39,3 +102,4 @@ template<> constexpr GLenum ScarabOpenGL::gl_type<uint16>() { return GL_UNSIGNED
 template<> constexpr GLenum ScarabOpenGL::gl_type<int16>()  { return GL_SHORT; }
 template<> constexpr GLenum ScarabOpenGL::gl_type<uint32>() { return GL_UNSIGNED_INT; }
 template<> constexpr GLenum ScarabOpenGL::gl_type<int32>()  { return GL_INT; }
+template<> constexpr GLenum ScarabOpenGL::gl_type<half16>() { return GL_HALF_FLOAT; }
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "scarablib/utils/file.hpp"
+#include "scarablib/typedef.hpp"
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Helper namespace for `.scarabpak` archives.
+// An archive is a header, the data of all files (each one 4K aligned) and a directory sorted by name hash.
+// Files are stored as they are or compressed with LZ4.
+// Use `ScarabVFS` to load files from archives, or the `scarabpak` tool to make them
+namespace ScarabPak {
+	// Data of stored files start at multiples of this
+	constexpr size_t ALIGNMENT = 4096;
+
+	enum class Method : uint8 {
+		// As it is, read without copying
+		Stored,
+		// LZ4 block
+		LZ4
+	};
+
+	// Entry of the archive directory
+	struct Entry {
+		// `ScarabHash::hash_bytes` of the name
+		uint64 hash;
+		// From the start of the archive
+		uint64 offset;
+		// Size inside the archive
+		uint64 size;
+		// Size after decompressing
+		uint64 original_size;
+		// Name, inside the names section
+		uint32 name_offset;
+		uint16 name_length;
+		Method method;
+		uint8 reserved;
+	};
+	static_assert(sizeof(Entry) == 40, "ScarabPak::Entry must match the file layout");
+
+	// File to add to an archive
+	struct Source {
+		// Where to read the file from
+		std::filesystem::path path;
+		// Name inside the archive, normalized when written
+		std::string name;
+	};
+
+	// Converts a path to how names are stored: forward slashes, no `.` or `..` and no leading `./`
+	// (e.g., `./textures\wall.png` -> `textures/wall.png`)
+	std::string normalize(const std::string_view path);
+
+	// Read-only archive, memory mapped once
+	class Archive {
+		public:
+			// Opens an archive.
+			// Throws ScarabError if the file does not exist or is not a valid archive
+			Archive(const std::filesystem::path& path);
+
+			// Delete copy
+			Archive(const Archive&) = delete;
+			Archive& operator=(const Archive&) = delete;
+
+			// Returns the entry of a file, or nullptr if the archive does not have it.
+			// `name` must be normalized
+			const Entry* find(const std::string_view name) const noexcept;
+
+			// Returns the name of an entry
+			std::string_view get_name(const Entry& entry) const noexcept;
+
+			// Returns the data of an entry as it is stored (compressed if its method is not Stored)
+			inline const uint8* stored_data(const Entry& entry) const noexcept {
+				return this->file.data() + entry.offset;
+			}
+
+			// Changes how the data of an entry will be read
+			inline void advise(const Entry& entry, const ScarabFile::Access access) const noexcept {
+				this->file.advise(access, entry.offset, entry.size);
+			}
+
+			// Decompresses an entry.
+			// Returns false if the data is corrupted.
+			// - `dst`: Must have `entry.original_size` bytes
+			bool extract(const Entry& entry, uint8* dst) const noexcept;
+
+			// Returns all entries, sorted by hash
+			inline const std::vector<Entry>& get_entries() const noexcept {
+				return this->entries;
+			}
+
+		private:
+			ScarabFile::MappedFile file;
+			std::vector<Entry> entries;
+			// Names of all entries, not null terminated
+			const char* names = nullptr;
+			size_t names_size = 0;
+	};
+
+	// Writes an archive with all files.
+	// Files that don't get smaller are stored as they are (e.g., PNG or OGG).
+	// Throws ScarabError if a file could not be read, two files have the same name or the archive could not be written.
+	// - `compress`: (Default: true) Compresses files with LZ4
+	void write(const std::filesystem::path& output, const std::vector<Source>& files, const bool compress = true);
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "scarablib/geometry/vertex.hpp"
+#include "scarablib/geometry/vertexlayout.hpp"
+#include "scarablib/typedef.hpp"
+#include <vector>
+
+// Helper namespace for packing vertex data in smaller types.
+// Uses SSE2 when available
+namespace ScarabQuantize {
+	// Converts a float to half float (round to nearest even)
+	uint16 float_to_half(const float value) noexcept;
+
+	// Converts a half float to float
+	float half_to_float(const uint16 value) noexcept;
+
+	// Encodes a normalized direction using octahedral mapping, stored as snorm16.
+	// Decode in the shader with:
+	// `vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y)); float t = max(-n.z, 0.0); n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0))); n = normalize(n);`
+	vec2<int16> encode_octahedral(const vec3<float>& normal) noexcept;
+
+	// Decodes a direction made by `encode_octahedral`
+	vec3<float> decode_octahedral(const vec2<int16>& encoded) noexcept;
+
+	// Returns the matrix that converts packed positions (in [-1, 1]) back to the mesh's local space.
+	// Apply it after the model matrix (`model * dequantize`).
+	// - `min`: Minimum corner of the mesh bounds.
+	// - `max`: Maximum corner of the mesh bounds
+	glm::mat4 dequantize_matrix(const vec3<float>& min, const vec3<float>& max) noexcept;
+
+	// Packs vertices using snorm16 positions relative to the bounds and unorm16 TexUV.
+	// - `vertices`: Vertices to pack.
+	// - `count`: Number of vertices.
+	// - `min`: Minimum corner of the mesh bounds.
+	// - `max`: Maximum corner of the mesh bounds
+	std::vector<VertexPacked> quantize_snorm16(const Vertex* vertices, const size_t count,
+			const vec3<float>& min, const vec3<float>& max);
+
+	// Packs vertices using half float positions relative to the bounds and unorm16 TexUV.
+	// - `vertices`: Vertices to pack.
+	// - `count`: Number of vertices.
+	// - `min`: Minimum corner of the mesh bounds.
+	// - `max`: Maximum corner of the mesh bounds
+	std::vector<VertexPackedHalf> quantize_half(const Vertex* vertices, const size_t count,
+			const vec3<float>& min, const vec3<float>& max);
+
+	// Packs vertices using snorm16 positions relative to the bounds, unorm16 TexUV and octahedral normals.
+	// - `vertices`: Vertices to pack.
+	// - `normals`: One normalized normal per vertex.
+	// - `count`: Number of vertices.
+	// - `min`: Minimum corner of the mesh bounds.
+	// - `max`: Maximum corner of the mesh bounds
+	std::vector<VertexPackedNormal> quantize_snorm16(const Vertex* vertices, const vec3<float>* normals,
+			const size_t count, const vec3<float>& min, const vec3<float>& max);
+};
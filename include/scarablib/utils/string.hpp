@@ -1,6 +1,8 @@
 #pragma once
 
+#include "scarablib/typedef.hpp"
 #include <string>
+#include <string_view>
 
 // Helper namespace with methods related to string manipulation
 namespace StringHelper {
@@ -18,6 +20,13 @@ namespace StringHelper {
 	// If not found, returns "."
 	std::string base_dir(const std::string& path) noexcept;
 
+	// Replacement character, returned for invalid UTF-8
+	constexpr uint32 INVALID_CODEPOINT = 0xFFFD;
+
+	// Decodes the UTF-8 codepoint starting at `index` and moves `index` past it.
+	// Invalid or truncated sequences return `INVALID_CODEPOINT` and skip one byte
+	uint32 next_codepoint(std::string_view text, size_t& index) noexcept;
+
 	// Get the base directory from a path to a file.
 	// If not found, returns "."
 	// inline std::string base_dir(const char* path) noexcept {
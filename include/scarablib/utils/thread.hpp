@@ -0,0 +1,52 @@
+#pragma once
+
+#include "scarablib/typedef.hpp"
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <vector>
+
+// Helper namespace with methods related to multithreading
+namespace ScarabThread {
+	// Returns how many worker threads should be used for parallel work.
+	// Never returns less than 1
+	inline uint32 worker_count() noexcept {
+		const uint32 count = std::thread::hardware_concurrency();
+		return (count == 0) ? 1 : count;
+	}
+
+	// Splits [0, `count`) into contiguous ranges and calls `func(begin, end)` for each one on worker threads.
+	// Blocks until all ranges are done. Exceptions thrown inside `func` are re-thrown here.
+	// - `count`: Number of items to process.
+	// - `func`: Callable with signature `void(size_t begin, size_t end)`.
+	// - `min_batch`: (Default: 1) Minimum number of items per range. Small works run on the calling thread
+	template <typename F>
+	void parallel_for(const size_t count, F&& func, const size_t min_batch = 1) {
+		if(count == 0) {
+			return;
+		}
+
+		const size_t batch   = std::max<size_t>(min_batch, 1);
+		const size_t njobs   = std::min<size_t>(ScarabThread::worker_count(), (count + batch - 1) / batch);
+		if(njobs <= 1) {
+			func(size_t(0), count);
+			return;
+		}
+
+		// Calling thread also works, so only spawn njobs - 1 threads
+		std::vector<std::future<void>> jobs;
+		jobs.reserve(njobs - 1);
+		for(size_t i = 1; i < njobs; i++) {
+			const size_t begin = count * i / njobs;
+			const size_t end   = count * (i + 1) / njobs;
+			jobs.emplace_back(std::async(std::launch::async, [&func, begin, end]() {
+				func(begin, end);
+			}));
+		}
+		func(size_t(0), count / njobs);
+
+		for(std::future<void>& job : jobs) {
+			job.get(); // Re-throws
+		}
+	}
+};
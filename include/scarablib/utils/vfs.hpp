@@ -0,0 +1,89 @@
+#pragma once
+
+#include "scarablib/utils/file.hpp"
+#include "scarablib/utils/pak.hpp"
+#include "scarablib/typedef.hpp"
+#include <filesystem>
+#include <memory>
+#include <string>
+
+// Virtual filesystem used by all loaders (images, models, fonts and audio).
+// Files are searched in the mounted archives first, then on disk.
+// Safe to use from any thread
+namespace ScarabVFS {
+	// Read-only content of a file opened with `ScarabVFS::open`
+	class File {
+		public:
+			File() noexcept = default;
+
+			// Delete copy
+			File(const File&) = delete;
+			File& operator=(const File&) = delete;
+
+			File(File&&) noexcept = default;
+			File& operator=(File&&) noexcept = default;
+
+			// Returns the content of the file
+			inline const uint8* data() const noexcept {
+				return this->bytes;
+			}
+
+			// Returns the size of the file in bytes
+			inline size_t size() const noexcept {
+				return this->length;
+			}
+
+			// Returns true if the file was found and is not empty
+			inline bool is_open() const noexcept {
+				return this->bytes != nullptr;
+			}
+
+			// Returns the content of the file
+			inline std::span<const uint8> span() const noexcept {
+				return std::span<const uint8>(this->bytes, this->length);
+			}
+
+			// Returns the content as text
+			inline std::string_view text() const noexcept {
+				return std::string_view(reinterpret_cast<const char*>(this->bytes), this->length);
+			}
+
+		private:
+			friend File open(const std::filesystem::path& path, const ScarabFile::Access access) noexcept;
+
+			const uint8* bytes = nullptr;
+			size_t length = 0;
+			// Keeps the archive mapped while stored files point inside it
+			std::shared_ptr<const ScarabPak::Archive> archive;
+			// Decompressed files
+			std::vector<uint8> buffer;
+			// Files on disk
+			ScarabFile::MappedFile file;
+	};
+
+	// Mounts an archive. Archives mounted later are searched first.
+	// Throws ScarabError if the archive does not exist or is invalid.
+	// - `path`: Path of the `.scarabpak` file.
+	// - `prefix`: (Default: "") Directory the archive is mounted at (e.g., with "resources", the archive file
+	//   `textures/wall.png` is opened as `resources/textures/wall.png`)
+	void mount(const std::filesystem::path& path, const std::string& prefix = "");
+
+	// Unmounts an archive. Files already opened stay valid.
+	// Returns false if it was not mounted
+	bool unmount(const std::filesystem::path& path) noexcept;
+
+	// Unmounts all archives
+	void unmount_all() noexcept;
+
+	// Returns true if the file is in a mounted archive or on disk
+	bool exists(const std::filesystem::path& path) noexcept;
+
+	// Returns true if the file is in a mounted archive
+	bool in_archive(const std::filesystem::path& path) noexcept;
+
+	// Opens a file from a mounted archive or from disk.
+	// Stored files in archives and files on disk are memory mapped, not copied.
+	// Use `is_open()` to check if it was found
+	// - `access`: (Default: Normal) How the file will be read
+	File open(const std::filesystem::path& path, const ScarabFile::Access access = ScarabFile::Access::Normal) noexcept;
+};
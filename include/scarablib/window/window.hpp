@@ -48,7 +48,8 @@ class Window {
 		}
 
 		// Swap the front and back buffers at the end of each frame.
-		// Also clears events buffer.
+		// Also clears events buffer and runs the OpenGL calls queued by other threads (see `ScarabOpenGL::submit`).
+		// Once per second, trims the resource caches so unused resources are evicted.
 		// This should be called at the end of each frame.
 		// to display the newly rendered frame to the screen
 		void swap_buffers() noexcept;
@@ -309,6 +310,8 @@ class Window {
 
 		// FPS and DT
 		Clock clock = Clock();
+		// Last time the resource caches were trimmed, in ms
+		uint32 last_trim = 0;
 
 		// INPUT HANDLERS
 		// Keyboard events in this frame
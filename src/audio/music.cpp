@@ -1,22 +1,30 @@
 #include "scarablib/audio/music.hpp"
 #include "scarablib/proper/error.hpp"
+#include "scarablib/utils/vfs.hpp"
 #include <SDL2/SDL_mixer.h>
 
 // Path validation is done in IAudio
 Music::Music(const char* path)
 	: IAudio(path) {
 	// Load audio
-	this->music = Mix_LoadMUS(path);
+	// Music is streamed, so the file must live as long as the music
+	ScarabVFS::File* file = new ScarabVFS::File(ScarabVFS::open(path, ScarabFile::Access::Sequential));
+	if(file->is_open()) {
+		this->music = Mix_LoadMUS_RW(SDL_RWFromConstMem(file->data(), (int)file->size()), 1);
+	}
 	if (this->music == NULL) {
+		delete file;
 		throw ScarabError("Music \"%s\" was not found", path);
 	}
 
+	this->file     = file;
 	this->type     = (Music::Type)Mix_GetMusicType((Mix_Music*)this->music);
 	this->duration = Mix_MusicDuration((Mix_Music*)this->music);
 }
 
 Music::~Music() noexcept {
 	Mix_FreeMusic((Mix_Music*)this->music);
+	delete (ScarabVFS::File*)this->file;
 	Mix_CloseAudio();
 }
 
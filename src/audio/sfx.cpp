@@ -1,11 +1,16 @@
 #include "scarablib/audio/sfx.hpp"
 #include "scarablib/proper/error.hpp"
+#include "scarablib/utils/vfs.hpp"
 #include <SDL2/SDL_mixer.h>
 
 // Path validation is done in IAudio
 Sfx::Sfx(const char* path) : IAudio(path) {
 	// Load audio
-	this->sfx = Mix_LoadWAV(path);
+	// Chunks are decoded when loaded, the file is not needed after
+	const ScarabVFS::File file = ScarabVFS::open(path, ScarabFile::Access::Sequential);
+	if(file.is_open()) {
+		this->sfx = Mix_LoadWAV_RW(SDL_RWFromConstMem(file.data(), (int)file.size()), 1);
+	}
 	if (this->sfx == NULL) {
 		throw ScarabError("Audio \"%s\" was not found", path);
 	}
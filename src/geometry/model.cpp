@@ -4,28 +4,64 @@
 #include "scarablib/utils/model.hpp"
 
 Model::Model() noexcept {
-	this->material->shader = ResourcesManager::get_instance().load_shader_program({
-		{ .source = Shaders::DEFAULT_VERTEX,   .type = Shader::Type::Vertex },
-		{ .source = Shaders::DEFAULT_FRAGMENT, .type = Shader::Type::Fragment },
-	});
+	this->material->shader = ResourcesManager::get_instance().builtin_program(ResourcesManager::Program::Default);
 }
 
-Model::Model(const char* path) : Mesh() {
-	// auto pair = ScarabModel::load_obj_old(path);
-	// this->vertexarray = ResourcesManager::get_instance()
-	// 	.acquire_vertexarray(pair.first, pair.second);
-	// // Position and TexUV
-	// this->vertexarray->add_attribute<float>(3, false);
-	// this->vertexarray->add_attribute<float>(2, true);
-
-	this->material->shader = ResourcesManager::get_instance().load_shader_program({
-		{ .source = Shaders::DEFAULT_VERTEX,   .type = Shader::Type::Vertex },
-		{ .source = Shaders::DEFAULT_FRAGMENT, .type = Shader::Type::Fragment },
-	});
-
-	auto pair = ScarabModel::load_obj(path);
-	this->submeshes   = pair.first;
-	this->vertexarray = pair.second;
+Model::Model(const char* path, const VertexFormat format)
+	: Model(ModelAsset::load(path, format)) {}
+
+Model::Model(std::shared_ptr<ModelAsset> asset) : Mesh() {
+	if(asset == nullptr) {
+		throw ScarabError("Model asset is null");
+	}
+	this->material->shader = ResourcesManager::get_instance().builtin_program(ResourcesManager::Program::Default);
+
+	const ScarabModel::ModelData& data = asset->get_data();
+	this->geometry   = data.geometry;
+	this->dequantize = data.dequantize;
+	this->format     = asset->get_format();
+	this->asset      = std::move(asset);
+	this->init_bounds(data.min, data.max);
+}
+
+Model::Model(ScarabModel::ModelData&& data) : Mesh() {
+	this->material->shader = ResourcesManager::get_instance().builtin_program(ResourcesManager::Program::Default);
+
+	this->submeshes   = std::move(data.submeshes);
+	this->textures    = std::move(data.textures);
+	this->geometry    = std::move(data.geometry);
+	this->dequantize  = data.dequantize;
+	this->format      = data.format;
+
+	this->init_bounds(data.min, data.max);
+}
+
+void Model::init_bounds(const vec3<float>& min, const vec3<float>& max) noexcept {
+	// Bounds are already known, no need to go through the vertices again.
+	// The model matrix includes the dequantization, so local bounds are in the stored space
+	const glm::mat4 quantize = glm::inverse(this->dequantize);
+	this->bbox = new BoundingBox();
+	this->bbox->local_min = vec3<float>(quantize * vec4<float>(min, 1.0f));
+	this->bbox->local_max = vec3<float>(quantize * vec4<float>(max, 1.0f));
+	this->bbox->min = min;
+	this->bbox->max = max;
+}
+
+void Model::set_vertex_pulling(const bool value) {
+	if(value == this->vertex_pulling) {
+		return;
+	}
+
+	// The material is not changed, it may be shared with other meshes
+	if(value) {
+		if(this->geometry == nullptr) {
+			throw ScarabError("Vertex pulling needs a model loaded from a file");
+		}
+		this->pull_shader = VertexPuller::default_shader();
+	} else {
+		this->pull_shader = nullptr;
+	}
+	this->vertex_pulling = value;
 }
 
 void Model::set_rotation(const float angle, const vec3<float>& axis) noexcept {
@@ -63,6 +99,8 @@ void Model::update_model_matrix() noexcept {
 	this->model = glm::rotate(this->model, glm::radians(this->angle), this->axis);
 	// Scale
 	this->model = glm::scale(this->model, this->scale.get());
+	// Packed vertices
+	this->model = this->model * this->dequantize;
 
 	this->isdirty = false;
 
@@ -80,14 +118,16 @@ void Model::draw_logic() noexcept {
 		this->bbox->update_world_bounds(this->model);
 	}
 
-	if(this->submeshes.empty()) {
-		glDrawElements(GL_TRIANGLES, this->vertexarray->get_length(), this->vertexarray->get_indices_type(), (void*)0);
+	const std::vector<SubMesh>& submeshes = (this->asset != nullptr) ? this->asset->get_data().submeshes : this->submeshes;
+	if(submeshes.empty()) {
+		const uint32 count = (this->geometry != nullptr) ? this->geometry->index_count : this->vertexarray->get_length();
+		this->draw_elements(count, 0);
 		return;
 	}
 
 	// Iterate and draw each submesh
 	uint32 last_texid = 0;
-	for(const SubMesh& submesh : this->submeshes) {
+	for(const SubMesh& submesh : submeshes) {
 		if(submesh.textureid != 0) {
 			uint32 curid = submesh.textureid;
 			if(curid != last_texid) {
@@ -104,92 +144,52 @@ void Model::draw_logic() noexcept {
 		}
 
 		// Draw only the portion of the EBO belonging to this submesh
-		// Offset must be: index * sizeof(uint32)
-		glDrawElements(
-			GL_TRIANGLES,
-			submesh.indices_count,
-			this->vertexarray->get_indices_type(),
-			this->vertexarray->index_offset(submesh.base_index)
-		);
+		this->draw_elements(submesh.indices_count, submesh.base_index);
 	}
 }
 
-
-
-
-
-
-/*
-std::vector<MeshTriangle> Model::get_obj_triangles(const char* path, const glm::mat4& transform) {
-	std::vector<MeshTriangle> triangles;
-
-	// Data containers
-	tinyobj::attrib_t attrib;                   // Mesh information
-	std::vector<tinyobj::shape_t> shapes;       // Mesh shapes
-	std::vector<tinyobj::material_t> materials; // Mesh materials
-
-	// Load obj
-	std::string warn, err;
-	bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, path, (StringHelper::base_dir(path) + "/").c_str());
-
-	// TODO: WARNINGS are also displayed here, throw just if error
-	if(!err.empty()) {
-		LOG_WARNING(err.c_str());
+void Model::draw_elements(const uint32 count, const uint32 first) const noexcept {
+	if(this->vertex_pulling) {
+		// Index offsets are always aligned to the index size
+		VertexPuller::draw(
+			this->geometry->pool->get_vboid(),
+			this->geometry->pool->get_eboid(),
+			VertexPuller::layout_of(this->format),
+			this->geometry->base_vertex,
+			static_cast<uint32>(this->geometry->index_offset / this->geometry->index_size) + first,
+			this->geometry->index_size,
+			count
+		);
+		return;
 	}
 
-	if(!ret) {
-		throw ScarabError("Failed to load/parse (%s) file", path);
+	if(this->geometry != nullptr) {
+		// Pool indices are relative to the mesh, base vertex moves them to the mesh's range
+		glDrawElementsBaseVertex(
+			GL_TRIANGLES,
+			static_cast<GLsizei>(count),
+			this->geometry->index_type,
+			this->geometry->index_pointer(first),
+			static_cast<GLint>(this->geometry->base_vertex)
+		);
+		return;
 	}
 
-	// Loop trough each shape in the file
-	for(const tinyobj::shape_t& shape : shapes) {
-		// Loop through each index of a face
-		// The indices are grouped by 3, because we assume the model is triangulated.
-		for(size_t i = 0; i < shape.mesh.indices.size(); i += 3) {
-			// Get the three vertices that make up this one triangle
-			tinyobj::index_t idx0 = shape.mesh.indices[i + 0];
-			tinyobj::index_t idx1 = shape.mesh.indices[i + 1];
-			tinyobj::index_t idx2 = shape.mesh.indices[i + 2];
-
-			// Extract the position for each vertex from the attrib list
-			// The attrib.vertices is a flat array [x0, y0, z0, x1, y1, z1, ...]
-			vec3<float> v0 = vec3<float>(
-				attrib.vertices[3 * (size_t)idx0.vertex_index + 0],
-				attrib.vertices[3 * (size_t)idx0.vertex_index + 1],
-				attrib.vertices[3 * (size_t)idx0.vertex_index + 2]
-			);
-
-			vec3<float> v1 = vec3<float>(
-				attrib.vertices[3 * (size_t)idx1.vertex_index + 0],
-				attrib.vertices[3 * (size_t)idx1.vertex_index + 1],
-				attrib.vertices[3 * (size_t)idx1.vertex_index + 2]
-			);
-
-			vec3<float> v2 = vec3<float>(
-				attrib.vertices[3 * (size_t)idx2.vertex_index + 0],
-				attrib.vertices[3 * (size_t)idx2.vertex_index + 1],
-				attrib.vertices[3 * (size_t)idx2.vertex_index + 2]
-			);
-
-			// Apply the transformation to the vertices
-			MeshTriangle tri;
-			tri.v0 = vec3<float>(transform * vec4<float>(v0, 1.0f));
-			tri.v1 = vec3<float>(transform * vec4<float>(v1, 1.0f));
-			tri.v2 = vec3<float>(transform * vec4<float>(v2, 1.0f));
-
-			// Calculate the triangle's normal
-			tri.normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
-
-			triangles.push_back(tri);
-		}
-	}
+	// Offset must be: index * sizeof(index type)
+	glDrawElements(
+		GL_TRIANGLES,
+		static_cast<GLsizei>(count),
+		this->vertexarray->get_indices_type(),
+		this->vertexarray->index_offset(first)
+	);
+}
 
-	attrib.vertices.clear();
-	attrib.normals.clear();
-	attrib.texcoords.clear();
-	shapes.clear();
-	materials.clear();
 
-	return triangles;
+std::vector<MeshTriangle> Model::get_obj_triangles(const char* path, const glm::mat4& transform) {
+	// Reuse the read of a model already loaded
+	std::shared_ptr<ModelAsset> asset = ModelAsset::find(path);
+	if(asset != nullptr) {
+		return asset->get_triangles(transform);
+	}
+	return ScarabModel::make_triangles(ScarabModel::read_obj(path), transform);
 }
-*/
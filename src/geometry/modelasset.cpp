@@ -0,0 +1,176 @@
+#include "scarablib/geometry/modelasset.hpp"
+#include "scarablib/geometry/vertex.hpp"
+#include "scarablib/proper/error.hpp"
+#include "scarablib/proper/log.hpp"
+#include "scarablib/utils/hash.hpp"
+#include "scarablib/utils/vfs.hpp"
+#include <filesystem>
+
+// #define SCARAB_DEBUG_MODEL_ASSET
+
+namespace {
+	ResourceCache<ModelAsset> cache = ResourceCache<ModelAsset>({ .budget = 128 * 1024 * 1024 });
+
+	constexpr VertexFormat FORMATS[] = { VertexFormat::Float, VertexFormat::Snorm16, VertexFormat::Half };
+
+	// Estimated memory used by an asset
+	ResourceCache<ModelAsset>::Usage usage_of(const ModelAsset& asset) noexcept {
+		const GeometryRange* range = asset.get_data().geometry.get();
+		if(range == nullptr) {
+			return {};
+		}
+
+		size_t vertex_size = sizeof(Vertex);
+		if(asset.get_format() == VertexFormat::Snorm16) {
+			vertex_size = sizeof(VertexPacked);
+		} else if(asset.get_format() == VertexFormat::Half) {
+			vertex_size = sizeof(VertexPackedHalf);
+		}
+		return {
+			.gpu = static_cast<size_t>(range->vertex_count) * vertex_size + static_cast<size_t>(range->index_count) * range->index_size,
+			.cpu = 0
+		};
+	}
+}
+
+
+ModelAsset::ModelAsset(const char* path, ScarabModel::ModelData&& data, const VertexFormat format) noexcept
+	: path(path), data(std::move(data)), format(format) {}
+
+
+std::shared_ptr<ModelAsset> ModelAsset::load(const char* path, const VertexFormat format, const bool keep_triangles) {
+	if(path == nullptr) {
+		throw ScarabError("Model path is null");
+	}
+
+	const size_t hash = ModelAsset::key(path, format);
+	if(hash != 0) {
+		std::shared_ptr<ModelAsset> asset = cache.find(hash);
+		if(asset != nullptr) {
+			if(keep_triangles) {
+				asset->get_triangles();
+			}
+			return asset;
+		}
+	}
+
+#if defined(SCARAB_DEBUG_MODEL_ASSET)
+	LOG_DEBUG("Model asset (%s) not cached, loading", path);
+#endif
+
+	const ScarabModel::ObjSource source = ScarabModel::read_obj(path);
+	auto asset = std::make_shared<ModelAsset>(path, ScarabModel::upload_obj(source, format), format);
+	// From the same read, so the file is not read again by `get_triangles`
+	if(keep_triangles) {
+		asset->triangles     = ScarabModel::make_triangles(source);
+		asset->has_triangles = true;
+	}
+
+	if(hash != 0) {
+		ResourceCache<ModelAsset>::Usage usage = usage_of(*asset);
+		usage.cpu = asset->triangles.size() * sizeof(MeshTriangle);
+		// Another thread may have loaded the same model meanwhile
+		std::shared_ptr<ModelAsset> cached = cache.try_insert(hash, asset, usage);
+		if(keep_triangles && cached != asset) {
+			cached->get_triangles();
+		}
+		return cached;
+	}
+	return asset;
+}
+
+std::shared_ptr<ModelAsset> ModelAsset::find(const char* path) noexcept {
+	if(path == nullptr) {
+		return nullptr;
+	}
+	for(const VertexFormat format : FORMATS) {
+		const size_t hash = ModelAsset::key(path, format);
+		if(hash != 0 && cache.contains(hash)) {
+			return cache.find(hash);
+		}
+	}
+	return nullptr;
+}
+
+std::shared_ptr<ModelAsset> ModelAsset::find(const char* path, const VertexFormat format) noexcept {
+	if(path == nullptr) {
+		return nullptr;
+	}
+	const size_t hash = ModelAsset::key(path, format);
+	return (hash != 0) ? cache.find(hash) : nullptr;
+}
+
+std::shared_ptr<ModelAsset> ModelAsset::store(const char* path, const ScarabModel::ObjSource& source, const VertexFormat format) {
+	auto asset = std::make_shared<ModelAsset>(path, ScarabModel::upload_obj(source, format), format);
+	const size_t hash = ModelAsset::key(path, format);
+	if(hash != 0) {
+		return cache.try_insert(hash, asset, usage_of(*asset));
+	}
+	return asset;
+}
+
+ResourceCache<ModelAsset>& ModelAsset::get_cache() noexcept {
+	return cache;
+}
+
+void ModelAsset::cleanup() noexcept {
+	cache.clear();
+}
+
+
+const std::vector<MeshTriangle>& ModelAsset::get_triangles() {
+	std::lock_guard<std::mutex> lock(this->triangles_mutex);
+	if(this->has_triangles) {
+		return this->triangles;
+	}
+
+	this->triangles     = ScarabModel::make_triangles(ScarabModel::read_obj(this->path.c_str()));
+	this->has_triangles = true;
+
+	// Count the triangles in the cache's usage
+	const size_t hash = ModelAsset::key(this->path.c_str(), this->format);
+	if(hash != 0) {
+		ResourceCache<ModelAsset>::Usage usage = usage_of(*this);
+		usage.cpu = this->triangles.size() * sizeof(MeshTriangle);
+		cache.set_usage(hash, usage);
+	}
+	return this->triangles;
+}
+
+std::vector<MeshTriangle> ModelAsset::get_triangles(const glm::mat4& transform) {
+	std::vector<MeshTriangle> result = this->get_triangles();
+	if(transform == glm::mat4(1.0f)) {
+		return result;
+	}
+
+	for(MeshTriangle& tri : result) {
+		tri.v0 = vec3<float>(transform * vec4<float>(tri.v0, 1.0f));
+		tri.v1 = vec3<float>(transform * vec4<float>(tri.v1, 1.0f));
+		tri.v2 = vec3<float>(transform * vec4<float>(tri.v2, 1.0f));
+
+		const vec3<float> normal = glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0);
+		const float length = glm::length(normal);
+		tri.normal = (length > 0.0f) ? normal / length : vec3<float>(0.0f);
+	}
+	return result;
+}
+
+
+size_t ModelAsset::key(const char* path, const VertexFormat format) noexcept {
+	size_t hash = ScarabHash::hash_make(std::string_view("MODEL_ASSET"));
+	ScarabHash::hash_combine(hash, std::string_view(path));
+	ScarabHash::hash_combine(hash, static_cast<uint8>(format));
+
+	// Files inside archives only change when the archive is mounted again
+	if(ScarabVFS::in_archive(path)) {
+		return hash;
+	}
+
+	std::error_code error;
+	const auto time = std::filesystem::last_write_time(path, error);
+	if(error) {
+		return 0;
+	}
+	ScarabHash::hash_combine(hash, static_cast<int64_t>(time.time_since_epoch().count()));
+	return hash;
+}
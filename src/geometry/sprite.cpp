@@ -6,13 +6,7 @@ Sprite::Sprite(const std::vector<Vertex2D>& vertices) noexcept
 	// Position and TexUV
 	this->vertexarray->add_attribute<float>(2, false);
 	this->vertexarray->add_attribute<float>(2, false);
-
-	// Set 2D Shader
-	std::shared_ptr<ShaderProgram> shader = ResourcesManager::get_instance().load_shader_program({
-		// Default vertex and fragment shader source
-		{ .source = Shaders::DEFAULT_VERTEX2D,   .type = Shader::Type::Vertex },
-		{ .source = Shaders::DEFAULT_FRAGMENT, .type = Shader::Type::Fragment },
-	});
+	// The material already uses the 2D shader (`ResourcesManager::default_shader`)
 }
 
 void Sprite::update_model_matrix() noexcept {
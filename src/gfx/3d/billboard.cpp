@@ -2,17 +2,18 @@
 #include "scarablib/geometry/geometry_factory.hpp"
 #include "scarablib/geometry/model.hpp"
 #include "scarablib/gfx/image.hpp"
+#include "scarablib/gfx/mipchain.hpp"
+#include "scarablib/utils/image.hpp"
+#include "scarablib/utils/thread.hpp"
+#include <algorithm>
+#include <array>
 #include <cstddef>
 #include <cstdlib>
 
 Billboard::Billboard() noexcept
 	: Model(GeometryFactory::make_plane_vertices(), std::vector<uint8> { 0, 1, 2, 0, 2, 3 }) {
 
-	this->material->shader = ResourcesManager::get_instance().load_shader_program({
-		// Default vertex and fragment shader source
-		{ .source = Shaders::BILLBOARD_VERTEX, .type = Shader::Type::Vertex },
-		{ .source = Shaders::DEFAULT_FRAGMENT, .type = Shader::Type::Fragment },
-	});
+	this->material->shader = ResourcesManager::get_instance().builtin_program(ResourcesManager::Program::Billboard);
 }
 
 
@@ -39,15 +40,16 @@ void Billboard::set_directional_textures(const std::vector<const char*> paths, c
 
 	const uint8 final_size = (paths.size() <= 4) ? 4 : 8;
 
-	// Load image to get dimensions and channels
-	Image* image = new Image(paths[0], false);
-	this->material->texture_array
-		= new TextureArray(image->width, image->height, final_size, image->channels);
-	delete image;
-
+	// Which image goes to each layer, and if it is flipped.
+	// Flipped images replace the layer at the opposite side
+	struct Source {
+		int8 path    = -1;
+		bool flipped = false;
+	};
+	std::array<Source, 8> sources;
 	for(size_t i = 0; i < paths.size(); i++) {
 		// Add base texture
-		this->material->texture_array->add_texture(paths[i], false);
+		sources[i] = Source { static_cast<int8>(i), false };
 
 		#ifdef SCARAB_DEBUG_BILLBOARD_TEXTURE
 		LOG_DEBUG("Setting texture %zu to %s", i, paths[i]);
@@ -61,20 +63,60 @@ void Billboard::set_directional_textures(const std::vector<const char*> paths, c
 			LOG_DEBUG("Flipping %zu and placing at %zu", i, opposite_index);
 			#endif
 
-			// this->textures[opposite_index] = std::make_shared<Texture>(paths[i], true);
-			this->material->texture_array->add_texture(paths[i], true, false, opposite_index);
+			sources[opposite_index] = Source { static_cast<int8>(i), true };
 		}
 	}
 
 	// Check if matches
-	if(this->material->texture_array->get_num_layers() != final_size) {
-		throw ScarabError(
-			"Texture configuration error: The final texture count must be %u. Check flip configuration.",
-			final_size
-		);
+	for(uint8 layer = 0; layer < final_size; layer++) {
+		if(sources[layer].path < 0) {
+			throw ScarabError(
+				"Texture configuration error: The final texture count must be %u. Check flip configuration.",
+				final_size
+			);
+		}
+	}
+
+	// Each image is decoded once on worker threads, its flipped copy is made from the same pixels
+	std::array<MipChain, 8> base;
+	std::array<MipChain, 8> flipped;
+	ScarabThread::parallel_for(paths.size(), [&](const size_t begin, const size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			const auto uses = [&](const bool is_flipped) {
+				return std::any_of(sources.begin(), sources.begin() + final_size, [&](const Source& source) {
+					return source.path == static_cast<int8>(i) && source.flipped == is_flipped;
+				});
+			};
+
+			Image image = Image(paths[i], false);
+			if(image.data == nullptr) {
+				throw ScarabError("Image (%s) was not found", paths[i]);
+			}
+			if(uses(false)) {
+				base[i] = MipChain(image);
+			}
+			if(uses(true)) {
+				ScarabImage::flip_horizontal(image.data, image.width, image.height, image.channels);
+				flipped[i] = MipChain(image);
+			}
+		}
+	});
+
+	const MipChain& first = base[0].empty() ? flipped[0] : base[0];
+	TextureArray* texture_array = new TextureArray(first.width, first.height, final_size, first.channels);
+	try {
+		for(uint8 layer = 0; layer < final_size; layer++) {
+			const Source& source = sources[layer];
+			texture_array->add_texture(source.flipped ? flipped[source.path] : base[source.path], layer);
+		}
+	} catch(...) {
+		delete texture_array;
+		throw;
 	}
 
-	this->material->texture_array->generate_mipmap();
+	// Layers already have all their mipmap levels
+	delete this->material->texture_array;
+	this->material->texture_array = texture_array;
 
 	// this->num_sectors = this->textures.size();
 	this->angle_step = M_PI2 / (float)this->material->texture_array->get_num_layers();
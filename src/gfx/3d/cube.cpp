@@ -1,11 +1,22 @@
 #include "scarablib/gfx/3d/cube.hpp"
 #include "scarablib/geometry/geometry_factory.hpp"
+#include "scarablib/utils/hash.hpp"
 
 Cube::Cube(const uint8 face_mask) noexcept
 	: Model() {
 
+	// Cubes with the same faces share a VAO, the vertices are only made for the first one
+	static constexpr size_t CUBE_HASH = ScarabHash::hash_const("BUILTIN_CUBE");
+	const size_t hash = CUBE_HASH + face_mask;
+
+	ResourcesManager& manager = ResourcesManager::get_instance();
+	this->vertexarray = manager.get_vertexarray(hash);
+	if(this->vertexarray != nullptr) {
+		return;
+	}
+
 	auto geometry = GeometryFactory::make_cube_faces(face_mask);
-	this->set_geometry(geometry.first, geometry.second);
+	this->vertexarray = manager.acquire_vertexarray(geometry.first, geometry.second, false, hash);
 	// Position and TexUV
 	this->vertexarray->add_attribute<float>(3, false);
 	this->vertexarray->add_attribute<float>(2, false);
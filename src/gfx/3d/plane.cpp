@@ -1,35 +1,46 @@
 #include "scarablib/gfx/3d/plane.hpp"
 #include "scarablib/geometry/geometry_factory.hpp"
 #include "scarablib/typedef.hpp"
+#include "scarablib/utils/hash.hpp"
 
 Plane::Plane(const Plane::Type type) noexcept : Model(), type(type) {
+	// Planes of the same type share a VAO, the vertices are only made for the first one
+	static constexpr size_t PLANE_HASH = ScarabHash::hash_const("BUILTIN_PLANE");
+	const size_t hash = PLANE_HASH + type;
+
+	ResourcesManager& manager = ResourcesManager::get_instance();
+	this->vertexarray = manager.get_vertexarray(hash);
+	if(this->vertexarray != nullptr) {
+		return;
+	}
+
 	switch (type) {
 		case Plane::Type::SINGLE_PLANE:
-			this->set_geometry(
+			this->vertexarray = manager.acquire_vertexarray(
 				GeometryFactory::make_plane_vertices(),
 				std::vector<uint8> {
 					0, 1, 2, 0, 2, 3
-				}
+				}, false, hash
 			);
 			break;
 		case Plane::Type::CROSSED_PLANE:
-			this->set_geometry(
+			this->vertexarray = manager.acquire_vertexarray(
 				GeometryFactory::make_crossedplane_vertices(),
 				std::vector<uint8> {
 					0, 1, 2, 2, 3, 0, // First quad
 					4, 5, 6, 6, 7, 4  // Second quad
-				}
+				}, false, hash
 			);
 			break;
 		case Plane::Type::FOUR_CROSSED_PLANE:
-			this->set_geometry(
+			this->vertexarray = manager.acquire_vertexarray(
 				GeometryFactory::make_fourcrossedplane_vertices(),
 				std::vector<uint8> {
 					 0,  1,  2,  0,  2,  3, // Quad 1
 					 4,  5,  6,  4,  6,  7, // Quad 2
 					 8,  9, 10,  8, 10, 11, // Quad 3
 					12, 13, 14, 12, 14, 15  // Quad 4
-				}
+				}, false, hash
 			);
 			break;
 
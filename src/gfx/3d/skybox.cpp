@@ -4,15 +4,137 @@
 #include "scarablib/proper/error.hpp"
 #include "scarablib/proper/log.hpp"
 #include "scarablib/typedef.hpp"
-#include "scarablib/gfx/image.hpp"
 
 // I could make a different texture class for loading cubemap textures
 // but i dont think is necessary
 // so thats why i load Skybox's texture this way
 
 Skybox::Skybox(const Camera& camera, const std::array<const char*, 6>& faces)
+	: Skybox(camera, Cubemap(faces)) {}
+
+Skybox::Skybox(const Camera& camera, const char* path, const Cubemap::Layout layout, const uint32 face_size)
+	: Skybox(camera, Cubemap::load_cached(path, layout, face_size)) {}
+
+Skybox::Skybox(const Camera& camera, const Cubemap& cubemap)
+	: camera(camera) {
+
+	if(cubemap.empty()) {
+		throw ScarabError("Skybox cubemap has no data");
+	}
+
+	this->init_cube();
+
+	const GLenum internal = TextureBase::extract_format(cubemap.channels, true);
+	const GLenum format   = TextureBase::extract_format(cubemap.channels, false);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+#if !defined(BUILD_OPGL30)
+	glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &this->texid);
+	glTextureStorage2D(this->texid,
+		cubemap.levels,
+		internal,
+		cubemap.size, cubemap.size
+	);
+#else
+	// Gen texture cube map
+	glGenTextures(1, &this->texid);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, this->texid);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, cubemap.levels - 1);
+#endif
+
+	// Order: Right > Left > Top > Bottom > Back > Front
+	for(uint32 face = 0; face < 6; face++) {
+		for(uint32 level = 0; level < cubemap.levels; level++) {
+		#if !defined(BUILD_OPGL30)
+			glTextureSubImage3D(this->texid,
+				level,
+				0, 0, face, // x, y, layer
+				cubemap.level_width(level), cubemap.level_width(level), 1, // width, height, depth
+				format,
+				GL_UNSIGNED_BYTE,
+				cubemap.level(face, level)
+			);
+		#else
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+				level,
+				internal,
+				cubemap.level_width(level), cubemap.level_width(level), 0,
+				format,
+				GL_UNSIGNED_BYTE,
+				cubemap.level(face, level)
+			);
+		#endif
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	this->init_sampler(true);
+
+	// Bind to set uniform
+	this->shader->use();
+	this->shader->set_int("samplerSkybox", 0);
+	this->shader->unbind();
+}
+
+Skybox::Skybox(const Camera& camera, const CompressedImage& cubemap)
 	: camera(camera) {
 
+	if(cubemap.empty()) {
+		throw ScarabError("Compressed skybox has no data");
+	}
+	if(!cubemap.cubemap || cubemap.layers != 6) {
+		throw ScarabError("Compressed image is not a cubemap");
+	}
+
+	this->init_cube();
+	const GLenum format = cubemap.gl_format();
+
+#if !defined(BUILD_OPGL30)
+	glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &this->texid);
+	glTextureStorage2D(this->texid,
+		cubemap.levels,
+		format,
+		cubemap.width, cubemap.height
+	);
+#else
+	glGenTextures(1, &this->texid);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, this->texid);
+#endif
+
+	// Order: Right > Left > Top > Bottom > Back > Front
+	for(uint32 face = 0; face < 6; face++) {
+		for(uint32 level = 0; level < cubemap.levels; level++) {
+		#if !defined(BUILD_OPGL30)
+			glCompressedTextureSubImage3D(this->texid,
+				level,
+				0, 0, face, // x, y, layer
+				cubemap.level_width(level), cubemap.level_height(level), 1,
+				format,
+				static_cast<GLsizei>(cubemap.surface_size(level)),
+				cubemap.surface(level, face)
+			);
+		#else
+			glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+				level,
+				format,
+				cubemap.level_width(level), cubemap.level_height(level), 0,
+				static_cast<GLsizei>(cubemap.surface_size(level)),
+				cubemap.surface(level, face)
+			);
+		#endif
+		}
+	}
+
+	// Compressed textures can't generate mipmaps, only the stored levels are used
+	this->init_sampler(cubemap.levels > 1);
+
+	// Bind to set uniform
+	this->shader->use();
+	this->shader->set_int("samplerSkybox", 0);
+	this->shader->unbind();
+}
+
+void Skybox::init_cube() {
 	// TODO: Back to vec3<float> later
 	const std::vector<Vertex> vertices = {
 		Vertex { glm::vec3(-1.0f,  1.0f, -1.0f) }, // 0 - Top-Left-Back
@@ -49,76 +171,18 @@ Skybox::Skybox(const Camera& camera, const std::array<const char*, 6>& faces)
 	this->vertexarray = ResourcesManager::get_instance()
 		.acquire_vertexarray(vertices, indices);
 	this->vertexarray->add_attribute<float>(3, false);
+}
 
-
-#if !defined(BUILD_OPGL30)
-	glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &this->texid);
-
-	// Load first image to get dimensions and format
-	Image* firstimage = new Image(faces.at(0), false, true);
-	if (firstimage->data == nullptr) {
-		delete firstimage;
-		throw ScarabError("Image (%s) in skybox was not found", faces.at(0));
-	}
-	glTextureStorage2D(this->texid,
-		1,
-		TextureBase::extract_format(firstimage->channels, true),
-		firstimage->width, firstimage->height
-	);
-
-	delete firstimage;
-#else
-	// Gen texture cube map
-	glGenTextures(1, &this->texid);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, this->texid);
-#endif
-
-	// Order: Right > Left > Top > Bottom > Back > Front
-	for(uint16 i = 0; i < 6; i++) {
-		// OpenGL loads cubemap textures differently
-		// so here makes sense enabling flip vertically (which actually disables)
-		Image* image = new Image(faces.at(i), false, true);
-		if(image->data == nullptr) {
-			delete image;
-			throw ScarabError("Image (%s) in skybox was not found", image->path);
-		}
-
-		const GLenum format = Texture::extract_format((uint32)image->channels, false);
-	#if !defined(BUILD_OPGL30)
-		glTextureSubImage3D(this->texid,
-			0, // mipmap level
-			0, 0, i, // x, y, layer
-			image->width, image->height, 1, // width, height, depth
-			format,
-			GL_UNSIGNED_BYTE,
-			image->data
-		);
-	#else
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-			0,
-			Texture::extract_format((uint32)image->channels, true),
-			image->width, image->height, 0,
-			Texture::extract_format((uint32)image->channels, false),
-			GL_UNSIGNED_BYTE,
-			image->data
-		);
-	#endif
-
-		delete image;
-	}
-
+void Skybox::init_sampler(const bool mipmaps) {
 #if !defined(BUILD_OPGL30)
-	glGenerateTextureMipmap(this->texid);
-
 	glTextureParameteri(this->texid, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTextureParameteri(this->texid, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTextureParameteri(this->texid, GL_TEXTURE_MIN_FILTER, (mipmaps) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
 
 	glTextureParameteri(this->texid, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTextureParameteri(this->texid, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTextureParameteri(this->texid, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE); // Z
 #else
-	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-
+	(void)mipmaps; // Only linear filter on OpenGL 3.0
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
@@ -126,11 +190,6 @@ Skybox::Skybox(const Camera& camera, const std::array<const char*, 6>& faces)
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE); // Z
 #endif
-
-	// Bind to set uniform
-	this->shader->use();
-	this->shader->set_int("samplerSkybox", 0);
-	this->shader->unbind();
 }
 
 void Skybox::draw() noexcept {
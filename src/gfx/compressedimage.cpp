@@ -0,0 +1,359 @@
+#include "scarablib/gfx/compressedimage.hpp"
+#include "scarablib/proper/error.hpp"
+#include "scarablib/utils/file.hpp"
+#include <cctype>
+#include <cstring>
+#include <string_view>
+
+namespace {
+	// DDS
+	constexpr uint32 DDS_MAGIC        = 0x20534444; // "DDS "
+	constexpr uint32 DDS_HEADER_SIZE  = 124;
+	constexpr uint32 DDPF_FOURCC      = 0x4;
+	constexpr uint32 DDSCAPS2_CUBEMAP = 0x200;
+	constexpr uint32 DDS_MISC_CUBEMAP = 0x4;
+
+	constexpr uint32 fourcc(const char a, const char b, const char c, const char d) noexcept {
+		return uint32(uint8(a)) | (uint32(uint8(b)) << 8) | (uint32(uint8(c)) << 16) | (uint32(uint8(d)) << 24);
+	}
+
+	// DXGI_FORMAT values used in the DX10 header
+	enum DXGIFormat : uint32 {
+		DXGI_BC1_UNORM      = 71,
+		DXGI_BC1_UNORM_SRGB = 72,
+		DXGI_BC3_UNORM      = 77,
+		DXGI_BC3_UNORM_SRGB = 78,
+		DXGI_BC4_UNORM      = 80,
+		DXGI_BC5_UNORM      = 83,
+		DXGI_BC7_UNORM      = 98,
+		DXGI_BC7_UNORM_SRGB = 99
+	};
+
+	// KTX2
+	constexpr uint8 KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	constexpr size_t KTX2_HEADER_SIZE = 80;
+
+	// VkFormat values
+	enum VkFormat : uint32 {
+		VK_BC1_RGB_UNORM  = 131,
+		VK_BC1_RGB_SRGB   = 132,
+		VK_BC1_RGBA_UNORM = 133,
+		VK_BC1_RGBA_SRGB  = 134,
+		VK_BC3_UNORM      = 137,
+		VK_BC3_SRGB       = 138,
+		VK_BC4_UNORM      = 139,
+		VK_BC5_UNORM      = 141,
+		VK_BC7_UNORM      = 145,
+		VK_BC7_SRGB       = 146
+	};
+
+	template <typename T>
+	inline T read(const uint8* data) noexcept {
+		T value;
+		std::memcpy(&value, data, sizeof(T));
+		return value;
+	}
+}
+
+
+CompressedImage::CompressedImage(const char* path) {
+	if(path == nullptr) {
+		throw ScarabError("Compressed image has null path");
+	}
+
+	// All surfaces are uploaded right after
+	this->file = ScarabVFS::open(path, ScarabFile::Access::WillNeed);
+	if(!this->file.is_open()) {
+		throw ScarabError("Compressed image (%s) was not found", path);
+	}
+
+	if(this->file.size() >= 4 && read<uint32>(this->file.data()) == DDS_MAGIC) {
+		this->load_dds(path);
+	} else if(this->file.size() >= sizeof(KTX2_IDENTIFIER) && std::memcmp(this->file.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0) {
+		this->load_ktx2(path);
+	} else {
+		throw ScarabError("Compressed image (%s) is not a DDS or KTX2 file", path);
+	}
+}
+
+
+CompressedImage::CompressedImage(const Format format, const uint32 width, const uint32 height,
+		const uint32 levels, const uint32 layers, std::vector<uint8>&& data)
+	: format(format), width(width), height(height), levels(levels), layers(layers), buffer(std::move(data)) {
+
+	size_t offset = 0;
+	this->offsets.reserve(static_cast<size_t>(levels) * layers);
+	for(uint32 layer = 0; layer < layers; layer++) {
+		for(uint32 level = 0; level < levels; level++) {
+			this->offsets.push_back(offset);
+			offset += this->surface_size(level);
+		}
+	}
+
+	if(offset > this->buffer.size()) {
+		throw ScarabError("Compressed data is too small (%zu < %zu bytes)", this->buffer.size(), offset);
+	}
+	this->payload = this->buffer.data();
+}
+
+
+void CompressedImage::load_dds(const char* path) {
+	const uint8* data = this->file.data();
+	const size_t size = this->file.size();
+
+	if(size < 4 + DDS_HEADER_SIZE || read<uint32>(data + 4) != DDS_HEADER_SIZE) {
+		throw ScarabError("DDS (%s) has an invalid header", path);
+	}
+
+	const uint8* header = data + 4;
+	this->height = read<uint32>(header + 8);
+	this->width  = read<uint32>(header + 12);
+	this->levels = std::max<uint32>(read<uint32>(header + 24), 1);
+
+	// Pixel format starts at byte 72
+	const uint32 pfflags = read<uint32>(header + 76);
+	const uint32 code    = read<uint32>(header + 80);
+	const uint32 caps2   = read<uint32>(header + 108);
+
+	if((pfflags & DDPF_FOURCC) == 0) {
+		throw ScarabError("DDS (%s) is not block compressed", path);
+	}
+
+	size_t offset = 4 + DDS_HEADER_SIZE;
+	this->cubemap = (caps2 & DDSCAPS2_CUBEMAP) != 0;
+	this->layers  = 1;
+
+	if(code == fourcc('D', 'X', '1', '0')) {
+		if(size < offset + 20) {
+			throw ScarabError("DDS (%s) has an invalid DX10 header", path);
+		}
+		const uint32 dxgi      = read<uint32>(data + offset);
+		const uint32 miscflag  = read<uint32>(data + offset + 8);
+		const uint32 arraysize = std::max<uint32>(read<uint32>(data + offset + 12), 1);
+		offset += 20;
+
+		switch(dxgi) {
+			case DXGI_BC1_UNORM_SRGB: this->srgb = true; [[fallthrough]];
+			case DXGI_BC1_UNORM:      this->format = Format::BC1; break;
+			case DXGI_BC3_UNORM_SRGB: this->srgb = true; [[fallthrough]];
+			case DXGI_BC3_UNORM:      this->format = Format::BC3; break;
+			case DXGI_BC4_UNORM:      this->format = Format::BC4; break;
+			case DXGI_BC5_UNORM:      this->format = Format::BC5; break;
+			case DXGI_BC7_UNORM_SRGB: this->srgb = true; [[fallthrough]];
+			case DXGI_BC7_UNORM:      this->format = Format::BC7; break;
+			default:
+				throw ScarabError("DDS (%s) uses an unsupported DXGI format (%u)", path, dxgi);
+		}
+
+		this->cubemap = this->cubemap || (miscflag & DDS_MISC_CUBEMAP) != 0;
+		this->layers  = arraysize;
+	} else {
+		switch(code) {
+			case fourcc('D', 'X', 'T', '1'): this->format = Format::BC1; break;
+			case fourcc('D', 'X', 'T', '5'): this->format = Format::BC3; break;
+			case fourcc('A', 'T', 'I', '1'):
+			case fourcc('B', 'C', '4', 'U'): this->format = Format::BC4; break;
+			case fourcc('A', 'T', 'I', '2'):
+			case fourcc('B', 'C', '5', 'U'): this->format = Format::BC5; break;
+			default:
+				throw ScarabError("DDS (%s) uses an unsupported format", path);
+		}
+	}
+
+	if(this->cubemap) {
+		if(this->layers != 1) {
+			throw ScarabError("DDS (%s) cubemap arrays are not supported", path);
+		}
+		this->layers = 6;
+	}
+
+	// All levels of a layer, then the next layer
+	this->payload = data + offset;
+	this->offsets.reserve(static_cast<size_t>(this->levels) * this->layers);
+	size_t position = 0;
+	for(uint32 layer = 0; layer < this->layers; layer++) {
+		for(uint32 level = 0; level < this->levels; level++) {
+			this->offsets.push_back(position);
+			position += this->surface_size(level);
+		}
+	}
+
+	if(offset + position > size) {
+		throw ScarabError("DDS (%s) is truncated", path);
+	}
+}
+
+
+void CompressedImage::load_ktx2(const char* path) {
+	const uint8* data = this->file.data();
+	const size_t size = this->file.size();
+
+	if(size < KTX2_HEADER_SIZE) {
+		throw ScarabError("KTX2 (%s) has an invalid header", path);
+	}
+
+	const uint32 vkformat   = read<uint32>(data + 12);
+	this->width             = read<uint32>(data + 20);
+	this->height            = std::max<uint32>(read<uint32>(data + 24), 1);
+	const uint32 depth      = read<uint32>(data + 28);
+	const uint32 layercount = std::max<uint32>(read<uint32>(data + 32), 1);
+	const uint32 facecount  = read<uint32>(data + 36);
+	// 0 asks to generate mipmaps, only the base level is stored
+	this->levels            = std::max<uint32>(read<uint32>(data + 40), 1);
+	const uint32 supercompression = read<uint32>(data + 44);
+
+	if(supercompression != 0) {
+		throw ScarabError("KTX2 (%s) uses supercompression, which is not supported", path);
+	}
+	if(depth > 1) {
+		throw ScarabError("KTX2 (%s) 3D textures are not supported", path);
+	}
+	if(facecount == 6 && layercount > 1) {
+		throw ScarabError("KTX2 (%s) cubemap arrays are not supported", path);
+	}
+
+	switch(vkformat) {
+		case VK_BC1_RGB_SRGB:
+		case VK_BC1_RGBA_SRGB:  this->srgb = true; [[fallthrough]];
+		case VK_BC1_RGB_UNORM:
+		case VK_BC1_RGBA_UNORM: this->format = Format::BC1; break;
+		case VK_BC3_SRGB:       this->srgb = true; [[fallthrough]];
+		case VK_BC3_UNORM:      this->format = Format::BC3; break;
+		case VK_BC4_UNORM:      this->format = Format::BC4; break;
+		case VK_BC5_UNORM:      this->format = Format::BC5; break;
+		case VK_BC7_SRGB:       this->srgb = true; [[fallthrough]];
+		case VK_BC7_UNORM:      this->format = Format::BC7; break;
+		default:
+			throw ScarabError("KTX2 (%s) uses an unsupported VkFormat (%u)", path, vkformat);
+	}
+
+	this->cubemap = (facecount == 6);
+	this->layers  = (this->cubemap) ? 6 : layercount;
+
+	// Level index follows the header, 24 bytes per level
+	if(size < KTX2_HEADER_SIZE + static_cast<size_t>(this->levels) * 24) {
+		throw ScarabError("KTX2 (%s) is truncated", path);
+	}
+
+	// Each level has all its layers (and faces) together, so offsets are per level
+	this->payload = data;
+	this->offsets.resize(static_cast<size_t>(this->levels) * this->layers);
+	for(uint32 level = 0; level < this->levels; level++) {
+		const uint8* entry   = data + KTX2_HEADER_SIZE + static_cast<size_t>(level) * 24;
+		const uint64 start   = read<uint64>(entry);
+		const uint64 length  = read<uint64>(entry + 8);
+		const size_t surface = this->surface_size(level);
+
+		if(length < surface * this->layers || start + length > size) {
+			throw ScarabError("KTX2 (%s) level %u is truncated", path, level);
+		}
+		for(uint32 layer = 0; layer < this->layers; layer++) {
+			this->offsets[layer * this->levels + level] = static_cast<size_t>(start) + surface * layer;
+		}
+	}
+}
+
+
+uint32 CompressedImage::gl_format() const noexcept {
+	switch(this->format) {
+		case Format::BC1:
+			return (this->srgb) ? SCARAB_GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1 : SCARAB_GL_COMPRESSED_RGBA_S3TC_DXT1;
+		case Format::BC3:
+			return (this->srgb) ? SCARAB_GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5 : SCARAB_GL_COMPRESSED_RGBA_S3TC_DXT5;
+		case Format::BC4:
+			return GL_COMPRESSED_RED_RGTC1;
+		case Format::BC5:
+			return GL_COMPRESSED_RG_RGTC2;
+		case Format::BC7:
+			return (this->srgb) ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+	return 0;
+}
+
+
+bool CompressedImage::is_compressed_file(const char* path) noexcept {
+	if(path == nullptr) {
+		return false;
+	}
+
+	const std::string_view view = path;
+	const auto ends_with = [&view](const std::string_view extension) {
+		if(view.size() < extension.size()) {
+			return false;
+		}
+		// Case insensitive
+		for(size_t i = 0; i < extension.size(); i++) {
+			const char c = view[view.size() - extension.size() + i];
+			if(std::tolower(static_cast<unsigned char>(c)) != extension[i]) {
+				return false;
+			}
+		}
+		return true;
+	};
+	return ends_with(".dds") || ends_with(".ktx2");
+}
+
+
+bool CompressedImage::save_dds(const std::filesystem::path& path) const noexcept {
+	if(this->payload == nullptr) {
+		return false;
+	}
+
+	uint32 dxgi = 0;
+	switch(this->format) {
+		case Format::BC1: dxgi = (this->srgb) ? DXGI_BC1_UNORM_SRGB : DXGI_BC1_UNORM; break;
+		case Format::BC3: dxgi = (this->srgb) ? DXGI_BC3_UNORM_SRGB : DXGI_BC3_UNORM; break;
+		case Format::BC4: dxgi = DXGI_BC4_UNORM; break;
+		case Format::BC5: dxgi = DXGI_BC5_UNORM; break;
+		case Format::BC7: dxgi = (this->srgb) ? DXGI_BC7_UNORM_SRGB : DXGI_BC7_UNORM; break;
+	}
+
+	// Magic, header and DX10 header
+	uint8 header[4 + DDS_HEADER_SIZE + 20] = {};
+	const auto write32 = [&header](const size_t offset, const uint32 value) {
+		std::memcpy(header + offset, &value, sizeof(uint32));
+	};
+
+	constexpr uint32 DDSD_REQUIRED   = 0x1 | 0x2 | 0x4 | 0x1000 | 0x80000; // Caps, height, width, pixel format, linear size
+	constexpr uint32 DDSD_MIPMAPS    = 0x20000;
+	constexpr uint32 DDSCAPS_COMPLEX = 0x8;
+	constexpr uint32 DDSCAPS_TEXTURE = 0x1000;
+	constexpr uint32 DDSCAPS_MIPMAP  = 0x400000;
+	constexpr uint32 DDSCAPS2_FACES  = 0xFC00;
+
+	write32(0, DDS_MAGIC);
+	write32(4, DDS_HEADER_SIZE);
+	write32(8, DDSD_REQUIRED | ((this->levels > 1) ? DDSD_MIPMAPS : 0));
+	write32(12, this->height);
+	write32(16, this->width);
+	write32(20, static_cast<uint32>(this->surface_size(0)));
+	write32(28, this->levels);
+	// Pixel format
+	write32(76, 32);
+	write32(80, DDPF_FOURCC);
+	write32(84, fourcc('D', 'X', '1', '0'));
+	write32(108, DDSCAPS_TEXTURE
+		| ((this->levels > 1) ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0)
+		| ((this->cubemap) ? DDSCAPS_COMPLEX : 0));
+	write32(112, (this->cubemap) ? DDSCAPS2_CUBEMAP | DDSCAPS2_FACES : 0);
+	// DX10 header
+	write32(128, dxgi);
+	write32(132, 3); // Texture 2D
+	write32(136, (this->cubemap) ? DDS_MISC_CUBEMAP : 0);
+	write32(140, (this->cubemap) ? 1 : this->layers);
+
+	try {
+		return ScarabFile::write_atomic(path, [&](std::ostream& file) {
+			file.write(reinterpret_cast<const char*>(header), sizeof(header));
+			for(uint32 layer = 0; layer < this->layers; layer++) {
+				for(uint32 level = 0; level < this->levels; level++) {
+					file.write(reinterpret_cast<const char*>(this->surface(level, layer)),
+						static_cast<std::streamsize>(this->surface_size(level)));
+				}
+			}
+		});
+
+	} catch(...) {
+		return false;
+	}
+}
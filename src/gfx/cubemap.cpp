@@ -0,0 +1,401 @@
+#include "scarablib/gfx/cubemap.hpp"
+#include "scarablib/proper/error.hpp"
+#include "scarablib/proper/log.hpp"
+#include "scarablib/utils/file.hpp"
+#include "scarablib/utils/image.hpp"
+#include "scarablib/utils/thread.hpp"
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include <string>
+
+// #define SCARAB_DEBUG_CUBEMAP
+
+namespace {
+	// Cache file: header of 8 uint32, then all levels of each face, face by face
+	constexpr uint32 CUBE_MAGIC       = 0x42554353; // "SCUB"
+	constexpr uint32 CUBE_VERSION     = 1;
+	constexpr size_t CUBE_HEADER_SIZE = 32;
+	constexpr uint32 CUBE_FLAG_SRGB   = 0x1;
+
+	// Rows per job
+	constexpr size_t MIN_ROWS = 8;
+
+	template <typename T>
+	inline T read(const uint8* data) noexcept {
+		T value;
+		std::memcpy(&value, data, sizeof(T));
+		return value;
+	}
+
+	struct Direction {
+		float x, y, z;
+	};
+
+	// Direction of a point of a face, the same way OpenGL samples cubemaps.
+	// - `s`, `t`: In [-1, 1]. `t` goes down the rows
+	inline Direction face_direction(const uint32 face, const float s, const float t) noexcept {
+		switch(face) {
+			case 0:  return { 1.0f, -t, -s };   // Right  (+X)
+			case 1:  return { -1.0f, -t, s };   // Left   (-X)
+			case 2:  return { s, 1.0f, t };     // Top    (+Y)
+			case 3:  return { s, -1.0f, -t };   // Bottom (-Y)
+			case 4:  return { s, -t, 1.0f };    // Back   (+Z)
+			default: return { -s, -t, -1.0f };  // Front  (-Z)
+		}
+	}
+
+	// RGBA image sampled by the converter
+	struct Source {
+		const uint8* pixels;
+		uint32 width;
+		uint32 height;
+	};
+
+	// Adds a bilinear sample of a rectangle of the source to `out`.
+	// - `u`, `v`: In [0, 1] inside the rectangle
+	// - `wrap`: Wraps horizontally (equirectangular), otherwise clamps to the rectangle (cross cells)
+	inline void add_bilinear(const Source& src, const uint32 rx, const uint32 ry, const uint32 rw, const uint32 rh,
+			const float u, const float v, const bool wrap, float out[4]) noexcept {
+
+		const float px = u * static_cast<float>(rw) - 0.5f;
+		const float py = v * static_cast<float>(rh) - 0.5f;
+		const float fx = std::floor(px);
+		const float fy = std::floor(py);
+		const float tx = px - fx;
+		const float ty = py - fy;
+
+		int32 x0 = static_cast<int32>(fx);
+		int32 x1 = x0 + 1;
+		if(wrap) {
+			x0 = ((x0 % (int32)rw) + (int32)rw) % (int32)rw;
+			x1 = ((x1 % (int32)rw) + (int32)rw) % (int32)rw;
+		} else {
+			x0 = std::clamp<int32>(x0, 0, (int32)rw - 1);
+			x1 = std::clamp<int32>(x1, 0, (int32)rw - 1);
+		}
+		const int32 y0 = std::clamp<int32>(static_cast<int32>(fy), 0, (int32)rh - 1);
+		const int32 y1 = std::clamp<int32>(static_cast<int32>(fy) + 1, 0, (int32)rh - 1);
+
+		const auto texel = [&](const int32 x, const int32 y) {
+			return src.pixels + ((static_cast<size_t>(ry) + y) * src.width + rx + x) * 4;
+		};
+		const uint8* p00 = texel(x0, y0);
+		const uint8* p10 = texel(x1, y0);
+		const uint8* p01 = texel(x0, y1);
+		const uint8* p11 = texel(x1, y1);
+
+		const float w00 = (1.0f - tx) * (1.0f - ty);
+		const float w10 = tx * (1.0f - ty);
+		const float w01 = (1.0f - tx) * ty;
+		const float w11 = tx * ty;
+		for(uint32 c = 0; c < 4; c++) {
+			out[c] += p00[c] * w00 + p10[c] * w10 + p01[c] * w01 + p11[c] * w11;
+		}
+	}
+
+	void sample_equirectangular(const Source& src, const Direction dir, float out[4]) noexcept {
+		const float length = std::sqrt(dir.x * dir.x + dir.y * dir.y + dir.z * dir.z);
+		// Center of the image is the front (-Z), right of it is +X
+		const float u = 0.5f + std::atan2(dir.x, -dir.z) / (2.0f * std::numbers::pi_v<float>);
+		const float v = std::acos(std::clamp(dir.y / length, -1.0f, 1.0f)) / std::numbers::pi_v<float>;
+		add_bilinear(src, 0, 0, src.width, src.height, u, v, true, out);
+	}
+
+	// Cells are unfolded as seen from inside the cube, looking at the front with +X on the right
+	void sample_cross(const Source& src, const Direction dir, const bool vertical, float out[4]) noexcept {
+		const float ax = std::abs(dir.x);
+		const float ay = std::abs(dir.y);
+		const float az = std::abs(dir.z);
+
+		// Position inside the cell in [-1, 1], `b` goes down
+		float a, b;
+		uint32 col, row;
+		if(ax >= ay && ax >= az) {
+			if(dir.x > 0.0f) { // Right
+				a = dir.z / ax;  b = -dir.y / ax; col = 2; row = 1;
+			} else {           // Left
+				a = -dir.z / ax; b = -dir.y / ax; col = 0; row = 1;
+			}
+		} else if(ay >= az) {
+			if(dir.y > 0.0f) { // Top, its bottom edge touches the front
+				a = dir.x / ay;  b = -dir.z / ay; col = 1; row = 0;
+			} else {           // Bottom, its top edge touches the front
+				a = dir.x / ay;  b = dir.z / ay;  col = 1; row = 2;
+			}
+		} else {
+			if(dir.z < 0.0f) { // Front
+				a = dir.x / az;  b = -dir.y / az; col = 1; row = 1;
+			} else if(vertical) { // Back, its top edge touches the bottom
+				a = dir.x / az;  b = dir.y / az;  col = 1; row = 3;
+			} else {           // Back
+				a = -dir.x / az; b = -dir.y / az; col = 3; row = 1;
+			}
+		}
+
+		const uint32 cell = (vertical) ? src.width / 3 : src.width / 4;
+		add_bilinear(src, col * cell, row * cell, cell, cell, (a + 1.0f) * 0.5f, (b + 1.0f) * 0.5f, false, out);
+	}
+
+	const char* layout_name(const Cubemap::Layout layout) noexcept {
+		switch(layout) {
+			case Cubemap::Layout::Equirectangular: return "equirect";
+			case Cubemap::Layout::HorizontalCross: return "hcross";
+			case Cubemap::Layout::VerticalCross:   return "vcross";
+			default:                               return "auto";
+		}
+	}
+}
+
+
+Cubemap::Cubemap(const std::array<const char*, 6>& paths) {
+	// Faces are decoded and their mipmaps generated on worker threads
+	ScarabThread::parallel_for(6, [&](const size_t begin, const size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			// OpenGL loads cubemap textures differently
+			// so here makes sense enabling flip vertically (which actually disables)
+			const Image image = Image(paths.at(i), false, true);
+			if(image.data == nullptr) {
+				throw ScarabError("Image (%s) in skybox was not found", paths.at(i));
+			}
+			this->faces[i] = MipChain(image);
+		}
+	});
+
+	this->init_from_faces();
+}
+
+Cubemap::Cubemap(const Image& image, const Layout layout, const uint32 face_size) {
+	if(image.data == nullptr || image.width <= 0 || image.height <= 0) {
+		throw ScarabError("Cubemap image has no data");
+	}
+
+	const uint32 width  = static_cast<uint32>(image.width);
+	const uint32 height = static_cast<uint32>(image.height);
+	const Layout used   = (layout == Layout::Auto) ? Cubemap::detect_layout(width, height) : layout;
+	if(used == Layout::Auto) {
+		throw ScarabError("Cubemap image (%ux%u) is not equirectangular (2:1) or a cross (4:3 or 3:4)", width, height);
+	}
+
+	// Sampled as RGBA
+	std::vector<uint8> rgba;
+	const uint8* pixels = image.data;
+	if(image.channels != 4) {
+		rgba.resize(static_cast<size_t>(width) * height * 4);
+		ScarabImage::to_rgba(image.data, static_cast<uint32>(image.channels), rgba.data(), static_cast<size_t>(width) * height);
+		pixels = rgba.data();
+	}
+	const Source src = { pixels, width, height };
+
+	const uint32 native = (used == Layout::VerticalCross) ? width / 3 : width / 4;
+	const uint32 size   = (face_size != 0) ? face_size : std::max<uint32>(native, 1);
+
+#if defined(SCARAB_DEBUG_CUBEMAP)
+	LOG_DEBUG("Converting %ux%u %s image to %u cubemap faces", width, height, layout_name(used), size);
+#endif
+
+	// All rows of all faces are split between the workers
+	std::array<std::vector<uint8>, 6> pixelsout;
+	for(std::vector<uint8>& face : pixelsout) {
+		face.resize(static_cast<size_t>(size) * size * 4);
+	}
+	const float inv = 1.0f / static_cast<float>(size);
+	ScarabThread::parallel_for(static_cast<size_t>(size) * 6, [&](const size_t begin, const size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			const uint32 face = static_cast<uint32>(i / size);
+			const uint32 y    = static_cast<uint32>(i % size);
+			uint8* out = pixelsout[face].data() + static_cast<size_t>(y) * size * 4;
+
+			for(uint32 x = 0; x < size; x++) {
+				// 2x2 samples per texel
+				float color[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+				for(uint32 sub = 0; sub < 4; sub++) {
+					const float s = (static_cast<float>(x) + 0.25f + 0.5f * (sub & 1)) * inv * 2.0f - 1.0f;
+					const float t = (static_cast<float>(y) + 0.25f + 0.5f * (sub >> 1)) * inv * 2.0f - 1.0f;
+					const Direction dir = face_direction(face, s, t);
+					if(used == Layout::Equirectangular) {
+						sample_equirectangular(src, dir, color);
+					} else {
+						sample_cross(src, dir, used == Layout::VerticalCross, color);
+					}
+				}
+				for(uint32 c = 0; c < 4; c++) {
+					out[x * 4 + c] = static_cast<uint8>(std::min(color[c] * 0.25f + 0.5f, 255.0f));
+				}
+			}
+		}
+	}, MIN_ROWS);
+
+	for(uint32 face = 0; face < 6; face++) {
+		Image faceimage = Image(pixelsout[face].data(), size, size, 4);
+		faceimage.owns_data = false; // Owned by `pixelsout`
+		this->faces[face] = MipChain(faceimage);
+	}
+
+	this->init_from_faces();
+}
+
+Cubemap::Cubemap(const char* path) {
+	if(path == nullptr) {
+		throw ScarabError("Cubemap has null path");
+	}
+
+	// All faces are uploaded right after
+	this->file = ScarabVFS::open(path, ScarabFile::Access::WillNeed);
+	if(!this->file.is_open()) {
+		throw ScarabError("Cubemap (%s) was not found", path);
+	}
+
+	const uint8* data = this->file.data();
+	if(this->file.size() < CUBE_HEADER_SIZE || read<uint32>(data) != CUBE_MAGIC) {
+		throw ScarabError("Cubemap (%s) is not a valid file", path);
+	}
+	if(read<uint32>(data + 4) != CUBE_VERSION) {
+		throw ScarabError("Cubemap (%s) has unsupported version %u", path, read<uint32>(data + 4));
+	}
+
+	this->size = read<uint32>(data + 8);
+	const uint32 channels = read<uint32>(data + 12);
+	this->levels = read<uint32>(data + 16);
+	this->srgb   = (read<uint32>(data + 20) & CUBE_FLAG_SRGB) != 0;
+
+	if(this->size == 0 || (channels != 1 && channels != 4)
+		|| this->levels == 0 || this->levels > MipChain::count_levels(this->size, this->size)) {
+		throw ScarabError("Cubemap (%s) has an invalid header", path);
+	}
+	this->channels = static_cast<uint8>(channels);
+	this->compute_offsets();
+
+	if(this->file.size() - CUBE_HEADER_SIZE != this->total_size()) {
+		throw ScarabError("Cubemap (%s) has %zu bytes of data, expected %zu", path, this->file.size() - CUBE_HEADER_SIZE, this->total_size());
+	}
+	this->payload = data + CUBE_HEADER_SIZE;
+}
+
+
+bool Cubemap::save(const std::filesystem::path& path) const noexcept {
+	if(this->empty()) {
+		return false;
+	}
+
+	uint8 header[CUBE_HEADER_SIZE] = {};
+	const auto write32 = [&header](const size_t offset, const uint32 value) {
+		std::memcpy(header + offset, &value, sizeof(uint32));
+	};
+	write32(0, CUBE_MAGIC);
+	write32(4, CUBE_VERSION);
+	write32(8, this->size);
+	write32(12, this->channels);
+	write32(16, this->levels);
+	write32(20, (this->srgb) ? CUBE_FLAG_SRGB : 0);
+
+	try {
+		return ScarabFile::write_atomic(path, [&](std::ostream& file) {
+			file.write(reinterpret_cast<const char*>(header), sizeof(header));
+			// Levels of a face are contiguous
+			for(uint32 face = 0; face < 6; face++) {
+				file.write(reinterpret_cast<const char*>(this->level(face, 0)), static_cast<std::streamsize>(this->face_stride));
+			}
+		});
+
+	} catch(...) {
+		return false;
+	}
+}
+
+
+Cubemap Cubemap::load_cached(const char* path, const Layout layout, const uint32 face_size) {
+	if(path == nullptr) {
+		throw ScarabError("Skybox has null path");
+	}
+
+	const std::filesystem::path source = path;
+	std::string cachename = source.string() + "." + layout_name(layout);
+	if(face_size != 0) {
+		cachename += std::to_string(face_size);
+	}
+	const std::filesystem::path cachepath = cachename + ".cube";
+
+	// Archives have no modification time, a cache packed with the image is always up to date
+	const bool archived = ScarabVFS::in_archive(source);
+	bool uptodate = false;
+	if(archived) {
+		uptodate = ScarabVFS::in_archive(cachepath);
+	} else {
+		std::error_code error;
+		const auto source_time = std::filesystem::last_write_time(source, error);
+		if(error) {
+			throw ScarabError("Image (%s) was not found", path);
+		}
+		const auto cache_time = std::filesystem::last_write_time(cachepath, error);
+		uptodate = !error && cache_time >= source_time;
+	}
+
+	if(uptodate) {
+		try {
+			Cubemap cached = Cubemap(cachepath.string().c_str());
+			if((face_size == 0 || cached.size == face_size) && cached.levels == MipChain::count_levels(cached.size, cached.size)) {
+				return cached;
+			}
+		} catch(const std::exception& err) {
+			LOG_WARNING("Ignoring invalid cubemap cache: %s", err.what());
+		}
+	}
+
+	// Same orientation as the 6 faces constructor
+	const Image image = Image(path, false, true);
+	if(image.data == nullptr) {
+		throw ScarabError("Image (%s) was not found", path);
+	}
+
+	Cubemap result = Cubemap(image, layout, face_size);
+	if(!archived && !result.save(cachepath)) {
+		LOG_WARNING("Could not write cubemap cache (%s)", cachepath.string().c_str());
+	}
+	return result;
+}
+
+Cubemap::Layout Cubemap::detect_layout(const uint32 width, const uint32 height) noexcept {
+	if(width == 0 || height == 0) {
+		return Layout::Auto;
+	}
+	if(width == height * 2) {
+		return Layout::Equirectangular;
+	}
+	if(width % 4 == 0 && width / 4 * 3 == height) {
+		return Layout::HorizontalCross;
+	}
+	if(width % 3 == 0 && width / 3 * 4 == height) {
+		return Layout::VerticalCross;
+	}
+	return Layout::Auto;
+}
+
+
+void Cubemap::compute_offsets() noexcept {
+	this->offsets.resize(this->levels);
+	size_t offset = 0;
+	for(uint32 level = 0; level < this->levels; level++) {
+		this->offsets[level] = offset;
+		offset += this->level_size(level);
+	}
+	this->face_stride = offset;
+}
+
+void Cubemap::init_from_faces() {
+	const MipChain& first = this->faces[0];
+	for(const MipChain& face : this->faces) {
+		if(face.width != first.width || face.height != first.height || face.channels != first.channels) {
+			throw ScarabError("Skybox faces must have the same dimensions and channels");
+		}
+	}
+	if(first.width != first.height) {
+		throw ScarabError("Skybox faces must be square");
+	}
+
+	this->size     = first.width;
+	this->channels = first.channels;
+	this->levels   = first.levels;
+	this->srgb     = first.srgb;
+	this->compute_offsets();
+}
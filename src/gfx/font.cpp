@@ -1,88 +1,254 @@
 #include "scarablib/gfx/font.hpp"
-#include "scarablib/opengl/assets.hpp"
-#include "scarablib/opengl/resourcesmanager.hpp"
-#include "scarablib/opengl/shader_program.hpp"
+#include "scarablib/gfx/text.hpp"
 #include "scarablib/proper/error.hpp"
+#include "scarablib/proper/log.hpp"
 #include "scarablib/camera/camera2d.hpp"
 #include "scarablib/utils/file.hpp"
 #include "scarablib/utils/hash.hpp"
+#include "scarablib/utils/string.hpp"
+#include "scarablib/utils/thread.hpp"
+#include "scarablib/utils/vfs.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
 
 #define STB_TRUETYPE_IMPLEMENTATION
 #include <stb/stb_truetype.h>
 
 struct STBTruetype {
-	std::vector<stbtt_bakedchar> cdata;
-	STBTruetype() noexcept : cdata(96) {} // ASCII 32-127
+	// Kept open, glyphs are made from it while the font is used
+	ScarabVFS::File file;
+	stbtt_fontinfo info;
+	// Font units to pixels
+	float scale;
 };
 
-Font::Font(const Camera2D& camera, const char* path, const uint16 size)
-	: camera(camera), data(new STBTruetype()) {
-	const char* source = R"glsl(
-		void mainImage(out vec4 fragcolor, in vec2 texuv) {
-			// Sample red channel (glyph alpha)
-			vec4 tex = vec4(texture(texSampler, texuv).r);
-			fragcolor = vec4(tex * shapeColor);
+// SDF glyph cache (.sfont) layout:
+// [SFontHeader]
+// [Glyphs]  glyph_count * SFontGlyph
+// [Pixels]  All glyphs, width * height each, one channel
+
+namespace {
+	// Printable ASCII, made when the font is loaded
+	constexpr uint32 ASCII_FIRST = 32;
+	constexpr uint32 ASCII_COUNT = 95;
+	// Distance value of the glyph edge
+	constexpr uint8 SDF_ONEDGE = 128;
+
+	constexpr char SFONT_MAGIC[4]  = { 'S', 'F', 'N', 'T' };
+	constexpr uint32 SFONT_VERSION = 2; // 2: Glyphs instead of a packed atlas
+
+	struct SFontHeader {
+		char magic[4];
+		uint32 version;
+		// Hash of the font file and the SDF parameters
+		uint64 source_hash;
+		uint32 glyph_count;
+		uint32 reserved;
+		uint64 pixels_size;
+	};
+
+	struct SFontGlyph {
+		uint32 codepoint;
+		float advance;
+		uint16 width;
+		uint16 height;
+		int16 xoff;
+		int16 yoff;
+	};
+
+	// Glyph made from a font, before going into the cache
+	struct Raster {
+		SFontGlyph glyph;
+		std::vector<uint8> pixels;
+	};
+
+	Raster rasterize(const STBTruetype& font, const uint32 codepoint, const bool sdf, const int padding) {
+		Raster raster = {};
+		raster.glyph.codepoint = codepoint;
+
+		const int index = stbtt_FindGlyphIndex(&font.info, static_cast<int>(codepoint));
+		int advance, lsb;
+		stbtt_GetGlyphHMetrics(&font.info, index, &advance, &lsb);
+		raster.glyph.advance = static_cast<float>(advance) * font.scale;
+
+		int width = 0, height = 0, xoff = 0, yoff = 0;
+		// Null for empty glyphs (e.g., space)
+		uint8* pixels = (sdf)
+			? stbtt_GetGlyphSDF(&font.info, font.scale, index, padding, SDF_ONEDGE,
+				static_cast<float>(SDF_ONEDGE) / static_cast<float>(padding), &width, &height, &xoff, &yoff)
+			: stbtt_GetGlyphBitmap(&font.info, font.scale, font.scale, index, &width, &height, &xoff, &yoff);
+		if(pixels == nullptr) {
+			return raster;
 		}
-	)glsl";
-
-	this->material->shader = ResourcesManager::get_instance().load_shader_program({
-		ResourcesManager::ShaderInfo {
-			.source = Shaders::DEFAULT_VERTEX,
-			.type   = Shader::Type::Vertex
-		},
-		ResourcesManager::ShaderInfo {
-			.source   = source,
-			.type     = Shader::Type::Fragment,
-			.iscustom = true
-		},
-	});
+
+		raster.glyph.width  = static_cast<uint16>(width);
+		raster.glyph.height = static_cast<uint16>(height);
+		raster.glyph.xoff   = static_cast<int16>(xoff);
+		raster.glyph.yoff   = static_cast<int16>(yoff);
+		raster.pixels.assign(pixels, pixels + static_cast<size_t>(width) * height);
+		if(sdf) {
+			stbtt_FreeSDF(pixels, nullptr);
+		} else {
+			stbtt_FreeBitmap(pixels, nullptr);
+		}
+		return raster;
+	}
+
+	uint64 sdf_hash(const ScarabVFS::File& font, const uint16 size, const int padding) noexcept {
+		ScarabHash::Hasher hasher;
+		hasher.update(font.data(), font.size());
+		hasher.update(static_cast<uint64>(font.size()));
+		hasher.update(size);
+		hasher.update(padding);
+		hasher.update(SDF_ONEDGE);
+		return hasher.digest();
+	}
+
+	bool read_sfont(const std::filesystem::path& path, const uint64 hash, std::vector<Raster>& out) {
+		if(!ScarabVFS::exists(path)) {
+			return false;
+		}
+
+		const ScarabVFS::File file = ScarabVFS::open(path, ScarabFile::Access::WillNeed);
+		if(!file.is_open() || file.size() < sizeof(SFontHeader)) {
+			return false;
+		}
+
+		SFontHeader header;
+		std::memcpy(&header, file.data(), sizeof(SFontHeader));
+		const size_t glyphs_size = static_cast<size_t>(header.glyph_count) * sizeof(SFontGlyph);
+		if(std::memcmp(header.magic, SFONT_MAGIC, sizeof(SFONT_MAGIC)) != 0
+			|| header.version != SFONT_VERSION
+			|| header.glyph_count > UINT16_MAX
+			|| file.size() != sizeof(SFontHeader) + glyphs_size + header.pixels_size) {
+			LOG_WARNING("Invalid font cache '%s', it will be remade", path.c_str());
+			return false;
+		}
+
+		// Outdated
+		if(header.source_hash != hash) {
+			return false;
+		}
+
+		std::vector<Raster> rasters(header.glyph_count);
+		const uint8* pixels = file.data() + sizeof(SFontHeader) + glyphs_size;
+		size_t offset = 0;
+		for(uint32 i = 0; i < header.glyph_count; i++) {
+			Raster& raster = rasters[i];
+			std::memcpy(&raster.glyph, file.data() + sizeof(SFontHeader) + i * sizeof(SFontGlyph), sizeof(SFontGlyph));
+
+			const size_t size = static_cast<size_t>(raster.glyph.width) * raster.glyph.height;
+			if(offset + size > header.pixels_size) {
+				LOG_WARNING("Invalid font cache '%s', it will be remade", path.c_str());
+				return false;
+			}
+			raster.pixels.assign(pixels + offset, pixels + offset + size);
+			offset += size;
+		}
+
+		out = std::move(rasters);
+		return true;
+	}
+
+	bool save_sfont(const std::filesystem::path& path, const uint64 hash, const std::vector<Raster>& rasters) noexcept {
+		try {
+			SFontHeader header{};
+			std::memcpy(header.magic, SFONT_MAGIC, sizeof(SFONT_MAGIC));
+			header.version     = SFONT_VERSION;
+			header.source_hash = hash;
+			header.glyph_count = static_cast<uint32>(rasters.size());
+			for(const Raster& raster : rasters) {
+				header.pixels_size += raster.pixels.size();
+			}
+
+			return ScarabFile::write_atomic(path, [&](std::ostream& file) {
+				file.write(reinterpret_cast<const char*>(&header), sizeof(SFontHeader));
+				for(const Raster& raster : rasters) {
+					file.write(reinterpret_cast<const char*>(&raster.glyph), sizeof(SFontGlyph));
+				}
+				for(const Raster& raster : rasters) {
+					file.write(reinterpret_cast<const char*>(raster.pixels.data()), static_cast<std::streamsize>(raster.pixels.size()));
+				}
+			});
+
+		} catch(...) {
+			return false;
+		}
+	}
+
+	// Makes the glyphs of a range of codepoints on the worker threads
+	std::vector<Raster> rasterize_range(const STBTruetype& font, const uint32 first, const uint32 count, const bool sdf, const int padding) {
+		std::vector<Raster> rasters(count);
+		// Font info is only read, each glyph is independent
+		ScarabThread::parallel_for(count, [&](const size_t begin, const size_t end) {
+			for(size_t i = begin; i < end; i++) {
+				rasters[i] = rasterize(font, first + static_cast<uint32>(i), sdf, padding);
+			}
+		}, 8);
+		return rasters;
+	}
+}
+
+
+Font::Font(const Camera2D& camera, const char* path, const uint16 size, const Font::Type type, const uint16 max_pages)
+	: camera(camera), data(new STBTruetype()), size(static_cast<float>(size)), type(type) {
 
 	// Load font file
-	std::vector<uint8> buffer = ScarabFile::read_binary_file(path);
-	if(buffer.empty()) {
+	this->data->file = ScarabVFS::open(path, ScarabFile::Access::WillNeed);
+	const ScarabVFS::File& buffer = this->data->file;
+	if(!buffer.is_open()
+		|| !stbtt_InitFont(&this->data->info, buffer.data(), stbtt_GetFontOffsetForIndex(buffer.data(), 0))) {
+		delete this->data;
 		throw ScarabError("Font file (%s) is invalid", path);
 	}
+	this->data->scale = stbtt_ScaleForPixelHeight(&this->data->info, this->size);
+
+	// About 200 glyphs in each page
+	const uint32 page_size = std::clamp<uint32>(std::bit_ceil(static_cast<uint32>(size) * 16u), 256, 2048);
+	try {
+		this->glyphs = std::make_unique<GlyphCache>(static_cast<uint16>(page_size), max_pages);
+	} catch(...) {
+		delete this->data;
+		throw;
+	}
 
-	// Bake bitmap
-	std::vector<uint8> temp_bitmap =
-		std::vector<uint8>(this->ATLAS_WIDTH * this->ATLAS_HEIGHT);
+	// ASCII is made now, on the worker threads
+	std::vector<Raster> ascii;
+	if(type == Font::Type::SDF) {
+		const std::filesystem::path cachepath = std::string(path) + "." + std::to_string(size) + ".sfont";
+		const uint64 hash = sdf_hash(buffer, size, this->SDF_PADDING);
 
-	int result = stbtt_BakeFontBitmap(
-		buffer.data(), 0, (float)size,
-		temp_bitmap.data(), this->ATLAS_WIDTH, this->ATLAS_HEIGHT,
-		32, 96, // ASCII 32 to 127, 96 printable ASCII
-		this->data->cdata.data()
-	);
+		if(!read_sfont(cachepath, hash, ascii)) {
+			ascii = rasterize_range(*this->data, ASCII_FIRST, ASCII_COUNT, true, this->SDF_PADDING);
 
-	if(result <= 0) {
-		throw ScarabError("Failed to bake font (%s). Atlas too small?", path);
+			// Fonts inside archives can't have their cache written next to them
+			if(ScarabFile::file_exists(path) && !save_sfont(cachepath, hash, ascii)) {
+				LOG_WARNING("Failed to write font cache '%s'", cachepath.c_str());
+			}
+		}
+	} else {
+		ascii = rasterize_range(*this->data, ASCII_FIRST, ASCII_COUNT, false, 0);
+	}
+
+	// Tallest first, shelves waste less space. Never evicted
+	std::sort(ascii.begin(), ascii.end(), [](const Raster& a, const Raster& b) {
+		return a.glyph.height > b.glyph.height;
+	});
+	for(const Raster& raster : ascii) {
+		const SFontGlyph& glyph = raster.glyph;
+		this->glyphs->insert(glyph.codepoint, raster.pixels.data(), glyph.width, glyph.height,
+			glyph.xoff, glyph.yoff, glyph.advance, true);
 	}
 
-	// Texture from bitmap
-	// 1-byte alignment for grayscale
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	Image tmpimg = Image(temp_bitmap.data(), this->ATLAS_WIDTH, this->ATLAS_HEIGHT, 1);
-	tmpimg.owns_data = false; // Disables free
-	// This avoids double free (inside Image and end of this method)
-	this->material->texture = Assets::load(tmpimg);
-
-	// Buffer setup
-	this->buffer_capacity = 128; // Start with a decent size
-	this->buffer_data = new Vertex2D[this->buffer_capacity * 6];
-
-	this->vertexarray = ResourcesManager::get_instance()
-		.acquire_vertexarray(nullptr, 6 * this->buffer_capacity,
-			sizeof(Vertex2D), ScarabHash::hash_make(std::string(path)), true);
-
-	// Set position and texuv attributes
-	this->vertexarray->add_attribute<float>(2, false); // Position
-	this->vertexarray->add_attribute<float>(2, false); // UV
+	this->batch = std::make_unique<TextBatch>(camera, 256);
 }
 
 
 Font::~Font() noexcept {
 	delete this->data;
-	delete[] this->buffer_data;
 }
 
 void Font::draw_text(const std::string& text, const vec2<float>& pos, const float scale, const Color& color) noexcept {
@@ -90,77 +256,81 @@ void Font::draw_text(const std::string& text, const vec2<float>& pos, const floa
 		return;
 	}
 
-	std::shared_ptr<VertexArray>& vertexarray = this->vertexarray; // Cache
+	this->batch->add(*this, text, pos, scale, color);
+	this->batch->draw();
+}
 
-	// Grow buffer if needed
-	if(text.length() > this->buffer_capacity) {
-		this->buffer_capacity = text.length() + 64;
-		delete[] this->buffer_data;
-		this->buffer_data = new Vertex2D[this->buffer_capacity * 6];
+void Font::layout(std::string_view text, const Color& color, std::vector<TextVertex>& out, vec2<float>& min, vec2<float>& max) {
+	float curx = 0.0f;
+	float cury = 0.0f;
+	min = vec2<float>(std::numeric_limits<float>::max());
+	max = vec2<float>(std::numeric_limits<float>::lowest());
 
-		// Orphan the old GPU buffer
-		vertexarray->alloc_data(nullptr, 6 * this->buffer_capacity, true);
-	}
+	// Glyphs of this text are not evicted while it is laid out
+	this->glyphs->begin_use();
+	const float page_size = static_cast<float>(this->glyphs->get_page_size());
 
-	// Generate quads
-	float curx = 0.0f; // Start at local 0 to let Model Matrix handle pos
-	float cury = 0.0f;
-	uint32 num_vertices = 0;
+	out.reserve(out.size() + text.size() * 6);
+	size_t index = 0;
+	while(index < text.size()) {
+		const uint32 codepoint = StringHelper::next_codepoint(text, index);
+		if(codepoint == '\n') {
+			curx  = 0.0f;
+			cury += this->size;
+			continue;
+		}
 
-	Vertex2D* data = this->buffer_data; // Cache
-	for(char c : text) {
-		// In range
-		if(c < 32 || c > 127) {
+		// Control characters
+		if(codepoint < ASCII_FIRST) {
 			continue;
 		}
 
-		stbtt_aligned_quad q;
-		stbtt_GetBakedQuad(this->data->cdata.data(), this->ATLAS_WIDTH, this->ATLAS_HEIGHT,
-				c - 32, &curx, &cury, &q, 1);
-
-		// Apply scale if needed
-		// float x0 = q.x0 * scale;
-		// float y0 = q.y0 * scale;
-		// float x1 = q.x1 * scale;
-		// float y1 = q.y1 * scale;
-
-		// Standard 6-vertex quad (Triangles: 0,1,2 and 0,2,3)
-		// Position data
-		data[0].position = vec2<float>(q.x0, q.y0);
-		data[1].position = vec2<float>(q.x1, q.y0);
-		data[2].position = vec2<float>(q.x1, q.y1);
-		data[3].position = vec2<float>(q.x0, q.y1);
-		data[4].position = vec2<float>(q.x0, q.y0);
-		data[5].position = vec2<float>(q.x1, q.y1);
-
-		// UV data
-		data[0].texuv = vec2<float>(q.s0, q.t0);
-		data[1].texuv = vec2<float>(q.s1, q.t0);
-		data[2].texuv = vec2<float>(q.s1, q.t1);
-		data[3].texuv = vec2<float>(q.s0, q.t1);
-		data[4].texuv = vec2<float>(q.s0, q.t0);
-		data[5].texuv = vec2<float>(q.s1, q.t1);
-
-		data += 6;
-		num_vertices += 6;
-	}
+		const GlyphCache::Glyph* found = this->glyph(codepoint);
+		if(found == nullptr) {
+			continue;
+		}
+		const GlyphCache::Glyph glyph = *found;
 
-	// Render
-	this->material->texture->bind();
+		if(glyph.page != GlyphCache::NO_PAGE) {
+			// Rounded to whole pixels, like stbtt_GetBakedQuad
+			const float x0 = std::floor(curx + glyph.xoff + 0.5f);
+			const float y0 = std::floor(cury + glyph.yoff + 0.5f);
+			const float x1 = x0 + glyph.width;
+			const float y1 = y0 + glyph.height;
+			const float s0 = glyph.x / page_size;
+			const float t0 = glyph.y / page_size;
+			const float s1 = (glyph.x + glyph.width) / page_size;
+			const float t1 = (glyph.y + glyph.height) / page_size;
+			const float page = static_cast<float>(glyph.page);
 
-	std::shared_ptr<ShaderProgram> shader = this->material->shader;
-	shader->use();
+			// Standard 6-vertex quad (Triangles: 0,1,2 and 3,4,5)
+			out.push_back(TextVertex { vec2<float>(x0, y0), vec3<float>(s0, t0, page), color });
+			out.push_back(TextVertex { vec2<float>(x1, y0), vec3<float>(s1, t0, page), color });
+			out.push_back(TextVertex { vec2<float>(x1, y1), vec3<float>(s1, t1, page), color });
+			out.push_back(TextVertex { vec2<float>(x0, y1), vec3<float>(s0, t1, page), color });
+			out.push_back(TextVertex { vec2<float>(x0, y0), vec3<float>(s0, t0, page), color });
+			out.push_back(TextVertex { vec2<float>(x1, y1), vec3<float>(s1, t1, page), color });
 
+			min = glm::min(min, vec2<float>(x0, y0));
+			max = glm::max(max, vec2<float>(x1, y1));
+		}
+		curx += glyph.advance;
+	}
 
-	// Make model
-	glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(pos.x, pos.y, 0.0f));
-	model = glm::scale(model, glm::vec3(scale, scale, 1.0f));
+	// No glyph
+	if(min.x > max.x) {
+		min = vec2<float>(0.0f);
+		max = vec2<float>(0.0f);
+	}
+}
 
-	// Bind Shader
-	shader->set_color("shapeColor", color);
-	shader->set_matrix4f("mvp", (this->camera.get_proj_matrix() * this->camera.get_view_matrix()) * model);
+const GlyphCache::Glyph* Font::glyph(const uint32 codepoint) {
+	const GlyphCache::Glyph* glyph = this->glyphs->find(codepoint);
+	if(glyph != nullptr) {
+		return glyph;
+	}
 
-	vertexarray->bind_vao();
-	vertexarray->update_data(this->buffer_data, num_vertices * sizeof(Vertex2D));
-	glDrawArrays(GL_TRIANGLES, 0, num_vertices);
+	const Raster raster = rasterize(*this->data, codepoint, this->is_sdf(), this->SDF_PADDING);
+	return this->glyphs->insert(codepoint, raster.pixels.data(), raster.glyph.width, raster.glyph.height,
+		raster.glyph.xoff, raster.glyph.yoff, raster.glyph.advance);
 }
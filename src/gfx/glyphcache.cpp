@@ -0,0 +1,209 @@
+#include "scarablib/gfx/glyphcache.hpp"
+#include "scarablib/proper/log.hpp"
+#include <algorithm>
+#include <cstring>
+
+// #define SCARAB_DEBUG_GLYPH_CACHE
+
+GlyphCache::GlyphCache(const uint16 page_size, const uint16 max_pages)
+	: page_size(std::max<uint16>(page_size, 16)) {
+
+#if !defined(BUILD_OPGL30)
+	// Grows one page at a time
+	this->texture = std::make_unique<TextureArray>(this->page_size, this->page_size, 1, 1, false);
+#else
+	// Texture arrays can't grow, all pages are allocated now
+	this->texture = std::make_unique<TextureArray>(this->page_size, this->page_size, max_pages, 1, false);
+#endif
+	this->texture->set_wrap(TextureBase::Wrap::CLAMP_TO_EDGE);
+	this->max_pages = static_cast<uint16>(std::clamp<uint32>(max_pages, 1, this->texture->get_max_layers()));
+}
+
+const GlyphCache::Glyph* GlyphCache::find(const uint32 codepoint) noexcept {
+	const auto it = this->slots.find(codepoint);
+	if(it == this->slots.end()) {
+		return nullptr;
+	}
+
+	const Glyph& glyph = this->glyphs[it->second];
+	if(glyph.page != GlyphCache::NO_PAGE) {
+		this->pages[glyph.page].last_use = this->tick;
+	}
+	return &glyph;
+}
+
+const GlyphCache::Glyph* GlyphCache::insert(const uint32 codepoint, const uint8* pixels, const uint16 width, const uint16 height,
+		const int16 xoff, const int16 yoff, const float advance, const bool pinned) {
+
+	// Already cached
+	if(const Glyph* cached = this->find(codepoint)) {
+		return cached;
+	}
+
+	Glyph glyph = {
+		.codepoint = codepoint,
+		.advance   = advance,
+		.x = 0, .y = 0,
+		.width  = width,
+		.height = height,
+		.xoff   = xoff,
+		.yoff   = yoff,
+		.page   = GlyphCache::NO_PAGE
+	};
+
+	// Nothing to draw, only the advance is needed
+	if(pixels == nullptr || width == 0 || height == 0) {
+		glyph.width  = 0;
+		glyph.height = 0;
+		return &this->glyphs[this->store(glyph)];
+	}
+
+	// 1 pixel of border, cleared with the glyph so linear filtering never reads old glyphs
+	const uint16 rect_width  = static_cast<uint16>(width + 2);
+	const uint16 rect_height = static_cast<uint16>(height + 2);
+	uint16 x, y;
+	const int page = this->find_page(rect_width, rect_height, x, y);
+	if(page < 0) {
+		this->stats.misses++;
+	#if defined(SCARAB_DEBUG_GLYPH_CACHE)
+		LOG_DEBUG("No space for glyph U+%04X (%ux%u)", codepoint, width, height);
+	#endif
+		return nullptr;
+	}
+
+	std::vector<uint8> bordered(static_cast<size_t>(rect_width) * rect_height, 0);
+	for(uint16 row = 0; row < height; row++) {
+		std::memcpy(bordered.data() + static_cast<size_t>(row + 1) * rect_width + 1,
+			pixels + static_cast<size_t>(row) * width, width);
+	}
+	this->texture->update_region(static_cast<uint16>(page), x, y, rect_width, rect_height, bordered.data());
+
+	glyph.x    = static_cast<uint16>(x + 1);
+	glyph.y    = static_cast<uint16>(y + 1);
+	glyph.page = static_cast<uint16>(page);
+
+	Page& target = this->pages[page];
+	target.last_use = this->tick;
+	target.pinned   = target.pinned || pinned;
+	const uint32 slot = this->store(glyph);
+	target.slots.push_back(slot);
+	return &this->glyphs[slot];
+}
+
+
+bool GlyphCache::pack(Page& page, const uint16 width, const uint16 height, uint16& x, uint16& y) noexcept {
+	// Best fit: the lowest shelf tall enough, not wasting more than half of the glyph
+	Shelf* best = nullptr;
+	for(Shelf& shelf : page.shelves) {
+		if(shelf.height < height || shelf.height > height + height / 2 || shelf.x + width > this->page_size) {
+			continue;
+		}
+		if(best == nullptr || shelf.height < best->height) {
+			best = &shelf;
+		}
+	}
+
+	// New shelf
+	if(best == nullptr && page.bottom + height <= this->page_size) {
+		page.shelves.push_back(Shelf { 0, page.bottom, height });
+		page.bottom = static_cast<uint16>(page.bottom + height);
+		best = &page.shelves.back();
+	}
+
+	// Any shelf tall enough, when the page has no height left
+	if(best == nullptr) {
+		for(Shelf& shelf : page.shelves) {
+			if(shelf.height >= height && shelf.x + width <= this->page_size) {
+				best = &shelf;
+				break;
+			}
+		}
+	}
+
+	if(best == nullptr) {
+		return false;
+	}
+
+	x = best->x;
+	y = best->y;
+	best->x = static_cast<uint16>(best->x + width);
+	return true;
+}
+
+int GlyphCache::find_page(const uint16 width, const uint16 height, uint16& x, uint16& y) {
+	if(width > this->page_size || height > this->page_size) {
+		return -1;
+	}
+
+	for(size_t i = 0; i < this->pages.size(); i++) {
+		if(this->pack(this->pages[i], width, height, x, y)) {
+			return static_cast<int>(i);
+		}
+	}
+
+	// New page
+	if(this->pages.size() < this->max_pages) {
+	#if !defined(BUILD_OPGL30)
+		// Exactly the pages used, so memory stays bounded by `max_pages`
+		this->texture->reserve(static_cast<uint32>(this->pages.size() + 1));
+	#endif
+		const uint16 index = this->texture->add_empty(static_cast<int>(this->pages.size()));
+		this->pages.emplace_back();
+		this->stats.pages++;
+		this->pack(this->pages[index], width, height, x, y);
+		return index;
+	}
+
+	// Least recently used page not used by the current text
+	int oldest = -1;
+	for(size_t i = 0; i < this->pages.size(); i++) {
+		const Page& page = this->pages[i];
+		if(page.pinned || page.last_use >= this->tick) {
+			continue;
+		}
+		if(oldest < 0 || page.last_use < this->pages[oldest].last_use) {
+			oldest = static_cast<int>(i);
+		}
+	}
+	if(oldest < 0) {
+		return -1;
+	}
+
+	this->evict(static_cast<uint32>(oldest));
+	this->pack(this->pages[oldest], width, height, x, y);
+	return oldest;
+}
+
+void GlyphCache::evict(const uint32 index) noexcept {
+	Page& page = this->pages[index];
+	for(const uint32 slot : page.slots) {
+		this->slots.erase(this->glyphs[slot].codepoint);
+		this->free_slots.push_back(slot);
+	}
+
+#if defined(SCARAB_DEBUG_GLYPH_CACHE)
+	LOG_DEBUG("Glyph page %u evicted (%zu glyphs)", index, page.slots.size());
+#endif
+
+	this->stats.glyphs -= static_cast<uint32>(page.slots.size());
+	this->stats.evictions++;
+	page.slots.clear();
+	page.shelves.clear();
+	page.bottom = 0;
+	this->generation++;
+}
+
+uint32 GlyphCache::store(const Glyph& glyph) {
+	uint32 slot;
+	if(!this->free_slots.empty()) {
+		slot = this->free_slots.back();
+		this->free_slots.pop_back();
+		this->glyphs[slot] = glyph;
+	} else {
+		slot = static_cast<uint32>(this->glyphs.size());
+		this->glyphs.push_back(glyph);
+	}
+	this->slots[glyph.codepoint] = slot;
+	this->stats.glyphs++;
+	return slot;
+}
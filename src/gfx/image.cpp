@@ -1,14 +1,22 @@
 #include "scarablib/gfx/image.hpp"
+#include "scarablib/utils/image.hpp"
+#include "scarablib/utils/vfs.hpp"
 
 // STB entry point
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
 Image::Image(const char* path, const bool flip_h, const bool flip_v) noexcept : path(path) {
-	// Opposite because stbi acts the opposite
-	stbi_set_flip_vertically_on_load(!flip_v);
+	// Opposite because stbi acts the opposite.
+	// Only affects this thread, so images can be decoded on worker threads
+	stbi_set_flip_vertically_on_load_thread(!flip_v);
 
-	this->data = stbi_load(path, &this->width, &this->height, &this->channels, 0); // STBI_rgb_alpha to standarlize
+	// From a mounted archive or from disk
+	const ScarabVFS::File file = ScarabVFS::open(path, ScarabFile::Access::Sequential);
+	if(!file.is_open()) {
+		return;
+	}
+	this->data = stbi_load_from_memory(file.data(), (int)file.size(), &this->width, &this->height, &this->channels, 0); // STBI_rgb_alpha to standarlize
 
 	// This gives skybox a nice effect
 	// this->data = stbi_load(path, &this->width, &this->height, &channels, STBI_rgb_alpha); // STBI_rgb_alpha to standarlize
@@ -19,22 +27,14 @@ Image::Image(const char* path, const bool flip_h, const bool flip_v) noexcept :
 	}
 
 	if(flip_h) {
-		// Flip horizontally
-		int rowsize = this->width * this->channels * sizeof(uint8);
-		for(int y = 0; y < this->height; y++) {
-			uint8* row = this->data + (y * rowsize);
-			for(int x = 0; x < this->width / 2; x++) {
-				for(int c = 0; c < this->channels; c++) {
-					std::swap(row[x * this->channels + c], row[(this->width - 1 - x) * this->channels + c]);
-				}
-			}
-		}
+		ScarabImage::flip_horizontal(this->data, this->width, this->height, this->channels);
 	}
 }
 
 Image::Image(const uint8* data, const size_t size, const bool flip_h, const bool flip_v) noexcept {
-	// Opposite because stbi acts the opposite
-	stbi_set_flip_vertically_on_load(!flip_v);
+	// Opposite because stbi acts the opposite.
+	// Only affects this thread, so images can be decoded on worker threads
+	stbi_set_flip_vertically_on_load_thread(!flip_v);
 
 	this->data = stbi_load_from_memory(data, (int)size, &this->width, &this->height, &this->channels, 0);
 
@@ -44,16 +44,7 @@ Image::Image(const uint8* data, const size_t size, const bool flip_h, const bool
 	}
 
 	if(flip_h) {
-		// Flip horizontally
-		int rowsize = this->width * this->channels * sizeof(uint8);
-		for(int y = 0; y < this->height; y++) {
-			uint8* row = this->data + (y * rowsize);
-			for(int x = 0; x < this->width / 2; x++) {
-				for(int c = 0; c < this->channels; c++) {
-					std::swap(row[x * this->channels + c], row[(this->width - 1 - x) * this->channels + c]);
-				}
-			}
-		}
+		ScarabImage::flip_horizontal(this->data, this->width, this->height, this->channels);
 	}
 }
 
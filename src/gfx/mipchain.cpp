@@ -0,0 +1,265 @@
+#include "scarablib/gfx/mipchain.hpp"
+#include "scarablib/proper/error.hpp"
+#include "scarablib/proper/log.hpp"
+#include "scarablib/utils/file.hpp"
+#include "scarablib/utils/image.hpp"
+#include "scarablib/utils/thread.hpp"
+#include "scarablib/utils/vfs.hpp"
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+// #define SCARAB_DEBUG_MIPCHAIN
+
+namespace {
+	// Cache file: header of 8 uint32, then all levels from the biggest
+	constexpr uint32 MIPS_MAGIC       = 0x50494D53; // "SMIP"
+	constexpr uint32 MIPS_VERSION     = 1;
+	constexpr size_t MIPS_HEADER_SIZE = 32;
+	constexpr uint32 MIPS_FLAG_SRGB   = 0x1;
+
+	// Rows per job
+	constexpr size_t MIN_ROWS = 32;
+
+	template <typename T>
+	inline T read(const uint8* data) noexcept {
+		T value;
+		std::memcpy(&value, data, sizeof(T));
+		return value;
+	}
+
+	// Pixels to floats, in linear space if `srgb`
+	inline void decode(const uint8* src, float* dst, const size_t count, const uint32 channels, const bool srgb) noexcept {
+		if(srgb) {
+			ScarabImage::srgb_to_linear(src, dst, count, channels);
+			return;
+		}
+		for(size_t i = 0; i < count * channels; i++) {
+			dst[i] = static_cast<float>(src[i]) * (1.0f / 255.0f);
+		}
+	}
+
+	// Floats to pixels, back to sRGB if `srgb`
+	inline void encode(const float* src, uint8* dst, const size_t count, const uint32 channels, const bool srgb) noexcept {
+		if(srgb) {
+			ScarabImage::linear_to_srgb(src, dst, count, channels);
+			return;
+		}
+		for(size_t i = 0; i < count * channels; i++) {
+			dst[i] = static_cast<uint8>(std::clamp(src[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+		}
+	}
+}
+
+
+MipChain::MipChain(const Image& image, const bool srgb, const uint32 max_levels) : srgb(srgb) {
+	if(image.data == nullptr) {
+		throw ScarabError("Image (%s) was not found", image.path);
+	}
+
+	this->width    = static_cast<uint32>(image.width);
+	this->height   = static_cast<uint32>(image.height);
+	this->channels = (image.channels == 1) ? 1 : 4;
+	this->levels   = MipChain::count_levels(this->width, this->height);
+	if(max_levels != 0) {
+		this->levels = std::min(this->levels, max_levels);
+	}
+	this->compute_offsets();
+
+	const size_t total = this->offsets.back() + this->level_size(this->levels - 1);
+	this->buffer.resize(total);
+	this->payload = this->buffer.data();
+
+	// Level 0 is the image itself
+	const size_t count = static_cast<size_t>(this->width) * this->height;
+	if(this->channels == 1) {
+		std::memcpy(this->buffer.data(), image.data, count);
+	} else {
+		ScarabImage::to_rgba(image.data, static_cast<uint32>(image.channels), this->buffer.data(), count);
+	}
+
+	if(this->levels == 1) {
+		return;
+	}
+
+	// Each level is made from the previous one in float, so rounding errors don't add up
+	const uint32 ch = this->channels;
+	std::vector<float> current(count * ch);
+	ScarabThread::parallel_for(this->height, [&](const size_t begin, const size_t end) {
+		const size_t rowsize = static_cast<size_t>(this->width) * ch;
+		decode(this->buffer.data() + begin * rowsize, current.data() + begin * rowsize, (end - begin) * this->width, ch, srgb);
+	}, MIN_ROWS);
+
+	uint32 srcwidth  = this->width;
+	uint32 srcheight = this->height;
+	for(uint32 level = 1; level < this->levels; level++) {
+		const uint32 dstwidth  = this->level_width(level);
+		const uint32 dstheight = this->level_height(level);
+		std::vector<float> next(static_cast<size_t>(dstwidth) * dstheight * ch);
+		uint8* dst = this->buffer.data() + this->offsets[level];
+
+		ScarabThread::parallel_for(dstheight, [&](const size_t begin, const size_t end) {
+			for(size_t y = begin; y < end; y++) {
+				// Odd sizes repeat the last row and column
+				const float* row0 = &current[std::min<size_t>(y * 2, srcheight - 1) * srcwidth * ch];
+				const float* row1 = &current[std::min<size_t>(y * 2 + 1, srcheight - 1) * srcwidth * ch];
+				float* out = &next[y * dstwidth * ch];
+
+				for(uint32 x = 0; x < dstwidth; x++) {
+					const size_t x0 = std::min<size_t>(x * 2, srcwidth - 1) * ch;
+					const size_t x1 = std::min<size_t>(x * 2 + 1, srcwidth - 1) * ch;
+					for(uint32 c = 0; c < ch; c++) {
+						out[x * ch + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+					}
+				}
+				encode(out, dst + y * dstwidth * ch, dstwidth, ch, srgb);
+			}
+		}, MIN_ROWS);
+
+		current   = std::move(next);
+		srcwidth  = dstwidth;
+		srcheight = dstheight;
+	}
+}
+
+MipChain::MipChain(const char* path) {
+	if(path == nullptr) {
+		throw ScarabError("Mipmap chain has null path");
+	}
+
+	// All levels are uploaded right after
+	this->file = ScarabVFS::open(path, ScarabFile::Access::WillNeed);
+	if(!this->file.is_open()) {
+		throw ScarabError("Mipmap chain (%s) was not found", path);
+	}
+
+	const uint8* data = this->file.data();
+	if(this->file.size() < MIPS_HEADER_SIZE || read<uint32>(data) != MIPS_MAGIC) {
+		throw ScarabError("Mipmap chain (%s) is not a valid file", path);
+	}
+	if(read<uint32>(data + 4) != MIPS_VERSION) {
+		throw ScarabError("Mipmap chain (%s) has unsupported version %u", path, read<uint32>(data + 4));
+	}
+
+	this->width  = read<uint32>(data + 8);
+	this->height = read<uint32>(data + 12);
+	const uint32 channels = read<uint32>(data + 16);
+	this->levels = read<uint32>(data + 20);
+	this->srgb   = (read<uint32>(data + 24) & MIPS_FLAG_SRGB) != 0;
+
+	if(this->width == 0 || this->height == 0 || (channels != 1 && channels != 4)
+		|| this->levels == 0 || this->levels > MipChain::count_levels(this->width, this->height)) {
+		throw ScarabError("Mipmap chain (%s) has an invalid header", path);
+	}
+	this->channels = static_cast<uint8>(channels);
+	this->compute_offsets();
+
+	const size_t total = this->offsets.back() + this->level_size(this->levels - 1);
+	if(this->file.size() - MIPS_HEADER_SIZE != total) {
+		throw ScarabError("Mipmap chain (%s) has %zu bytes of data, expected %zu", path, this->file.size() - MIPS_HEADER_SIZE, total);
+	}
+	this->payload = data + MIPS_HEADER_SIZE;
+}
+
+
+bool MipChain::save(const std::filesystem::path& path) const noexcept {
+	if(this->payload == nullptr) {
+		return false;
+	}
+
+	uint8 header[MIPS_HEADER_SIZE] = {};
+	const auto write32 = [&header](const size_t offset, const uint32 value) {
+		std::memcpy(header + offset, &value, sizeof(uint32));
+	};
+	write32(0, MIPS_MAGIC);
+	write32(4, MIPS_VERSION);
+	write32(8, this->width);
+	write32(12, this->height);
+	write32(16, this->channels);
+	write32(20, this->levels);
+	write32(24, (this->srgb) ? MIPS_FLAG_SRGB : 0);
+
+	try {
+		// Loader threads may save the same image at the same time
+		return ScarabFile::write_atomic(path, [&](std::ostream& file) {
+			file.write(reinterpret_cast<const char*>(header), sizeof(header));
+			const size_t total = this->offsets.back() + this->level_size(this->levels - 1);
+			file.write(reinterpret_cast<const char*>(this->payload), static_cast<std::streamsize>(total));
+		});
+
+	} catch(...) {
+		return false;
+	}
+}
+
+
+MipChain MipChain::load_cached(const char* path, const bool flip_v, const bool flip_h, const bool srgb) {
+	if(path == nullptr) {
+		throw ScarabError("Texture has null path");
+	}
+
+	const std::filesystem::path source = path;
+	std::string cachename = source.string() + ((srgb) ? ".srgb" : ".linear");
+	if(flip_v) {
+		cachename += "v";
+	}
+	if(flip_h) {
+		cachename += "h";
+	}
+	const std::filesystem::path cachepath = cachename + ".mips";
+
+	// Archives have no modification time, a cache packed with the image is always up to date
+	const bool archived = ScarabVFS::in_archive(source);
+	bool uptodate = false;
+	if(archived) {
+		uptodate = ScarabVFS::in_archive(cachepath);
+	} else {
+		std::error_code error;
+		const auto source_time = std::filesystem::last_write_time(source, error);
+		if(error) {
+			throw ScarabError("Image (%s) was not found", path);
+		}
+		const auto cache_time = std::filesystem::last_write_time(cachepath, error);
+		uptodate = !error && cache_time >= source_time;
+	}
+
+	if(uptodate) {
+		try {
+			MipChain cached = MipChain(cachepath.string().c_str());
+			if(cached.srgb == srgb && cached.levels == MipChain::count_levels(cached.width, cached.height)) {
+				return cached;
+			}
+		} catch(const std::exception& err) {
+			LOG_WARNING("Ignoring invalid mipmap cache: %s", err.what());
+		}
+	}
+
+#if defined(SCARAB_DEBUG_MIPCHAIN)
+	LOG_DEBUG("Generating mipmaps of (%s)", path);
+#endif
+
+	// Same arguments order as Assets::load
+	const Image image = Image(path, flip_v, flip_h);
+	if(image.data == nullptr) {
+		throw ScarabError("Image (%s) was not found", path);
+	}
+
+	MipChain result = MipChain(image, srgb);
+	if(!archived && !result.save(cachepath)) {
+		LOG_WARNING("Could not write mipmap cache (%s)", cachepath.string().c_str());
+	}
+	return result;
+}
+
+uint32 MipChain::count_levels(const uint32 width, const uint32 height) noexcept {
+	return static_cast<uint32>(std::bit_width(std::max<uint32>(std::max(width, height), 1)));
+}
+
+void MipChain::compute_offsets() noexcept {
+	this->offsets.resize(this->levels);
+	size_t offset = 0;
+	for(uint32 level = 0; level < this->levels; level++) {
+		this->offsets[level] = offset;
+		offset += this->level_size(level);
+	}
+}
@@ -0,0 +1,455 @@
+#include "scarablib/gfx/text.hpp"
+#include "scarablib/camera/camera2d.hpp"
+#include "scarablib/opengl/resourcesmanager.hpp"
+#include "scarablib/opengl/shader_program.hpp"
+#include "scarablib/opengl/vertexarray.hpp"
+#include "scarablib/proper/log.hpp"
+#include "scarablib/utils/opengl.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+
+// #define SCARAB_DEBUG_TEXT
+
+namespace {
+	std::atomic<uint64> next_id = 0;
+
+	// Same program and uniforms for Text and TextBatch
+	const ShaderProgram& use_program(const Camera2D& camera, const bool sdf) noexcept {
+		const std::shared_ptr<ShaderProgram>& shader = ResourcesManager::get_instance()
+			.builtin_program(sdf ? ResourcesManager::Program::TextSDF : ResourcesManager::Program::Text);
+		shader->use();
+		shader->set_matrix4f("mvp", camera.get_proj_matrix() * camera.get_view_matrix());
+		shader->set_int("texSampler", 0);
+		return *shader;
+	}
+}
+
+
+Text::Text(Font& font, std::string_view content, const vec2<float>& position, const float scale, const Color& color) noexcept
+	: font(font), content(content), position(position), scale(scale), color(color), id(next_id++) {
+
+	this->layout();
+}
+
+Text::~Text() noexcept = default;
+
+void Text::set_text(std::string_view content) noexcept {
+	if(content == this->content) {
+		return;
+	}
+
+	this->content = content;
+	this->layout();
+}
+
+void Text::set_position(const vec2<float>& position) noexcept {
+	if(position == this->position) {
+		return;
+	}
+	this->position = position;
+	this->dirty = true;
+	this->version++;
+}
+
+void Text::set_scale(const float scale) noexcept {
+	if(scale == this->scale) {
+		return;
+	}
+	this->scale = scale;
+	this->dirty = true;
+	this->version++;
+}
+
+void Text::set_color(const Color& color) noexcept {
+	if(color == this->color) {
+		return;
+	}
+	this->color = color;
+	// Only the color changes, no need to layout again
+	for(TextVertex& vertex : this->local) {
+		vertex.color = color;
+	}
+	this->dirty = true;
+	this->version++;
+}
+
+const std::vector<TextVertex>& Text::get_vertices() const noexcept {
+	this->refresh();
+	if(!this->dirty) {
+		return this->vertices;
+	}
+
+	this->vertices.resize(this->local.size());
+	for(size_t i = 0; i < this->local.size(); i++) {
+		this->vertices[i] = this->local[i];
+		this->vertices[i].position = this->position + this->local[i].position * this->scale;
+	}
+	this->dirty = false;
+	return this->vertices;
+}
+
+void Text::get_bounds(vec2<float>& min, vec2<float>& max) const noexcept {
+	this->refresh();
+	min = this->position + this->local_min * this->scale;
+	max = this->position + this->local_max * this->scale;
+}
+
+vec2<float> Text::get_size() const noexcept {
+	this->refresh();
+	return (this->local_max - this->local_min) * this->scale;
+}
+
+void Text::layout() const noexcept {
+	this->local.clear();
+	this->font.layout(this->content, this->color, this->local, this->local_min, this->local_max);
+	this->generation = this->font.get_generation();
+	this->dirty = true;
+	this->version++;
+}
+
+void Text::draw() noexcept {
+	const std::vector<TextVertex>& vertices = this->get_vertices();
+	if(!this->visible || vertices.empty()) {
+		return;
+	}
+
+	// Upload only if changed
+	if(this->uploaded_version != this->version) {
+		if(this->vertexarray == nullptr || vertices.size() > this->vertexarray_capacity) {
+			this->vertexarray_capacity = vertices.size();
+			this->vertexarray = std::make_unique<VertexArray>(vertices.data(), vertices.size(), sizeof(TextVertex), true);
+			this->vertexarray->set_layout(TextVertex::LAYOUT);
+		} else {
+			this->vertexarray->update_data(vertices.data(), vertices.size() * sizeof(TextVertex));
+		}
+		this->uploaded_version = this->version;
+
+	#if defined(SCARAB_DEBUG_TEXT)
+		LOG_DEBUG("Text %zu uploaded (%zu vertices)", this->id, vertices.size());
+	#endif
+	}
+
+	use_program(this->font.get_camera(), this->font.is_sdf());
+	this->font.get_atlas().bind(0);
+	this->vertexarray->bind_vao();
+	glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices.size()));
+	this->vertexarray->unbind_vao();
+}
+
+
+TextBatch::TextBatch(const Camera2D& camera, const size_t capacity) noexcept
+	: camera(camera), segment_size(std::max<size_t>(capacity, 1) * 6) {
+
+	this->create_buffer();
+}
+
+TextBatch::~TextBatch() noexcept {
+	this->delete_buffer();
+}
+
+void TextBatch::add(const Text& text) noexcept {
+	if(!text.is_visible() || text.get_text().empty()) {
+		return;
+	}
+
+	vec2<float> min, max;
+	text.get_bounds(min, max);
+	if(!this->on_screen(min, max)) {
+		this->culled++;
+		return;
+	}
+
+	this->entries.push_back(Entry {
+		.atlas = &text.get_font().get_atlas(),
+		.sdf   = text.get_font().is_sdf(),
+		.text  = &text
+	});
+}
+
+void TextBatch::add(Font& font, std::string_view text, const vec2<float>& position, const float scale, const Color& color) noexcept {
+	if(text.empty()) {
+		return;
+	}
+
+	Entry entry = {
+		.atlas       = &font.get_atlas(),
+		.sdf         = font.is_sdf(),
+		.font        = &font,
+		.text_first  = static_cast<uint32>(this->immediate_text.size()),
+		.text_length = static_cast<uint32>(text.size()),
+		.position    = position,
+		.scale       = scale,
+		.color       = color
+	};
+	this->immediate_text += text;
+
+	vec2<float> min, max;
+	this->layout(entry, min, max);
+	if(!this->on_screen(min, max)) {
+		this->immediate.resize(entry.first);
+		this->immediate_text.resize(entry.text_first);
+		this->culled++;
+		return;
+	}
+
+	this->entries.push_back(entry);
+}
+
+void TextBatch::draw() noexcept {
+	this->stats = Stats {
+		.texts  = static_cast<uint32>(this->entries.size()),
+		.culled = this->culled
+	};
+
+	if(this->entries.empty()) {
+		this->clear();
+		return;
+	}
+
+	this->refresh();
+
+	// Texts drawn this time, immediate texts always change
+	this->keys.clear();
+	bool reuse = this->immediate.empty();
+	for(const Entry& entry : this->entries) {
+		if(entry.text == nullptr) {
+			continue;
+		}
+		this->keys.push_back(Key { entry.text->get_id(), entry.text->get_version() });
+	}
+	reuse = reuse && !this->ranges.empty() && this->keys == this->last_keys;
+
+	if(!reuse) {
+		// Atlases in order of first use, texts of each atlas keep their order
+		this->staging.clear();
+		this->ranges.clear();
+		// First entry of each atlas
+		std::vector<const Entry*> atlases;
+		for(const Entry& entry : this->entries) {
+			if(std::find_if(atlases.begin(), atlases.end(), [&entry](const Entry* other) { return other->atlas == entry.atlas; }) == atlases.end()) {
+				atlases.push_back(&entry);
+			}
+		}
+
+		for(const Entry* atlas : atlases) {
+			const size_t first = this->staging.size();
+			for(const Entry& entry : this->entries) {
+				if(entry.atlas != atlas->atlas) {
+					continue;
+				}
+				if(entry.text != nullptr) {
+					const std::vector<TextVertex>& vertices = entry.text->get_vertices();
+					this->staging.insert(this->staging.end(), vertices.begin(), vertices.end());
+				} else {
+					this->staging.insert(this->staging.end(),
+						this->immediate.begin() + entry.first, this->immediate.begin() + entry.first + entry.count);
+				}
+			}
+			if(this->staging.size() > first) {
+				this->ranges.push_back(Range { atlas->atlas, atlas->sdf, static_cast<uint32>(first), static_cast<uint32>(this->staging.size() - first) });
+			}
+		}
+
+		if(this->staging.empty()) {
+			this->clear();
+			return;
+		}
+
+		// Grows before anything is written, never between draws of the same batch
+		if(this->staging.size() > this->segment_size) {
+			this->segment_size = std::bit_ceil(this->staging.size());
+			this->delete_buffer();
+			this->create_buffer();
+
+		#if defined(SCARAB_DEBUG_TEXT)
+			LOG_DEBUG("Text batch grew to %zu vertices per segment", this->segment_size);
+		#endif
+		}
+
+		// Upload everything at once
+		const size_t base = this->reserve(this->staging.size());
+		const size_t bytes = this->staging.size() * sizeof(TextVertex);
+		if(this->mapped != nullptr) {
+			std::memcpy(this->mapped + base, this->staging.data(), bytes);
+		} else {
+		#if !defined(BUILD_OPGL30)
+			glNamedBufferSubData(this->vbo_id, static_cast<GLintptr>(base * sizeof(TextVertex)), static_cast<GLsizeiptr>(bytes), this->staging.data());
+		#else
+			glBindBuffer(GL_ARRAY_BUFFER, this->vbo_id);
+			glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(base * sizeof(TextVertex)), static_cast<GLsizeiptr>(bytes), this->staging.data());
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		#endif
+		}
+
+		for(Range& range : this->ranges) {
+			range.first += static_cast<uint32>(base);
+		}
+		this->keys.swap(this->last_keys);
+		this->stats.uploaded = true;
+	}
+
+	// One draw for each atlas, the program only changes between bitmap and SDF fonts
+	glBindVertexArray(this->vao_id);
+	for(size_t i = 0; i < this->ranges.size(); i++) {
+		const Range& range = this->ranges[i];
+		if(i == 0 || range.sdf != this->ranges[i - 1].sdf) {
+			use_program(this->camera, range.sdf);
+		}
+		range.atlas->bind(0);
+		glDrawArrays(GL_TRIANGLES, static_cast<GLint>(range.first), static_cast<GLsizei>(range.count));
+		this->stats.vertices += range.count;
+		this->stats.draw_calls++;
+	}
+	glBindVertexArray(0);
+
+	// Immediate texts are never reused
+	if(!this->immediate.empty()) {
+		this->last_keys.clear();
+	}
+	this->clear();
+}
+
+void TextBatch::clear() noexcept {
+	this->entries.clear();
+	this->immediate.clear();
+	this->immediate_text.clear();
+	this->culled = 0;
+}
+
+
+void TextBatch::layout(Entry& entry, vec2<float>& min, vec2<float>& max) noexcept {
+	const std::string_view text = std::string_view(this->immediate_text).substr(entry.text_first, entry.text_length);
+	const size_t first = this->immediate.size();
+	entry.font->layout(text, entry.color, this->immediate, min, max);
+	for(size_t i = first; i < this->immediate.size(); i++) {
+		this->immediate[i].position = entry.position + this->immediate[i].position * entry.scale;
+	}
+
+	entry.first      = static_cast<uint32>(first);
+	entry.count      = static_cast<uint32>(this->immediate.size() - first);
+	entry.generation = entry.font->get_generation();
+	min = entry.position + min * entry.scale;
+	max = entry.position + max * entry.scale;
+}
+
+void TextBatch::refresh() noexcept {
+	// A text laid out again can evict glyphs of a text before it (only when the cache is too small for a frame).
+	// Tries a few times, after that the draw may show wrong glyphs for a frame
+	for(uint32 pass = 0; pass < 3; pass++) {
+		for(Entry& entry : this->entries) {
+			if(entry.text != nullptr) {
+				entry.text->get_vertices();
+			} else if(entry.generation != entry.font->get_generation()) {
+				vec2<float> min, max;
+				this->layout(entry, min, max);
+			}
+		}
+
+		const bool current = std::all_of(this->entries.begin(), this->entries.end(), [](const Entry& entry) {
+			return (entry.text != nullptr) ? entry.text->is_current() : entry.generation == entry.font->get_generation();
+		});
+		if(current) {
+			return;
+		}
+	}
+}
+
+
+void TextBatch::create_buffer() noexcept {
+	const GLsizeiptr size = static_cast<GLsizeiptr>(this->segment_size * SEGMENTS * sizeof(TextVertex));
+
+#if !defined(BUILD_OPGL30)
+	// Mapped once, written every draw
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &this->vbo_id);
+	glNamedBufferStorage(this->vbo_id, size, nullptr, flags | GL_DYNAMIC_STORAGE_BIT);
+	this->mapped = static_cast<TextVertex*>(glMapNamedBufferRange(this->vbo_id, 0, size, flags));
+	if(this->mapped == nullptr) {
+		LOG_WARNING("Failed to map text buffer, texts will be uploaded with glBufferSubData");
+	}
+
+	glCreateVertexArrays(1, &this->vao_id);
+	glVertexArrayVertexBuffer(this->vao_id, 0, this->vbo_id, 0, TextVertex::LAYOUT.stride);
+	for(uint32 i = 0; i < TextVertex::LAYOUT.attributes.size(); i++) {
+		const VertexAttribute& attribute = TextVertex::LAYOUT.attributes[i];
+		glEnableVertexArrayAttrib(this->vao_id, i);
+		glVertexArrayAttribFormat(this->vao_id, i, static_cast<GLint>(attribute.count), attribute.type,
+			attribute.normalized ? GL_TRUE : GL_FALSE, attribute.offset);
+		glVertexArrayAttribBinding(this->vao_id, i, 0);
+	}
+#else
+	glGenBuffers(1, &this->vbo_id);
+	glBindBuffer(GL_ARRAY_BUFFER, this->vbo_id);
+	glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+
+	glGenVertexArrays(1, &this->vao_id);
+	glBindVertexArray(this->vao_id);
+	for(uint32 i = 0; i < TextVertex::LAYOUT.attributes.size(); i++) {
+		const VertexAttribute& attribute = TextVertex::LAYOUT.attributes[i];
+		glEnableVertexAttribArray(i);
+		glVertexAttribPointer(i, static_cast<GLint>(attribute.count), attribute.type,
+			attribute.normalized ? GL_TRUE : GL_FALSE, TextVertex::LAYOUT.stride, (void*)(uintptr_t)attribute.offset);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+#endif
+
+	this->current = 0;
+	this->used    = 0;
+	this->last_keys.clear();
+	GL_CHECK();
+}
+
+void TextBatch::delete_buffer() noexcept {
+	// Deleting a buffer still read by the GPU is fine, the driver keeps it until the draws finish
+#if !defined(BUILD_OPGL30)
+	for(GLsync& fence : this->fences) {
+		if(fence != nullptr) {
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+	if(this->mapped != nullptr) {
+		glUnmapNamedBuffer(this->vbo_id);
+		this->mapped = nullptr;
+	}
+#endif
+	glDeleteBuffers(1, &this->vbo_id);
+	glDeleteVertexArrays(1, &this->vao_id);
+}
+
+bool TextBatch::on_screen(const vec2<float>& min, const vec2<float>& max) const noexcept {
+	const glm::mat4 mvp = this->camera.get_proj_matrix() * this->camera.get_view_matrix();
+	const vec4<float> a = mvp * vec4<float>(min, 0.0f, 1.0f);
+	const vec4<float> b = mvp * vec4<float>(max, 0.0f, 1.0f);
+	const vec2<float> ndc_min = glm::min(vec2<float>(a), vec2<float>(b));
+	const vec2<float> ndc_max = glm::max(vec2<float>(a), vec2<float>(b));
+	return ndc_max.x >= -1.0f && ndc_min.x <= 1.0f && ndc_max.y >= -1.0f && ndc_min.y <= 1.0f;
+}
+
+size_t TextBatch::reserve(const size_t count) noexcept {
+	if(this->used + count > this->segment_size) {
+	#if !defined(BUILD_OPGL30)
+		// Fence after the draws reading this segment
+		this->fences[this->current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	#endif
+		this->current = (this->current + 1) % SEGMENTS;
+		this->used    = 0;
+
+	#if !defined(BUILD_OPGL30)
+		// Usually done frames ago, only waits if the GPU is far behind
+		GLsync& fence = this->fences[this->current];
+		if(fence != nullptr) {
+			while(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	#endif
+	}
+
+	const size_t first = this->current * this->segment_size + this->used;
+	this->used += count;
+	return first;
+}
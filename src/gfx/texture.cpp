@@ -3,10 +3,31 @@
 #include "scarablib/gfx/texturebase.hpp"
 #include "scarablib/proper/error.hpp"
 #include "scarablib/typedef.hpp"
+#include "scarablib/utils/image.hpp"
 #include <SDL2/SDL_render.h>
+#include <algorithm>
+#include <bit>
+#include <vector>
+
+namespace {
+	// RGB rows are not 4 bytes aligned, so they are expanded to RGBA before uploading.
+	// The driver would convert them anyway, usually slower.
+	// Returns the pixels to upload and changes `channels` to the uploaded channels
+	const uint8* prepare_pixels(const uint8* data, const uint32 width, const uint32 height, uint8& channels, std::vector<uint8>& buffer) {
+		if(channels != 3) {
+			return data;
+		}
+		const size_t count = static_cast<size_t>(width) * height;
+		buffer.resize(count * 4);
+		ScarabImage::rgb_to_rgba(data, buffer.data(), count);
+		channels = 4;
+		return buffer.data();
+	}
+}
 
 Texture::Texture() noexcept : TextureBase(GL_TEXTURE_2D, 1, 1) {
 	constexpr uint8 white_pixel[4] = { 255, 255, 255, 255 };
+	this->byte_size = 4;
 
 #if !defined(BUILD_OPGL30)
 	glGenTextures(1, &this->id);
@@ -75,55 +96,68 @@ Texture::Texture() noexcept : TextureBase(GL_TEXTURE_2D, 1, 1) {
 }
 
 Texture::Texture(const Image& image)
-	: TextureBase(GL_TEXTURE_2D, image.width, image.height) {
+	: Texture(MipChain(image)) {}
+
+
+Texture::Texture(const MipChain& mips)
+	: TextureBase(GL_TEXTURE_2D, mips.width, mips.height) {
 
-	if(image.data == nullptr) {
-		throw ScarabError("Image (%s) was not found", image.path);
+	if(mips.empty()) {
+		throw ScarabError("Mipmap chain has no data");
 	}
 
+	const GLenum internal = TextureBase::extract_format(mips.channels, true);
+	const GLenum format   = TextureBase::extract_format(mips.channels, false);
+	this->byte_size = TextureBase::storage_size(mips.width, mips.height, mips.channels, mips.levels);
+	// Small levels of grayscale images have rows not 4 bytes aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
 #if !defined(BUILD_OPGL30)
 	glCreateTextures(GL_TEXTURE_2D, 1, &this->id);
-	glTextureStorage2D(this->id, 1,
-		TextureBase::extract_format(image.channels, true),
-		image.width,
-		image.height
-	);
-	glTextureSubImage2D(this->id,
-		0,
-		0, 0,
-		image.width, image.height,
-		Texture::extract_format(image.channels, false),
-		GL_UNSIGNED_BYTE,
-		image.data
+	glTextureStorage2D(this->id,
+		mips.levels,
+		internal,
+		mips.width, mips.height
 	);
-	glGenerateTextureMipmap(this->id);
+
+	for(uint32 level = 0; level < mips.levels; level++) {
+		glTextureSubImage2D(this->id,
+			level,
+			0, 0,
+			mips.level_width(level), mips.level_height(level),
+			format,
+			GL_UNSIGNED_BYTE,
+			mips.level(level)
+		);
+	}
 
 	this->set_wrap(TextureBase::Wrap::REPEAT);
-	this->set_filter(TextureBase::Filter::NEAREST);
+	this->set_filter((mips.levels > 1) ? TextureBase::Filter::NEAREST_MIPMAP : TextureBase::Filter::NEAREST);
 #else
-	// Generate and bind texture
 	glGenTextures(1, &this->id);
 	glBindTexture(GL_TEXTURE_2D, this->id);
-	// Allocate data
-	glTexImage2D(
-		GL_TEXTURE_2D, 0,
-		TextureBase::extract_format(image->channels, true),
-		image->width, image->height, 0,
-		TextureBase::extract_format(image->channels, false),
-		GL_UNSIGNED_BYTE,
-		image->data
-	);
+
+	for(uint32 level = 0; level < mips.levels; level++) {
+		glTexImage2D(GL_TEXTURE_2D,
+			level,
+			internal,
+			mips.level_width(level), mips.level_height(level), 0,
+			format,
+			GL_UNSIGNED_BYTE,
+			mips.level(level)
+		);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mips.levels - 1);
 
 	this->set_wrap(TextureBase::Wrap::REPEAT);
-	this->set_filter(TextureBase::Filter::NEAREST);
+	this->set_filter((mips.levels > 1) ? TextureBase::Filter::NEAREST_MIPMAP : TextureBase::Filter::NEAREST);
 
-	// Generate mipmap and unbind
-	glGenerateMipmap(GL_TEXTURE_2D);
 	glBindTexture(GL_TEXTURE_2D, 0);
 #endif
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
 #ifdef SCARAB_DEBUG_TEXTURE
-	LOG_INFO("Texture loaded succesfully! Width: %d, Height: %d", surface->w, surface->h);
+	LOG_INFO("Texture loaded succesfully! Width: %u, Height: %u, Levels: %u", mips.width, mips.height, mips.levels);
 #endif
 }
 
@@ -135,6 +169,11 @@ Texture::Texture(const uint8* data, const uint32 width, const uint32 height, con
 		throw ScarabError("Texture raw data is null");
 	}
 
+	std::vector<uint8> buffer;
+	uint8 upload_channels = channels;
+	const uint8* pixels = prepare_pixels(data, width, height, upload_channels, buffer);
+	this->byte_size = TextureBase::storage_size(width, height, channels, 1);
+
 #if !defined(BUILD_OPGL30)
 	glGenTextures(1, &this->id);
 	glBindTexture(GL_TEXTURE_2D, this->id);
@@ -151,15 +190,58 @@ Texture::Texture(const uint8* data, const uint32 width, const uint32 height, con
 		0,
 		0, 0,
 		width, height,
-		TextureBase::extract_format(channels, false),
+		TextureBase::extract_format(upload_channels, false),
+		GL_UNSIGNED_BYTE,
+		pixels
+	);
+
+	this->set_wrap(TextureBase::Wrap::REPEAT);
+	this->set_filter(TextureBase::Filter::NEAREST);
+
+#else
+	glGenTextures(1, &this->id);
+	glBindTexture(GL_TEXTURE_2D, this->id);
+
+	glTexImage2D(GL_TEXTURE_2D, 0,
+		TextureBase::extract_format(channels, true),
+		width, height, 0,
+		TextureBase::extract_format(upload_channels, false),
 		GL_UNSIGNED_BYTE,
-		data
+		pixels
+	);
+
+	this->set_wrap(TextureBase::Wrap::REPEAT);
+	this->set_filter(TextureBase::Filter::NEAREST);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+#endif
+}
+
+
+Texture::Texture(const uint32 width, const uint32 height, const uint8 channels, const bool mipmaps)
+	: TextureBase(GL_TEXTURE_2D, width, height) {
+
+	if(width == 0 || height == 0) {
+		throw ScarabError("Texture size can't be zero");
+	}
+
+	const GLsizei levels = (mipmaps) ? static_cast<GLsizei>(std::bit_width(std::max(width, height))) : 1;
+	this->byte_size = TextureBase::storage_size(width, height, channels, levels);
+
+#if !defined(BUILD_OPGL30)
+
+	glCreateTextures(GL_TEXTURE_2D, 1, &this->id);
+	glTextureStorage2D(this->id,
+		levels,
+		TextureBase::extract_format(channels, true),
+		width, height
 	);
 
 	this->set_wrap(TextureBase::Wrap::REPEAT);
 	this->set_filter(TextureBase::Filter::NEAREST);
 
 #else
+	// Mipmaps are made by glGenerateMipmap after the data is uploaded
 	glGenTextures(1, &this->id);
 	glBindTexture(GL_TEXTURE_2D, this->id);
 
@@ -168,9 +250,71 @@ Texture::Texture(const uint8* data, const uint32 width, const uint32 height, con
 		width, height, 0,
 		TextureBase::extract_format(channels, false),
 		GL_UNSIGNED_BYTE,
-		data
+		nullptr
+	);
+
+	this->set_wrap(TextureBase::Wrap::REPEAT);
+	this->set_filter(TextureBase::Filter::NEAREST);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+#endif
+}
+
+
+Texture::Texture(const CompressedImage& image)
+	: TextureBase(GL_TEXTURE_2D, image.width, image.height) {
+
+	if(image.empty()) {
+		throw ScarabError("Compressed image has no data");
+	}
+	if(image.layers != 1) {
+		throw ScarabError("Compressed image has %u layers, use TextureArray or Skybox", image.layers);
+	}
+
+	const GLenum format = image.gl_format();
+	for(uint32 level = 0; level < image.levels; level++) {
+		this->byte_size += image.surface_size(level);
+	}
+
+#if !defined(BUILD_OPGL30)
+	glCreateTextures(GL_TEXTURE_2D, 1, &this->id);
+	glTextureStorage2D(this->id,
+		image.levels,
+		format,
+		image.width, image.height
 	);
 
+	// Data is uploaded as is, the GPU reads the blocks directly
+	for(uint32 level = 0; level < image.levels; level++) {
+		glCompressedTextureSubImage2D(this->id,
+			level,
+			0, 0,
+			image.level_width(level), image.level_height(level),
+			format,
+			static_cast<GLsizei>(image.surface_size(level)),
+			image.surface(level)
+		);
+	}
+	glTextureParameteri(this->id, GL_TEXTURE_MAX_LEVEL, image.levels - 1);
+
+	this->set_wrap(TextureBase::Wrap::REPEAT);
+	this->set_filter(TextureBase::Filter::NEAREST);
+
+#else
+	glGenTextures(1, &this->id);
+	glBindTexture(GL_TEXTURE_2D, this->id);
+
+	for(uint32 level = 0; level < image.levels; level++) {
+		glCompressedTexImage2D(GL_TEXTURE_2D,
+			level,
+			format,
+			image.level_width(level), image.level_height(level), 0,
+			static_cast<GLsizei>(image.surface_size(level)),
+			image.surface(level)
+		);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levels - 1);
+
 	this->set_wrap(TextureBase::Wrap::REPEAT);
 	this->set_filter(TextureBase::Filter::NEAREST);
 
@@ -3,43 +3,18 @@
 #include "scarablib/gfx/texturebase.hpp"
 #include "scarablib/proper/error.hpp"
 #include "scarablib/typedef.hpp"
+#include "scarablib/utils/thread.hpp"
 #include <algorithm>
 
-TextureArray::TextureArray(const uint16 width, const uint16 height, const uint16 max_layers, const uint8 channels)
-	: TextureBase(GL_TEXTURE_2D_ARRAY, width, height), max_layers(max_layers), channels(channels) {
+TextureArray::TextureArray(const uint16 width, const uint16 height, const uint16 capacity, const uint8 channels, const bool mipmaps)
+	: TextureBase(GL_TEXTURE_2D_ARRAY, width, height), channels(channels) {
 
-	// Set number of textures
-	GLint maxlayers;
-	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxlayers);
-	this->max_layers = std::clamp((uint32)maxlayers, 1u, (uint32)max_layers);
-
-#if !defined(BUILD_OPGL30)
-	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &this->id);
-	glTextureStorage3D(this->id,
-		1,
-		TextureBase::extract_format(channels, true),
-		width, height, this->max_layers
-	);
-
-	this->set_filter(TextureBase::Filter::NEAREST);
-	this->set_wrap(TextureBase::Wrap::REPEAT);
-#else
-	// Generate and bind texture
-	glGenTextures(1, &this->id);
-	glBindTexture(GL_TEXTURE_2D_ARRAY, this->id);
+	this->levels = (mipmaps) ? MipChain::count_levels(width, height) : 1;
+	this->init_layers(capacity);
+	this->id = this->create_storage(this->capacity);
 
-	// Allocate data
-	glTexStorage3D(
-		GL_TEXTURE_2D_ARRAY,
-		1, // Mipmap level
-		TextureBase::extract_format(channels, true),
-		(int)width, (int)height,
-		(int)max_textures
-	);
-
-	this->set_filter(TextureBase::Filter::NEAREST);
+	this->set_filter((mipmaps) ? TextureBase::Filter::NEAREST_MIPMAP : TextureBase::Filter::LINEAR);
 	this->set_wrap(TextureBase::Wrap::REPEAT);
-#endif
 }
 
 
@@ -51,170 +26,404 @@ TextureArray::TextureArray(const std::vector<Image>& images)
 		throw ScarabError("Images vector is empty!");
 	}
 
-	// Set number of textures
-	GLint maxlayers;
-	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxlayers);
-	this->max_layers = std::clamp((uint32)maxlayers, 1u, (uint32)max_layers);
-
 	// Set configuration
 	this->width    = images[0].width;
 	this->height   = images[0].height;
 	this->channels = images[0].channels;
+	this->levels   = MipChain::count_levels(this->width, this->height);
+	this->init_layers(static_cast<uint32>(std::min<size_t>(images.size(), UINT16_MAX)));
+	if(images.size() > this->max_layers) {
+		throw ScarabError("Texture array limit (%u) reached", this->max_layers);
+	}
+
+	// Validated and their mipmaps generated on worker threads, uploaded after
+	std::vector<MipChain> mips(images.size());
+	ScarabThread::parallel_for(images.size(), [&](const size_t begin, const size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			this->validate(images[i], images[i].path);
+			mips[i] = MipChain(images[i]);
+		}
+	});
+
+	this->id = this->create_storage(this->capacity);
+	this->set_filter(TextureBase::Filter::NEAREST_MIPMAP);
+	this->set_wrap(TextureBase::Wrap::REPEAT);
+
+	for(const MipChain& chain : mips) {
+		this->add_texture(chain);
+	}
+}
+
+TextureArray::TextureArray(const std::vector<CompressedImage>& images)
+	// Placeholder
+	: TextureBase(GL_TEXTURE_2D_ARRAY, 1, 1), max_layers(0), channels(4), compressed(true) {
+
+	if(images.empty()) {
+		throw ScarabError("Images vector is empty!");
+	}
+
+	const CompressedImage& first = images[0];
+	uint32 layers = 0;
+	for(const CompressedImage& image : images) {
+		if(image.empty()) {
+			throw ScarabError("Compressed image has no data");
+		}
+		if(image.width != first.width || image.height != first.height) {
+			throw ScarabError("Compressed image dimensions (%ux%u) mismatch (%ux%u)", image.width, image.height, first.width, first.height);
+		}
+		if(image.format != first.format || image.srgb != first.srgb || image.levels != first.levels) {
+			throw ScarabError("Compressed images must have the same format and number of levels");
+		}
+		layers += image.layers;
+	}
+
+	GLint maxlayers;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxlayers);
+	if(layers > (uint32)maxlayers) {
+		throw ScarabError("Texture array limit (%i) reached", maxlayers);
+	}
+
+	this->width      = first.width;
+	this->height     = first.height;
+	this->max_layers = layers;
+	this->capacity   = layers;
+	this->levels     = first.levels;
+	this->used.assign(layers, true);
+	const GLenum format = first.gl_format();
+	for(uint32 level = 0; level < first.levels; level++) {
+		this->byte_size += first.surface_size(level) * layers;
+	}
 
 #if !defined(BUILD_OPGL30)
 	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &this->id);
 	glTextureStorage3D(this->id,
-		1,
-		TextureBase::extract_format(channels, true),
-		width, height, this->max_layers
+		first.levels,
+		format,
+		this->width, this->height, layers
 	);
-
-	this->set_filter(TextureBase::Filter::NEAREST);
-	this->set_wrap(TextureBase::Wrap::REPEAT);
 #else
-	// Generate and bind texture
 	glGenTextures(1, &this->id);
 	glBindTexture(GL_TEXTURE_2D_ARRAY, this->id);
-
-	// Allocate data
-	glTexStorage3D(
-		GL_TEXTURE_2D_ARRAY,
-		1, // Mipmap level
-		TextureBase::extract_format(channels, true),
-		(int)width, (int)height,
-		(int)max_textures
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY,
+		first.levels,
+		format,
+		this->width, this->height, layers
 	);
+#endif
+
+	for(const CompressedImage& image : images) {
+		for(uint32 layer = 0; layer < image.layers; layer++) {
+			for(uint32 level = 0; level < image.levels; level++) {
+			#if !defined(BUILD_OPGL30)
+				glCompressedTextureSubImage3D(this->id,
+					level,
+					0, 0, this->next_layer, // x, y, layer (z)
+					image.level_width(level), image.level_height(level), 1,
+					format,
+					static_cast<GLsizei>(image.surface_size(level)),
+					image.surface(level, layer)
+				);
+			#else
+				glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY,
+					level,
+					0, 0, this->next_layer, // x, y, layer (z)
+					image.level_width(level), image.level_height(level), 1,
+					format,
+					static_cast<GLsizei>(image.surface_size(level)),
+					image.surface(level, layer)
+				);
+			#endif
+			}
+			this->next_layer++;
+			this->num_layers++;
+		}
+	}
 
 	this->set_filter(TextureBase::Filter::NEAREST);
 	this->set_wrap(TextureBase::Wrap::REPEAT);
+#if defined(BUILD_OPGL30)
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 #endif
+}
 
+uint16 TextureArray::add_texture(const char* path, const bool flip_v, const bool flip_h, const int layer) {
+	if(this->compressed) {
+		throw ScarabError("Can't add uncompressed textures to a compressed texture array");
+	}
 
-	for(size_t i = 0; i < images.size(); i++) {
-		const Image& image = images.at(i);
+	if(layer >= (int)this->max_layers) {
+		throw ScarabError("Layer (%i) exceeds limit (%u)", layer, this->max_layers);
+	}
 
-		// Check if limit has been reached
-		if(this->num_layers >= this->max_layers) {
-			throw ScarabError("Texture array limit (%u) reached", this->max_layers);
-		}
+	if(path == nullptr) {
+		throw ScarabError("Texture has null path");
+	}
 
-		if(image.data == nullptr) {
-			throw ScarabError("Image (%s) was not found", image.path);
-		}
+	const Image image = Image(path, flip_v, flip_h);
+	this->validate(image, path);
+	// Only the levels the array has are generated
+	return this->add_texture(MipChain(image, true, this->levels), layer);
+}
 
-		// Validate dimensions
-		if((image.width != (int)this->width) || (image.height != (int)this->height)) {
-			throw ScarabError("Image (%s) dimensions (%ix%i) mismatch (%ix%i)i", image.path, this->width, this->height);
-		}
+uint16 TextureArray::add_texture(const MipChain& mips, const int layer) {
+	if(this->compressed) {
+		throw ScarabError("Can't add uncompressed textures to a compressed texture array");
+	}
 
-		// Validate channels
-		if(image.channels > (int)this->channels) {
-			throw ScarabError("(%s) Too many channels in image (%i > %i)", image.path, image.channels, this->channels);
-		}
+	if(mips.empty()) {
+		throw ScarabError("Mipmap chain has no data");
+	}
+
+	if(mips.width != this->width || mips.height != this->height) {
+		throw ScarabError("Mipmap chain dimensions (%ux%u) mismatch (%ux%u)", mips.width, mips.height, this->width, this->height);
+	}
+
+	const uint16 index = this->acquire_layer(layer);
+	this->upload_layer(mips, index);
+	return index;
+}
+
+uint16 TextureArray::add_empty(const int layer) {
+	if(this->compressed) {
+		throw ScarabError("Can't add uncompressed textures to a compressed texture array");
+	}
+	return this->acquire_layer(layer);
+}
+
+void TextureArray::update_region(const uint16 layer, const uint32 x, const uint32 y,
+		const uint32 width, const uint32 height, const uint8* data) const noexcept {
 
+	const GLenum format = TextureBase::extract_format(this->channels, false);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 #if !defined(BUILD_OPGL30)
-		glTextureSubImage3D(this->id,
-			0, // Mipmap level
-			0, 0, this->next_layer, // x, y, layer (z)
-			this->width, this->height,
-			1, // Depth
-			TextureBase::extract_format(image.channels, false),
-			GL_UNSIGNED_BYTE,
-			image.data
-		);
+	glTextureSubImage3D(this->id, 0, x, y, layer, width, height, 1, format, GL_UNSIGNED_BYTE, data);
 #else
-		glBindTexture(GL_TEXTURE_2D_ARRAY, this->id);
-		// Upload to texture array
-		glTexSubImage3D(
-			GL_TEXTURE_2D_ARRAY,
-			0, // Mipmap level
-			0, 0, this->next_texture, // x, y, layer (z)
-			this->width, this->height, 1, // Width, Height, Depth
-			TextureBase::extract_format(image.channels, false),
-			GL_UNSIGNED_BYTE,
-			image.data
-		);
-		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, this->id);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, layer, width, height, 1, format, GL_UNSIGNED_BYTE, data);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 #endif
-		this->next_layer++;
-	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 }
 
-uint16 TextureArray::add_texture(const char* path, const bool flip_v, const bool flip_h, const int layer) {
-	// Check if limit has been reached
-	if(this->num_layers >= this->max_layers) {
+std::vector<uint16> TextureArray::add_textures(const std::vector<TextureArray::Layer>& paths) {
+	if(this->compressed) {
+		throw ScarabError("Can't add uncompressed textures to a compressed texture array");
+	}
+
+	// Decoded and their mipmaps generated on worker threads
+	std::vector<MipChain> mips(paths.size());
+	ScarabThread::parallel_for(paths.size(), [&](const size_t begin, const size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			const TextureArray::Layer& layer = paths[i];
+			if(layer.path == nullptr) {
+				throw ScarabError("Texture has null path");
+			}
+
+			const Image image = Image(layer.path, layer.flip_v, layer.flip_h);
+			this->validate(image, layer.path);
+			mips[i] = MipChain(image, true, this->levels);
+		}
+	});
+
+	// Grows once for all of them, removed layers are used first
+	const size_t reused = std::min(this->free_layers.size(), paths.size());
+	const size_t needed = this->next_layer + (paths.size() - reused);
+	if(needed > this->max_layers) {
 		throw ScarabError("Texture array limit (%u) reached", this->max_layers);
 	}
+	if(needed > this->capacity) {
+		this->reserve(static_cast<uint32>(needed));
+	}
 
-	if(layer >= (int)this->max_layers) {
-		throw ScarabError("Layer (%i) exceeds limit (%u)", layer, this->max_layers);
+	std::vector<uint16> indices;
+	indices.reserve(paths.size());
+	for(const MipChain& chain : mips) {
+		indices.push_back(this->add_texture(chain));
 	}
+	return indices;
+}
 
-	if(path == nullptr) {
-		throw ScarabError("Texture has null path");
+bool TextureArray::remove_texture(const uint16 layer) noexcept {
+	if(!this->has_texture(layer)) {
+		return false;
 	}
 
-	Image* image = new Image(path, flip_v, flip_h);
-	if(image->data == nullptr) {
-		throw ScarabError("Image (%s) was not found", image->path);
+	this->used[layer] = false;
+	this->free_layers.push_back(layer);
+	this->num_layers--;
+	return true;
+}
+
+void TextureArray::reserve(const uint32 layers) {
+	if(layers <= this->capacity) {
+		return;
 	}
 
-	// Validate dimensions
-	if((image->width != (int)this->width) || (image->height != (int)this->height)) {
-		delete image;
-		throw ScarabError("Image (%s) dimensions (%ix%i) mismatch (%ix%i)i", path, this->width, this->height);
+	if(layers > this->max_layers) {
+		throw ScarabError("Texture array limit (%u) reached", this->max_layers);
 	}
 
-	// Validate channels
-	if(image->channels > (int)this->channels) {
-		throw ScarabError("(%s) Too many channels in image (%i > %i)", path, image->channels, this->channels);
+	if(this->compressed) {
+		throw ScarabError("Compressed texture arrays can't grow");
 	}
 
 #if !defined(BUILD_OPGL30)
-	glTextureSubImage3D(this->id,
-		0, // Mipmap level
-		// Put in specific layer or not (-1)
-		0, 0, (layer < 0) ? this->next_layer : layer, // x, y, layer (z)
-		this->width, this->height,
-		1, // Depth
-		TextureBase::extract_format(image->channels, false),
-		GL_UNSIGNED_BYTE,
-		image->data
+	const GLuint grown = this->create_storage(layers);
+
+	// Same sampling as before
+	for(const GLenum name : { GL_TEXTURE_MIN_FILTER, GL_TEXTURE_MAG_FILTER, GL_TEXTURE_WRAP_S, GL_TEXTURE_WRAP_T }) {
+		GLint value;
+		glGetTextureParameteriv(this->id, name, &value);
+		glTextureParameteri(grown, name, value);
+	}
+
+	// Layers are copied on the GPU, all levels. Layers never used are not copied
+	if(this->next_layer > 0) {
+		for(uint32 level = 0; level < this->levels; level++) {
+			glCopyImageSubData(
+				this->id, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+				grown,    GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+				std::max<GLsizei>(this->width >> level, 1), std::max<GLsizei>(this->height >> level, 1),
+				this->next_layer
+			);
+		}
+	}
+
+	glDeleteTextures(1, &this->id);
+	this->id        = grown;
+	this->capacity  = static_cast<uint16>(layers);
+	this->byte_size = TextureBase::storage_size(this->width, this->height, this->channels, this->levels) * layers;
+	this->used.resize(layers, false);
+#else
+	throw ScarabError("Texture array limit (%u) reached. Growing needs OpenGL 4.3+, not available with BUILD_OPGL30", this->capacity);
+#endif
+}
+
+
+GLuint TextureArray::create_storage(const uint32 layers) const noexcept {
+	GLuint texture;
+#if !defined(BUILD_OPGL30)
+	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+	glTextureStorage3D(texture,
+		this->levels, // All mipmap levels
+		TextureBase::extract_format(this->channels, true),
+		this->width, this->height, layers
 	);
 #else
-	glBindTexture(GL_TEXTURE_2D_ARRAY, this->id);
-	// Upload to texture array
-	glTexSubImage3D(
+	// Generate and bind texture
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+	// Allocate data
+	glTexStorage3D(
 		GL_TEXTURE_2D_ARRAY,
-		0, // Mipmap level
-		// Put in specific layer or not (-1)
-		0, 0, (layer < 0) ? this->next_texture : layer, // x, y, layer (z)
-		this->width, this->height, 1, // Width, Height, Depth
-		TextureBase::extract_format(image->channels, false),
-		GL_UNSIGNED_BYTE,
-		image->data
+		this->levels, // All mipmap levels
+		TextureBase::extract_format(this->channels, true),
+		(int)this->width, (int)this->height,
+		(int)layers
 	);
-	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 #endif
+	return texture;
+}
 
-	delete image;
+uint16 TextureArray::acquire_layer(const int layer) {
+	uint32 index;
+	if(layer >= 0) {
+		index = static_cast<uint32>(layer);
+	} else if(!this->free_layers.empty()) {
+		index = this->free_layers.back();
+		this->free_layers.pop_back();
+	} else {
+		index = this->next_layer;
+	}
 
-	// Only increment next texture if adding to the end
-	if(layer < 0) {
-		this->next_layer++;
+	if(index >= this->max_layers) {
+		throw ScarabError("Texture array limit (%u) reached", this->max_layers);
 	}
 
-	uint16 index = this->num_layers++; // Increment index
-	return index;
+	// Grows by doubling, so adding one by one does not copy every time
+	if(index >= this->capacity) {
+		this->reserve(std::clamp<uint32>(this->capacity * 2u, index + 1, this->max_layers));
+	}
+
+	if(index >= this->next_layer) {
+		// Skipped layers can be used later
+		for(uint32 skipped = this->next_layer; skipped < index; skipped++) {
+			this->free_layers.push_back(static_cast<uint16>(skipped));
+		}
+		this->next_layer = static_cast<uint16>(index + 1);
+	} else if(!this->used[index] && layer >= 0) {
+		// Chosen by the caller, not free anymore
+		this->free_layers.erase(std::find(this->free_layers.begin(), this->free_layers.end(), static_cast<uint16>(index)));
+	}
+
+	// Replacing a layer in use does not count it again
+	if(!this->used[index]) {
+		this->used[index] = true;
+		this->num_layers++;
+	}
+	return static_cast<uint16>(index);
 }
 
-uint16 TextureArray::add_textures(const std::vector<TextureArray::Layer>& paths) {
-	uint16 index = 0;
-	for(size_t i = 0; i < paths.size(); i++) {
-		const TextureArray::Layer& tex = paths[i];
-		index = this->add_texture(tex.path, tex.flip_v, tex.flip_h);
+void TextureArray::validate(const Image& image, const char* path) const {
+	if(image.data == nullptr) {
+		throw ScarabError("Image (%s) was not found", path);
 	}
-	this->generate_mipmap();
-	return index;
+
+	// Validate dimensions
+	if((image.width != (int)this->width) || (image.height != (int)this->height)) {
+		throw ScarabError("Image (%s) dimensions (%ix%i) mismatch (%ix%i)", path, image.width, image.height, this->width, this->height);
+	}
+
+	// Validate channels
+	if(image.channels > (int)this->channels) {
+		throw ScarabError("(%s) Too many channels in image (%i > %i)", path, image.channels, this->channels);
+	}
+}
+
+void TextureArray::init_layers(const uint32 capacity) noexcept {
+	GLint maxlayers;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxlayers);
+	this->max_layers = static_cast<uint16>(std::clamp<GLint>(maxlayers, 1, UINT16_MAX));
+	this->capacity   = static_cast<uint16>(std::clamp<uint32>(capacity, 1u, this->max_layers));
+	this->byte_size  = TextureBase::storage_size(this->width, this->height, this->channels, this->levels) * this->capacity;
+	this->used.assign(this->capacity, false);
+}
+
+void TextureArray::upload_layer(const MipChain& mips, const uint32 layer) {
+	const GLenum format = TextureBase::extract_format(mips.channels, false);
+	// Small levels of grayscale images have rows not 4 bytes aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	// Levels the array was not made with are skipped (e.g., a full chain added to an array without mipmaps)
+	const uint32 levels = std::min(mips.levels, this->levels);
+
+#if !defined(BUILD_OPGL30)
+	for(uint32 level = 0; level < levels; level++) {
+		glTextureSubImage3D(this->id,
+			level,
+			0, 0, layer, // x, y, layer (z)
+			mips.level_width(level), mips.level_height(level),
+			1, // Depth
+			format,
+			GL_UNSIGNED_BYTE,
+			mips.level(level)
+		);
+	}
+#else
+	glBindTexture(GL_TEXTURE_2D_ARRAY, this->id);
+	for(uint32 level = 0; level < levels; level++) {
+		glTexSubImage3D(
+			GL_TEXTURE_2D_ARRAY,
+			level,
+			0, 0, layer, // x, y, layer (z)
+			mips.level_width(level), mips.level_height(level), 1, // Width, Height, Depth
+			format,
+			GL_UNSIGNED_BYTE,
+			mips.level(level)
+		);
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+#endif
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 }
 
@@ -1,23 +1,31 @@
 #include "scarablib/gfx/texturebase.hpp"
 #include "scarablib/proper/error.hpp"
+#include "scarablib/utils/opengl.hpp"
+#include <algorithm>
 
 TextureBase::TextureBase(const GLint texturetype, const uint16 width, const uint16 height, const uint32 id) noexcept
 	: id(id), width(width), height(height), texturetype(texturetype) {}
 
 TextureBase::~TextureBase() noexcept {
-	glDeleteTextures(1, &this->id);
+	// The last reference may be released by a worker thread
+	ScarabOpenGL::submit([id = this->id]() {
+		glDeleteTextures(1, &id);
+	});
 }
 
 void TextureBase::set_filter(const TextureBase::Filter filter) const noexcept {
+	// Magnification can't use mipmaps
+	const GLint mag = (filter == Filter::LINEAR || filter == Filter::LINEAR_MIPMAP) ? GL_LINEAR : GL_NEAREST;
+
 #if !defined(BUILD_OPGL30)
 	glTextureParameteri(this->id, GL_TEXTURE_MIN_FILTER, (GLint)filter);
-	glTextureParameteri(this->id, GL_TEXTURE_MAG_FILTER, (GLint)filter);
+	glTextureParameteri(this->id, GL_TEXTURE_MAG_FILTER, mag);
 #else
 	this->bind();
 	// Nearest: Pixelate
 	// Linear: Blur
 	glTexParameteri(this->texturetype, GL_TEXTURE_MIN_FILTER, (GLint)filter);
-	glTexParameteri(this->texturetype, GL_TEXTURE_MAG_FILTER, (GLint)filter);
+	glTexParameteri(this->texturetype, GL_TEXTURE_MAG_FILTER, mag);
 	this->unbind();
 #endif
 }
@@ -51,3 +59,12 @@ uint32 TextureBase::extract_format(const uint8 num_channels, const bool internal
 	}
 }
 
+
+size_t TextureBase::storage_size(const uint32 width, const uint32 height, const uint8 channels, const uint32 levels) noexcept {
+	const size_t bpp = (channels == 3) ? 4 : channels;
+	size_t total = 0;
+	for(uint32 level = 0; level < levels; level++) {
+		total += static_cast<size_t>(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * bpp;
+	}
+	return total;
+}
@@ -0,0 +1,595 @@
+#include "scarablib/opengl/assetloader.hpp"
+#include "scarablib/gfx/image.hpp"
+#include "scarablib/gfx/mipchain.hpp"
+#include "scarablib/opengl/assets.hpp"
+#include "scarablib/proper/log.hpp"
+#include "scarablib/utils/model.hpp"
+#include "scarablib/utils/opengl.hpp"
+#include "scarablib/utils/thread.hpp"
+#include <chrono>
+#include <cstring>
+#include <unordered_set>
+
+// #define SCARAB_DEBUG_ASSET_LOADER
+
+// Ring of persistently mapped pixel buffer objects, one segment per frame.
+// A segment is reused only after the GPU finished reading it (checked with a fence, never waiting).
+// If the segment is still in use or full, data is uploaded straight from client memory
+class AssetLoader::StagingBuffer {
+	public:
+		static constexpr uint32 SEGMENTS = 3;
+
+		StagingBuffer(const size_t segment_size) : segment_size(segment_size) {
+		#if !defined(BUILD_OPGL30)
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glCreateBuffers(1, &this->id);
+			glNamedBufferStorage(this->id, static_cast<GLsizeiptr>(segment_size * SEGMENTS), nullptr, flags);
+			this->mapped = static_cast<uint8*>(glMapNamedBufferRange(this->id, 0, static_cast<GLsizeiptr>(segment_size * SEGMENTS), flags));
+			if(this->mapped == nullptr) {
+				LOG_WARNING("Failed to map staging buffer, textures will be uploaded without it");
+			}
+		#endif
+		}
+
+		~StagingBuffer() noexcept {
+		#if !defined(BUILD_OPGL30)
+			for(GLsync& fence : this->fences) {
+				if(fence != nullptr) {
+					glDeleteSync(fence);
+				}
+			}
+			if(this->mapped != nullptr) {
+				glUnmapNamedBuffer(this->id);
+			}
+			glDeleteBuffers(1, &this->id);
+		#endif
+		}
+
+		// Moves to the next segment
+		void begin_frame() noexcept {
+			this->current   = (this->current + 1) % SEGMENTS;
+			this->used      = 0;
+			this->available = (this->mapped != nullptr);
+
+		#if !defined(BUILD_OPGL30)
+			GLsync& fence = this->fences[this->current];
+			if(fence != nullptr) {
+				// Timeout 0, just checks
+				const GLenum result = glClientWaitSync(fence, 0, 0);
+				if(result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED) {
+					this->available = false;
+					return;
+				}
+				glDeleteSync(fence);
+				fence = nullptr;
+			}
+		#endif
+		}
+
+		// Puts a fence after the commands reading this segment
+		void end_frame() noexcept {
+		#if !defined(BUILD_OPGL30)
+			if(this->used > 0) {
+				this->fences[this->current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			}
+		#endif
+		}
+
+		// Returns where `size` bytes can be written inside the buffer.
+		// Returns SIZE_MAX if there is no space this frame
+		size_t reserve(const size_t size) noexcept {
+			if(!this->available || this->used + size > this->segment_size) {
+				return SIZE_MAX;
+			}
+			const size_t offset = this->current * this->segment_size + this->used;
+			// 4 bytes aligned, rows may be of any size
+			this->used += (size + 3) & ~size_t(3);
+			return offset;
+		}
+
+		inline uint8* data(const size_t offset) const noexcept {
+			return this->mapped + offset;
+		}
+
+		inline GLuint get_id() const noexcept {
+			return this->id;
+		}
+
+		inline size_t get_segment_size() const noexcept {
+			return this->segment_size;
+		}
+
+	private:
+		GLuint id       = 0;
+		uint8* mapped   = nullptr;
+		GLsync fences[SEGMENTS] = {};
+		size_t segment_size;
+		uint32 current  = 0;
+		size_t used     = 0;
+		bool available  = false;
+};
+
+
+namespace {
+	// Decoded texture waiting to be uploaded
+	struct TextureJob {
+		std::string path;
+		bool flip_v = false;
+		bool flip_h = false;
+		std::unique_ptr<MipChain> mips;
+		// Created on the first upload step
+		std::shared_ptr<Texture> texture;
+		// Next level and row to upload
+		uint32 level = 0;
+		uint32 row   = 0;
+	};
+
+	// Decoded model waiting to be uploaded
+	struct ModelJob {
+		std::string path;
+		VertexFormat format;
+		ScarabModel::ObjSource source;
+		std::vector<std::shared_ptr<TextureJob>> textures;
+		size_t next_texture = 0;
+		// Uploaded textures, keeps them in the Assets cache until `upload_obj` uses them
+		std::vector<std::shared_ptr<Texture>> loaded;
+	};
+
+	// Uploads as many rows as the budget allows, level by level.
+	// Returns true when the texture is complete and stored in the Assets cache
+	bool upload_texture(TextureJob& job, AssetLoader::Frame& frame) {
+		if(job.texture == nullptr) {
+			// Loaded by someone else while it was decoded
+			job.texture = Assets::find(job.path.c_str(), job.flip_v, job.flip_h);
+			if(job.texture != nullptr) {
+				job.mips.reset();
+				return true;
+			}
+
+			const MipChain& mips = *job.mips;
+			job.texture = std::make_shared<Texture>(mips.width, mips.height, mips.channels, true);
+		}
+
+		const MipChain& mips = *job.mips;
+		const GLenum format  = TextureBase::extract_format(mips.channels, false);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		while(job.level < mips.levels) {
+			const uint32 width    = mips.level_width(job.level);
+			const uint32 height   = mips.level_height(job.level);
+			const size_t row_size = static_cast<size_t>(width) * mips.channels;
+
+			size_t rows = frame.budget / row_size;
+			if(rows == 0 && frame.budget == frame.full) {
+				// Row bigger than the whole budget, would never be uploaded
+				rows = 1;
+			}
+			rows = std::min<size_t>(rows, height - job.row);
+			if(rows == 0) {
+				break;
+			}
+
+			const size_t size   = rows * row_size;
+			const uint8* pixels = mips.level(job.level) + job.row * row_size;
+
+		#if !defined(BUILD_OPGL30)
+			const size_t offset = (frame.staging != nullptr) ? frame.staging->reserve(size) : SIZE_MAX;
+			if(offset != SIZE_MAX) {
+				std::memcpy(frame.staging->data(offset), pixels, size);
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, frame.staging->get_id());
+				glTextureSubImage2D(job.texture->get_id(), job.level,
+					0, static_cast<GLint>(job.row),
+					width, static_cast<GLsizei>(rows),
+					format, GL_UNSIGNED_BYTE,
+					(const void*)(uintptr_t)offset
+				);
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			} else {
+				glTextureSubImage2D(job.texture->get_id(), job.level,
+					0, static_cast<GLint>(job.row),
+					width, static_cast<GLsizei>(rows),
+					format, GL_UNSIGNED_BYTE,
+					pixels
+				);
+			}
+		#else
+			glBindTexture(GL_TEXTURE_2D, job.texture->get_id());
+			if(job.level > 0 && job.row == 0) {
+				// Only level 0 is allocated by the texture
+				glTexImage2D(GL_TEXTURE_2D, job.level,
+					TextureBase::extract_format(mips.channels, true),
+					width, height, 0,
+					format, GL_UNSIGNED_BYTE,
+					nullptr
+				);
+			}
+			glTexSubImage2D(GL_TEXTURE_2D, job.level,
+				0, static_cast<GLint>(job.row),
+				width, static_cast<GLsizei>(rows),
+				format, GL_UNSIGNED_BYTE,
+				pixels
+			);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		#endif
+
+			frame.budget -= std::min(size, frame.budget);
+			job.row += static_cast<uint32>(rows);
+			if(job.row == height) {
+				job.row = 0;
+				job.level++;
+			}
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		if(job.level < mips.levels) {
+			return false;
+		}
+
+		// Texture was made with only level 0 in mind, it has all levels now
+	#if defined(BUILD_OPGL30)
+		glBindTexture(GL_TEXTURE_2D, job.texture->get_id());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mips.levels - 1);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	#endif
+		job.texture->set_filter((mips.levels > 1) ? TextureBase::Filter::NEAREST_MIPMAP : TextureBase::Filter::NEAREST);
+
+		Assets::store(job.path.c_str(), job.flip_v, job.flip_h, job.texture);
+		job.mips.reset();
+		return true;
+	}
+
+	// Decodes an image and generates its mipmaps, returns nullptr if it could not be loaded.
+	// - `cache`: Uses the mipmap cache, see `MipChain::load_cached`
+	std::unique_ptr<MipChain> decode_texture(const std::string& path, const bool flip_v, const bool flip_h, const bool cache) {
+		if(cache) {
+			try {
+				return std::make_unique<MipChain>(MipChain::load_cached(path.c_str(), flip_v, flip_h));
+			} catch(const std::exception&) {
+				return nullptr;
+			}
+		}
+
+		// Same arguments order as Assets::load
+		const Image image = Image(path.c_str(), flip_v, flip_h);
+		if(image.data == nullptr) {
+			return nullptr;
+		}
+		return std::make_unique<MipChain>(image);
+	}
+}
+
+
+AssetLoader::AssetLoader(const size_t upload_budget, const uint32 threads)
+	: upload_budget(std::max<size_t>(upload_budget, 1)) {
+
+	const uint32 count = (threads == 0) ? std::max<uint32>(ScarabThread::worker_count() - 1, 1) : threads;
+	this->workers.reserve(count);
+	for(uint32 i = 0; i < count; i++) {
+		this->workers.emplace_back(&AssetLoader::worker_loop, this);
+	}
+}
+
+AssetLoader::~AssetLoader() noexcept {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->job_condition.notify_all();
+	for(std::thread& worker : this->workers) {
+		worker.join();
+	}
+
+	// Workers are stopped, the queues are only used here.
+	// Assets not loaded yet fail, so their handles are not left Loading
+	try {
+		std::vector<Cancel> cancels;
+		cancels.reserve(this->jobs.size() + this->decoded.size() + this->uploads.size());
+		for(Job& job : this->jobs) {
+			cancels.push_back(std::move(job.cancel));
+		}
+		for(std::deque<Step>* steps : { &this->decoded, &this->uploads }) {
+			for(Step& step : *steps) {
+				cancels.push_back(std::move(step.cancel));
+			}
+		}
+		if(cancels.empty()) {
+			return;
+		}
+
+		// Handles are only used on the OpenGL thread
+		ScarabOpenGL::submit([cancels = std::move(cancels)]() {
+			for(const Cancel& cancel : cancels) {
+				cancel();
+			}
+		});
+		this->pending = 0;
+	} catch(const std::exception& err) {
+		LOG_ERROR("Failed to cancel the assets not loaded yet: %s", err.what());
+	}
+}
+
+
+AssetHandle<Texture> AssetLoader::load_texture(const char* path, const bool flip_v, const bool flip_h) {
+	AssetHandle<Texture> handle = AssetHandle<Texture>(Assets::default_texture());
+	if(path == nullptr) {
+		handle.fail("Texture path is null");
+		return handle;
+	}
+
+	// Already loaded, no need to decode
+	std::shared_ptr<Texture> cached = Assets::find(path, flip_v, flip_h);
+	if(cached != nullptr) {
+		handle.resolve(std::move(cached));
+		return handle;
+	}
+
+	auto job = std::make_shared<TextureJob>();
+	job->path   = path;
+	job->flip_v = flip_v;
+	job->flip_h = flip_h;
+	const bool cache = Assets::get_mipmap_cache();
+
+	this->pending++;
+	this->enqueue([job, handle, cache]() mutable -> Upload {
+		job->mips = decode_texture(job->path, job->flip_v, job->flip_h, cache);
+		if(job->mips == nullptr) {
+			const std::string error = "Image (" + job->path + ") was not found";
+			return [handle, error](Frame&) mutable {
+				handle.fail(error);
+				return true;
+			};
+		}
+
+		return [job, handle](Frame& frame) mutable {
+			try {
+				if(!upload_texture(*job, frame)) {
+					return false;
+				}
+				handle.resolve(job->texture);
+			} catch(const std::exception& err) {
+				handle.fail(err.what());
+			}
+			return true;
+		};
+	}, AssetLoader::cancel(handle));
+
+	return handle;
+}
+
+
+AssetHandle<Model> AssetLoader::load_model(const char* path, const VertexFormat format) {
+	AssetHandle<Model> handle = AssetHandle<Model>(nullptr);
+	if(path == nullptr) {
+		handle.fail("Model path is null");
+		return handle;
+	}
+
+	// Already loaded, the file is not read again
+	std::shared_ptr<ModelAsset> asset = ModelAsset::find(path, format);
+	if(asset != nullptr) {
+		handle.resolve(std::make_shared<Model>(std::move(asset)));
+		return handle;
+	}
+
+	auto job = std::make_shared<ModelJob>();
+	job->path   = path;
+	job->format = format;
+	const bool cache = Assets::get_mipmap_cache();
+
+	this->pending++;
+	this->enqueue([job, handle, cache]() mutable -> Upload {
+		// Another job may have loaded the same model while this one was queued
+		std::shared_ptr<ModelAsset> cached = ModelAsset::find(job->path.c_str(), job->format);
+		if(cached != nullptr) {
+			return [cached, handle](Frame&) mutable {
+				try {
+					handle.resolve(std::make_shared<Model>(std::move(cached)));
+				} catch(const std::exception& err) {
+					handle.fail(err.what());
+				}
+				return true;
+			};
+		}
+
+		try {
+			job->source = ScarabModel::read_obj(job->path.c_str());
+
+			// Textures may already be in the Assets cache, but it can only be checked on the OpenGL thread.
+			// They are decoded anyway and the upload is skipped if so
+			std::unordered_set<std::string> seen;
+			for(const std::string& texpath : job->source.texpaths) {
+				if(texpath.empty() || !seen.insert(texpath).second) {
+					continue;
+				}
+				auto texture = std::make_shared<TextureJob>();
+				texture->path  = texpath;
+				texture->mips = decode_texture(texpath, false, false, cache);
+				if(texture->mips == nullptr) {
+					throw ScarabError("Image (%s) was not found", texpath.c_str());
+				}
+				job->textures.push_back(std::move(texture));
+			}
+		} catch(const std::exception& err) {
+			const std::string error = err.what();
+			return [handle, error](Frame&) mutable {
+				handle.fail(error);
+				return true;
+			};
+		}
+
+		return [job, handle](Frame& frame) mutable {
+			try {
+				while(job->next_texture < job->textures.size()) {
+					TextureJob& texture = *job->textures[job->next_texture];
+					if(!upload_texture(texture, frame)) {
+						return false;
+					}
+					job->loaded.push_back(texture.texture);
+					job->next_texture++;
+				}
+
+				const ScarabModel::ObjSource& source = job->source;
+				const size_t size = source.vertex_count * sizeof(Vertex) + source.index_count * source.index_size;
+				if(size > frame.budget && frame.budget != frame.full) {
+					return false;
+				}
+				frame.budget -= std::min(size, frame.budget);
+
+				// Textures are found in the Assets cache
+				// Cached, so models loaded from the same file later share it
+				handle.resolve(std::make_shared<Model>(ModelAsset::store(job->path.c_str(), source, job->format)));
+			} catch(const std::exception& err) {
+				handle.fail(err.what());
+			}
+			return true;
+		};
+	}, AssetLoader::cancel(handle));
+
+	return handle;
+}
+
+
+AssetHandle<Skybox> AssetLoader::load_skybox(const Camera& camera, const char* path,
+		const Cubemap::Layout layout, const uint32 face_size) {
+
+	AssetHandle<Skybox> handle = AssetHandle<Skybox>(nullptr);
+	if(path == nullptr) {
+		handle.fail("Skybox path is null");
+		return handle;
+	}
+
+	auto cubemap = std::make_shared<Cubemap>();
+	const Camera* cameraptr = &camera;
+	const std::string source = path;
+
+	this->pending++;
+	this->enqueue([cubemap, handle, cameraptr, source, layout, face_size]() mutable -> Upload {
+		try {
+			*cubemap = Cubemap::load_cached(source.c_str(), layout, face_size);
+		} catch(const std::exception& err) {
+			const std::string error = err.what();
+			return [handle, error](Frame&) mutable {
+				handle.fail(error);
+				return true;
+			};
+		}
+
+		return [cubemap, handle, cameraptr](Frame& frame) mutable {
+			// All faces are uploaded at once
+			const size_t size = cubemap->total_size();
+			if(size > frame.budget && frame.budget != frame.full) {
+				return false;
+			}
+			frame.budget -= std::min(size, frame.budget);
+
+			try {
+				handle.resolve(std::make_shared<Skybox>(*cameraptr, *cubemap));
+			} catch(const std::exception& err) {
+				handle.fail(err.what());
+			}
+			*cubemap = Cubemap();
+			return true;
+		};
+	}, AssetLoader::cancel(handle));
+
+	return handle;
+}
+
+
+void AssetLoader::update() {
+	this->process(this->upload_budget);
+}
+
+void AssetLoader::finish() {
+	while(this->pending > 0) {
+		this->process(SIZE_MAX);
+		if(this->pending == 0) {
+			break;
+		}
+
+		// Everything decoded was uploaded, wait for the workers.
+		// Meanwhile runs the OpenGL calls other threads are waiting for (e.g., a streaming thread loading a texture)
+		std::unique_lock<std::mutex> lock(this->mutex);
+		while(!this->decoded_condition.wait_for(lock, std::chrono::milliseconds(1), [this]() {
+			return !this->decoded.empty();
+		})) {
+			lock.unlock();
+			ScarabOpenGL::run_commands();
+			lock.lock();
+		}
+	}
+}
+
+
+void AssetLoader::worker_loop() {
+	while(true) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->job_condition.wait(lock, [this]() {
+				return this->stopping || !this->jobs.empty();
+			});
+			if(this->stopping) {
+				return;
+			}
+			job = std::move(this->jobs.front());
+			this->jobs.pop_front();
+		}
+		this->push_decoded(Step { job.decode(), std::move(job.cancel) });
+	}
+}
+
+void AssetLoader::enqueue(std::function<Upload()> decode, Cancel cancel) {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->jobs.push_back(Job { std::move(decode), std::move(cancel) });
+	}
+	this->job_condition.notify_one();
+}
+
+void AssetLoader::push_decoded(Step step) {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->decoded.push_back(std::move(step));
+	}
+	this->decoded_condition.notify_one();
+}
+
+
+void AssetLoader::process(const size_t budget) {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		while(!this->decoded.empty()) {
+			this->uploads.push_back(std::move(this->decoded.front()));
+			this->decoded.pop_front();
+		}
+	}
+	if(this->uploads.empty()) {
+		return;
+	}
+
+#if !defined(BUILD_OPGL30)
+	// Created here so the loader can be made before the OpenGL context
+	if(this->staging == nullptr || this->staging->get_segment_size() < this->upload_budget) {
+		this->staging = std::make_unique<StagingBuffer>(this->upload_budget);
+	}
+	this->staging->begin_frame();
+#endif
+
+	Frame frame = { budget, budget, this->staging.get() };
+	while(!this->uploads.empty() && frame.budget > 0) {
+		if(!this->uploads.front().upload(frame)) {
+			break;
+		}
+		this->uploads.pop_front();
+		this->pending--;
+	}
+
+#if defined(SCARAB_DEBUG_ASSET_LOADER)
+	LOG_DEBUG("Uploaded %zu bytes, %zu assets pending", budget - frame.budget, this->pending);
+#endif
+
+	if(this->staging != nullptr) {
+		this->staging->end_frame();
+	}
+}
@@ -1,23 +1,39 @@
 #include "scarablib/opengl/assets.hpp"
 #include "scarablib/proper/log.hpp"
+#include "scarablib/utils/bcencoder.hpp"
 #include "scarablib/utils/hash.hpp"
+#include "scarablib/utils/opengl.hpp"
 #include "scarablib/window/window.hpp" // SDL_GL_GetCurrentContext
 
 // #define SCARAB_DEBUG_ASSETS_MANAGER
 
 Assets::Instance Assets::instance;
 
+std::shared_ptr<Texture> Assets::default_texture() noexcept {
+	{
+		std::lock_guard<std::mutex> lock(Assets::instance.def_mutex);
+		if(Assets::instance.def_tex != nullptr) {
+			return Assets::instance.def_tex;
+		}
+	}
+
+	// Not locked while uploading, a worker would hold the lock while waiting for the OpenGL thread
+	std::shared_ptr<Texture> texture = ScarabOpenGL::run_sync([]() {
+		return std::make_shared<Texture>();
+	});
+	std::lock_guard<std::mutex> lock(Assets::instance.def_mutex);
+	if(Assets::instance.def_tex == nullptr) {
+		Assets::instance.def_tex = std::move(texture);
+	}
+	return Assets::instance.def_tex;
+}
+
 std::shared_ptr<Texture> Assets::load(const char* path, const bool flip_v, const bool flip_h) noexcept {
 	if(path == nullptr) {
 		return Assets::default_texture();
 	}
 
-	// Theoretically raw-data textures and file textures can collide
-	// This "header" is added to prevent this collision
-	size_t hash = ScarabHash::hash_make(std::string_view("FILE_TEXTURE"));
-	ScarabHash::hash_combine(hash, std::string_view(path));
-	ScarabHash::hash_combine(hash, flip_v);
-	ScarabHash::hash_combine(hash, flip_h);
+	const size_t hash = Assets::file_hash(path, flip_v, flip_h);
 
 	// Chek if the texture is already compiled and cached
 	std::shared_ptr<Texture> texture = Assets::get_tex(hash);
@@ -29,10 +45,41 @@ std::shared_ptr<Texture> Assets::load(const char* path, const bool flip_v, const
 	LOG_DEBUG("NOT found/expired texture hash (%zu), compiling new", hash);
 #endif
 
-	Image image = Image(path, flip_v, flip_h);
-	texture = std::make_shared<Texture>(image);
-	Assets::instance.tex_cache[hash] = texture;
-	return texture;
+	// Decoded on the calling thread, only the upload is sent to the OpenGL thread
+	if(CompressedImage::is_compressed_file(path)) {
+		const CompressedImage image = CompressedImage(path);
+		texture = Assets::upload(image);
+	} else if(Assets::instance.mipmap_cache.load(std::memory_order_relaxed)) {
+		const MipChain mips = MipChain::load_cached(path, flip_v, flip_h);
+		texture = Assets::upload(mips);
+	} else {
+		const Image image = Image(path, flip_v, flip_h);
+		texture = Assets::upload(image);
+	}
+	// Another thread may have loaded the same file meanwhile
+	return Assets::instance.tex_cache.try_insert(hash, texture, { .gpu = texture->get_byte_size() });
+}
+
+std::shared_ptr<Texture> Assets::load(const char* path, const CompressedImage::Format format, const bool flip_v, const bool flip_h) noexcept {
+	if(path == nullptr) {
+		return Assets::default_texture();
+	}
+
+	size_t hash = Assets::file_hash(path, flip_v, flip_h);
+	ScarabHash::hash_combine(hash, static_cast<uint8>(format));
+
+	std::shared_ptr<Texture> texture = Assets::get_tex(hash);
+	if(texture != nullptr) {
+		return texture;
+	}
+
+#if defined(SCARAB_DEBUG_ASSETS_MANAGER)
+	LOG_DEBUG("NOT found/expired compressed texture hash (%zu), compiling new", hash);
+#endif
+
+	const CompressedImage image = ScarabBC::load_cached(path, format, flip_v, flip_h);
+	texture = Assets::upload(image);
+	return Assets::instance.tex_cache.try_insert(hash, texture, { .gpu = texture->get_byte_size() });
 }
 
 std::shared_ptr<Texture> Assets::load(const Image& image) noexcept {
@@ -46,7 +93,7 @@ std::shared_ptr<Texture> Assets::load(const Image& image) noexcept {
 	if(image.path) {
 		ScarabHash::hash_combine(hash, std::string_view(image.path));
 	} else {
-		ScarabHash::hash_combine(hash, ScarabHash::hash_bytes_fnv1a(image.data, image.byte_size()));
+		ScarabHash::hash_combine(hash, ScarabHash::hash_bytes(image.data, image.byte_size()));
 	}
 	// ScarabHash::hash_combine(hash, image.width);
 	// ScarabHash::hash_combine(hash, image.height);
@@ -62,28 +109,58 @@ std::shared_ptr<Texture> Assets::load(const Image& image) noexcept {
 	LOG_DEBUG("NOT found/expired texture hash (%zu), compiling new", hash);
 #endif
 
-	texture = std::make_shared<Texture>(image);
-	Assets::instance.tex_cache[hash] = texture;
-	return texture;
+	texture = Assets::upload(image);
+	return Assets::instance.tex_cache.try_insert(hash, texture, { .gpu = texture->get_byte_size() });
 }
 
-std::shared_ptr<Texture> Assets::get_tex(const size_t hash) {
-	// Check if Texture was cached already
-	auto it = Assets::instance.tex_cache.find(hash);
-	if(it == Assets::instance.tex_cache.end()) {
+std::shared_ptr<Texture> Assets::find(const char* path, const bool flip_v, const bool flip_h) noexcept {
+	if(path == nullptr) {
 		return nullptr;
 	}
+	return Assets::get_tex(Assets::file_hash(path, flip_v, flip_h));
+}
 
-	if(std::shared_ptr<Texture> tex = it->second.lock()) {
-	#if defined(SCARAB_DEBUG_ASSETS_MANAGER)
-		LOG_DEBUG("Found texture with hash: %zu", hash);
-	#endif
-		return tex; // Get Cache
+void Assets::store(const char* path, const bool flip_v, const bool flip_h, const std::shared_ptr<Texture>& texture) {
+	Assets::instance.tex_cache.insert(Assets::file_hash(path, flip_v, flip_h), texture, { .gpu = texture->get_byte_size() });
+}
+
+bool Assets::set_pinned(const char* path, const bool pinned, const bool flip_v, const bool flip_h) noexcept {
+	if(path == nullptr) {
+		return false;
 	}
+	return Assets::instance.tex_cache.set_pinned(Assets::file_hash(path, flip_v, flip_h), pinned);
+}
+
+void Assets::trim() noexcept {
+	Assets::instance.tex_cache.trim();
+	Assets::instance.texarr_cache.trim();
+}
+
+size_t Assets::file_hash(const char* path, const bool flip_v, const bool flip_h) noexcept {
+	// Theoretically raw-data textures and file textures can collide
+	// This "header" is added to prevent this collision
+	size_t hash = ScarabHash::hash_make(std::string_view("FILE_TEXTURE"));
+	ScarabHash::hash_combine(hash, std::string_view(path));
+	ScarabHash::hash_combine(hash, flip_v);
+	ScarabHash::hash_combine(hash, flip_h);
+	return hash;
+}
 
-	// weak_ptr expired, remove entry
-	Assets::instance.tex_cache.erase(it);
-	return nullptr;
+template <typename Source>
+std::shared_ptr<Texture> Assets::upload(const Source& source) {
+	return ScarabOpenGL::run_sync([&source]() {
+		return std::make_shared<Texture>(source);
+	});
+}
+
+std::shared_ptr<Texture> Assets::get_tex(const size_t hash) {
+	std::shared_ptr<Texture> tex = Assets::instance.tex_cache.find(hash);
+#if defined(SCARAB_DEBUG_ASSETS_MANAGER)
+	if(tex != nullptr) {
+		LOG_DEBUG("Found texture with hash: %zu", hash);
+	}
+#endif
+	return tex;
 }
 
 void Assets::cleanup() noexcept {
@@ -92,8 +169,9 @@ void Assets::cleanup() noexcept {
 		LOG_WARNING_FN("Called without a valid OpenGL context. Leaking GPU resources");
 		return;
 	}
-	// Has no effect since its called implicitly, but i like to have them here
+	// Caches hold the last references of unused textures, release them while the context is valid
 	Assets::instance.tex_cache.clear();
 	Assets::instance.texarr_cache.clear();
-	// Assets::instance.def_tex.reset();
+	std::lock_guard<std::mutex> lock(Assets::instance.def_mutex);
+	Assets::instance.def_tex.reset();
 }
@@ -0,0 +1,475 @@
+#include "scarablib/opengl/geometrypool.hpp"
+#include "scarablib/opengl/vertexpuller.hpp"
+#include "scarablib/proper/error.hpp"
+#include "scarablib/proper/log.hpp"
+#include "scarablib/utils/opengl.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+// #define SCARAB_DEBUG_GEOMETRY_POOL
+
+namespace {
+	// Ranges released by other threads, linked by `GeometryRange::next_released`
+	std::atomic<GeometryRange*> released = nullptr;
+
+	// Index blocks are aligned to the biggest index type, so any type can start at any block
+	constexpr size_t INDEX_ALIGNMENT = sizeof(uint32);
+
+	inline size_t align_index_bytes(const size_t size) noexcept {
+		return (size + INDEX_ALIGNMENT - 1) & ~(INDEX_ALIGNMENT - 1);
+	}
+
+	// Capacity doubled until `needed` fits
+	inline size_t grow_capacity(size_t capacity, const size_t needed) noexcept {
+		capacity = std::max<size_t>(capacity, 1);
+		while(capacity < needed) {
+			capacity *= 2;
+		}
+		return capacity;
+	}
+
+	GLuint create_buffer(const size_t size) noexcept {
+		GLuint buffer = 0;
+	#if !defined(BUILD_OPGL30)
+		glCreateBuffers(1, &buffer);
+		// Immutable storage, only written using glNamedBufferSubData and copies
+		glNamedBufferStorage(buffer, static_cast<GLsizeiptr>(size), nullptr, GL_DYNAMIC_STORAGE_BIT);
+	#else
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(size), nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	#endif
+		return buffer;
+	}
+
+	void write_buffer(const GLuint buffer, const size_t offset, const size_t size, const void* data) noexcept {
+	#if !defined(BUILD_OPGL30)
+		glNamedBufferSubData(buffer, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size), data);
+	#else
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size), data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	#endif
+	}
+
+	void copy_buffer(const GLuint source, const GLuint destination,
+			const size_t source_offset, const size_t destination_offset, const size_t size) noexcept {
+	#if !defined(BUILD_OPGL30)
+		glCopyNamedBufferSubData(source, destination, static_cast<GLintptr>(source_offset),
+			static_cast<GLintptr>(destination_offset), static_cast<GLsizeiptr>(size));
+	#else
+		glBindBuffer(GL_COPY_READ_BUFFER, source);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(source_offset),
+			static_cast<GLintptr>(destination_offset), static_cast<GLsizeiptr>(size));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	#endif
+	}
+
+	// Joins copies of ranges that are next to each other in both buffers
+	struct CopyBatch {
+		GLuint source;
+		GLuint destination;
+		size_t source_offset      = 0;
+		size_t destination_offset = 0;
+		size_t size               = 0;
+
+		void add(const size_t from, const size_t to, const size_t length) noexcept {
+			if(this->size > 0 && from == this->source_offset + this->size && to == this->destination_offset + this->size) {
+				this->size += length;
+				return;
+			}
+			this->flush();
+			this->source_offset      = from;
+			this->destination_offset = to;
+			this->size               = length;
+		}
+
+		void flush() noexcept {
+			if(this->size > 0) {
+				copy_buffer(this->source, this->destination, this->source_offset, this->destination_offset, this->size);
+				this->size = 0;
+			}
+		}
+	};
+}
+
+
+void GeometryPool::FreeList::reset(const size_t capacity, const size_t used) noexcept {
+	this->blocks.clear();
+	this->total     = capacity;
+	this->available = capacity - used;
+	if(this->available > 0) {
+		this->blocks.push_back({ used, this->available });
+	}
+}
+
+size_t GeometryPool::FreeList::allocate(const size_t size) noexcept {
+	// Best fit, keeps big blocks for big meshes
+	size_t best = this->blocks.size();
+	for(size_t i = 0; i < this->blocks.size(); i++) {
+		if(this->blocks[i].size >= size && (best == this->blocks.size() || this->blocks[i].size < this->blocks[best].size)) {
+			best = i;
+			if(this->blocks[i].size == size) {
+				break;
+			}
+		}
+	}
+
+	if(best == this->blocks.size()) {
+		return SIZE_MAX;
+	}
+
+	Block& block = this->blocks[best];
+	const size_t offset = block.offset;
+	block.offset += size;
+	block.size   -= size;
+	if(block.size == 0) {
+		this->blocks.erase(this->blocks.begin() + static_cast<std::ptrdiff_t>(best));
+	}
+	this->available -= size;
+	return offset;
+}
+
+void GeometryPool::FreeList::free(const size_t offset, const size_t size) noexcept {
+	if(size == 0) {
+		return;
+	}
+	this->available += size;
+
+	// First block after the freed space
+	auto next = std::lower_bound(this->blocks.begin(), this->blocks.end(), offset,
+		[](const Block& block, const size_t value) { return block.offset < value; });
+
+	// Join with the previous block
+	if(next != this->blocks.begin()) {
+		auto prev = next - 1;
+		if(prev->offset + prev->size == offset) {
+			prev->size += size;
+			// Previous block now touches the next one
+			if(next != this->blocks.end() && prev->offset + prev->size == next->offset) {
+				prev->size += next->size;
+				this->blocks.erase(next);
+			}
+			return;
+		}
+	}
+
+	// Join with the next block
+	if(next != this->blocks.end() && offset + size == next->offset) {
+		next->offset = offset;
+		next->size  += size;
+		return;
+	}
+
+	// Reserved for one more block than live ranges, should not allocate
+	try {
+		this->blocks.insert(next, { offset, size });
+	} catch(...) {
+		// Lost until the pool is packed again
+		this->available -= size;
+	}
+}
+
+
+void GeometryPool::init(const size_t vertex_capacity, const size_t index_capacity) {
+	if(this->stride == 0) {
+		throw ScarabError("GeometryPool layout has no attributes");
+	}
+
+	const size_t vcapacity = std::max<size_t>(vertex_capacity, 1);
+	const size_t icapacity = align_index_bytes(std::max(index_capacity, INDEX_ALIGNMENT));
+
+#if !defined(BUILD_OPGL30)
+	glCreateVertexArrays(1, &this->vao_id);
+#else
+	glGenVertexArrays(1, &this->vao_id);
+#endif
+	this->vbo_id = create_buffer(vcapacity * this->stride);
+	this->ebo_id = create_buffer(icapacity);
+	this->vertex_free.reset(vcapacity, 0);
+	this->index_free.reset(icapacity, 0);
+	this->link_buffers();
+
+	GL_CHECK();
+}
+
+GeometryPool::~GeometryPool() noexcept {
+	// Ranges still alive just stop pointing to this pool
+	for(GeometryRange* range : this->ranges) {
+		range->pool = nullptr;
+	}
+
+	glDeleteBuffers(1, &this->ebo_id);
+	glDeleteBuffers(1, &this->vbo_id);
+	glDeleteVertexArrays(1, &this->vao_id);
+}
+
+void GeometryPool::link_buffers() const noexcept {
+#if !defined(BUILD_OPGL30)
+	// All attributes read from binding 0
+	glVertexArrayVertexBuffer(this->vao_id, 0, this->vbo_id, 0, static_cast<GLsizei>(this->stride));
+	glVertexArrayElementBuffer(this->vao_id, this->ebo_id);
+
+	for(uint32 i = 0; i < this->attributes.size(); i++) {
+		const VertexAttribute& attribute = this->attributes[i];
+		const bool isinteger = (attribute.type != GL_FLOAT && attribute.type != GL_HALF_FLOAT
+			&& attribute.type != GL_DOUBLE && !attribute.normalized);
+
+		glEnableVertexArrayAttrib(this->vao_id, i);
+		if(isinteger) {
+			glVertexArrayAttribIFormat(this->vao_id, i, static_cast<GLint>(attribute.count),
+				attribute.type, attribute.offset);
+		} else {
+			glVertexArrayAttribFormat(this->vao_id, i, static_cast<GLint>(attribute.count),
+				attribute.type, attribute.normalized, attribute.offset);
+		}
+		glVertexArrayAttribBinding(this->vao_id, i, 0);
+	}
+
+#else
+	// Attribute pointers keep the buffer bound when they are set, so they are set again for a new buffer
+	glBindVertexArray(this->vao_id);
+	glBindBuffer(GL_ARRAY_BUFFER, this->vbo_id);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ebo_id);
+
+	for(uint32 i = 0; i < this->attributes.size(); i++) {
+		const VertexAttribute& attribute = this->attributes[i];
+		const bool isinteger = (attribute.type != GL_FLOAT && attribute.type != GL_HALF_FLOAT
+			&& attribute.type != GL_DOUBLE && !attribute.normalized);
+
+		glEnableVertexAttribArray(i);
+		if(isinteger) {
+			glVertexAttribIPointer(i, static_cast<GLint>(attribute.count), attribute.type,
+				static_cast<GLsizei>(this->stride), reinterpret_cast<void*>((uintptr_t)attribute.offset));
+		} else {
+			glVertexAttribPointer(i, static_cast<GLint>(attribute.count), attribute.type, attribute.normalized,
+				static_cast<GLsizei>(this->stride), reinterpret_cast<void*>((uintptr_t)attribute.offset));
+		}
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+#endif
+}
+
+
+std::shared_ptr<GeometryRange> GeometryPool::allocate(const void* vertices, const size_t vertex_count,
+		const void* indices, const size_t index_count, const uint32 index_size, const size_t hash) {
+
+	if(vertices == nullptr || vertex_count == 0) {
+		throw ScarabError("Vertices are empty for GeometryPool allocation");
+	}
+
+	if(indices == nullptr || index_count == 0) {
+		throw ScarabError("Indices are empty for GeometryPool allocation");
+	}
+
+	if(index_size != sizeof(uint8) && index_size != sizeof(uint16) && index_size != sizeof(uint32)) {
+		throw ScarabError("Invalid index size (%u) for GeometryPool allocation", index_size);
+	}
+
+	// -- CHECK IF CACHED
+	if(hash != 0) {
+		std::shared_ptr<GeometryRange> cached = this->get_range(hash);
+		if(cached != nullptr) {
+			return cached;
+		}
+	}
+
+	const size_t index_bytes = align_index_bytes(index_count * index_size);
+
+	// -- FIND SPACE
+	size_t voffset = this->vertex_free.allocate(vertex_count);
+	size_t ioffset = this->index_free.allocate(index_bytes);
+
+	if(voffset == SIZE_MAX || ioffset == SIZE_MAX) {
+		if(voffset != SIZE_MAX) {
+			this->vertex_free.free(voffset, vertex_count);
+		}
+		if(ioffset != SIZE_MAX) {
+			this->index_free.free(ioffset, index_bytes);
+		}
+
+		// Packing joins all free space at the end, only grow if the total free space is not enough
+		const size_t vcapacity = (this->vertex_free.free_space() >= vertex_count)
+			? this->vertex_capacity()
+			: grow_capacity(this->vertex_capacity(), this->used_vertices() + vertex_count);
+		const size_t icapacity = (this->index_free.free_space() >= index_bytes)
+			? this->index_capacity()
+			: grow_capacity(this->index_capacity(), this->used_index_bytes() + index_bytes);
+
+		this->relocate(vcapacity, icapacity);
+		voffset = this->vertex_free.allocate(vertex_count);
+		ioffset = this->index_free.allocate(index_bytes);
+	}
+
+	// -- UPLOAD
+	write_buffer(this->vbo_id, voffset * this->stride, vertex_count * this->stride, vertices);
+	write_buffer(this->ebo_id, ioffset, index_count * index_size, indices);
+
+	// Free blocks are never more than the ranges plus one, so releasing a range never allocates
+	this->vertex_free.reserve(this->ranges.size() + 2);
+	this->index_free.reserve(this->ranges.size() + 2);
+	this->ranges.reserve(this->ranges.size() + 1);
+
+	GeometryRange* range = new GeometryRange();
+	range->pool         = this;
+	range->base_vertex  = static_cast<uint32>(voffset);
+	range->vertex_count = static_cast<uint32>(vertex_count);
+	range->index_offset = ioffset;
+	range->index_count  = static_cast<uint32>(index_count);
+	range->index_size   = index_size;
+	range->index_type   = ScarabOpenGL::index_type(index_size);
+	range->hash         = hash;
+	range->slot         = this->ranges.size();
+	this->ranges.push_back(range);
+
+	std::shared_ptr<GeometryRange> output = std::shared_ptr<GeometryRange>(range, GeometryPool::destroy_range);
+	if(hash != 0) {
+		this->range_cache[hash] = output;
+	}
+
+#if defined(SCARAB_DEBUG_GEOMETRY_POOL)
+	LOG_DEBUG("GeometryPool %u: %zu vertices at %zu, %zu indices at byte %zu",
+		this->vao_id, vertex_count, voffset, index_count, ioffset);
+#endif
+
+	GL_CHECK();
+	return output;
+}
+
+
+std::shared_ptr<GeometryRange> GeometryPool::get_range(const size_t hash) noexcept {
+	auto it = this->range_cache.find(hash);
+	if(it == this->range_cache.end()) {
+		return nullptr;
+	}
+
+	if(std::shared_ptr<GeometryRange> cache = it->second.lock()) {
+		return cache;
+	}
+
+	// weak_ptr expired, remove entry
+	this->range_cache.erase(it);
+	return nullptr;
+}
+
+
+void GeometryPool::defragment() {
+	this->relocate(this->vertex_capacity(), this->index_capacity());
+}
+
+
+void GeometryPool::relocate(const size_t vertex_capacity, const size_t index_capacity) {
+#if defined(SCARAB_DEBUG_GEOMETRY_POOL)
+	LOG_DEBUG("GeometryPool %u: relocating %zu ranges to %zu vertices and %zu index bytes",
+		this->vao_id, this->ranges.size(), vertex_capacity, index_capacity);
+#endif
+
+	const GLuint newvbo = create_buffer(vertex_capacity * this->stride);
+	const GLuint newebo = create_buffer(index_capacity);
+
+	// Ranges keep their order, meshes loaded together stay together
+	std::vector<GeometryRange*> sorted = this->ranges;
+	std::sort(sorted.begin(), sorted.end(), [](const GeometryRange* a, const GeometryRange* b) {
+		return a->base_vertex < b->base_vertex;
+	});
+
+	CopyBatch vcopy = { .source = this->vbo_id, .destination = newvbo };
+	CopyBatch icopy = { .source = this->ebo_id, .destination = newebo };
+	size_t vertex_end = 0;
+	size_t index_end  = 0;
+
+	for(GeometryRange* range : sorted) {
+		const size_t index_bytes = align_index_bytes(static_cast<size_t>(range->index_count) * range->index_size);
+
+		vcopy.add(static_cast<size_t>(range->base_vertex) * this->stride, vertex_end * this->stride,
+			static_cast<size_t>(range->vertex_count) * this->stride);
+		icopy.add(range->index_offset, index_end, index_bytes);
+
+		range->base_vertex  = static_cast<uint32>(vertex_end);
+		range->index_offset = index_end;
+		vertex_end += range->vertex_count;
+		index_end  += index_bytes;
+	}
+	vcopy.flush();
+	icopy.flush();
+
+	glDeleteBuffers(1, &this->vbo_id);
+	glDeleteBuffers(1, &this->ebo_id);
+	this->vbo_id = newvbo;
+	this->ebo_id = newebo;
+	this->link_buffers();
+	// Old IDs may be given to new buffers
+	VertexPuller::reset_bindings();
+
+	this->vertex_free.reset(vertex_capacity, vertex_end);
+	this->index_free.reset(index_capacity, index_end);
+
+	GL_CHECK();
+}
+
+
+void GeometryPool::release(GeometryRange* range) noexcept {
+	this->vertex_free.free(range->base_vertex, range->vertex_count);
+	this->index_free.free(range->index_offset, align_index_bytes(static_cast<size_t>(range->index_count) * range->index_size));
+
+	// Swap with the last range
+	GeometryRange* last = this->ranges.back();
+	last->slot = range->slot;
+	this->ranges[range->slot] = last;
+	this->ranges.pop_back();
+
+	// The entry may already be of a newer range with the same hash, made while this one waited for the OpenGL thread.
+	// This range expired before being released, so only an expired entry can be its
+	if(range->hash != 0) {
+		auto it = this->range_cache.find(range->hash);
+		if(it != this->range_cache.end() && it->second.expired()) {
+			this->range_cache.erase(it);
+		}
+	}
+}
+
+
+void GeometryPool::destroy_range(GeometryRange* range) noexcept {
+	// Pools are only used by the OpenGL thread, the last Model using the range may be released by a worker
+	if(!ScarabOpenGL::is_context_thread()) {
+		GeometryRange* head = released.load(std::memory_order_relaxed);
+		do {
+			range->next_released = head;
+		} while(!released.compare_exchange_weak(head, range, std::memory_order_release, std::memory_order_relaxed));
+
+		// Only the first range of the list queues a command, it destroys all of them
+		if(head == nullptr) {
+			try {
+				ScarabOpenGL::submit(&GeometryPool::destroy_released);
+			} catch(...) {
+				// Out of memory, the list is destroyed the next time a range is released on the OpenGL thread
+			}
+		}
+		return;
+	}
+
+	GeometryPool::destroy_released();
+	if(range->pool != nullptr) {
+		range->pool->release(range);
+	}
+	delete range;
+}
+
+void GeometryPool::destroy_released() noexcept {
+	GeometryRange* range = released.exchange(nullptr, std::memory_order_acquire);
+	while(range != nullptr) {
+		GeometryRange* next = range->next_released;
+		if(range->pool != nullptr) {
+			range->pool->release(range);
+		}
+		delete range;
+		range = next;
+	}
+}
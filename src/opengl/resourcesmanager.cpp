@@ -1,21 +1,53 @@
 #include "scarablib/opengl/resourcesmanager.hpp"
 #include "scarablib/opengl/shaders.hpp"
 #include "scarablib/proper/log.hpp"
+#include "scarablib/utils/hash.hpp"
+#include "scarablib/utils/opengl.hpp"
 #include "scarablib/window/window.hpp" // SDL_GL_GetCurrentContext
+#include <cstring>
+#include <iterator>
 // Please keep this so in the future if i want to change SDL version i will just need to rename in one file
 
+namespace {
+	// Hashes of the built-in sources, made at compile time
+	struct BuiltinSource {
+		const char* source;
+		size_t hash;
+	};
+
+	constexpr BuiltinSource builtin_source(const char* source) noexcept {
+		return BuiltinSource { source, static_cast<size_t>(ScarabHash::hash_const(source)) };
+	}
+
+	// Vertex and fragment shader of each `ResourcesManager::Program`
+	constexpr BuiltinSource BUILTIN_PROGRAMS[][2] = {
+		{ builtin_source(Shaders::DEFAULT_VERTEX),   builtin_source(Shaders::DEFAULT_FRAGMENT) },
+		{ builtin_source(Shaders::DEFAULT_VERTEX2D), builtin_source(Shaders::DEFAULT_FRAGMENT) },
+	#if !defined(BUILD_OPGL30)
+		{ builtin_source(Shaders::PULL_VERTEX),      builtin_source(Shaders::DEFAULT_FRAGMENT) },
+	#else
+		{ BuiltinSource { nullptr, 0 },              BuiltinSource { nullptr, 0 } },
+	#endif
+		{ builtin_source(Shaders::SKYBOX_VERTEX),    builtin_source(Shaders::SKYBOX_FRAGMENT) },
+		{ builtin_source(Shaders::BILLBOARD_VERTEX), builtin_source(Shaders::DEFAULT_FRAGMENT) },
+		{ builtin_source(Shaders::TEXT_VERTEX),      builtin_source(Shaders::FONT_FRAGMENT) },
+		{ builtin_source(Shaders::TEXT_VERTEX),      builtin_source(Shaders::FONT_SDF_FRAGMENT) },
+	};
+	static_assert(std::size(BUILTIN_PROGRAMS) == static_cast<size_t>(ResourcesManager::Program::COUNT));
+}
+
 std::shared_ptr<ShaderProgram> ResourcesManager::load_shader_program(const std::vector<ResourcesManager::ShaderInfo>& infos) {
 	if(infos.empty()) {
 		throw ScarabError("No shader info provided to create a program");
 	}
 
-	// Creates a temporary vector of ShaderInfo to pass to the constructor.
-	// This vector is now holding the owner of all shader's IDs
-	// but inside the ShaderProgram's constructor this ownership is moved (not explicitly)
-	std::vector<std::shared_ptr<Shader>> shaders;
-	shaders.reserve(infos.size());
+	// Sources with the user code injected, kept alive until compiled.
+	// Reserved so the strings never move
+	std::vector<std::string> custom_sources;
+	custom_sources.reserve(infos.size());
+	std::vector<HashedSource> sources;
+	sources.reserve(infos.size());
 
-	size_t combined_hash = 0; // To check if program exist
 	// -- VALIDATE SHADERS
 	for(const ResourcesManager::ShaderInfo& info : infos) {
 		if(info.source == nullptr) {
@@ -28,26 +60,36 @@ std::shared_ptr<ShaderProgram> ResourcesManager::load_shader_program(const std::
 
 		// TODO: Support Vertex shader too
 		// Inject custom shader
-		std::string source = info.source; // std::string to void memory erros inside if-check
+		const char* source = info.source;
 		if(info.iscustom) {
-			source = std::string(Shaders::DEFAULT_FRAGMENT);
+			std::string injected = std::string(Shaders::DEFAULT_FRAGMENT);
 			std::string placeholder = "// {{USER_CODE}}";
-			source.replace(
+			injected.replace(
 				// Find substring
-				source.find(placeholder),
+				injected.find(placeholder),
 				// Size
 				placeholder.length(),
 				// Replace with
 				// "#define HAS_USER_SHADER\n#ifdef HAS_USER_SHADER\n" + std::string(info.source) + "\n#endif"
 				"#define HAS_USER_SHADER" + std::string(info.source)
 			);
+			custom_sources.emplace_back(std::move(injected));
+			source = custom_sources.back().c_str();
 		}
-		shaders.emplace_back(this->get_or_compile_shader(source.c_str(), info.type));
-		ScarabHash::hash_combine(combined_hash, ScarabHash::hash_make(std::string_view(source)));
+		sources.push_back(HashedSource { source, info.type, static_cast<size_t>(ScarabHash::hash_const(source)) });
+	}
+
+	return this->load_shader_program(sources.data(), sources.size());
+}
+
+std::shared_ptr<ShaderProgram> ResourcesManager::load_shader_program(const HashedSource* sources, const size_t count) {
+	size_t combined_hash = 0; // To check if program exist
+	for(size_t i = 0; i < count; i++) {
+		ScarabHash::hash_combine(combined_hash, sources[i].hash);
 	}
 
 	// -- CHECK COMBINED HASHES
-	// Check if the program is already cached
+	// Check if the program is already cached, before compiling any shader
 	std::shared_ptr<ShaderProgram> program = this->get_program(combined_hash);
 	if(program != nullptr) {
 		return program;
@@ -57,17 +99,60 @@ std::shared_ptr<ShaderProgram> ResourcesManager::load_shader_program(const std::
 	LOG_DEBUG(
 		"Not Found/Expired shader program hash: %zu \nVertex Shader: \n%s \nFragment Shader: \n%s",
 		combined_hash,
-		infos[0].source,
-		infos[1].source
+		sources[0].source,
+		(count > 1) ? sources[1].source : ""
 	);
 #endif
 
+	// Creates a temporary vector of shaders to pass to the constructor.
+	// This vector is now holding the owner of all shader's IDs
+	// but inside the ShaderProgram's constructor this ownership is moved (not explicitly)
+	std::vector<std::shared_ptr<Shader>> shaders;
+	shaders.reserve(count);
+	for(size_t i = 0; i < count; i++) {
+		shaders.emplace_back(this->get_or_compile_shader(sources[i].source, sources[i].type, sources[i].hash));
+	}
+
 	// -- CREATE PROGRAM
-	// Create the ShaderProgram and cache it
-	program = std::make_shared<ShaderProgram>(shaders);
+	// Create the ShaderProgram (linked by the OpenGL thread) and cache it
+	program = ScarabOpenGL::run_sync([&shaders]() {
+		return std::make_shared<ShaderProgram>(shaders);
+	});
 	program->hash = combined_hash;
-	this->program_cache[combined_hash] = program;
-	return program;
+	// Another thread may have linked the same one meanwhile
+	return this->program_cache.try_insert(combined_hash, program);
+}
+
+const std::shared_ptr<ShaderProgram>& ResourcesManager::builtin_program(const Program program) {
+	const uint8 index = static_cast<uint8>(program);
+	if(index >= static_cast<uint8>(Program::COUNT)) {
+		throw ScarabError("Invalid built-in program (%u)", index);
+	}
+
+	std::shared_ptr<ShaderProgram>& cached = this->builtin_programs[index];
+	{
+		std::lock_guard<std::mutex> lock(this->builtin_mutex);
+		if(cached != nullptr) {
+			return cached;
+		}
+	}
+
+	const BuiltinSource (&builtin)[2] = BUILTIN_PROGRAMS[index];
+	if(builtin[0].source == nullptr) {
+		throw ScarabError("Built-in program (%u) needs OpenGL 4.3+, not available with BUILD_OPGL30", index);
+	}
+	const HashedSource sources[2] = {
+		{ builtin[0].source, Shader::Type::Vertex,   builtin[0].hash },
+		{ builtin[1].source, Shader::Type::Fragment, builtin[1].hash },
+	};
+	// Not locked while compiling, a worker would hold the lock while waiting for the OpenGL thread.
+	// Threads compiling it at the same time get the same program from the cache
+	std::shared_ptr<ShaderProgram> loaded = this->load_shader_program(sources, 2);
+	std::lock_guard<std::mutex> lock(this->builtin_mutex);
+	if(cached == nullptr) {
+		cached = std::move(loaded);
+	}
+	return cached;
 }
 
 
@@ -86,7 +171,9 @@ std::shared_ptr<VertexArray> ResourcesManager::acquire_vertexarray(const void* d
 	LOG_DEBUG("Hash %zu not found. Creating new VAO.", hash);
 #endif
 
-	vertexarray = std::make_shared<VertexArray>(data, capacity, vertex_size, dynamic_vertex);
+	vertexarray = ScarabOpenGL::run_sync([&]() {
+		return std::make_shared<VertexArray>(data, capacity, vertex_size, dynamic_vertex);
+	});
 
 #if defined(SCARAB_DEBUG_VERTEXARRAY_MANAGER)
 	LOG_DEBUG("VAO ID made: %zu", vertexarray->get_vaoid());
@@ -94,8 +181,36 @@ std::shared_ptr<VertexArray> ResourcesManager::acquire_vertexarray(const void* d
 #endif
 
 	vertexarray->hash = hash;
-	this->vertexarray_cache[hash] = vertexarray;
-	return vertexarray;
+	// Another thread may have made the same one meanwhile
+	return this->vertexarray_cache.try_insert(hash, vertexarray, { .gpu = capacity });
+}
+
+
+std::shared_ptr<VertexArray> ResourcesManager::acquire_vertexarray(const void* vertices, const size_t vertex_count,
+		const size_t vertex_size, const void* indices, const size_t index_count,
+		const uint32 index_size, const size_t hash) noexcept {
+	// -- CHECK IF CACHED
+
+	std::shared_ptr<VertexArray> vertexarray = this->get_vertexarray(hash);
+	if(vertexarray != nullptr) {
+	#if defined(SCARAB_DEBUG_VERTEXARRAY_MANAGER)
+		LOG_DEBUG("Hash %zu found! Reusing VAO.", hash);
+	#endif
+		return vertexarray; // Return the existing entry
+	}
+
+#if defined(SCARAB_DEBUG_VERTEXARRAY_MANAGER)
+	LOG_DEBUG("Hash %zu not found. Creating new VAO.", hash);
+#endif
+
+	vertexarray = ScarabOpenGL::run_sync([&]() {
+		return std::make_shared<VertexArray>(vertices, vertex_count, vertex_size,
+			indices, index_count, index_size);
+	});
+
+	vertexarray->hash = hash;
+	// Another thread may have made the same one meanwhile
+	return this->vertexarray_cache.try_insert(hash, vertexarray, { .gpu = vertex_count * vertex_size + index_count * index_size });
 }
 
 
@@ -108,8 +223,10 @@ std::shared_ptr<VertexArray> ResourcesManager::acquire_vertexarray(const void* d
 // }
 
 std::shared_ptr<Shader> ResourcesManager::get_or_compile_shader(const char* source, Shader::Type type) {
-	size_t hash = ScarabHash::hash_make(std::string_view(source));
+	return this->get_or_compile_shader(source, type, static_cast<size_t>(ScarabHash::hash_const(source)));
+}
 
+std::shared_ptr<Shader> ResourcesManager::get_or_compile_shader(const char* source, const Shader::Type type, const size_t hash) {
 	std::shared_ptr shader = this->get_shader(hash);
 	if(shader != nullptr) {
 		return shader;
@@ -119,67 +236,71 @@ std::shared_ptr<Shader> ResourcesManager::get_or_compile_shader(const char* sour
 	LOG_DEBUG("NOT found/expired %s hash (%zu) not found, compiling new", ((int)type == GL_VERTEX_SHADER) ? "VERTEX" : "FRAGMENT", hash);
 #endif
 
-	shader = std::make_shared<Shader>(source, type);
-	this->shader_cache[hash] = shader;
-	return shader;
+	// Compiled by the OpenGL thread if called by a worker
+	shader = ScarabOpenGL::run_sync([source, type]() {
+		return std::make_shared<Shader>(source, type);
+	});
+	// Another thread may have compiled the same one meanwhile
+	return this->shader_cache.try_insert(hash, shader, { .cpu = std::strlen(source) });
 }
 
 std::shared_ptr<VertexArray> ResourcesManager::get_vertexarray(const size_t hash) noexcept {
-	// Chek if the Shader is already compiled and cached
-	auto it = this->vertexarray_cache.find(hash);
-	if(it == this->vertexarray_cache.end()) {
-		return nullptr;
+	std::shared_ptr<VertexArray> cache = this->vertexarray_cache.find(hash);
+#if defined(SCARAB_DEBUG_SHADER_MANAGER)
+	if(cache != nullptr) {
+		LOG_DEBUG("Found Vertex Array with hash: %zu", hash);
 	}
+#endif
+	return cache;
+}
 
-	if(std::shared_ptr<VertexArray> cache = it->second.lock()) {
-	#if defined(SCARAB_DEBUG_SHADER_MANAGER)
-		LOG_DEBUG("Found Vertex Array with hash: %zu", hash);
-	#endif
-		return cache; // Get Cache
+
+GeometryPool& ResourcesManager::geometry_pool(const VertexFormat format) {
+	std::unique_ptr<GeometryPool>& pool = this->geometry_pools[static_cast<uint8>(format)];
+	if(pool != nullptr) {
+		return *pool;
 	}
 
-	// weak_ptr expired, remove entry
-	this->vertexarray_cache.erase(it);
-	return nullptr;
+	switch(format) {
+		case VertexFormat::Half:
+			pool = std::make_unique<GeometryPool>(VertexPackedHalf::LAYOUT);
+			break;
+		case VertexFormat::Snorm16:
+			pool = std::make_unique<GeometryPool>(VertexPacked::LAYOUT);
+			break;
+		default:
+			pool = std::make_unique<GeometryPool>(Vertex::LAYOUT);
+			break;
+	}
+	return *pool;
 }
 
 
 std::shared_ptr<Shader> ResourcesManager::get_shader(const size_t hash) noexcept {
-	// Chek if the Shader is already compiled and cached
-	auto it = this->shader_cache.find(hash);
-	if(it == this->shader_cache.end()) {
-		return nullptr;
-	}
-
-	if(std::shared_ptr<Shader> cache = it->second.lock()) {
-	#if defined(SCARAB_DEBUG_SHADER_MANAGER)
+	std::shared_ptr<Shader> cache = this->shader_cache.find(hash);
+#if defined(SCARAB_DEBUG_SHADER_MANAGER)
+	if(cache != nullptr) {
 		LOG_DEBUG("Found Shader with hash: %zu", hash);
-	#endif
-		return cache; // Get Cache
 	}
-
-	// weak_ptr expired, remove entry
-	this->shader_cache.erase(it);
-	return nullptr;
+#endif
+	return cache;
 }
 
 std::shared_ptr<ShaderProgram> ResourcesManager::get_program(const size_t hash) noexcept {
-	// Chek if the Shader Program is already compiled and cached
-	auto it = this->program_cache.find(hash);
-	if(it == this->program_cache.end()) {
-		return nullptr;
-	}
-
-	if(std::shared_ptr<ShaderProgram> cache = it->second.lock()) {
-	#if defined(SCARAB_DEBUG_SHADER_MANAGER)
+	std::shared_ptr<ShaderProgram> cache = this->program_cache.find(hash);
+#if defined(SCARAB_DEBUG_SHADER_MANAGER)
+	if(cache != nullptr) {
 		LOG_DEBUG("Found Shader Program with hash: %zu", hash);
-	#endif
-		return cache; // Get Cache
 	}
+#endif
+	return cache;
+}
 
-	// weak_ptr expired, remove entry
-	this->program_cache.erase(it);
-	return nullptr;
+void ResourcesManager::trim() noexcept {
+	this->vertexarray_cache.trim();
+	this->program_cache.trim();
+	// After programs, they hold their shaders
+	this->shader_cache.trim();
 }
 
 
@@ -189,14 +310,25 @@ void ResourcesManager::cleanup() noexcept {
 		LOG_WARNING_FN("Called without a valid OpenGL context. Leaking GPU resources");
 		return;
 	}
-	// Has no effect since its called implicitly, but i like to have them here
+	// Caches hold the last references of unused resources, release them while the context is valid
+	{
+		std::lock_guard<std::mutex> lock(this->builtin_mutex);
+		for(std::shared_ptr<ShaderProgram>& program : this->builtin_programs) {
+			program.reset();
+		}
+	}
 	this->vertexarray_cache.clear();
-	this->shader_cache.clear();
 	this->program_cache.clear();
+	this->shader_cache.clear();
+	// Models still alive keep their ranges, but can't be drawn anymore
+	for(std::unique_ptr<GeometryPool>& pool : this->geometry_pools) {
+		pool.reset();
+	}
 
 	// Delete Uniform Buffers
 	delete this->u_camera();
 	delete this->u_transform();
 	delete this->u_material();
+	delete this->u_pull();
 }
 
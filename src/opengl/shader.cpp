@@ -1,5 +1,6 @@
 #include "scarablib/opengl/shader.hpp"
 #include "scarablib/proper/error.hpp"
+#include "scarablib/utils/opengl.hpp"
 
 Shader::Shader(const char* source, const Shader::Type type) {
 	if(source == nullptr) {
@@ -28,5 +29,8 @@ Shader::Shader(const char* source, const Shader::Type type) {
 }
 
 Shader::~Shader() noexcept {
-	glDeleteShader(this->id);
+	// The last reference may be released by a worker thread
+	ScarabOpenGL::submit([id = this->id]() {
+		glDeleteShader(id);
+	});
 }
@@ -1,5 +1,6 @@
 #include "scarablib/opengl/shader_program.hpp"
 #include "scarablib/proper/error.hpp"
+#include "scarablib/utils/opengl.hpp"
 #include <algorithm>
 #include <cstddef>
 
@@ -55,7 +56,10 @@ ShaderProgram::ShaderProgram(const std::vector<std::shared_ptr<Shader>>& shaders
 }
 
 ShaderProgram::~ShaderProgram() noexcept {
-	glDeleteProgram(this->programid);
+	// The last reference may be released by a worker thread
+	ScarabOpenGL::submit([id = this->programid]() {
+		glDeleteProgram(id);
+	});
 	// Has no effect since its all shared_ptr, but i like to have it here
 	this->attached_shaders.clear();
 }
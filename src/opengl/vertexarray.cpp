@@ -1,5 +1,6 @@
 #include "scarablib/opengl/vertexarray.hpp"
 #include "scarablib/typedef.hpp"
+#include "scarablib/utils/opengl.hpp"
 
 VertexArray::VertexArray(const void* data, const size_t capacity, const size_t vertex_size, const bool dynamic) noexcept
 	: vsize(vertex_size), length(0) {
@@ -14,12 +15,60 @@ VertexArray::VertexArray(const void* data, const size_t capacity, const size_t v
 	this->alloc_data(data, capacity, dynamic);
 }
 
-VertexArray::~VertexArray() noexcept {
-	if(this->ebo_id != 0) {
-		glDeleteBuffers(1, &this->ebo_id);
+VertexArray::VertexArray(const void* vertices, const size_t vertex_count, const size_t vertex_size,
+		const void* indices, const size_t index_count, const uint32 index_size) noexcept
+	: vsize(vertex_size), indexstride(index_size), length(vertex_count) {
+
+#if !defined(BUILD_OPGL30)
+	glCreateVertexArrays(1, &this->vao_id);
+	glCreateBuffers(1, &this->vbo_id);
+	glNamedBufferStorage(this->vbo_id, static_cast<GLsizeiptr>(vertex_count * vertex_size), vertices, 0);
+
+	if(indices != nullptr && index_count > 0) {
+		glCreateBuffers(1, &this->ebo_id);
+		glNamedBufferStorage(this->ebo_id, static_cast<GLsizeiptr>(index_count * index_size), indices, 0);
+
+		// Attach EBO to VAO
+		glVertexArrayElementBuffer(this->vao_id, this->ebo_id);
+		this->length = index_count;
+		this->indices_type = ScarabOpenGL::index_type(index_size);
 	}
-	glDeleteBuffers(1, &this->vbo_id);
-	glDeleteVertexArrays(1, &this->vao_id);
+#else
+	glGenVertexArrays(1, &this->vao_id);
+	glGenBuffers(1, &this->vbo_id);
+	this->alloc_data(vertices, vertex_count);
+
+	if(indices != nullptr && index_count > 0) {
+		glGenBuffers(1, &this->ebo_id);
+		glBindVertexArray(this->vao_id); // Bind VAO
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ebo_id);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+			static_cast<GLsizei>(index_count * index_size),
+			indices,
+			GL_STATIC_DRAW
+		);
+
+		glBindVertexArray(0); // Unbind VAO
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+		this->length = index_count;
+		this->indices_type = ScarabOpenGL::index_type(index_size);
+	}
+#endif
+
+	GL_CHECK();
+}
+
+VertexArray::~VertexArray() noexcept {
+	// The last reference may be released by a worker thread
+	ScarabOpenGL::submit([vao_id = this->vao_id, vbo_id = this->vbo_id, ebo_id = this->ebo_id]() {
+		if(ebo_id != 0) {
+			glDeleteBuffers(1, &ebo_id);
+		}
+		glDeleteBuffers(1, &vbo_id);
+		glDeleteVertexArrays(1, &vao_id);
+	});
 }
 
 void VertexArray::alloc_data(const void* data, const size_t capacity, const bool dynamic) const noexcept {
@@ -57,6 +106,44 @@ void VertexArray::update_data(const void* data, size_t size) noexcept {
 #endif
 }
 
+void VertexArray::link_attrib(const uint32 index, const VertexAttribute& attribute, const uint32 stride) const noexcept {
+	const bool isinteger = (attribute.type != GL_FLOAT && attribute.type != GL_HALF_FLOAT
+		&& attribute.type != GL_DOUBLE && !attribute.normalized);
+
+#if !defined(BUILD_OPGL30)
+	// Initialize
+	glVertexArrayVertexBuffer(this->vao_id, index, this->vbo_id, 0, stride);
+	glEnableVertexArrayAttrib(this->vao_id, index); // Enable index
+	if(isinteger) {
+		glVertexArrayAttribIFormat(this->vao_id, index, static_cast<GLint>(attribute.count),
+			attribute.type, static_cast<GLuint>(attribute.offset)
+		);
+	} else {
+		glVertexArrayAttribFormat(this->vao_id, index, static_cast<GLint>(attribute.count),
+			attribute.type, attribute.normalized, static_cast<GLuint>(attribute.offset)
+		);
+	}
+	// Attach VBO to VAO
+	glVertexArrayAttribBinding(this->vao_id, index, index);
+
+#else
+	glBindVertexArray(this->vao_id);
+	glBindBuffer(GL_ARRAY_BUFFER, this->vbo_id);
+
+	glEnableVertexAttribArray(index);
+	if(isinteger) {
+		glVertexAttribIPointer(index, static_cast<GLint>(attribute.count), attribute.type,
+				static_cast<GLsizei>(stride), reinterpret_cast<void*>((uintptr_t)attribute.offset));
+	} else {
+		glVertexAttribPointer(index, static_cast<GLint>(attribute.count), attribute.type, attribute.normalized,
+				static_cast<GLsizei>(stride), reinterpret_cast<void*>((uintptr_t)attribute.offset));
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+#endif
+}
+
 /*
 BIND
 ALLOC DATA <- (first being used)
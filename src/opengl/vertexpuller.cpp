@@ -0,0 +1,54 @@
+#include "scarablib/opengl/vertexpuller.hpp"
+#include "scarablib/opengl/resourcesmanager.hpp"
+#include "scarablib/opengl/shaders.hpp"
+#include "scarablib/proper/error.hpp"
+
+uint32 VertexPuller::empty_vao() noexcept {
+	// Attributes are never enabled, the shader reads everything from the storage buffers
+	static GLuint vao = [] {
+		GLuint id = 0;
+	#if !defined(BUILD_OPGL30)
+		glCreateVertexArrays(1, &id);
+	#else
+		glGenVertexArrays(1, &id);
+	#endif
+		return id;
+	}();
+	return vao;
+}
+
+std::shared_ptr<ShaderProgram> VertexPuller::default_shader() {
+#if !defined(BUILD_OPGL30)
+	return ResourcesManager::get_instance().builtin_program(ResourcesManager::Program::VertexPull);
+#else
+	throw ScarabError("Vertex pulling needs OpenGL 4.3+, not available with BUILD_OPGL30");
+#endif
+}
+
+void VertexPuller::draw(const uint32 vertices, const uint32 indices, const VertexPuller::Layout layout,
+		const uint32 base_vertex, const uint32 first_index, const uint32 index_size, const uint32 count) noexcept {
+#if !defined(BUILD_OPGL30)
+	if(vertices != VertexPuller::bound_vertices) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, vertices);
+		VertexPuller::bound_vertices = vertices;
+	}
+	if(indices != 0 && indices != VertexPuller::bound_indices) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, indices);
+		VertexPuller::bound_indices = indices;
+	}
+
+	const Shaders::PullUniformBuffer pull = {
+		.base_vertex = base_vertex,
+		.first_index = first_index,
+		.index_size  = (indices != 0) ? index_size : 0,
+		.layout      = static_cast<uint32>(layout)
+	};
+	ResourcesManager::u_pull()->update(&pull);
+
+	// Indices are fetched by the shader, so it is always an array draw
+	glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(count));
+#else
+	(void)vertices; (void)indices; (void)layout;
+	(void)base_vertex; (void)first_index; (void)index_size; (void)count;
+#endif
+}
@@ -4,6 +4,12 @@
 #include "scarablib/proper/log.hpp"
 
 #define SCARAB_DEBUG_RENDERER
+// Logs the CPU time spent submitting draws, to compare the VAO and vertex pulling paths
+// #define SCARAB_DEBUG_SUBMISSION
+
+#if defined(SCARAB_DEBUG_SUBMISSION)
+	#include <chrono>
+#endif
 
 void RenderPipeline::render(const Scene& scene) noexcept {
 	this->begin_frame();
@@ -21,13 +27,26 @@ void RenderPipeline::render(const Scene& scene) noexcept {
 	this->end_frame();
 }
 
-void RenderPipeline::drawmeshes(const std::vector<std::unique_ptr<Mesh>>& meshes) noexcept {
+void RenderPipeline::drawmeshes(const std::vector<Scene::MeshPtr>& meshes) noexcept {
 	static GLuint last_vaoid = 0;
 
-	for(const std::unique_ptr<Mesh>& mesh : meshes) {
-		if(mesh->vertexarray->get_vaoid() != last_vaoid) {
-			last_vaoid = mesh->vertexarray->get_vaoid();
+#if defined(SCARAB_DEBUG_SUBMISSION)
+	// Accumulated over SUBMISSION_FRAMES frames
+	static constexpr uint32 SUBMISSION_FRAMES = 300;
+	static double submission_ms = 0.0;
+	static uint32 submission_frames = 0;
+	static uint32 vao_changes = 0;
+	const auto start = std::chrono::steady_clock::now();
+#endif
+
+	for(const Scene::MeshPtr& mesh : meshes) {
+		// Meshes from the same GeometryPool (or using vertex pulling) don't change the VAO
+		if(mesh->get_vaoid() != last_vaoid) {
+			last_vaoid = mesh->get_vaoid();
 			glBindVertexArray(last_vaoid);
+		#if defined(SCARAB_DEBUG_SUBMISSION)
+			vao_changes++;
+		#endif
 		}
 
 		mesh->update_model_matrix();
@@ -37,23 +56,34 @@ void RenderPipeline::drawmeshes(const std::vector<std::unique_ptr<Mesh>>& meshes
 		ResourcesManager::u_transform()->update(&trans);
 
 		// Bind shader, texture and color
-		this->bind_material(*mesh->material);
+		this->bind_material(*mesh->material, mesh->get_shader());
 		mesh->draw_logic();
 	}
+
+#if defined(SCARAB_DEBUG_SUBMISSION)
+	submission_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	if(++submission_frames == SUBMISSION_FRAMES) {
+		LOG_DEBUG("Submission: %.4f ms per frame, %zu meshes, %.1f VAO changes per frame",
+			submission_ms / SUBMISSION_FRAMES, meshes.size(), static_cast<double>(vao_changes) / SUBMISSION_FRAMES);
+		submission_ms = 0.0;
+		submission_frames = 0;
+		vao_changes = 0;
+	}
+#endif
 }
 
-void RenderPipeline::bind_material(Material& material) noexcept {
+void RenderPipeline::bind_material(Material& material, const std::shared_ptr<ShaderProgram>& shader) noexcept {
 	static std::shared_ptr<ShaderProgram> last_shader = ResourcesManager::default_shader();
 	static std::shared_ptr<Texture> last_texture      = Assets::default_texture();
 	static TextureArray* last_texarray                = nullptr;
+	static uint32 last_texarray_id                    = 0; // Changes when the array grows
 	static Color last_color                           = Colors::WHITE;
 	static float last_mix_amount                      = 0.0f;
 	static int last_texlayer                          = 0;
 
 	// -- SHADER //
-	std::shared_ptr<ShaderProgram> mesh_shader = material.shader;
-	if(mesh_shader != last_shader) {
-		last_shader = mesh_shader;
+	if(shader != last_shader) {
+		last_shader = shader;
 		last_shader->use();
 
 	#if defined(SCARAB_DEBUG_RENDERER)
@@ -87,8 +117,9 @@ void RenderPipeline::bind_material(Material& material) noexcept {
 	bool texarray_changed = false;
 
 	if(has_texarray) {
-		if(last_texarray == nullptr || material.texture_array->get_id() != last_texarray->get_id()) {
-			last_texarray = material.texture_array;
+		if(last_texarray == nullptr || material.texture_array->get_id() != last_texarray_id) {
+			last_texarray    = material.texture_array;
+			last_texarray_id = last_texarray->get_id();
 			last_texarray->bind(1); // Unit 0
 			texarray_changed = true;
 		}
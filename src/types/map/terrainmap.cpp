@@ -1,6 +1,8 @@
 #include "scarablib/types/map/terrainmap.hpp"
 #include "scarablib/proper/error.hpp"
 #include "scarablib/gfx/image.hpp"
+#include "scarablib/utils/image.hpp"
+#include <vector>
 
 void TerrainMap::load_file(const char* path) {
 	// Flip image so Y-coodinate is correctly: (0, 0) = top-left instead of bottom-left
@@ -8,21 +10,26 @@ void TerrainMap::load_file(const char* path) {
 	Image* image = new Image(path, true, false);
 	if(image->data == nullptr) {
 		delete image;
-		throw ScarabError("Image (%s) was not found", image->path);
+		throw ScarabError("Image (%s) was not found", path);
 	}
 
 	this->width  = static_cast<uint32>(image->width);
 	this->height = static_cast<uint32>(image->height);
 
+	// Any number of channels works the same (e.g., grayscale or RGBA maps)
+	std::vector<uint8> pixels(static_cast<size_t>(this->width) * this->height * 4);
+	ScarabImage::to_rgba(image->data, static_cast<uint32>(image->channels), pixels.data(), static_cast<size_t>(this->width) * this->height);
+	delete image;
+
 	// 0 = Empty
 	this->terrain_map.resize(this->width * this->height, 0);
 
 	for(uint32 y = 0; y < this->height; y++) {
 		for(uint32 x = 0; x < this->width; x++) {
 			// Finds position of pixel in data
-			const uint32 index = (y * this->width + x) * 3; // 3 because ignoring alpha
-			// Color of current pixel
-			Color pixel = Color(image->data[index], image->data[index + 1], image->data[index + 2], 255);
+			const size_t index = (static_cast<size_t>(y) * this->width + x) * 4;
+			// Color of current pixel, ignoring alpha
+			Color pixel = Color(pixels[index], pixels[index + 1], pixels[index + 2], 255);
 
 			// Best match for this pixel
 			uint8 best_match = 0; // 0 is no terrain
@@ -54,6 +61,4 @@ void TerrainMap::load_file(const char* path) {
 			}
 		}
 	}
-
-	delete image;
 }
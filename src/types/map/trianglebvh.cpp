@@ -0,0 +1,522 @@
+#include "scarablib/types/map/trianglebvh.hpp"
+#include "scarablib/geometry/model.hpp"
+#include "scarablib/utils/thread.hpp"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+namespace {
+	// Split planes tested for each axis
+	constexpr uint32 BINS = 16;
+	// Leaves larger than this are always split
+	constexpr uint32 MAX_LEAF_SIZE = 8;
+	// Deepest the tree can be, size of the traversal stack
+	constexpr uint32 MAX_DEPTH = 64;
+	// Nodes with more triangles are binned on worker threads
+	constexpr uint32 PARALLEL_BINNING = 32768;
+	// Smallest subtree built on its own thread
+	constexpr uint32 MIN_SUBTREE = 1024;
+
+	struct Bounds {
+		vec3<float> min = vec3<float>(std::numeric_limits<float>::max());
+		vec3<float> max = vec3<float>(std::numeric_limits<float>::lowest());
+
+		inline void grow(const vec3<float>& point) noexcept {
+			this->min = glm::min(this->min, point);
+			this->max = glm::max(this->max, point);
+		}
+
+		inline void grow(const Bounds& other) noexcept {
+			this->min = glm::min(this->min, other.min);
+			this->max = glm::max(this->max, other.max);
+		}
+
+		inline float area() const noexcept {
+			if(this->min.x > this->max.x) {
+				return 0.0f;
+			}
+			const vec3<float> size = this->max - this->min;
+			return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+		}
+	};
+
+	struct Bin {
+		Bounds bounds;
+		uint32 count = 0;
+	};
+
+	// State shared by all threads while building
+	struct Builder {
+		std::vector<TriangleBVH::Node>& nodes;
+		std::vector<Bounds> bounds;
+		std::vector<vec3<float>> centroids;
+		// Triangles in the order of the tree
+		std::vector<uint32> indices;
+		std::atomic<uint32> node_count = 1;
+
+		struct Task {
+			uint32 node;
+			uint32 first;
+			uint32 count;
+			uint32 depth;
+		};
+		// Subtrees left to be built on worker threads
+		std::vector<Task> subtrees;
+		uint32 subtree_size = 0;
+
+		Builder(std::vector<TriangleBVH::Node>& nodes) noexcept : nodes(nodes) {}
+
+		// Makes a node of the triangles in `indices[first, first + count)`, splitting it if worth it.
+		// - `parallel`: Bins large nodes on worker threads and leaves subtrees smaller than `subtree_size` in `subtrees`
+		void build_node(const uint32 index, const uint32 first, const uint32 count, const uint32 depth, const bool parallel);
+	};
+
+	void Builder::build_node(const uint32 index, const uint32 first, const uint32 count, const uint32 depth, const bool parallel) {
+		const bool parallel_binning = parallel && count >= PARALLEL_BINNING;
+		std::mutex mutex;
+
+		// Bounds of the triangles and of their centroids
+		Bounds node_bounds, centroid_bounds;
+		const auto bound = [&](const size_t begin, const size_t end) {
+			Bounds local_bounds, local_centroids;
+			for(size_t i = first + begin; i < first + end; i++) {
+				local_bounds.grow(this->bounds[this->indices[i]]);
+				local_centroids.grow(this->centroids[this->indices[i]]);
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			node_bounds.grow(local_bounds);
+			centroid_bounds.grow(local_centroids);
+		};
+		if(parallel_binning) {
+			ScarabThread::parallel_for(count, bound, PARALLEL_BINNING / 4);
+		} else {
+			bound(0, count);
+		}
+
+		TriangleBVH::Node& node = this->nodes[index];
+		node.min   = node_bounds.min;
+		node.max   = node_bounds.max;
+		node.first = first;
+		node.count = count;
+		if(count == 1 || depth + 1 >= MAX_DEPTH) {
+			return;
+		}
+
+		// Sort the centroids into bins on each axis
+		const vec3<float> extent = centroid_bounds.max - centroid_bounds.min;
+		vec3<float> scale;
+		for(int axis = 0; axis < 3; axis++) {
+			scale[axis] = (extent[axis] > 0.0f) ? (float)BINS / extent[axis] : 0.0f;
+		}
+		const auto bin_of = [&](const vec3<float>& centroid, const int axis) {
+			return std::min(BINS - 1, (uint32)((centroid[axis] - centroid_bounds.min[axis]) * scale[axis]));
+		};
+
+		Bin bins[3][BINS];
+		const auto fill = [&](const size_t begin, const size_t end) {
+			Bin local[3][BINS];
+			for(size_t i = first + begin; i < first + end; i++) {
+				const uint32 tri = this->indices[i];
+				for(int axis = 0; axis < 3; axis++) {
+					Bin& bin = local[axis][bin_of(this->centroids[tri], axis)];
+					bin.bounds.grow(this->bounds[tri]);
+					bin.count++;
+				}
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			for(int axis = 0; axis < 3; axis++) {
+				for(uint32 i = 0; i < BINS; i++) {
+					bins[axis][i].bounds.grow(local[axis][i].bounds);
+					bins[axis][i].count += local[axis][i].count;
+				}
+			}
+		};
+		if(parallel_binning) {
+			ScarabThread::parallel_for(count, fill, PARALLEL_BINNING / 4);
+		} else {
+			fill(0, count);
+		}
+
+		// Cheapest plane, cost is the area of each side times its triangles
+		int best_axis   = -1;
+		uint32 best_bin = 0;
+		float best_cost = std::numeric_limits<float>::max();
+		for(int axis = 0; axis < 3; axis++) {
+			if(scale[axis] == 0.0f) {
+				continue;
+			}
+
+			// Right side of each plane, swept from the last bin
+			float right_cost[BINS - 1];
+			Bounds right;
+			uint32 right_count = 0;
+			for(uint32 i = BINS - 1; i > 0; i--) {
+				right.grow(bins[axis][i].bounds);
+				right_count += bins[axis][i].count;
+				right_cost[i - 1] = right.area() * (float)right_count;
+			}
+
+			Bounds left;
+			uint32 left_count = 0;
+			for(uint32 i = 0; i < BINS - 1; i++) {
+				left.grow(bins[axis][i].bounds);
+				left_count += bins[axis][i].count;
+				const float cost = left.area() * (float)left_count + right_cost[i];
+				if(left_count > 0 && left_count < count && cost < best_cost) {
+					best_cost = cost;
+					best_axis = axis;
+					best_bin  = i;
+				}
+			}
+		}
+
+		// Splitting costs one more node to walk
+		const float area      = node_bounds.area();
+		const float leaf_cost = area * (float)count;
+		best_cost += area;
+		if(count <= MAX_LEAF_SIZE && (best_axis < 0 || best_cost >= leaf_cost)) {
+			return;
+		}
+
+		uint32 left_count;
+		if(best_axis >= 0) {
+			uint32* middle = std::partition(this->indices.data() + first, this->indices.data() + first + count, [&](const uint32 tri) {
+				return bin_of(this->centroids[tri], best_axis) <= best_bin;
+			});
+			left_count = (uint32)(middle - (this->indices.data() + first));
+		} else {
+			// All centroids in the same place, split in half
+			left_count = count / 2;
+		}
+
+		const uint32 left = this->node_count.fetch_add(2);
+		node.first = left;
+		node.count = 0;
+
+		const Task children[2] = {
+			{ left,     first,              left_count,         depth + 1 },
+			{ left + 1, first + left_count, count - left_count, depth + 1 }
+		};
+		for(const Task& child : children) {
+			if(parallel && child.count < this->subtree_size) {
+				this->subtrees.push_back(child);
+			} else {
+				this->build_node(child.node, child.first, child.count, child.depth, parallel);
+			}
+		}
+	}
+
+	inline bool intersects_box(const TriangleBVH::Node& node, const vec3<float>& origin, const vec3<float>& invdir, const float max_distance, float& out_distance) noexcept {
+		const vec3<float> t0 = (node.min - origin) * invdir;
+		const vec3<float> t1 = (node.max - origin) * invdir;
+		const vec3<float> tmin = glm::min(t0, t1);
+		const vec3<float> tmax = glm::max(t0, t1);
+		const float tenter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+		const float texit  = std::min(std::min(tmax.x, tmax.y), std::min(tmax.z, max_distance));
+		out_distance = tenter;
+		return tenter <= texit;
+	}
+
+	inline bool overlaps_box(const TriangleBVH::Node& node, const vec3<float>& min, const vec3<float>& max) noexcept {
+		return node.min.x <= max.x && node.max.x >= min.x &&
+			node.min.y <= max.y && node.max.y >= min.y &&
+			node.min.z <= max.z && node.max.z >= min.z;
+	}
+
+	// Closest point of a triangle to a point (Ericson, Real-Time Collision Detection)
+	vec3<float> closest_point(const vec3<float>& point, const MeshTriangle& tri) noexcept {
+		const vec3<float> ab = tri.v1 - tri.v0;
+		const vec3<float> ac = tri.v2 - tri.v0;
+		const vec3<float> ap = point - tri.v0;
+		const float d1 = glm::dot(ab, ap);
+		const float d2 = glm::dot(ac, ap);
+		if(d1 <= 0.0f && d2 <= 0.0f) {
+			return tri.v0;
+		}
+
+		const vec3<float> bp = point - tri.v1;
+		const float d3 = glm::dot(ab, bp);
+		const float d4 = glm::dot(ac, bp);
+		if(d3 >= 0.0f && d4 <= d3) {
+			return tri.v1;
+		}
+
+		const float vc = d1 * d4 - d3 * d2;
+		if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+			return tri.v0 + ab * (d1 / (d1 - d3));
+		}
+
+		const vec3<float> cp = point - tri.v2;
+		const float d5 = glm::dot(ab, cp);
+		const float d6 = glm::dot(ac, cp);
+		if(d6 >= 0.0f && d5 <= d6) {
+			return tri.v2;
+		}
+
+		const float vb = d5 * d2 - d1 * d6;
+		if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+			return tri.v0 + ac * (d2 / (d2 - d6));
+		}
+
+		const float va = d3 * d6 - d5 * d4;
+		if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+			return tri.v1 + (tri.v2 - tri.v1) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		}
+
+		// Inside the face
+		const float denom = 1.0f / (va + vb + vc);
+		return tri.v0 + ab * (vb * denom) + ac * (vc * denom);
+	}
+
+	// Separating axis test of a triangle and a box (Akenine-Moller)
+	bool overlaps_triangle(const vec3<float>& center, const vec3<float>& half, const MeshTriangle& tri) noexcept {
+		const vec3<float> v[3] = { tri.v0 - center, tri.v1 - center, tri.v2 - center };
+
+		// Axes of the box
+		for(int axis = 0; axis < 3; axis++) {
+			const float min = std::min(std::min(v[0][axis], v[1][axis]), v[2][axis]);
+			const float max = std::max(std::max(v[0][axis], v[1][axis]), v[2][axis]);
+			if(min > half[axis] || max < -half[axis]) {
+				return false;
+			}
+		}
+
+		// Plane of the triangle
+		const vec3<float> e[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+		const vec3<float> normal = glm::cross(e[0], e[1]);
+		const float radius = glm::dot(half, glm::abs(normal));
+		if(std::abs(glm::dot(normal, v[0])) > radius) {
+			return false;
+		}
+
+		// Edges of the triangle crossed with the axes of the box
+		for(const vec3<float>& edge : e) {
+			for(int axis = 0; axis < 3; axis++) {
+				vec3<float> unit(0.0f);
+				unit[axis] = 1.0f;
+				const vec3<float> test = glm::cross(unit, edge);
+				const float p0 = glm::dot(v[0], test);
+				const float p1 = glm::dot(v[1], test);
+				const float p2 = glm::dot(v[2], test);
+				const float r  = glm::dot(half, glm::abs(test));
+				if(std::min(std::min(p0, p1), p2) > r || std::max(std::max(p0, p1), p2) < -r) {
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+}
+
+
+TriangleBVH::TriangleBVH(const std::vector<MeshTriangle>& triangles) {
+	this->build(triangles);
+}
+
+TriangleBVH::TriangleBVH(const char* path, const glm::mat4& transform) {
+	this->build(Model::get_obj_triangles(path, transform));
+}
+
+void TriangleBVH::build(const std::vector<MeshTriangle>& source) {
+	const uint32 count = (uint32)source.size();
+	if(count == 0) {
+		return;
+	}
+
+	// A tree of N leaves never has more than 2N - 1 nodes
+	this->nodes.resize((size_t)count * 2 - 1);
+
+	Builder builder(this->nodes);
+	builder.bounds.resize(count);
+	builder.centroids.resize(count);
+	builder.indices.resize(count);
+	ScarabThread::parallel_for(count, [&](const size_t begin, const size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			const MeshTriangle& tri = source[i];
+			Bounds& bounds = builder.bounds[i];
+			bounds.grow(tri.v0);
+			bounds.grow(tri.v1);
+			bounds.grow(tri.v2);
+			builder.centroids[i] = (bounds.min + bounds.max) * 0.5f;
+			builder.indices[i]   = (uint32)i;
+		}
+	}, 4096);
+
+	// Top of the tree on this thread, the subtrees below on worker threads
+	const bool parallel = count >= MIN_SUBTREE * 2;
+	builder.subtree_size = std::max(MIN_SUBTREE, count / (ScarabThread::worker_count() * 4));
+	builder.build_node(0, 0, count, 0, parallel);
+	ScarabThread::parallel_for(builder.subtrees.size(), [&](const size_t begin, const size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			const Builder::Task& task = builder.subtrees[i];
+			builder.build_node(task.node, task.first, task.count, task.depth, false);
+		}
+	});
+
+	this->nodes.resize(builder.node_count.load());
+	this->nodes.shrink_to_fit();
+
+	// Store the triangles in the order of the leaves
+	this->triangles.resize(count);
+	this->edges.resize(count);
+	ScarabThread::parallel_for(count, [&](const size_t begin, const size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			const MeshTriangle& tri = source[builder.indices[i]];
+			this->triangles[i] = tri;
+			this->edges[i] = { tri.v0, tri.v1 - tri.v0, tri.v2 - tri.v0 };
+		}
+	}, 4096);
+}
+
+size_t TriangleBVH::get_memory_usage() const noexcept {
+	return this->nodes.capacity() * sizeof(TriangleBVH::Node)
+		+ this->triangles.capacity() * sizeof(MeshTriangle)
+		+ this->edges.capacity() * sizeof(TriangleBVH::Edges);
+}
+
+
+template <bool ANY>
+uint32 TriangleBVH::intersect(const Raycast::Ray& ray, float& distance) const noexcept {
+	uint32 hit = UINT32_MAX;
+	if(this->nodes.empty()) {
+		return hit;
+	}
+
+	const vec3<float> invdir = 1.0f / ray.direction;
+	float tnode;
+	if(!intersects_box(this->nodes[0], ray.origin, invdir, distance, tnode)) {
+		return hit;
+	}
+
+	// Far children waiting to be walked, with the distance where the ray enters them
+	uint32 stack[MAX_DEPTH];
+	float stack_distance[MAX_DEPTH];
+	uint32 size = 0;
+	uint32 index = 0;
+
+	while(true) {
+		const TriangleBVH::Node& node = this->nodes[index];
+		if(node.is_leaf()) {
+			for(uint32 i = node.first; i < node.first + node.count; i++) {
+				const TriangleBVH::Edges& tri = this->edges[i];
+				float dist;
+				if(Raycast::intersects_triangle(ray, tri.v0, tri.edge1, tri.edge2, dist) && dist < distance) {
+					distance = dist;
+					hit = i;
+					if constexpr (ANY) {
+						return hit;
+					}
+				}
+			}
+		} else {
+			// Closest child first
+			float tleft, tright;
+			const bool left  = intersects_box(this->nodes[node.first], ray.origin, invdir, distance, tleft);
+			const bool right = intersects_box(this->nodes[node.first + 1], ray.origin, invdir, distance, tright);
+			if(left && right) {
+				const bool swap = tright < tleft;
+				stack[size] = swap ? node.first : node.first + 1;
+				stack_distance[size++] = swap ? tleft : tright;
+				index = swap ? node.first + 1 : node.first;
+				continue;
+			}
+			if(left || right) {
+				index = left ? node.first : node.first + 1;
+				continue;
+			}
+		}
+
+		// Next node not farther than the closest hit
+		do {
+			if(size == 0) {
+				return hit;
+			}
+			size--;
+		} while(stack_distance[size] > distance);
+		index = stack[size];
+	}
+}
+
+Raycast::Rayhit TriangleBVH::raycast(const Raycast::Ray& ray) const noexcept {
+	Raycast::Rayhit closest_hit;
+	const uint32 hit = this->intersect<false>(ray, closest_hit.distance);
+	if(hit != UINT32_MAX) {
+		closest_hit.hit = true;
+		closest_hit.point = ray.origin + ray.direction * closest_hit.distance;
+		closest_hit.normal = this->triangles[hit].normal;
+	}
+	return closest_hit;
+}
+
+bool TriangleBVH::raycast_any(const Raycast::Ray& ray, const float max_distance) const noexcept {
+	float distance = max_distance;
+	return this->intersect<true>(ray, distance) != UINT32_MAX;
+}
+
+
+size_t TriangleBVH::query_sphere(const vec3<float>& center, const float radius, std::vector<uint32>& out) const {
+	const size_t start = out.size();
+	if(this->nodes.empty()) {
+		return 0;
+	}
+
+	const float radius2 = radius * radius;
+	uint32 stack[MAX_DEPTH];
+	uint32 size = 0;
+	stack[size++] = 0;
+	while(size > 0) {
+		const TriangleBVH::Node& node = this->nodes[stack[--size]];
+		// Closest point of the box to the center
+		const vec3<float> offset = glm::clamp(center, node.min, node.max) - center;
+		if(glm::dot(offset, offset) > radius2) {
+			continue;
+		}
+
+		if(node.is_leaf()) {
+			for(uint32 i = node.first; i < node.first + node.count; i++) {
+				const vec3<float> distance = closest_point(center, this->triangles[i]) - center;
+				if(glm::dot(distance, distance) <= radius2) {
+					out.push_back(i);
+				}
+			}
+		} else {
+			stack[size++] = node.first + 1;
+			stack[size++] = node.first;
+		}
+	}
+
+	return out.size() - start;
+}
+
+size_t TriangleBVH::query_aabb(const vec3<float>& min, const vec3<float>& max, std::vector<uint32>& out) const {
+	const size_t start = out.size();
+	if(this->nodes.empty()) {
+		return 0;
+	}
+
+	const vec3<float> center = (min + max) * 0.5f;
+	const vec3<float> half   = (max - min) * 0.5f;
+	uint32 stack[MAX_DEPTH];
+	uint32 size = 0;
+	stack[size++] = 0;
+	while(size > 0) {
+		const TriangleBVH::Node& node = this->nodes[stack[--size]];
+		if(!overlaps_box(node, min, max)) {
+			continue;
+		}
+
+		if(node.is_leaf()) {
+			for(uint32 i = node.first; i < node.first + node.count; i++) {
+				if(overlaps_triangle(center, half, this->triangles[i])) {
+					out.push_back(i);
+				}
+			}
+		} else {
+			stack[size++] = node.first + 1;
+			stack[size++] = node.first;
+		}
+	}
+
+	return out.size() - start;
+}
@@ -1,11 +1,12 @@
 #include "scarablib/types/map/uniformgrid.hpp"
 #include "scarablib/geometry/model.hpp"
 #include "scarablib/proper/log.hpp"
+#include <algorithm>
 
 UniformGrid::UniformGrid(const char* path, const vec3<uint32>& griddims, const glm::mat4& transform) noexcept
 	: griddims(griddims) {
 
-	const std::vector<MeshTriangle> terrainmesh = Model::get_obj_triangles(path, transform);
+	std::vector<MeshTriangle> terrainmesh = Model::get_obj_triangles(path, transform);
 
 	// Calculate the World Bounds to correctly size the Grid
 	// loop through all loaded vertices to find the min and max corners
@@ -27,15 +28,12 @@ UniformGrid::UniformGrid(const char* path, const vec3<uint32>& griddims, const g
 	worldmax += glm::vec3(1.0f);
 
 	// Initialize the Grid
-	this->griddims = griddims;
 	this->worldsize = worldmax - worldmin;
 	this->cellsize = this->worldsize / (vec3<float>)this->griddims;
-	this->cells.resize((size_t)(this->griddims.x * this->griddims.y * this->griddims.z));
 
 	// Populate the Grid
-	for (const MeshTriangle& tri : terrainmesh) {
-		this->add_triangle(tri);
-	}
+	this->triangles = std::move(terrainmesh);
+	this->build();
 }
 
 
@@ -44,79 +42,141 @@ UniformGrid::UniformGrid(const vec3<float>& worldmin, const vec3<float>& worldma
 
 	this->worldsize = worldmax - worldmin;
 	this->cellsize = this->worldsize / (vec3<float>)this->griddims;
-	this->cells.resize((size_t)(this->griddims.x * this->griddims.y * this->griddims.z));
 }
 
 void UniformGrid::add_triangle(const MeshTriangle& tri) noexcept {
-	// Find the min/max grid cells the triangle's bounding box overlaps
-	const vec3<float> tri_min = glm::min(glm::min(tri.v0, tri.v1), tri.v2);
-	const vec3<float> tri_max = glm::max(glm::max(tri.v0, tri.v1), tri.v2);
-
-	const vec3<uint32> min_cell = get_cell_index(tri_min);
-	const vec3<uint32> max_cell = get_cell_index(tri_max);
-
-	// Add the triangle to all overlapped cells
-	for(uint32 z = min_cell.z; z <= max_cell.z; ++z) {
-		for(uint32 y = min_cell.y; y <= max_cell.y; ++y) {
-			for(uint32 x = min_cell.x; x <= max_cell.x; ++x) {
-				const size_t linearindex = (size_t)(z * this->griddims.x * this->griddims.y + y * this->griddims.x + x);
-				this->cells[linearindex].push_back(tri);
+	this->triangles.push_back(tri);
+	this->built = false;
+}
+
+void UniformGrid::build() noexcept {
+	const size_t cellcount = this->get_cell_count();
+
+	// Cells overlapped by the bounding box of a triangle
+	const auto for_each_cell = [&](const MeshTriangle& tri, auto&& func) {
+		const vec3<uint32> min_cell = this->get_cell_index(glm::min(glm::min(tri.v0, tri.v1), tri.v2));
+		const vec3<uint32> max_cell = this->get_cell_index(glm::max(glm::max(tri.v0, tri.v1), tri.v2));
+
+		for(uint32 z = min_cell.z; z <= max_cell.z; ++z) {
+			for(uint32 y = min_cell.y; y <= max_cell.y; ++y) {
+				for(uint32 x = min_cell.x; x <= max_cell.x; ++x) {
+					func(((size_t)z * this->griddims.y + y) * this->griddims.x + x);
+				}
 			}
 		}
+	};
+
+	// Count the triangles of each cell, shifted by one so the prefix sum gives the offsets
+	std::vector<size_t> counts(cellcount + 1, 0);
+	for(const MeshTriangle& tri : this->triangles) {
+		for_each_cell(tri, [&](const size_t cell) {
+			counts[cell + 1]++;
+		});
+	}
+	for(size_t i = 1; i <= cellcount; i++) {
+		counts[i] += counts[i - 1];
+	}
+
+	if(counts[cellcount] > UINT32_MAX) {
+		LOG_ERROR("Uniform grid has too many triangles in its cells (%zu), use a coarser grid", counts[cellcount]);
+		return;
 	}
+
+	this->cell_offsets.assign(counts.begin(), counts.end());
+	this->cell_triangles.resize(counts[cellcount]);
+	this->occupancy.assign((cellcount + 63) / 64, 0);
+
+	// Fill the cells, `counts` is used as the write cursor of each cell
+	for(size_t i = 0; i < this->triangles.size(); i++) {
+		for_each_cell(this->triangles[i], [&](const size_t cell) {
+			this->cell_triangles[counts[cell]++] = (uint32)i;
+			this->occupancy[cell >> 6] |= (uint64)1 << (cell & 63);
+		});
+	}
+
+	// Vectors from previous builds may have more capacity than needed
+	this->cell_triangles.shrink_to_fit();
+	this->built = true;
+}
+
+size_t UniformGrid::get_memory_usage() const noexcept {
+	return this->triangles.capacity() * sizeof(MeshTriangle)
+		+ this->cell_offsets.capacity() * sizeof(uint32)
+		+ this->cell_triangles.capacity() * sizeof(uint32)
+		+ this->occupancy.capacity() * sizeof(uint64);
 }
 
 
 vec3<uint32> UniformGrid::get_cell_index(const vec3<float>& pos) const noexcept {
 	const vec3<float> local_pos = pos - this->worldmin;
-	const vec3<uint32> index = glm::floor(local_pos / this->cellsize);
-	// Clamp to grid dimensions to handle points exactly on the max boundary
-	return glm::clamp(index, vec3<uint32>(0), this->griddims - (uint32)1);
+	const vec3<float> index = glm::floor(local_pos / this->cellsize);
+	// Clamp to grid dimensions to handle points exactly on the max boundary.
+	// Done before converting, so points before the grid do not wrap around
+	return (vec3<uint32>)glm::clamp(index, vec3<float>(0.0f), (vec3<float>)(this->griddims - (uint32)1));
 }
 
 
 
 Raycast::Rayhit UniformGrid::raycast(const Raycast::Ray& ray) const noexcept {
 	Raycast::Rayhit closest_hit;
+	if(!this->built || this->triangles.empty()) {
+		return closest_hit;
+	}
 
-	// Voxel Traversal Algorithm (Amanatides & Woo)
-	// This algorithm efficiently finds every cell a ray passes through
-
-	vec3<uint32> currentcell = get_cell_index(ray.origin);
+	// Find where the ray enters and leaves the grid (slab test)
+	const vec3<float> worldmax = this->worldmin + this->worldsize;
+	float tenter = 0.0f;
+	float texit  = std::numeric_limits<float>::max();
+	for(int axis = 0; axis < 3; axis++) {
+		if(ray.direction[axis] == 0.0f) {
+			// Parallel to this axis, it never enters if it starts outside
+			if(ray.origin[axis] < this->worldmin[axis] || ray.origin[axis] > worldmax[axis]) {
+				return closest_hit;
+			}
+			continue;
+		}
 
-	// Handle case where ray starts outside the grid
-	if (currentcell.x < 0 || currentcell.x >= this->griddims.x ||
-		currentcell.y < 0 || currentcell.y >= this->griddims.y ||
-		currentcell.z < 0 || currentcell.z >= this->griddims.z) {
-		// A more robust implementation would find the entry point.
-		// For this example, we'll just assume rays start inside or don't hit.
+		const float t0 = (this->worldmin[axis] - ray.origin[axis]) / ray.direction[axis];
+		const float t1 = (worldmax[axis] - ray.origin[axis]) / ray.direction[axis];
+		tenter = std::max(tenter, std::min(t0, t1));
+		texit  = std::min(texit, std::max(t0, t1));
+	}
+	if(tenter > texit) {
 		return closest_hit;
 	}
 
-	const vec3<int> step = vec3<int>(
-		(ray.direction.x > 0) ? 1 : -1,
-		(ray.direction.y > 0) ? 1 : -1,
-		(ray.direction.z > 0) ? 1 : -1
-	);
-
-	const vec3<int> next_boundary = vec3<int>(
-		((float)currentcell.x + (step.x > 0 ? 1 : 0)) * this->cellsize.x,
-		((float)currentcell.y + (step.y > 0 ? 1 : 0)) * this->cellsize.y,
-		((float)currentcell.z + (step.z > 0 ? 1 : 0)) * this->cellsize.z
-	);
+	// Voxel Traversal Algorithm (Amanatides & Woo)
+	// This algorithm efficiently finds every cell a ray passes through
+	const vec3<int> griddims = (vec3<int>)this->griddims;
+	vec3<int> currentcell = (vec3<int>)this->get_cell_index(ray.origin + ray.direction * tenter);
+
+	vec3<int> step;
+	vec3<float> tmax;
+	vec3<float> tdelta;
+	for(int axis = 0; axis < 3; axis++) {
+		if(ray.direction[axis] == 0.0f) {
+			step[axis]   = 0;
+			tmax[axis]   = std::numeric_limits<float>::max();
+			tdelta[axis] = std::numeric_limits<float>::max();
+			continue;
+		}
 
-	vec3<float> tmax   = ((vec3<float>)next_boundary - ray.origin) / ray.direction;
-	vec3<float> tdelta = this->cellsize / glm::abs(ray.direction);
+		step[axis] = (ray.direction[axis] > 0.0f) ? 1 : -1;
+		const float next_boundary = this->worldmin[axis] + (float)(currentcell[axis] + (step[axis] > 0 ? 1 : 0)) * this->cellsize[axis];
+		tmax[axis]   = (next_boundary - ray.origin[axis]) / ray.direction[axis];
+		tdelta[axis] = this->cellsize[axis] / std::abs(ray.direction[axis]);
+	}
 
 	// Transverse the grid
-	// Safety break
-	for(int i = 0; i < 100; i++) {
-		// Test triangles in the current cell
-		uint32 linearindex = currentcell.z * this->griddims.x * this->griddims.y + currentcell.y * this->griddims.x + currentcell.x;
-		for(const auto& tri : this->cells[(size_t)linearindex]) {
-			float dist;
-			if(Raycast::intersects_triangle(ray, tri, dist)) {
-				if(dist < closest_hit.distance) {
+	while(true) {
+		// Test triangles in the current cell, empty cells are skipped using only the bitmask
+		const size_t linearindex = ((size_t)currentcell.z * this->griddims.y + (size_t)currentcell.y) * this->griddims.x + (size_t)currentcell.x;
+		if(this->is_occupied(linearindex)) {
+			const uint32 end = this->cell_offsets[linearindex + 1];
+			for(uint32 i = this->cell_offsets[linearindex]; i < end; i++) {
+				const MeshTriangle& tri = this->triangles[this->cell_triangles[i]];
+				float dist;
+				if(Raycast::intersects_triangle(ray, tri, dist) && dist < closest_hit.distance) {
 					closest_hit.hit = true;
 					closest_hit.distance = dist;
 					closest_hit.point = ray.origin + ray.direction * dist;
@@ -125,34 +185,30 @@ Raycast::Rayhit UniformGrid::raycast(const Raycast::Ray& ray) const noexcept {
 			}
 		}
 
-		// If have a hit, dont need to check cells further away
-		if(closest_hit.hit && (tmax.x > closest_hit.distance && tmax.y > closest_hit.distance && tmax.z > closest_hit.distance)) {
+		// Where the ray leaves the current cell
+		const float tnext = std::min(std::min(tmax.x, tmax.y), tmax.z);
+
+		// If have a hit inside this cell, dont need to check cells further away
+		if(closest_hit.hit && closest_hit.distance <= tnext) {
+			break;
+		}
+		// Left the grid
+		if(tnext > texit) {
 			break;
 		}
 
 		// Move to the next cell
+		int axis;
 		if(tmax.x < tmax.y) {
-			if(tmax.x < tmax.z) {
-				currentcell.x += step.x;
-				tmax.x += tdelta.x;
-			} else {
-				currentcell.z += step.z;
-				tmax.z += tdelta.z;
-			}
+			axis = (tmax.x < tmax.z) ? 0 : 2;
 		} else {
-			if(tmax.y < tmax.z) {
-				currentcell.y += step.y;
-				tmax.y += tdelta.y;
-			} else {
-				currentcell.z += step.z;
-				tmax.z += tdelta.z;
-			}
+			axis = (tmax.y < tmax.z) ? 1 : 2;
 		}
+		currentcell[axis] += step[axis];
+		tmax[axis] += tdelta[axis];
 
 		// Check if exited the grid
-		if (currentcell.x < 0 || currentcell.x >= this->griddims.x ||
-			currentcell.y < 0 || currentcell.y >= this->griddims.y ||
-			currentcell.z < 0 || currentcell.z >= this->griddims.z) {
+		if(currentcell[axis] < 0 || currentcell[axis] >= griddims[axis]) {
 			break;
 		}
 	}
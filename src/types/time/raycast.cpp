@@ -100,10 +100,12 @@ Raycast::Rayhit Raycast::cast(const Ray& ray, const std::function<bool(const vec
 // }
 
 bool Raycast::intersects_triangle(const Ray& ray, const MeshTriangle& triangle, float& out_distance) {
+	return Raycast::intersects_triangle(ray, triangle.v0, triangle.v1 - triangle.v0, triangle.v2 - triangle.v0, out_distance);
+}
+
+bool Raycast::intersects_triangle(const Ray& ray, const vec3<float>& v0, const vec3<float>& edge1, const vec3<float>& edge2, float& out_distance) {
 	constexpr float EPSILON = 0.0000001f;
 
-	const vec3<float> edge1 = triangle.v1 - triangle.v0;
-	const vec3<float> edge2 = triangle.v2 - triangle.v0;
 	const vec3<float> h = glm::cross(ray.direction, edge2);
 
 	const float a = glm::dot(edge1, h);
@@ -114,7 +116,7 @@ bool Raycast::intersects_triangle(const Ray& ray, const MeshTriangle& triangle,
 	}
 
 	const float f = 1.0f / a;
-	const vec3<float> s = ray.origin - triangle.v0;
+	const vec3<float> s = ray.origin - v0;
 	const float u = f * glm::dot(s, h);
 
 	if(u < 0.0f || u > 1.0f) {
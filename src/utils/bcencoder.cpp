@@ -0,0 +1,465 @@
+#include "scarablib/utils/bcencoder.hpp"
+#include "scarablib/proper/error.hpp"
+#include "scarablib/proper/log.hpp"
+#include "scarablib/utils/image.hpp"
+#include "scarablib/utils/thread.hpp"
+#include "scarablib/utils/vfs.hpp"
+#include <bit>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+// #define SCARAB_DEBUG_BC_ENCODER
+
+// Endpoints are found along the principal axis of the block colors (like stb_dxt and squish's range fit),
+// then refined once with least squares. Good enough for runtime and much faster than cluster fit
+
+namespace {
+	using Format = CompressedImage::Format;
+
+	// Rows of blocks per job
+	constexpr size_t MIN_BLOCK_ROWS = 4;
+
+	// Converts any image to RGBA
+	std::vector<uint8> to_rgba(const Image& image) {
+		const size_t count = static_cast<size_t>(image.width) * static_cast<size_t>(image.height);
+		std::vector<uint8> rgba(count * 4);
+		ScarabImage::to_rgba(image.data, static_cast<uint32>(image.channels), rgba.data(), count);
+		return rgba;
+	}
+
+	// Halves the image with a box filter
+	std::vector<uint8> downsample(const std::vector<uint8>& src, const uint32 width, const uint32 height) {
+		std::vector<uint8> dst(static_cast<size_t>(std::max<uint32>(width / 2, 1)) * std::max<uint32>(height / 2, 1) * 4);
+		ScarabImage::downscale_box(src.data(), width, height, 4, dst.data());
+		return dst;
+	}
+
+	// Copies a 4x4 block, repeating the last row and column at the edges
+	void fetch_block(const uint8* rgba, const uint32 width, const uint32 height,
+			const uint32 blockx, const uint32 blocky, uint8 (&block)[16][4]) noexcept {
+
+		for(uint32 y = 0; y < 4; y++) {
+			const uint32 py = std::min(blocky * 4 + y, height - 1);
+			for(uint32 x = 0; x < 4; x++) {
+				const uint32 px = std::min(blockx * 4 + x, width - 1);
+				std::memcpy(block[y * 4 + x], rgba + (static_cast<size_t>(py) * width + px) * 4, 4);
+			}
+		}
+	}
+
+	inline uint16 pack565(const float (&color)[3]) noexcept {
+		const uint32 r = static_cast<uint32>(std::clamp(std::lround(color[0] * 31.0f / 255.0f), 0l, 31l));
+		const uint32 g = static_cast<uint32>(std::clamp(std::lround(color[1] * 63.0f / 255.0f), 0l, 63l));
+		const uint32 b = static_cast<uint32>(std::clamp(std::lround(color[2] * 31.0f / 255.0f), 0l, 31l));
+		return static_cast<uint16>((r << 11) | (g << 5) | b);
+	}
+
+	inline void unpack565(const uint16 packed, int (&color)[3]) noexcept {
+		const int r = (packed >> 11) & 31;
+		const int g = (packed >> 5) & 63;
+		const int b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	inline void write16(uint8* out, const uint16 value) noexcept {
+		out[0] = static_cast<uint8>(value);
+		out[1] = static_cast<uint8>(value >> 8);
+	}
+
+	// Least squares endpoints for the current index assignment (4 colors mode).
+	// Returns false if the system can't be solved (e.g., all pixels use the same index)
+	bool refine_endpoints(const uint8 (&block)[16][4], const bool (&skip)[16], float (&start)[3], float (&end)[3]) noexcept {
+		// Weight of `end` for each palette entry, in index order
+		constexpr float WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+		float palette[4][3];
+		for(uint32 c = 0; c < 3; c++) {
+			for(uint32 i = 0; i < 4; i++) {
+				palette[i][c] = start[c] + (end[c] - start[c]) * WEIGHTS[i];
+			}
+		}
+
+		float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+		float ax[3] = {}, bx[3] = {};
+		for(uint32 i = 0; i < 16; i++) {
+			if(skip[i]) {
+				continue;
+			}
+
+			uint32 best = 0;
+			float bestdist = FLT_MAX;
+			for(uint32 p = 0; p < 4; p++) {
+				float dist = 0.0f;
+				for(uint32 c = 0; c < 3; c++) {
+					const float d = palette[p][c] - block[i][c];
+					dist += d * d;
+				}
+				if(dist < bestdist) {
+					bestdist = dist;
+					best = p;
+				}
+			}
+
+			const float b = WEIGHTS[best];
+			const float a = 1.0f - b;
+			aa += a * a;
+			bb += b * b;
+			ab += a * b;
+			for(uint32 c = 0; c < 3; c++) {
+				ax[c] += a * block[i][c];
+				bx[c] += b * block[i][c];
+			}
+		}
+
+		const float det = aa * bb - ab * ab;
+		if(std::fabs(det) < 1e-6f) {
+			return false;
+		}
+
+		const float inv = 1.0f / det;
+		for(uint32 c = 0; c < 3; c++) {
+			start[c] = std::clamp((ax[c] * bb - bx[c] * ab) * inv, 0.0f, 255.0f);
+			end[c]   = std::clamp((bx[c] * aa - ax[c] * ab) * inv, 0.0f, 255.0f);
+		}
+		return true;
+	}
+
+	// BC1 color block, 8 bytes.
+	// If `alpha` is true, pixels with alpha < 128 are made transparent (3 colors mode)
+	void encode_bc1(const uint8 (&block)[16][4], const bool alpha, uint8* out) noexcept {
+		bool transparent[16];
+		bool has_transparent = false;
+		uint32 opaque = 0;
+		for(uint32 i = 0; i < 16; i++) {
+			transparent[i] = alpha && block[i][3] < 128;
+			has_transparent |= transparent[i];
+			opaque += !transparent[i];
+		}
+
+		if(opaque == 0) {
+			// Same endpoints is 3 colors mode, index 3 is transparent
+			write16(out, 0);
+			write16(out + 2, 0);
+			std::memset(out + 4, 0xFF, 4);
+			return;
+		}
+
+		// -- Principal axis
+		float mean[3] = {};
+		for(uint32 i = 0; i < 16; i++) {
+			if(!transparent[i]) {
+				for(uint32 c = 0; c < 3; c++) {
+					mean[c] += block[i][c];
+				}
+			}
+		}
+		for(float& value : mean) {
+			value /= static_cast<float>(opaque);
+		}
+
+		// Covariance: xx, xy, xz, yy, yz, zz
+		float cov[6] = {};
+		for(uint32 i = 0; i < 16; i++) {
+			if(transparent[i]) {
+				continue;
+			}
+			const float r = block[i][0] - mean[0];
+			const float g = block[i][1] - mean[1];
+			const float b = block[i][2] - mean[2];
+			cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+			cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+		}
+
+		float axis[3] = { 1.0f, 1.0f, 1.0f };
+		for(uint32 iteration = 0; iteration < 4; iteration++) {
+			const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+			const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+			const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+			const float length = std::max({ std::fabs(x), std::fabs(y), std::fabs(z) });
+			if(length < 1e-6f) {
+				break; // Flat block, any axis works
+			}
+			axis[0] = x / length;
+			axis[1] = y / length;
+			axis[2] = z / length;
+		}
+
+		// -- Endpoints are the extreme pixels along the axis
+		float minproj = FLT_MAX, maxproj = -FLT_MAX;
+		uint32 minindex = 0, maxindex = 0;
+		for(uint32 i = 0; i < 16; i++) {
+			if(transparent[i]) {
+				continue;
+			}
+			const float proj = block[i][0] * axis[0] + block[i][1] * axis[1] + block[i][2] * axis[2];
+			if(proj < minproj) {
+				minproj  = proj;
+				minindex = i;
+			}
+			if(proj > maxproj) {
+				maxproj  = proj;
+				maxindex = i;
+			}
+		}
+
+		float start[3], end[3];
+		for(uint32 c = 0; c < 3; c++) {
+			start[c] = block[maxindex][c];
+			end[c]   = block[minindex][c];
+			// Inset a bit, extremes are rarely the best endpoints
+			const float inset = (start[c] - end[c]) / 16.0f;
+			start[c] -= inset;
+			end[c]   += inset;
+		}
+
+		if(!has_transparent) {
+			refine_endpoints(block, transparent, start, end);
+		}
+
+		uint16 color0 = pack565(start);
+		uint16 color1 = pack565(end);
+		// color0 > color1 is 4 colors mode, otherwise 3 colors and transparent
+		if(has_transparent ? color0 > color1 : color0 < color1) {
+			std::swap(color0, color1);
+		}
+		const bool four_colors = color0 > color1;
+
+		int palette[4][3];
+		unpack565(color0, palette[0]);
+		unpack565(color1, palette[1]);
+		for(uint32 c = 0; c < 3; c++) {
+			if(four_colors) {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+			} else {
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+
+		// Index 3 is transparent in 3 colors mode, never used for opaque pixels
+		const uint32 count = (four_colors) ? 4 : 3;
+		uint32 indices = 0;
+		for(uint32 i = 0; i < 16; i++) {
+			uint32 best = 3;
+			if(!transparent[i]) {
+				int bestdist = INT32_MAX;
+				for(uint32 p = 0; p < count; p++) {
+					const int r = palette[p][0] - block[i][0];
+					const int g = palette[p][1] - block[i][1];
+					const int b = palette[p][2] - block[i][2];
+					const int dist = r * r + g * g + b * b;
+					if(dist < bestdist) {
+						bestdist = dist;
+						best = p;
+					}
+				}
+			}
+			indices |= best << (i * 2);
+		}
+
+		write16(out, color0);
+		write16(out + 2, color1);
+		std::memcpy(out + 4, &indices, 4); // Little endian
+	}
+
+	// BC4 single channel block, 8 bytes
+	void encode_bc4(const uint8 (&values)[16], uint8* out) noexcept {
+		uint8 low = 255, high = 0;
+		for(const uint8 value : values) {
+			low  = std::min(low, value);
+			high = std::max(high, value);
+		}
+
+		out[0] = high;
+		out[1] = low;
+		if(high == low) {
+			// All indices point to the first endpoint
+			std::memset(out + 2, 0, 6);
+			return;
+		}
+
+		// high > low is 8 values mode: endpoints and 6 interpolated values
+		int palette[8];
+		palette[0] = high;
+		palette[1] = low;
+		for(int i = 1; i <= 6; i++) {
+			palette[i + 1] = ((7 - i) * high + i * low + 3) / 7;
+		}
+
+		uint64 bits = 0;
+		for(uint32 i = 0; i < 16; i++) {
+			uint64 best = 0;
+			int bestdist = INT32_MAX;
+			for(uint32 p = 0; p < 8; p++) {
+				const int dist = std::abs(palette[p] - values[i]);
+				if(dist < bestdist) {
+					bestdist = dist;
+					best = p;
+				}
+			}
+			bits |= best << (i * 3);
+		}
+
+		for(uint32 i = 0; i < 6; i++) {
+			out[2 + i] = static_cast<uint8>(bits >> (i * 8));
+		}
+	}
+
+	inline void encode_bc4_channel(const uint8 (&block)[16][4], const uint32 channel, uint8* out) noexcept {
+		uint8 values[16];
+		for(uint32 i = 0; i < 16; i++) {
+			values[i] = block[i][channel];
+		}
+		encode_bc4(values, out);
+	}
+
+	void encode_block(const Format format, const uint8 (&block)[16][4], uint8* out) noexcept {
+		switch(format) {
+			case Format::BC1:
+				encode_bc1(block, true, out);
+				break;
+			case Format::BC3:
+				// Alpha block, then color block always read in 4 colors mode
+				encode_bc4_channel(block, 3, out);
+				encode_bc1(block, false, out + 8);
+				break;
+			case Format::BC4:
+				encode_bc4_channel(block, 0, out);
+				break;
+			case Format::BC5:
+				encode_bc4_channel(block, 0, out);
+				encode_bc4_channel(block, 1, out + 8);
+				break;
+			case Format::BC7:
+				break;
+		}
+	}
+
+	const char* format_name(const Format format) noexcept {
+		switch(format) {
+			case Format::BC1: return "bc1";
+			case Format::BC3: return "bc3";
+			case Format::BC4: return "bc4";
+			case Format::BC5: return "bc5";
+			case Format::BC7: return "bc7";
+		}
+		return "";
+	}
+}
+
+
+CompressedImage ScarabBC::encode(const Image& image, const CompressedImage::Format format, const bool mipmaps, const bool srgb) {
+	if(image.data == nullptr) {
+		throw ScarabError("Image (%s) has no data to compress", (image.path) ? image.path : "raw data");
+	}
+	if(format == Format::BC7) {
+		throw ScarabError("BC7 can't be encoded, only loaded");
+	}
+
+	uint32 width  = static_cast<uint32>(image.width);
+	uint32 height = static_cast<uint32>(image.height);
+	const uint32 levels = (mipmaps) ? static_cast<uint32>(std::bit_width(std::max(width, height))) : 1;
+
+	size_t total = 0;
+	for(uint32 level = 0; level < levels; level++) {
+		total += CompressedImage::surface_size(format, std::max<uint32>(width >> level, 1), std::max<uint32>(height >> level, 1));
+	}
+	std::vector<uint8> data(total);
+
+	std::vector<uint8> pixels = to_rgba(image);
+	const size_t blocksize = CompressedImage::block_size(format);
+	size_t offset = 0;
+
+	for(uint32 level = 0; level < levels; level++) {
+		const uint32 blocks_x = (width + 3) / 4;
+		const uint32 blocks_y = (height + 3) / 4;
+		uint8* surface = data.data() + offset;
+
+		ScarabThread::parallel_for(blocks_y, [&](const size_t begin, const size_t end) {
+			uint8 block[16][4];
+			for(size_t by = begin; by < end; by++) {
+				for(uint32 bx = 0; bx < blocks_x; bx++) {
+					fetch_block(pixels.data(), width, height, bx, static_cast<uint32>(by), block);
+					encode_block(format, block, surface + (by * blocks_x + bx) * blocksize);
+				}
+			}
+		}, MIN_BLOCK_ROWS);
+
+		offset += static_cast<size_t>(blocks_x) * blocks_y * blocksize;
+		if(level + 1 < levels) {
+			pixels = downsample(pixels, width, height);
+			width  = std::max<uint32>(width / 2, 1);
+			height = std::max<uint32>(height / 2, 1);
+		}
+	}
+
+	CompressedImage result = CompressedImage(format,
+		static_cast<uint32>(image.width), static_cast<uint32>(image.height), levels, 1, std::move(data));
+	result.srgb = srgb && (format == Format::BC1 || format == Format::BC3);
+	return result;
+}
+
+
+CompressedImage ScarabBC::load_cached(const char* path, const CompressedImage::Format format,
+		const bool flip_v, const bool flip_h, const bool mipmaps) {
+
+	if(path == nullptr) {
+		throw ScarabError("Texture has null path");
+	}
+
+	const std::filesystem::path source = path;
+	std::string cachename = source.string() + "." + format_name(format);
+	if(flip_v) {
+		cachename += "v";
+	}
+	if(flip_h) {
+		cachename += "h";
+	}
+	const std::filesystem::path cachepath = cachename + ".dds";
+
+	// Archives have no modification time, a cache packed with the image is always up to date
+	const bool archived = ScarabVFS::in_archive(source);
+	bool uptodate = false;
+	if(archived) {
+		uptodate = ScarabVFS::in_archive(cachepath);
+	} else {
+		std::error_code error;
+		const auto source_time = std::filesystem::last_write_time(source, error);
+		if(error) {
+			throw ScarabError("Image (%s) was not found", path);
+		}
+		const auto cache_time = std::filesystem::last_write_time(cachepath, error);
+		uptodate = !error && cache_time >= source_time;
+	}
+
+	if(uptodate) {
+		try {
+			CompressedImage cached = CompressedImage(cachepath.string().c_str());
+			if(cached.format == format && (cached.levels > 1) == mipmaps) {
+				return cached;
+			}
+		} catch(const std::exception& err) {
+			LOG_WARNING("Ignoring invalid texture cache: %s", err.what());
+		}
+	}
+
+#if defined(SCARAB_DEBUG_BC_ENCODER)
+	LOG_DEBUG("Compressing (%s) to %s", path, format_name(format));
+#endif
+
+	// Same arguments order as Assets::load
+	const Image image = Image(path, flip_v, flip_h);
+	if(image.data == nullptr) {
+		throw ScarabError("Image (%s) was not found", path);
+	}
+
+	CompressedImage result = ScarabBC::encode(image, format, mipmaps);
+	if(!archived && !result.save_dds(cachepath)) {
+		LOG_WARNING("Could not write texture cache (%s)", cachepath.string().c_str());
+	}
+	return result;
+}
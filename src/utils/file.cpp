@@ -1,70 +1,337 @@
 #include "scarablib/utils/file.hpp"
 #include "scarablib/typedef.hpp"
 #include <algorithm>
+#include <atomic>
 #include <filesystem>
 #include <fstream>
-#include <ios>
+#include <string>
+#include <thread>
+#include <utility>
 
 #include <unistd.h> // readlink
 
+#if !defined(_WIN32)
+	#include <fcntl.h>    // open
+	#include <sys/mman.h> // mmap
+	#include <sys/stat.h> // fstat
+#endif
+
+namespace {
+#if !defined(_WIN32)
+	inline int to_advice(const ScarabFile::Access access) noexcept {
+		switch(access) {
+			case ScarabFile::Access::Sequential: return MADV_SEQUENTIAL;
+			case ScarabFile::Access::Random:     return MADV_RANDOM;
+			case ScarabFile::Access::WillNeed:   return MADV_WILLNEED;
+			default:                             return MADV_NORMAL;
+		}
+	}
+#endif
+
+	// 64 bit offsets on all platforms
+	inline bool seek(std::FILE* file, const uint64 offset) noexcept {
+#if defined(_WIN32)
+		return _fseeki64(file, (long long)offset, SEEK_SET) == 0;
+#else
+		return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+	}
+
+	// Creates an empty file next to `path`, with a name no other writer is using.
+	// Returns an empty path if it could not be created
+	std::filesystem::path create_temp_file(const std::filesystem::path& path) noexcept {
+		static std::atomic<uint32> counter = 0;
+		const size_t thread = std::hash<std::thread::id>{}(std::this_thread::get_id());
+
+		try {
+			// A file left by a crash (or another process) may have the same name, try the next one
+			for(uint32 attempt = 0; attempt < 16; attempt++) {
+				std::filesystem::path temppath = path;
+				temppath += ".tmp." + std::to_string(thread) + "." + std::to_string(counter.fetch_add(1));
+
+			#if !defined(_WIN32)
+				// O_EXCL fails if the file exists, so the name is only ours
+				const int fd = open(temppath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+				if(fd >= 0) {
+					::close(fd);
+					return temppath;
+				}
+			#else
+				// "x" is the O_EXCL of fopen
+				std::FILE* file = _wfopen(temppath.c_str(), L"wbx");
+				if(file != nullptr) {
+					std::fclose(file);
+					return temppath;
+				}
+			#endif
+			}
+		} catch(...) {}
+
+		return {};
+	}
+}
+
+
+ScarabFile::MappedFile::MappedFile(const std::filesystem::path& path, const Access access) noexcept {
+#if !defined(_WIN32)
+	const int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0) {
+		return;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) == 0 && st.st_size > 0) {
+		void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(map != MAP_FAILED) {
+			this->mapped = map;
+			this->bytes  = static_cast<const uint8*>(map);
+			this->length = (size_t)st.st_size;
+			if(access != Access::Normal) {
+				madvise(map, this->length, to_advice(access));
+			}
+		}
+	}
+	close(fd); // Mapping stays valid after closing
+	if(this->mapped != nullptr) {
+		return;
+	}
+#endif
+
+	// Fallback
+	this->buffer = ScarabFile::read_binary_file(path);
+	if(!this->buffer.empty()) {
+		this->bytes  = this->buffer.data();
+		this->length = this->buffer.size();
+	}
+}
+
+ScarabFile::MappedFile::~MappedFile() noexcept {
+	this->release();
+}
+
+ScarabFile::MappedFile::MappedFile(MappedFile&& other) noexcept {
+	*this = std::move(other);
+}
+
+ScarabFile::MappedFile& ScarabFile::MappedFile::operator=(MappedFile&& other) noexcept {
+	if(this == &other) {
+		return *this;
+	}
+	this->release();
+
+	this->mapped = std::exchange(other.mapped, nullptr);
+	this->length = std::exchange(other.length, 0);
+	this->buffer = std::move(other.buffer);
+	this->bytes  = (this->mapped != nullptr) ? static_cast<const uint8*>(this->mapped) : this->buffer.data();
+	if(this->length == 0) {
+		this->bytes = nullptr;
+	}
+	other.bytes = nullptr;
+	return *this;
+}
+
+void ScarabFile::MappedFile::advise(const Access access, const size_t offset, const size_t size) const noexcept {
+#if !defined(_WIN32)
+	if(this->mapped == nullptr || offset >= this->length) {
+		return;
+	}
+	// Must start at a page
+	static const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	const size_t start = offset - (offset % page_size);
+	const size_t end   = offset + std::min(size, this->length - offset);
+	madvise(static_cast<uint8*>(this->mapped) + start, end - start, to_advice(access));
+#else
+	(void)access; (void)offset; (void)size;
+#endif
+}
+
+void ScarabFile::MappedFile::release() noexcept {
+#if !defined(_WIN32)
+	if(this->mapped != nullptr) {
+		munmap(this->mapped, this->length);
+	}
+#endif
+	this->mapped = nullptr;
+	this->bytes  = nullptr;
+	this->length = 0;
+	this->buffer.clear();
+}
+
+ScarabFile::FileReader::FileReader(const std::filesystem::path& path, const size_t chunk_size) noexcept {
+	std::error_code error;
+	const uintmax_t size = std::filesystem::file_size(path, error);
+	if(error) {
+		return;
+	}
+
+#if defined(_WIN32)
+	this->file = _wfopen(path.c_str(), L"rb");
+#else
+	this->file = std::fopen(path.c_str(), "rb");
+#endif
+	if(this->file == nullptr) {
+		return;
+	}
+	// Chunks are already big, no need for stdio's buffer
+	std::setvbuf(this->file, nullptr, _IONBF, 0);
+#if !defined(_WIN32)
+	posix_fadvise(fileno(this->file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	this->length = (uint64)size;
+	this->buffer.resize(std::max<size_t>(std::min<uint64>(chunk_size, this->length), 1));
+}
+
+ScarabFile::FileReader::~FileReader() noexcept {
+	this->close();
+}
+
+ScarabFile::FileReader::FileReader(FileReader&& other) noexcept {
+	*this = std::move(other);
+}
+
+ScarabFile::FileReader& ScarabFile::FileReader::operator=(FileReader&& other) noexcept {
+	if(this == &other) {
+		return *this;
+	}
+	this->close();
+
+	this->file   = std::exchange(other.file, nullptr);
+	this->buffer = std::move(other.buffer);
+	this->length = std::exchange(other.length, 0);
+	this->offset = std::exchange(other.offset, 0);
+	return *this;
+}
+
+std::span<const uint8> ScarabFile::FileReader::next() noexcept {
+	if(this->file == nullptr || this->offset >= this->length) {
+		return {};
+	}
+
+	const size_t count = std::fread(this->buffer.data(), 1, this->buffer.size(), this->file);
+	this->offset += count;
+	return std::span<const uint8>(this->buffer.data(), count);
+}
+
+void ScarabFile::FileReader::close() noexcept {
+	if(this->file != nullptr) {
+		std::fclose(this->file);
+	}
+	this->file = nullptr;
+	this->buffer.clear();
+	this->length = 0;
+	this->offset = 0;
+}
+
+
+size_t ScarabFile::read_into(const std::filesystem::path& path, std::span<uint8> dst, const uint64 offset) noexcept {
+	if(dst.empty()) {
+		return 0;
+	}
+
+#if defined(_WIN32)
+	std::FILE* file = _wfopen(path.c_str(), L"rb");
+#else
+	std::FILE* file = std::fopen(path.c_str(), "rb");
+#endif
+	if(file == nullptr) {
+		return 0;
+	}
+	// Read straight to `dst`
+	std::setvbuf(file, nullptr, _IONBF, 0);
+
+	size_t count = 0;
+	if(seek(file, offset)) {
+		count = std::fread(dst.data(), 1, dst.size(), file);
+	}
+	std::fclose(file);
+	return count;
+}
+
 std::string ScarabFile::read_file(const std::filesystem::path& path) noexcept {
-	if(!ScarabFile::file_exists(path)) {
+	std::error_code error;
+	const uintmax_t size = std::filesystem::file_size(path, error);
+	if(error) {
 		return "";
 	}
-	std::ifstream file = std::ifstream(path);
 
-	// Prepare buffer
+	// Read straight to the returned string
 	std::string buffer;
-	file.seekg(0, std::ios::end);
-
-	const int64 size = file.tellg();
 	buffer.resize((size_t)size);
-
-	// Read
-	file.seekg(0, std::ios::beg);
-	file.read(buffer.data(), size);
-
+	buffer.resize(ScarabFile::read_into(path, std::span<uint8>(reinterpret_cast<uint8*>(buffer.data()), buffer.size())));
 	return buffer;
 }
 
 char* ScarabFile::read_file_char(const std::filesystem::path& path) noexcept {
-	if(!ScarabFile::file_exists(path)) {
+	std::error_code error;
+	const uintmax_t size = std::filesystem::file_size(path, error);
+	if(error) {
 		return nullptr;
 	}
 
-	std::string content = ScarabFile::read_file(path);
-	size_t size = content.size();
-
-	// Allocate memory for the content
-	char* result = new char[size + 1];
-	std::copy(content.begin(), content.end(), result);
+	// Read straight to the returned memory
+	char* result = new char[(size_t)size + 1];
+	const size_t count = ScarabFile::read_into(path, std::span<uint8>(reinterpret_cast<uint8*>(result), (size_t)size));
 
-	result[size] = '\0'; // Null-terminate the string
+	result[count] = '\0'; // Null-terminate the string
 	return result;
 }
 
 std::vector<uint8> ScarabFile::read_binary_file(const std::filesystem::path& path) noexcept {
-	if(!ScarabFile::file_exists(path)) {
+	std::error_code error;
+	const uintmax_t size = std::filesystem::file_size(path, error);
+	if(error) {
 		return {};
 	}
-	// Open in binary mode
-	std::ifstream file = std::ifstream(path, std::ios::binary | std::ios::ate);
 
-	// Get file size
-	std::streamsize size = file.tellg();
+	// Read straight to the returned buffer
+	std::vector<uint8> buffer = std::vector<uint8>((size_t)size);
+	if(ScarabFile::read_into(path, buffer) != buffer.size()) {
+		return {};
+	}
+	return buffer;
+}
 
-	// Return to the beginning for reading
-	file.seekg(0, std::ios::beg);
+bool ScarabFile::write_atomic(const std::filesystem::path& path, const std::function<void(std::ostream&)>& write) {
+	const std::filesystem::path temppath = create_temp_file(path);
+	if(temppath.empty()) {
+		return false;
+	}
 
-	// Create a buffer
-	std::vector<uint8> buffer = std::vector<uint8>(static_cast<size_t>(size));
+	std::error_code error;
+	try {
+		std::ofstream file(temppath, std::ios::binary | std::ios::trunc);
+		if(file) {
+			write(file);
+			file.close();
+		}
+		if(!file) {
+			file.close();
+			std::filesystem::remove(temppath, error);
+			return false;
+		}
+	} catch(...) {
+		// The stream is closed by now
+		std::filesystem::remove(temppath, error);
+		throw;
+	}
 
-	// Read file into buffer
-	if(!file.read(reinterpret_cast<char*>(buffer.data()), size)) {
-		return {};
+	std::filesystem::rename(temppath, path, error);
+	if(error) {
+		std::filesystem::remove(temppath, error);
+		return false;
 	}
+	return true;
+}
 
-	return buffer;
+bool ScarabFile::write_atomic(const std::filesystem::path& path, std::span<const uint8> bytes) noexcept {
+	try {
+		return ScarabFile::write_atomic(path, [bytes](std::ostream& file) {
+			file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+		});
+	} catch(...) {
+		return false;
+	}
 }
 
 std::vector<std::string> ScarabFile::list_files(const std::filesystem::path& path, const bool sort) noexcept {
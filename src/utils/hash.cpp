@@ -0,0 +1,212 @@
+#include "scarablib/utils/hash.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define SCARAB_HASH_SSE2
+	#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+	#include <intrin.h>
+#endif
+
+// Data is processed in stripes of 64 bytes, 16 stripes make a block.
+// Each stripe is mixed with a different part of the secret and accumulators are scrambled after each block.
+// Same construction as XXH3's long input loop
+
+namespace {
+	constexpr uint64 PRIME32_1 = 0x9E3779B1u;
+	constexpr uint64 PRIME64_1 = 0x9E3779B185EBCA87ull;
+	constexpr uint64 PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+	constexpr uint64 PRIME64_3 = 0x165667B19E3779F9ull;
+	constexpr uint64 PRIME64_4 = 0x85EBCA77C2B2AE63ull;
+	constexpr uint64 PRIME64_5 = 0x27D4EB2F165667C5ull;
+
+	constexpr size_t STRIPE_SIZE       = 64;
+	constexpr uint32 STRIPES_PER_BLOCK = 16;
+	// Offset of the secret used to scramble
+	constexpr size_t SCRAMBLE_OFFSET   = 128;
+
+	// 192 bytes of random looking constants, made with splitmix64
+	struct Secret {
+		alignas(16) uint64 words[24];
+
+		constexpr Secret() noexcept : words() {
+			uint64 state = PRIME64_5;
+			for(uint64& word : this->words) {
+				state += 0x9E3779B97F4A7C15ull;
+				uint64 value = state;
+				value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+				value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+				word  = value ^ (value >> 31);
+			}
+		}
+	};
+	constexpr Secret SECRET = Secret();
+
+	inline const uint8* secret_at(const size_t offset) noexcept {
+		return reinterpret_cast<const uint8*>(SECRET.words) + offset;
+	}
+
+	inline uint64 read64(const uint8* data) noexcept {
+		uint64 value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	// 64x64 -> 128 bits multiplication, folded to 64 bits
+	inline uint64 mul128_fold64(const uint64 a, const uint64 b) noexcept {
+	#if defined(__SIZEOF_INT128__)
+		const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+		return static_cast<uint64>(product) ^ static_cast<uint64>(product >> 64);
+	#elif defined(_MSC_VER) && defined(_M_X64)
+		uint64 high;
+		const uint64 low = _umul128(a, b, &high);
+		return low ^ high;
+	#else
+		const uint64 alo = a & 0xFFFFFFFF, ahi = a >> 32;
+		const uint64 blo = b & 0xFFFFFFFF, bhi = b >> 32;
+		const uint64 lolo = alo * blo;
+		const uint64 hilo = ahi * blo;
+		const uint64 lohi = alo * bhi;
+		const uint64 hihi = ahi * bhi;
+		const uint64 cross = (lolo >> 32) + (hilo & 0xFFFFFFFF) + lohi;
+		const uint64 high  = (hilo >> 32) + (cross >> 32) + hihi;
+		const uint64 low   = (cross << 32) | (lolo & 0xFFFFFFFF);
+		return low ^ high;
+	#endif
+	}
+
+	inline uint64 avalanche(uint64 hash) noexcept {
+		hash ^= hash >> 37;
+		hash *= 0x165667919E3779F9ull;
+		hash ^= hash >> 32;
+		return hash;
+	}
+
+	// Mixes one stripe into the accumulators
+	inline void accumulate(uint64* acc, const uint8* stripe, const uint8* secret) noexcept {
+	#if defined(SCARAB_HASH_SSE2)
+		__m128i* vacc = reinterpret_cast<__m128i*>(acc);
+		for(size_t i = 0; i < 4; i++) {
+			const __m128i data    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stripe) + i);
+			const __m128i key     = _mm_loadu_si128(reinterpret_cast<const __m128i*>(secret) + i);
+			const __m128i datakey = _mm_xor_si128(data, key);
+			// Low 32 bits times high 32 bits of each lane
+			const __m128i high    = _mm_shuffle_epi32(datakey, _MM_SHUFFLE(0, 3, 0, 1));
+			const __m128i product = _mm_mul_epu32(datakey, high);
+			// Data is added to the other lane, so both halves keep their entropy
+			const __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+			vacc[i] = _mm_add_epi64(vacc[i], _mm_add_epi64(product, swapped));
+		}
+	#else
+		for(size_t i = 0; i < 8; i++) {
+			const uint64 data    = read64(stripe + i * 8);
+			const uint64 datakey = data ^ read64(secret + i * 8);
+			acc[i ^ 1] += data;
+			acc[i]     += (datakey & 0xFFFFFFFF) * (datakey >> 32);
+		}
+	#endif
+	}
+
+	// Keeps the accumulators from growing in only a few bits, once per block
+	inline void scramble(uint64* acc) noexcept {
+		const uint8* secret = secret_at(SCRAMBLE_OFFSET);
+		for(size_t i = 0; i < 8; i++) {
+			uint64 value = acc[i];
+			value ^= value >> 47;
+			value ^= read64(secret + i * 8);
+			acc[i] = value * PRIME32_1;
+		}
+	}
+
+	inline void process_stripe(uint64* acc, uint32& stripe, const uint8* data) noexcept {
+		accumulate(acc, data, secret_at(static_cast<size_t>(stripe) * 8));
+		if(++stripe == STRIPES_PER_BLOCK) {
+			scramble(acc);
+			stripe = 0;
+		}
+	}
+}
+
+
+ScarabHash::Hasher::Hasher(const uint64 seed) noexcept {
+	const uint64 init[8] = {
+		PRIME32_1, PRIME64_1, PRIME64_2, PRIME64_3,
+		PRIME64_4, 0x85EBCA77u, PRIME64_5, 0xC2B2AE3Du
+	};
+	for(size_t i = 0; i < 8; i++) {
+		// Seed is added with alternated sign, as in XXH3
+		this->acc[i] = (i % 2 == 0) ? init[i] + seed : init[i] - seed;
+	}
+}
+
+
+void ScarabHash::Hasher::update(const void* data, const size_t size) noexcept {
+	if(size == 0) {
+		return;
+	}
+
+	const uint8* bytes = static_cast<const uint8*>(data);
+	size_t remaining   = size;
+	this->length += size;
+
+	// Complete the buffered stripe first
+	if(this->buffered > 0) {
+		const size_t fill = std::min<size_t>(STRIPE_SIZE - this->buffered, remaining);
+		std::memcpy(this->buffer + this->buffered, bytes, fill);
+		this->buffered += static_cast<uint32>(fill);
+		bytes     += fill;
+		remaining -= fill;
+
+		if(this->buffered < STRIPE_SIZE) {
+			return;
+		}
+		process_stripe(this->acc, this->stripe, this->buffer);
+		this->buffered = 0;
+	}
+
+	// Full stripes straight from the input
+	while(remaining >= STRIPE_SIZE) {
+		process_stripe(this->acc, this->stripe, bytes);
+		bytes     += STRIPE_SIZE;
+		remaining -= STRIPE_SIZE;
+	}
+
+	if(remaining > 0) {
+		std::memcpy(this->buffer, bytes, remaining);
+		this->buffered = static_cast<uint32>(remaining);
+	}
+}
+
+
+uint64 ScarabHash::Hasher::digest() const noexcept {
+	alignas(16) uint64 result[8];
+	std::memcpy(result, this->acc, sizeof(result));
+
+	// Last stripe is padded with zeros, the length is mixed below so padding can't collide
+	if(this->buffered > 0) {
+		alignas(16) uint8 last[STRIPE_SIZE] = {};
+		std::memcpy(last, this->buffer, this->buffered);
+		accumulate(result, last, secret_at(static_cast<size_t>(this->stripe) * 8));
+	}
+
+	// Merge accumulators
+	const uint8* secret = secret_at(11);
+	uint64 hash = this->length * PRIME64_1;
+	for(size_t i = 0; i < 4; i++) {
+		hash += mul128_fold64(
+			result[i * 2]     ^ read64(secret + i * 16),
+			result[i * 2 + 1] ^ read64(secret + i * 16 + 8)
+		);
+	}
+	return avalanche(hash);
+}
+
+
+uint64 ScarabHash::hash_bytes(const void* data, const size_t size, const uint64 seed) noexcept {
+	ScarabHash::Hasher hasher(seed);
+	hasher.update(data, size);
+	return hasher.digest();
+}
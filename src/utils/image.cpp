@@ -0,0 +1,881 @@
+#include "scarablib/utils/image.hpp"
+#include "scarablib/utils/thread.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define SCARAB_IMAGE_SSE2
+	#include <emmintrin.h>
+	// AVX2 functions are compiled with a target attribute, so the library still runs on older CPUs
+	#if defined(__GNUC__) || defined(__clang__)
+		#define SCARAB_IMAGE_AVX2
+		#define SCARAB_TARGET_AVX2 __attribute__((target("avx2")))
+		#include <immintrin.h>
+	#elif defined(_MSC_VER)
+		#define SCARAB_IMAGE_AVX2
+		#define SCARAB_TARGET_AVX2
+		#include <immintrin.h>
+		#include <intrin.h>
+	#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	#define SCARAB_IMAGE_NEON
+	#include <arm_neon.h>
+#endif
+
+// Each instruction set has its own namespace with the same kernels.
+// Kernels only handle the bulk of the data and use the scalar version for what is left,
+// so all of them give the same result
+
+namespace {
+	// Flags returned by `alpha_scan`
+	constexpr uint32 NOT_OPAQUE = 1;
+	constexpr uint32 NOT_CUTOUT = 2;
+
+	// Rows per job in `resize_lanczos`
+	constexpr size_t LANCZOS_MIN_ROWS = 16;
+	constexpr float LANCZOS_RADIUS    = 3.0f;
+
+	// c * a / 255, rounded
+	inline uint8 mul255(const uint32 c, const uint32 a) noexcept {
+		const uint32 t = c * a + 128;
+		return static_cast<uint8>((t + (t >> 8)) >> 8);
+	}
+
+	namespace scalar {
+		// Reverses the pixels in [begin, end) of a row
+		void flip_span(uint8* row, uint32 begin, uint32 end, const uint32 channels) noexcept {
+			while(end - begin > 1) {
+				end--;
+				std::swap_ranges(row + begin * channels, row + (begin + 1) * channels, row + end * channels);
+				begin++;
+			}
+		}
+
+		void flip_row4(uint8* row, const uint32 width) noexcept {
+			flip_span(row, 0, width, 4);
+		}
+
+		void flip_row1(uint8* row, const uint32 width) noexcept {
+			flip_span(row, 0, width, 1);
+		}
+
+		void rgb_to_rgba(const uint8* src, uint8* dst, const size_t count, const uint8 alpha) noexcept {
+			for(size_t i = 0; i < count; i++, src += 3, dst += 4) {
+				dst[0] = src[0];
+				dst[1] = src[1];
+				dst[2] = src[2];
+				dst[3] = alpha;
+			}
+		}
+
+		void swizzle(uint8* data, const size_t count, const uint8* order) noexcept {
+			for(size_t i = 0; i < count; i++, data += 4) {
+				const uint8 pixel[4] = { data[0], data[1], data[2], data[3] };
+				data[0] = pixel[order[0]];
+				data[1] = pixel[order[1]];
+				data[2] = pixel[order[2]];
+				data[3] = pixel[order[3]];
+			}
+		}
+
+		void premultiply(uint8* data, const size_t count) noexcept {
+			for(size_t i = 0; i < count; i++, data += 4) {
+				const uint32 alpha = data[3];
+				data[0] = mul255(data[0], alpha);
+				data[1] = mul255(data[1], alpha);
+				data[2] = mul255(data[2], alpha);
+			}
+		}
+
+		uint32 alpha_scan(const uint8* data, const size_t count, const uint32 channels) noexcept {
+			uint32 flags = 0;
+			for(size_t i = 0; i < count; i++) {
+				const uint8 alpha = data[i * channels + channels - 1];
+				if(alpha != 255) {
+					flags |= NOT_OPAQUE;
+					if(alpha != 0) {
+						return NOT_OPAQUE | NOT_CUTOUT;
+					}
+				}
+			}
+			return flags;
+		}
+
+		uint32 alpha_scan4(const uint8* data, const size_t count) noexcept {
+			return alpha_scan(data, count, 4);
+		}
+
+		// One row of `downscale_box`, `begin` is the first output pixel
+		void box_row(const uint8* row0, const uint8* row1, const uint32 width, const uint32 channels,
+				uint8* dst, const uint32 begin, const uint32 dst_width) noexcept {
+
+			for(uint32 x = begin; x < dst_width; x++) {
+				const uint32 x0 = std::min(x * 2, width - 1) * channels;
+				const uint32 x1 = std::min(x * 2 + 1, width - 1) * channels;
+				for(uint32 c = 0; c < channels; c++) {
+					const uint32 sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+					dst[x * channels + c] = static_cast<uint8>((sum + 2) >> 2);
+				}
+			}
+		}
+
+		void box_row4(const uint8* row0, const uint8* row1, const uint32 width, uint8* dst, const uint32 dst_width) noexcept {
+			box_row(row0, row1, width, 4, dst, 0, dst_width);
+		}
+	}
+
+
+#if defined(SCARAB_IMAGE_SSE2)
+	namespace sse2 {
+		inline __m128i reverse_bytes(__m128i value) noexcept {
+			value = _mm_shuffle_epi32(value, _MM_SHUFFLE(0, 1, 2, 3));
+			value = _mm_shufflelo_epi16(value, _MM_SHUFFLE(2, 3, 0, 1));
+			value = _mm_shufflehi_epi16(value, _MM_SHUFFLE(2, 3, 0, 1));
+			return _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8));
+		}
+
+		void flip_row4(uint8* row, const uint32 width) noexcept {
+			uint32 begin = 0, end = width;
+			// Swaps 4 pixels from each side
+			while(end - begin >= 8) {
+				__m128i* left  = reinterpret_cast<__m128i*>(row + begin * 4);
+				__m128i* right = reinterpret_cast<__m128i*>(row + (end - 4) * 4);
+				const __m128i a = _mm_loadu_si128(left);
+				const __m128i b = _mm_loadu_si128(right);
+				_mm_storeu_si128(left,  _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 1, 2, 3)));
+				_mm_storeu_si128(right, _mm_shuffle_epi32(a, _MM_SHUFFLE(0, 1, 2, 3)));
+				begin += 4;
+				end   -= 4;
+			}
+			scalar::flip_span(row, begin, end, 4);
+		}
+
+		void flip_row1(uint8* row, const uint32 width) noexcept {
+			uint32 begin = 0, end = width;
+			while(end - begin >= 32) {
+				__m128i* left  = reinterpret_cast<__m128i*>(row + begin);
+				__m128i* right = reinterpret_cast<__m128i*>(row + end - 16);
+				const __m128i a = _mm_loadu_si128(left);
+				const __m128i b = _mm_loadu_si128(right);
+				_mm_storeu_si128(left,  reverse_bytes(b));
+				_mm_storeu_si128(right, reverse_bytes(a));
+				begin += 16;
+				end   -= 16;
+			}
+			scalar::flip_span(row, begin, end, 1);
+		}
+
+		void premultiply(uint8* data, const size_t count) noexcept {
+			const __m128i zero   = _mm_setzero_si128();
+			const __m128i round  = _mm_set1_epi16(128);
+			const __m128i amask  = _mm_set1_epi32(static_cast<int>(0xFF000000));
+
+			size_t i = 0;
+			for(; i + 4 <= count; i += 4) {
+				__m128i* pointer = reinterpret_cast<__m128i*>(data + i * 4);
+				const __m128i pixels = _mm_loadu_si128(pointer);
+
+				__m128i lo = _mm_unpacklo_epi8(pixels, zero);
+				__m128i hi = _mm_unpackhi_epi8(pixels, zero);
+				// Alpha of each pixel in all its lanes
+				const __m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+				const __m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+
+				lo = _mm_add_epi16(_mm_mullo_epi16(lo, alo), round);
+				hi = _mm_add_epi16(_mm_mullo_epi16(hi, ahi), round);
+				lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+				hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+				// Keeps the original alpha
+				const __m128i result = _mm_packus_epi16(lo, hi);
+				_mm_storeu_si128(pointer, _mm_or_si128(_mm_andnot_si128(amask, result), _mm_and_si128(amask, pixels)));
+			}
+			scalar::premultiply(data + i * 4, count - i);
+		}
+
+		uint32 alpha_scan4(const uint8* data, const size_t count) noexcept {
+			const __m128i amask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+			const __m128i zero  = _mm_setzero_si128();
+
+			uint32 flags = 0;
+			size_t i = 0;
+			for(; i + 4 <= count; i += 4) {
+				const __m128i alpha  = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 4)), amask);
+				const __m128i opaque = _mm_cmpeq_epi32(alpha, amask);
+				if(_mm_movemask_epi8(opaque) != 0xFFFF) {
+					flags |= NOT_OPAQUE;
+					if(_mm_movemask_epi8(_mm_or_si128(opaque, _mm_cmpeq_epi32(alpha, zero))) != 0xFFFF) {
+						return NOT_OPAQUE | NOT_CUTOUT;
+					}
+				}
+			}
+			return flags | scalar::alpha_scan(data + i * 4, count - i, 4);
+		}
+
+		void box_row4(const uint8* row0, const uint8* row1, const uint32 width, uint8* dst, const uint32 dst_width) noexcept {
+			if(width < 2) {
+				scalar::box_row(row0, row1, width, 4, dst, 0, dst_width);
+				return;
+			}
+
+			const __m128i zero  = _mm_setzero_si128();
+			const __m128i round = _mm_set1_epi16(2);
+
+			// 4 source pixels of each row make 2 pixels
+			uint32 x = 0;
+			for(; x + 2 <= dst_width; x += 2) {
+				const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+				const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+				const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+				const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+				// Adds the pixel pairs
+				const __m128i first  = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+				const __m128i second = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+				__m128i sum = _mm_unpacklo_epi64(first, second);
+				sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi16(sum, zero));
+			}
+			scalar::box_row(row0, row1, width, 4, dst, x, dst_width);
+		}
+	}
+#endif
+
+
+#if defined(SCARAB_IMAGE_AVX2)
+	namespace avx2 {
+		SCARAB_TARGET_AVX2
+		void flip_row4(uint8* row, const uint32 width) noexcept {
+			const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+			uint32 begin = 0, end = width;
+			while(end - begin >= 16) {
+				__m256i* left  = reinterpret_cast<__m256i*>(row + begin * 4);
+				__m256i* right = reinterpret_cast<__m256i*>(row + (end - 8) * 4);
+				const __m256i a = _mm256_loadu_si256(left);
+				const __m256i b = _mm256_loadu_si256(right);
+				_mm256_storeu_si256(left,  _mm256_permutevar8x32_epi32(b, reverse));
+				_mm256_storeu_si256(right, _mm256_permutevar8x32_epi32(a, reverse));
+				begin += 8;
+				end   -= 8;
+			}
+			scalar::flip_span(row, begin, end, 4);
+		}
+
+		SCARAB_TARGET_AVX2
+		void flip_row1(uint8* row, const uint32 width) noexcept {
+			const __m256i reverse = _mm256_setr_epi8(
+				15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+				15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+			);
+			uint32 begin = 0, end = width;
+			while(end - begin >= 64) {
+				__m256i* left  = reinterpret_cast<__m256i*>(row + begin);
+				__m256i* right = reinterpret_cast<__m256i*>(row + end - 32);
+				// Reverses inside each 128 bits lane, then swaps the lanes
+				const __m256i a = _mm256_shuffle_epi8(_mm256_loadu_si256(left), reverse);
+				const __m256i b = _mm256_shuffle_epi8(_mm256_loadu_si256(right), reverse);
+				_mm256_storeu_si256(left,  _mm256_permute2x128_si256(b, b, 1));
+				_mm256_storeu_si256(right, _mm256_permute2x128_si256(a, a, 1));
+				begin += 32;
+				end   -= 32;
+			}
+			scalar::flip_span(row, begin, end, 1);
+		}
+
+		SCARAB_TARGET_AVX2
+		void rgb_to_rgba(const uint8* src, uint8* dst, const size_t count, const uint8 alpha) noexcept {
+			const __m256i expand = _mm256_setr_epi8(
+				0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+				0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1
+			);
+			const __m256i alphas = _mm256_set1_epi32(static_cast<int>(static_cast<uint32>(alpha) << 24));
+
+			size_t i = 0;
+			// Each lane reads 16 bytes but uses 12, stop before reading past the end
+			for(; i + 10 <= count; i += 8) {
+				const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+				const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 12));
+				const __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4),
+					_mm256_or_si256(_mm256_shuffle_epi8(pixels, expand), alphas));
+			}
+			scalar::rgb_to_rgba(src + i * 3, dst + i * 4, count - i, alpha);
+		}
+
+		SCARAB_TARGET_AVX2
+		void swizzle(uint8* data, const size_t count, const uint8* order) noexcept {
+			alignas(32) int8 indices[32];
+			for(uint32 i = 0; i < 32; i++) {
+				indices[i] = static_cast<int8>((i & ~3u) % 16 + order[i & 3]);
+			}
+			const __m256i shuffle = _mm256_load_si256(reinterpret_cast<const __m256i*>(indices));
+
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8) {
+				__m256i* pointer = reinterpret_cast<__m256i*>(data + i * 4);
+				_mm256_storeu_si256(pointer, _mm256_shuffle_epi8(_mm256_loadu_si256(pointer), shuffle));
+			}
+			scalar::swizzle(data + i * 4, count - i, order);
+		}
+
+		SCARAB_TARGET_AVX2
+		void premultiply(uint8* data, const size_t count) noexcept {
+			const __m256i zero   = _mm256_setzero_si256();
+			const __m256i round  = _mm256_set1_epi16(128);
+			const __m256i amask  = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8) {
+				__m256i* pointer = reinterpret_cast<__m256i*>(data + i * 4);
+				const __m256i pixels = _mm256_loadu_si256(pointer);
+
+				__m256i lo = _mm256_unpacklo_epi8(pixels, zero);
+				__m256i hi = _mm256_unpackhi_epi8(pixels, zero);
+				const __m256i alo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+				const __m256i ahi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+
+				lo = _mm256_add_epi16(_mm256_mullo_epi16(lo, alo), round);
+				hi = _mm256_add_epi16(_mm256_mullo_epi16(hi, ahi), round);
+				lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+				hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+
+				// Unpack and pack work per lane, so the order is kept
+				const __m256i result = _mm256_packus_epi16(lo, hi);
+				_mm256_storeu_si256(pointer, _mm256_blendv_epi8(result, pixels, amask));
+			}
+			scalar::premultiply(data + i * 4, count - i);
+		}
+
+		SCARAB_TARGET_AVX2
+		uint32 alpha_scan4(const uint8* data, const size_t count) noexcept {
+			const __m256i amask = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+			const __m256i zero  = _mm256_setzero_si256();
+
+			uint32 flags = 0;
+			size_t i = 0;
+			for(; i + 8 <= count; i += 8) {
+				const __m256i alpha  = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i * 4)), amask);
+				const __m256i opaque = _mm256_cmpeq_epi32(alpha, amask);
+				if(static_cast<uint32>(_mm256_movemask_epi8(opaque)) != 0xFFFFFFFFu) {
+					flags |= NOT_OPAQUE;
+					const __m256i cutout = _mm256_or_si256(opaque, _mm256_cmpeq_epi32(alpha, zero));
+					if(static_cast<uint32>(_mm256_movemask_epi8(cutout)) != 0xFFFFFFFFu) {
+						return NOT_OPAQUE | NOT_CUTOUT;
+					}
+				}
+			}
+			return flags | scalar::alpha_scan(data + i * 4, count - i, 4);
+		}
+	}
+#endif
+
+
+#if defined(SCARAB_IMAGE_NEON)
+	namespace neon {
+		inline uint8x16_t reverse_pixels(const uint8x16_t value) noexcept {
+			const uint32x4_t swapped = vrev64q_u32(vreinterpretq_u32_u8(value));
+			return vreinterpretq_u8_u32(vcombine_u32(vget_high_u32(swapped), vget_low_u32(swapped)));
+		}
+
+		inline uint8x16_t reverse_bytes(const uint8x16_t value) noexcept {
+			const uint8x16_t swapped = vrev64q_u8(value);
+			return vcombine_u8(vget_high_u8(swapped), vget_low_u8(swapped));
+		}
+
+		void flip_row4(uint8* row, const uint32 width) noexcept {
+			uint32 begin = 0, end = width;
+			while(end - begin >= 8) {
+				uint8* left  = row + begin * 4;
+				uint8* right = row + (end - 4) * 4;
+				const uint8x16_t a = vld1q_u8(left);
+				const uint8x16_t b = vld1q_u8(right);
+				vst1q_u8(left,  reverse_pixels(b));
+				vst1q_u8(right, reverse_pixels(a));
+				begin += 4;
+				end   -= 4;
+			}
+			scalar::flip_span(row, begin, end, 4);
+		}
+
+		void flip_row1(uint8* row, const uint32 width) noexcept {
+			uint32 begin = 0, end = width;
+			while(end - begin >= 32) {
+				uint8* left  = row + begin;
+				uint8* right = row + end - 16;
+				const uint8x16_t a = vld1q_u8(left);
+				const uint8x16_t b = vld1q_u8(right);
+				vst1q_u8(left,  reverse_bytes(b));
+				vst1q_u8(right, reverse_bytes(a));
+				begin += 16;
+				end   -= 16;
+			}
+			scalar::flip_span(row, begin, end, 1);
+		}
+
+		void rgb_to_rgba(const uint8* src, uint8* dst, const size_t count, const uint8 alpha) noexcept {
+			size_t i = 0;
+			for(; i + 16 <= count; i += 16) {
+				const uint8x16x3_t rgb = vld3q_u8(src + i * 3);
+				uint8x16x4_t rgba;
+				rgba.val[0] = rgb.val[0];
+				rgba.val[1] = rgb.val[1];
+				rgba.val[2] = rgb.val[2];
+				rgba.val[3] = vdupq_n_u8(alpha);
+				vst4q_u8(dst + i * 4, rgba);
+			}
+			scalar::rgb_to_rgba(src + i * 3, dst + i * 4, count - i, alpha);
+		}
+
+		void swizzle(uint8* data, const size_t count, const uint8* order) noexcept {
+			uint8 indices[16];
+			for(uint32 i = 0; i < 16; i++) {
+				indices[i] = static_cast<uint8>((i & ~3u) + order[i & 3]);
+			}
+			const uint8x16_t table = vld1q_u8(indices);
+
+			size_t i = 0;
+			for(; i + 4 <= count; i += 4) {
+				vst1q_u8(data + i * 4, vqtbl1q_u8(vld1q_u8(data + i * 4), table));
+			}
+			scalar::swizzle(data + i * 4, count - i, order);
+		}
+
+		inline uint8x8_t mul255(const uint8x8_t color, const uint8x8_t alpha) noexcept {
+			uint16x8_t t = vaddq_u16(vmull_u8(color, alpha), vdupq_n_u16(128));
+			t = vaddq_u16(t, vshrq_n_u16(t, 8));
+			return vshrn_n_u16(t, 8);
+		}
+
+		void premultiply(uint8* data, const size_t count) noexcept {
+			size_t i = 0;
+			for(; i + 16 <= count; i += 16) {
+				uint8x16x4_t pixels = vld4q_u8(data + i * 4);
+				const uint8x16_t alpha = pixels.val[3];
+				for(uint32 c = 0; c < 3; c++) {
+					const uint8x8_t low  = mul255(vget_low_u8(pixels.val[c]), vget_low_u8(alpha));
+					const uint8x8_t high = mul255(vget_high_u8(pixels.val[c]), vget_high_u8(alpha));
+					pixels.val[c] = vcombine_u8(low, high);
+				}
+				vst4q_u8(data + i * 4, pixels);
+			}
+			scalar::premultiply(data + i * 4, count - i);
+		}
+
+		uint32 alpha_scan4(const uint8* data, const size_t count) noexcept {
+			uint32 flags = 0;
+			size_t i = 0;
+			for(; i + 16 <= count; i += 16) {
+				const uint8x16_t alpha  = vld4q_u8(data + i * 4).val[3];
+				const uint8x16_t opaque = vceqq_u8(alpha, vdupq_n_u8(255));
+				if(vminvq_u8(opaque) == 0) {
+					flags |= NOT_OPAQUE;
+					if(vminvq_u8(vorrq_u8(opaque, vceqq_u8(alpha, vdupq_n_u8(0)))) == 0) {
+						return NOT_OPAQUE | NOT_CUTOUT;
+					}
+				}
+			}
+			return flags | scalar::alpha_scan(data + i * 4, count - i, 4);
+		}
+	}
+#endif
+
+
+	// Kernels of one instruction set
+	struct Kernels {
+		ScarabImage::SIMD simd;
+		void (*flip_row4)(uint8* row, const uint32 width) noexcept;
+		void (*flip_row1)(uint8* row, const uint32 width) noexcept;
+		void (*rgb_to_rgba)(const uint8* src, uint8* dst, const size_t count, const uint8 alpha) noexcept;
+		void (*swizzle)(uint8* data, const size_t count, const uint8* order) noexcept;
+		void (*premultiply)(uint8* data, const size_t count) noexcept;
+		uint32 (*alpha_scan4)(const uint8* data, const size_t count) noexcept;
+		void (*box_row4)(const uint8* row0, const uint8* row1, const uint32 width, uint8* dst, const uint32 dst_width) noexcept;
+	};
+
+	constexpr Kernels SCALAR_KERNELS = {
+		ScarabImage::SIMD::Scalar,
+		scalar::flip_row4, scalar::flip_row1, scalar::rgb_to_rgba, scalar::swizzle,
+		scalar::premultiply, scalar::alpha_scan4, scalar::box_row4
+	};
+
+#if defined(SCARAB_IMAGE_SSE2)
+	// SSE2 has no byte shuffle, so RGB to RGBA and swizzle stay scalar
+	constexpr Kernels SSE2_KERNELS = {
+		ScarabImage::SIMD::SSE2,
+		sse2::flip_row4, sse2::flip_row1, scalar::rgb_to_rgba, scalar::swizzle,
+		sse2::premultiply, sse2::alpha_scan4, sse2::box_row4
+	};
+#endif
+
+#if defined(SCARAB_IMAGE_AVX2)
+	// Box filter is bound by memory, SSE2 is enough
+	constexpr Kernels AVX2_KERNELS = {
+		ScarabImage::SIMD::AVX2,
+		avx2::flip_row4, avx2::flip_row1, avx2::rgb_to_rgba, avx2::swizzle,
+		avx2::premultiply, avx2::alpha_scan4, sse2::box_row4
+	};
+#endif
+
+#if defined(SCARAB_IMAGE_NEON)
+	constexpr Kernels NEON_KERNELS = {
+		ScarabImage::SIMD::NEON,
+		neon::flip_row4, neon::flip_row1, neon::rgb_to_rgba, neon::swizzle,
+		neon::premultiply, neon::alpha_scan4, scalar::box_row4
+	};
+#endif
+
+	std::atomic<const Kernels*> active_kernels = nullptr;
+
+	const Kernels* kernels_for(const ScarabImage::SIMD simd) noexcept {
+		switch(simd) {
+		#if defined(SCARAB_IMAGE_SSE2)
+			case ScarabImage::SIMD::SSE2: return &SSE2_KERNELS;
+		#endif
+		#if defined(SCARAB_IMAGE_AVX2)
+			case ScarabImage::SIMD::AVX2: return &AVX2_KERNELS;
+		#endif
+		#if defined(SCARAB_IMAGE_NEON)
+			case ScarabImage::SIMD::NEON: return &NEON_KERNELS;
+		#endif
+			default: return &SCALAR_KERNELS;
+		}
+	}
+
+	inline const Kernels& kernels() noexcept {
+		const Kernels* current = active_kernels.load(std::memory_order_relaxed);
+		if(current == nullptr) {
+			current = kernels_for(ScarabImage::detect_simd());
+			active_kernels.store(current, std::memory_order_relaxed);
+		}
+		return *current;
+	}
+
+#if defined(SCARAB_IMAGE_AVX2)
+	bool cpu_has_avx2() noexcept {
+	#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_cpu_supports("avx2");
+	#else
+		int info[4];
+		__cpuid(info, 0);
+		if(info[0] < 7) {
+			return false;
+		}
+		// OS must save the AVX registers
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx     = (info[2] & (1 << 28)) != 0;
+		if(!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+	#endif
+	}
+#endif
+
+	// sRGB <-> linear tables
+	struct SRGBTables {
+		static constexpr uint32 LINEAR_STEPS = 4096;
+
+		float to_linear[256];
+		// First guess of the sRGB value of a linear value
+		uint8 guess[LINEAR_STEPS + 1];
+		// Linear value halfway between sRGB `i` and `i + 1`
+		float thresholds[255];
+
+		static float decode(const float value) noexcept {
+			return (value <= 0.04045f) ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+		}
+
+		SRGBTables() noexcept {
+			for(uint32 i = 0; i < 256; i++) {
+				this->to_linear[i] = decode(static_cast<float>(i) / 255.0f);
+			}
+			for(uint32 i = 0; i < 255; i++) {
+				this->thresholds[i] = decode((static_cast<float>(i) + 0.5f) / 255.0f);
+			}
+			uint32 code = 0;
+			for(uint32 i = 0; i <= LINEAR_STEPS; i++) {
+				const float value = static_cast<float>(i) / LINEAR_STEPS;
+				while(code < 255 && value >= this->thresholds[code]) {
+					code++;
+				}
+				this->guess[i] = static_cast<uint8>(code);
+			}
+		}
+
+		// Exact: the guess is off by at most a few steps near black
+		inline uint8 encode(const float value) const noexcept {
+			const float clamped = std::clamp(value, 0.0f, 1.0f);
+			uint32 code = this->guess[static_cast<uint32>(clamped * LINEAR_STEPS)];
+			while(code < 255 && clamped >= this->thresholds[code]) {
+				code++;
+			}
+			while(code > 0 && clamped < this->thresholds[code - 1]) {
+				code--;
+			}
+			return static_cast<uint8>(code);
+		}
+	};
+
+	const SRGBTables& srgb_tables() noexcept {
+		static const SRGBTables tables;
+		return tables;
+	}
+
+	inline float lanczos(const float x) noexcept {
+		if(x == 0.0f) {
+			return 1.0f;
+		}
+		if(std::fabs(x) >= LANCZOS_RADIUS) {
+			return 0.0f;
+		}
+		const float pix = std::numbers::pi_v<float> * x;
+		return LANCZOS_RADIUS * std::sin(pix) * std::sin(pix / LANCZOS_RADIUS) / (pix * pix);
+	}
+
+	// Weights of the source pixels used by each output pixel
+	struct LanczosFilter {
+		std::vector<int32> first;
+		std::vector<float> weights;
+		uint32 taps;
+
+		LanczosFilter(const uint32 size, const uint32 dst_size) {
+			const float scale   = static_cast<float>(size) / static_cast<float>(dst_size);
+			// Wider filter when downscaling, so all source pixels are used
+			const float stretch = std::max(scale, 1.0f);
+			const float support = LANCZOS_RADIUS * stretch;
+			this->taps = static_cast<uint32>(std::ceil(support * 2.0f)) + 1;
+
+			this->first.resize(dst_size);
+			this->weights.resize(static_cast<size_t>(dst_size) * this->taps);
+			for(uint32 d = 0; d < dst_size; d++) {
+				const float center = (static_cast<float>(d) + 0.5f) * scale;
+				const int32 start  = static_cast<int32>(std::floor(center - support));
+				this->first[d] = start;
+
+				float* weights = &this->weights[static_cast<size_t>(d) * this->taps];
+				float sum = 0.0f;
+				for(uint32 t = 0; t < this->taps; t++) {
+					const float position = static_cast<float>(start + static_cast<int32>(t)) + 0.5f;
+					weights[t] = lanczos((position - center) / stretch);
+					sum += weights[t];
+				}
+				for(uint32 t = 0; t < this->taps; t++) {
+					weights[t] /= sum;
+				}
+			}
+		}
+	};
+}
+
+
+ScarabImage::SIMD ScarabImage::detect_simd() noexcept {
+#if defined(SCARAB_IMAGE_NEON)
+	return SIMD::NEON;
+#elif defined(SCARAB_IMAGE_SSE2)
+	#if defined(SCARAB_IMAGE_AVX2)
+	if(cpu_has_avx2()) {
+		return SIMD::AVX2;
+	}
+	#endif
+	return SIMD::SSE2;
+#else
+	return SIMD::Scalar;
+#endif
+}
+
+ScarabImage::SIMD ScarabImage::get_simd() noexcept {
+	return kernels().simd;
+}
+
+void ScarabImage::set_simd(const SIMD simd) noexcept {
+	const SIMD best = ScarabImage::detect_simd();
+	bool supported = (simd == SIMD::Scalar || simd == best);
+#if defined(SCARAB_IMAGE_SSE2)
+	supported = supported || simd == SIMD::SSE2;
+#endif
+	active_kernels.store(kernels_for(supported ? simd : best), std::memory_order_relaxed);
+}
+
+
+void ScarabImage::flip_vertical(uint8* data, const uint32 width, const uint32 height, const uint32 channels) noexcept {
+	const size_t rowsize = static_cast<size_t>(width) * channels;
+	for(uint32 y = 0; y < height / 2; y++) {
+		uint8* top    = data + y * rowsize;
+		uint8* bottom = data + (height - 1 - y) * rowsize;
+		std::swap_ranges(top, top + rowsize, bottom);
+	}
+}
+
+void ScarabImage::flip_horizontal(uint8* data, const uint32 width, const uint32 height, const uint32 channels) noexcept {
+	const Kernels& kernel = kernels();
+	const size_t rowsize  = static_cast<size_t>(width) * channels;
+	for(uint32 y = 0; y < height; y++) {
+		uint8* row = data + y * rowsize;
+		switch(channels) {
+			case 4:  kernel.flip_row4(row, width); break;
+			case 1:  kernel.flip_row1(row, width); break;
+			default: scalar::flip_span(row, 0, width, channels); break;
+		}
+	}
+}
+
+void ScarabImage::rgb_to_rgba(const uint8* src, uint8* dst, const size_t count, const uint8 alpha) noexcept {
+	kernels().rgb_to_rgba(src, dst, count, alpha);
+}
+
+void ScarabImage::to_rgba(const uint8* src, const uint32 channels, uint8* dst, const size_t count) noexcept {
+	switch(channels) {
+		case 1:
+			for(size_t i = 0; i < count; i++, dst += 4) {
+				dst[0] = dst[1] = dst[2] = src[i];
+				dst[3] = 255;
+			}
+			break;
+		case 2:
+			for(size_t i = 0; i < count; i++, src += 2, dst += 4) {
+				dst[0] = dst[1] = dst[2] = src[0];
+				dst[3] = src[1];
+			}
+			break;
+		case 3:
+			kernels().rgb_to_rgba(src, dst, count, 255);
+			break;
+		default:
+			std::memcpy(dst, src, count * 4);
+			break;
+	}
+}
+
+void ScarabImage::swizzle(uint8* data, const size_t count, const std::array<uint8, 4>& order) noexcept {
+	const uint8 clamped[4] = {
+		static_cast<uint8>(order[0] & 3), static_cast<uint8>(order[1] & 3),
+		static_cast<uint8>(order[2] & 3), static_cast<uint8>(order[3] & 3)
+	};
+	kernels().swizzle(data, count, clamped);
+}
+
+void ScarabImage::premultiply_alpha(uint8* data, const size_t count) noexcept {
+	kernels().premultiply(data, count);
+}
+
+void ScarabImage::srgb_to_linear(const uint8* src, float* dst, const size_t count, const uint32 channels) noexcept {
+	const SRGBTables& tables = srgb_tables();
+	const bool has_alpha = (channels == 2 || channels == 4);
+	for(size_t i = 0; i < count; i++) {
+		for(uint32 c = 0; c < channels; c++) {
+			const size_t index = i * channels + c;
+			dst[index] = (has_alpha && c == channels - 1)
+				? static_cast<float>(src[index]) / 255.0f
+				: tables.to_linear[src[index]];
+		}
+	}
+}
+
+void ScarabImage::linear_to_srgb(const float* src, uint8* dst, const size_t count, const uint32 channels) noexcept {
+	const SRGBTables& tables = srgb_tables();
+	const bool has_alpha = (channels == 2 || channels == 4);
+	for(size_t i = 0; i < count; i++) {
+		for(uint32 c = 0; c < channels; c++) {
+			const size_t index = i * channels + c;
+			dst[index] = (has_alpha && c == channels - 1)
+				? static_cast<uint8>(std::lround(std::clamp(src[index], 0.0f, 1.0f) * 255.0f))
+				: tables.encode(src[index]);
+		}
+	}
+}
+
+ScarabImage::AlphaCoverage ScarabImage::alpha_coverage(const uint8* data, const size_t count, const uint32 channels) noexcept {
+	uint32 flags = 0;
+	if(channels == 4) {
+		flags = kernels().alpha_scan4(data, count);
+	} else if(channels == 2) {
+		flags = scalar::alpha_scan(data, count, 2);
+	}
+
+	if(flags & NOT_CUTOUT) {
+		return AlphaCoverage::Blended;
+	}
+	return (flags & NOT_OPAQUE) ? AlphaCoverage::Cutout : AlphaCoverage::Opaque;
+}
+
+void ScarabImage::downscale_box(const uint8* src, const uint32 width, const uint32 height, const uint32 channels, uint8* dst) noexcept {
+	const Kernels& kernel    = kernels();
+	const uint32 dst_width   = std::max<uint32>(width / 2, 1);
+	const uint32 dst_height  = std::max<uint32>(height / 2, 1);
+	const size_t rowsize     = static_cast<size_t>(width) * channels;
+	const size_t dst_rowsize = static_cast<size_t>(dst_width) * channels;
+
+	for(uint32 y = 0; y < dst_height; y++) {
+		const uint8* row0 = src + std::min(y * 2, height - 1) * rowsize;
+		const uint8* row1 = src + std::min(y * 2 + 1, height - 1) * rowsize;
+		uint8* out = dst + y * dst_rowsize;
+		if(channels == 4) {
+			kernel.box_row4(row0, row1, width, out, dst_width);
+		} else {
+			scalar::box_row(row0, row1, width, channels, out, 0, dst_width);
+		}
+	}
+}
+
+void ScarabImage::resize_lanczos(const uint8* src, const uint32 width, const uint32 height, const uint32 channels,
+		uint8* dst, const uint32 dst_width, const uint32 dst_height) {
+
+	if(width == 0 || height == 0 || dst_width == 0 || dst_height == 0) {
+		return;
+	}
+
+	const LanczosFilter horizontal = LanczosFilter(width, dst_width);
+	const LanczosFilter vertical   = LanczosFilter(height, dst_height);
+	const size_t rowsize     = static_cast<size_t>(dst_width) * channels;
+	const int32 last_column  = static_cast<int32>(width) - 1;
+	const int32 last_row     = static_cast<int32>(height) - 1;
+
+	// Horizontal pass, all source rows with the new width
+	std::vector<float> temp(rowsize * height);
+	ScarabThread::parallel_for(height, [&](const size_t begin, const size_t end) {
+		for(size_t y = begin; y < end; y++) {
+			const uint8* row = src + y * width * channels;
+			float* out = &temp[y * rowsize];
+			for(uint32 x = 0; x < dst_width; x++) {
+				const float* weights = &horizontal.weights[static_cast<size_t>(x) * horizontal.taps];
+				float sum[4] = {};
+				for(uint32 t = 0; t < horizontal.taps; t++) {
+					const int32 sx = std::clamp(horizontal.first[x] + static_cast<int32>(t), 0, last_column);
+					for(uint32 c = 0; c < channels; c++) {
+						sum[c] += weights[t] * row[static_cast<size_t>(sx) * channels + c];
+					}
+				}
+				for(uint32 c = 0; c < channels; c++) {
+					out[x * channels + c] = sum[c];
+				}
+			}
+		}
+	}, LANCZOS_MIN_ROWS);
+
+	// Vertical pass, whole rows at once
+	ScarabThread::parallel_for(dst_height, [&](const size_t begin, const size_t end) {
+		std::vector<float> line(rowsize);
+		for(size_t y = begin; y < end; y++) {
+			std::fill(line.begin(), line.end(), 0.0f);
+			const float* weights = &vertical.weights[y * vertical.taps];
+			for(uint32 t = 0; t < vertical.taps; t++) {
+				const int32 sy = std::clamp(vertical.first[y] + static_cast<int32>(t), 0, last_row);
+				const float* row = &temp[static_cast<size_t>(sy) * rowsize];
+				const float weight = weights[t];
+				for(size_t i = 0; i < rowsize; i++) {
+					line[i] += weight * row[i];
+				}
+			}
+
+			uint8* out = dst + y * rowsize;
+			for(size_t i = 0; i < rowsize; i++) {
+				out[i] = static_cast<uint8>(std::clamp(line[i] + 0.5f, 0.0f, 255.0f));
+			}
+		}
+	}, LANCZOS_MIN_ROWS);
+}
@@ -0,0 +1,190 @@
+#include "scarablib/utils/lz4.hpp"
+#include <algorithm>
+#include <cstring>
+
+// Greedy LZ4 with a single hash table, like LZ4's fast mode.
+// Format rules: matches are at least 4 bytes, the last 5 bytes are always literals
+// and the last match starts at least 12 bytes before the end
+
+namespace {
+	constexpr size_t MIN_MATCH     = 4;
+	constexpr size_t LAST_LITERALS = 5;
+	constexpr size_t MF_LIMIT      = 12;
+	constexpr size_t MAX_DISTANCE  = 65535;
+	constexpr uint32 HASH_LOG      = 16;
+	// Search gets faster the longer no match is found
+	constexpr uint32 SKIP_TRIGGER  = 6;
+
+	inline uint32 read32(const uint8* data) noexcept {
+		uint32 value;
+		std::memcpy(&value, data, sizeof(uint32));
+		return value;
+	}
+
+	inline uint32 hash4(const uint32 sequence) noexcept {
+		return (sequence * 2654435761u) >> (32 - HASH_LOG);
+	}
+
+	// Writes a length bigger than 15 as extra bytes
+	inline void write_length(std::vector<uint8>& out, size_t length) {
+		while(length >= 255) {
+			out.push_back(255);
+			length -= 255;
+		}
+		out.push_back(static_cast<uint8>(length));
+	}
+
+	void write_sequence(std::vector<uint8>& out, const uint8* literals, const size_t nliterals,
+			const size_t offset, const size_t match_length) {
+
+		const size_t match_code = match_length - MIN_MATCH;
+		const uint8 token = static_cast<uint8>((std::min<size_t>(nliterals, 15) << 4) | std::min<size_t>(match_code, 15));
+		out.push_back(token);
+		if(nliterals >= 15) {
+			write_length(out, nliterals - 15);
+		}
+		out.insert(out.end(), literals, literals + nliterals);
+
+		out.push_back(static_cast<uint8>(offset));
+		out.push_back(static_cast<uint8>(offset >> 8));
+		if(match_code >= 15) {
+			write_length(out, match_code - 15);
+		}
+	}
+
+	void write_last_literals(std::vector<uint8>& out, const uint8* literals, const size_t nliterals) {
+		out.push_back(static_cast<uint8>(std::min<size_t>(nliterals, 15) << 4));
+		if(nliterals >= 15) {
+			write_length(out, nliterals - 15);
+		}
+		out.insert(out.end(), literals, literals + nliterals);
+	}
+
+	// Reads the extra bytes of a length. Returns false if the input ends
+	inline bool read_length(const uint8*& src, const uint8* end, size_t& length) noexcept {
+		uint8 byte;
+		do {
+			if(src >= end) {
+				return false;
+			}
+			byte = *src++;
+			length += byte;
+		} while(byte == 255);
+		return true;
+	}
+}
+
+
+std::vector<uint8> ScarabLZ4::compress(const uint8* data, const size_t size) {
+	std::vector<uint8> out;
+	out.reserve(ScarabLZ4::compress_bound(size));
+
+	if(size < MF_LIMIT + 1) {
+		write_last_literals(out, data, size);
+		return out;
+	}
+
+	// Position + 1 of the last sequence with each hash, 0 is empty
+	std::vector<uint32> table(size_t(1) << HASH_LOG, 0);
+	const size_t match_limit = size - MF_LIMIT;
+	const size_t end_limit   = size - LAST_LITERALS;
+
+	size_t anchor = 0;
+	size_t pos    = 0;
+	uint32 misses = 0;
+	while(pos < match_limit) {
+		const uint32 sequence = read32(data + pos);
+		const uint32 hash     = hash4(sequence);
+		const size_t ref      = table[hash];
+		table[hash] = static_cast<uint32>(pos + 1);
+
+		if(ref == 0 || pos - (ref - 1) > MAX_DISTANCE || read32(data + ref - 1) != sequence) {
+			pos += 1 + (misses++ >> SKIP_TRIGGER);
+			continue;
+		}
+		misses = 0;
+
+		size_t match = ref - 1;
+		// Extends backwards over literals that also match
+		while(pos > anchor && match > 0 && data[pos - 1] == data[match - 1]) {
+			pos--;
+			match--;
+		}
+
+		size_t length = MIN_MATCH;
+		while(pos + length < end_limit && data[match + length] == data[pos + length]) {
+			length++;
+		}
+
+		write_sequence(out, data + anchor, pos - anchor, pos - match, length);
+		pos   += length;
+		anchor = pos;
+
+		// Position inside the match, helps the next search
+		if(pos - 2 < match_limit) {
+			table[hash4(read32(data + pos - 2))] = static_cast<uint32>(pos - 2 + 1);
+		}
+	}
+
+	write_last_literals(out, data + anchor, size - anchor);
+	return out;
+}
+
+bool ScarabLZ4::decompress(const uint8* src, const size_t src_size, uint8* dst, const size_t dst_size) noexcept {
+	const uint8* end  = src + src_size;
+	uint8* out        = dst;
+	uint8* const oend = dst + dst_size;
+
+	while(src < end) {
+		const uint8 token = *src++;
+
+		// Literals
+		size_t nliterals = token >> 4;
+		if(nliterals == 15 && !read_length(src, end, nliterals)) {
+			return false;
+		}
+		if(nliterals > static_cast<size_t>(end - src) || nliterals > static_cast<size_t>(oend - out)) {
+			return false;
+		}
+		std::memcpy(out, src, nliterals);
+		src += nliterals;
+		out += nliterals;
+
+		// Last sequence has no match
+		if(src == end) {
+			break;
+		}
+
+		// Match
+		if(end - src < 2) {
+			return false;
+		}
+		const size_t offset = static_cast<size_t>(src[0]) | (static_cast<size_t>(src[1]) << 8);
+		src += 2;
+		if(offset == 0 || offset > static_cast<size_t>(out - dst)) {
+			return false;
+		}
+
+		size_t length = token & 15;
+		if(length == 15 && !read_length(src, end, length)) {
+			return false;
+		}
+		length += MIN_MATCH;
+		if(length > static_cast<size_t>(oend - out)) {
+			return false;
+		}
+
+		// May overlap (e.g., offset 1 repeats a byte), copy forward
+		const uint8* match = out - offset;
+		if(offset >= length) {
+			std::memcpy(out, match, length);
+			out += length;
+		} else {
+			for(size_t i = 0; i < length; i++) {
+				*out++ = match[i];
+			}
+		}
+	}
+
+	return out == oend;
+}
@@ -0,0 +1,297 @@
+#include "scarablib/utils/model.hpp"
+#include "scarablib/opengl/assets.hpp"
+#include "scarablib/proper/error.hpp"
+#include "scarablib/proper/log.hpp"
+#include "scarablib/utils/file.hpp"
+#include "scarablib/utils/hash.hpp"
+#include "scarablib/utils/vfs.hpp"
+#include "scarablib/utils/opengl.hpp"
+#include <cstring>
+
+// Binary mesh cache (.smesh) layout, all values are little endian:
+// [SMeshHeader]
+// [Vertices]   vertex_count * vertex_size
+// [Indices]    index_count * index_size
+// [SubMeshes]  submesh_count * SMeshSubMesh
+// [Strings]    Texture names and dependencies, not null terminated
+// Every section starts 16 bytes aligned, so it can be used straight from the mapped file
+
+namespace {
+	constexpr char SMESH_MAGIC[4]     = { 'S', 'M', 'S', 'H' };
+	constexpr uint32 SMESH_VERSION    = 2; // 2: Optimized geometry
+	constexpr uint64 SMESH_ALIGNMENT  = 16;
+
+	struct SMeshHeader {
+		char magic[4];
+		uint32 version;
+		uint64 source_hash;
+		uint32 vertex_size;
+		uint32 index_size;
+		uint64 vertex_count;
+		uint64 index_count;
+		uint32 submesh_count;
+		uint32 dependency_count;
+		float min[3];
+		float max[3];
+		// Offsets from the start of the file
+		uint64 vertex_offset;
+		uint64 index_offset;
+		uint64 submesh_offset;
+		uint64 string_offset;
+		uint64 string_size;
+	};
+
+	// Strings are stored as offset and length inside the string section
+	struct SMeshString {
+		uint32 offset;
+		uint32 length;
+	};
+
+	struct SMeshSubMesh {
+		uint32 base_index;
+		uint32 indices_count;
+		SMeshString texname;
+	};
+
+	constexpr uint64 align_offset(const uint64 offset) noexcept {
+		return (offset + SMESH_ALIGNMENT - 1) & ~(SMESH_ALIGNMENT - 1);
+	}
+
+	// Returns the index data narrowed to `index_size`
+	std::vector<uint8> pack_indices(const std::vector<uint32>& indices, const uint32 index_size) {
+		std::vector<uint8> packed(indices.size() * index_size);
+		for(size_t i = 0; i < indices.size(); i++) {
+			if(index_size == sizeof(uint8)) {
+				packed[i] = static_cast<uint8>(indices[i]);
+			} else if(index_size == sizeof(uint16)) {
+				const uint16 value = static_cast<uint16>(indices[i]);
+				std::memcpy(packed.data() + i * sizeof(uint16), &value, sizeof(uint16));
+			} else {
+				std::memcpy(packed.data() + i * sizeof(uint32), &indices[i], sizeof(uint32));
+			}
+		}
+		return packed;
+	}
+
+	// Returns false if the range is outside of the file
+	inline bool in_file(const uint64 offset, const uint64 size, const size_t filesize) noexcept {
+		return offset <= filesize && size <= filesize - offset;
+	}
+
+	// Returns false if `count` elements of `size` bytes are outside of the file.
+	// Divides instead of multiplying, counts come from the file and may overflow
+	inline bool in_file(const uint64 offset, const uint64 count, const uint64 size, const size_t filesize) noexcept {
+		return offset <= filesize && count <= (filesize - offset) / size;
+	}
+}
+
+
+uint64 ScarabModel::source_hash(const char* path, const std::vector<std::string>& dependencies) noexcept {
+	// All files go through the same stream
+	ScarabHash::Hasher hasher;
+	const ScarabVFS::File source = ScarabVFS::open(path, ScarabFile::Access::Sequential);
+	hasher.update(source.data(), source.size());
+	hasher.update(static_cast<uint64>(source.size()));
+
+	// A missing file also changes the hash, so the cache is remade when it appears
+	for(const std::string& dependency : dependencies) {
+		const ScarabVFS::File file = ScarabVFS::open(dependency, ScarabFile::Access::Sequential);
+		hasher.update(std::string_view(dependency));
+		hasher.update(file.data(), file.size());
+		hasher.update(static_cast<uint64>(file.size()));
+	}
+
+	return hasher.digest();
+}
+
+
+bool ScarabModel::save_smesh(const std::filesystem::path& path, const ScarabModel::MeshData& mesh,
+		const uint64 hash, const std::vector<std::string>& dependencies) noexcept {
+	try {
+		const uint32 index_size = ScarabOpenGL::narrowest_index_size(mesh.vertices.size());
+		const std::vector<uint8> indices = pack_indices(mesh.indices, index_size);
+
+		// -- STRINGS
+		std::string strings;
+		const auto push_string = [&strings](const std::string& str) {
+			const SMeshString entry = { static_cast<uint32>(strings.size()), static_cast<uint32>(str.size()) };
+			strings += str;
+			return entry;
+		};
+
+		std::vector<SMeshSubMesh> submeshes;
+		submeshes.reserve(mesh.submeshes.size());
+		for(size_t i = 0; i < mesh.submeshes.size(); i++) {
+			submeshes.push_back(SMeshSubMesh{
+				.base_index    = mesh.submeshes[i].base_index,
+				.indices_count = mesh.submeshes[i].indices_count,
+				.texname       = push_string((i < mesh.texnames.size()) ? mesh.texnames[i] : std::string())
+			});
+		}
+
+		std::vector<SMeshString> depnames;
+		depnames.reserve(dependencies.size());
+		for(const std::string& dependency : dependencies) {
+			depnames.push_back(push_string(dependency));
+		}
+
+		// -- HEADER
+		SMeshHeader header{};
+		std::memcpy(header.magic, SMESH_MAGIC, sizeof(SMESH_MAGIC));
+		header.version          = SMESH_VERSION;
+		header.source_hash      = hash;
+		header.vertex_size      = sizeof(Vertex);
+		header.index_size       = index_size;
+		header.vertex_count     = mesh.vertices.size();
+		header.index_count      = mesh.indices.size();
+		header.submesh_count    = static_cast<uint32>(submeshes.size());
+		header.dependency_count = static_cast<uint32>(depnames.size());
+		std::memcpy(header.min, &mesh.min, sizeof(header.min));
+		std::memcpy(header.max, &mesh.max, sizeof(header.max));
+		header.vertex_offset    = align_offset(sizeof(SMeshHeader));
+		header.index_offset     = align_offset(header.vertex_offset + mesh.vertices.size() * sizeof(Vertex));
+		header.submesh_offset   = align_offset(header.index_offset + indices.size());
+		// Dependencies entries are right after the submeshes entries
+		header.string_offset    = align_offset(header.submesh_offset
+			+ submeshes.size() * sizeof(SMeshSubMesh) + depnames.size() * sizeof(SMeshString));
+		header.string_size      = strings.size();
+
+		// -- WRITE
+		// Never half written, even if another thread saves the same cache
+		return ScarabFile::write_atomic(path, [&](std::ostream& file) {
+			const auto write_at = [&file](const uint64 offset, const void* data, const size_t size) {
+				static constexpr char padding[SMESH_ALIGNMENT] = {};
+				const uint64 position = static_cast<uint64>(file.tellp());
+				file.write(padding, static_cast<std::streamsize>(offset - position));
+				file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+			};
+
+			file.write(reinterpret_cast<const char*>(&header), sizeof(SMeshHeader));
+			write_at(header.vertex_offset, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+			write_at(header.index_offset, indices.data(), indices.size());
+			write_at(header.submesh_offset, submeshes.data(), submeshes.size() * sizeof(SMeshSubMesh));
+			file.write(reinterpret_cast<const char*>(depnames.data()),
+					static_cast<std::streamsize>(depnames.size() * sizeof(SMeshString)));
+			write_at(header.string_offset, strings.data(), strings.size());
+		});
+
+	} catch(...) {
+		return false;
+	}
+}
+
+
+bool ScarabModel::read_smesh(const std::filesystem::path& path, const char* source, ScarabModel::ObjSource& out) {
+	if(!ScarabVFS::exists(path)) {
+		return false;
+	}
+
+	ScarabVFS::File file = ScarabVFS::open(path, ScarabFile::Access::WillNeed);
+	if(!file.is_open() || file.size() < sizeof(SMeshHeader)) {
+		return false;
+	}
+
+	// -- VALIDATE
+	SMeshHeader header;
+	std::memcpy(&header, file.data(), sizeof(SMeshHeader));
+
+	if(std::memcmp(header.magic, SMESH_MAGIC, sizeof(SMESH_MAGIC)) != 0
+		|| header.version != SMESH_VERSION
+		|| header.vertex_size != sizeof(Vertex)
+		|| (header.index_size != sizeof(uint8) && header.index_size != sizeof(uint16) && header.index_size != sizeof(uint32))
+		|| header.vertex_count == 0
+		|| !in_file(header.vertex_offset, header.vertex_count, header.vertex_size, file.size())
+		|| !in_file(header.index_offset, header.index_count, header.index_size, file.size())
+		|| !in_file(header.submesh_offset, header.submesh_count, sizeof(SMeshSubMesh), file.size())
+		// Names of the dependencies are right after the submeshes
+		|| !in_file(header.submesh_offset + uint64(header.submesh_count) * sizeof(SMeshSubMesh),
+			header.dependency_count, sizeof(SMeshString), file.size())
+		|| !in_file(header.string_offset, header.string_size, file.size())) {
+		LOG_WARNING("Invalid mesh cache '%s', it will be remade", path.c_str());
+		return false;
+	}
+
+	const uint8* bytes = file.data();
+	const char* strings = reinterpret_cast<const char*>(bytes + header.string_offset);
+	const auto read_string = [&](const SMeshString& entry) {
+		if(!in_file(entry.offset, entry.length, header.string_size)) {
+			return std::string();
+		}
+		return std::string(strings + entry.offset, entry.length);
+	};
+
+	// Entries are copied out since the section is not guaranteed to be aligned to the struct
+	std::vector<SMeshSubMesh> submeshes(header.submesh_count);
+	std::memcpy(submeshes.data(), bytes + header.submesh_offset, submeshes.size() * sizeof(SMeshSubMesh));
+
+	std::vector<SMeshString> depnames(header.dependency_count);
+	std::memcpy(depnames.data(), bytes + header.submesh_offset + submeshes.size() * sizeof(SMeshSubMesh),
+			depnames.size() * sizeof(SMeshString));
+
+	std::vector<std::string> dependencies;
+	dependencies.reserve(depnames.size());
+	for(const SMeshString& entry : depnames) {
+		dependencies.push_back(read_string(entry));
+	}
+
+	// Outdated
+	if(ScarabModel::source_hash(source, dependencies) != header.source_hash) {
+		return false;
+	}
+
+	// -- SUBMESHES
+	const std::filesystem::path modeldir = (ScarabFile::parent_dir(source).string() + "/");
+	ScarabModel::ObjSource output;
+	output.submeshes.reserve(submeshes.size());
+	output.texpaths.reserve(submeshes.size());
+	for(const SMeshSubMesh& entry : submeshes) {
+		if(uint64(entry.base_index) + entry.indices_count > header.index_count) {
+			LOG_WARNING("Invalid mesh cache '%s', it will be remade", path.c_str());
+			return false;
+		}
+
+		SubMesh submesh;
+		submesh.base_index    = entry.base_index;
+		submesh.indices_count = entry.indices_count;
+
+		std::string texpath;
+		const std::string texname = read_string(entry.texname);
+		if(!texname.empty()) {
+			texpath = (modeldir / texname).string();
+			if(!ScarabVFS::exists(texpath)) {
+				throw ScarabError(
+					"Missing texture '%s' referenced by model '%s'",
+					texpath.c_str(),
+					source
+				);
+			}
+		}
+		output.submeshes.push_back(submesh);
+		output.texpaths.push_back(std::move(texpath));
+	}
+
+	std::memcpy(&output.min, header.min, sizeof(header.min));
+	std::memcpy(&output.max, header.max, sizeof(header.max));
+
+	// Buffers are used straight from the mapped file
+	output.vertices     = reinterpret_cast<const Vertex*>(bytes + header.vertex_offset);
+	output.vertex_count = header.vertex_count;
+	output.indices      = bytes + header.index_offset;
+	output.index_count  = header.index_count;
+	output.index_size   = header.index_size;
+	output.hash         = header.source_hash;
+	output.file         = std::move(file);
+
+	out = std::move(output);
+	return true;
+}
+
+
+bool ScarabModel::load_smesh(const std::filesystem::path& path, const char* source, ScarabModel::ModelData& out, const VertexFormat format) {
+	ScarabModel::ObjSource cache;
+	if(!ScarabModel::read_smesh(path, source, cache)) {
+		return false;
+	}
+	out = ScarabModel::upload_obj(cache, format);
+	return true;
+}
@@ -0,0 +1,368 @@
+#include "scarablib/utils/model.hpp"
+#include "scarablib/proper/error.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// Forsyth's "Linear-Speed Vertex Cache Optimisation" and the cluster sorting from
+// Sander, Nehab and Barczak's "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+
+namespace {
+	// Size of the cache modelled when scoring, not the size of the real cache
+	constexpr uint32 FORSYTH_CACHE_SIZE  = 32;
+	constexpr uint32 FORSYTH_MAX_VALENCE = 32;
+	constexpr float CACHE_DECAY_POWER    = 1.5f;
+	constexpr float LAST_TRI_SCORE       = 0.75f;
+	constexpr float VALENCE_BOOST_SCALE  = 2.0f;
+	constexpr float VALENCE_BOOST_POWER  = 0.5f;
+
+	// Cache size used when splitting clusters
+	constexpr uint32 CLUSTER_CACHE_SIZE  = 16;
+	// A cluster can be split when its ACMR is this close to the ACMR of the whole range.
+	// Higher values give more clusters, so less overdraw but worse cache use
+	constexpr float CLUSTER_THRESHOLD    = 1.05f;
+
+	struct ScoreTables {
+		float cache[FORSYTH_CACHE_SIZE];
+		float valence[FORSYTH_MAX_VALENCE];
+	};
+
+	const ScoreTables& score_tables() noexcept {
+		static const ScoreTables tables = []() {
+			ScoreTables result{};
+			for(uint32 i = 0; i < FORSYTH_CACHE_SIZE; i++) {
+				// Vertices from the last triangle get a fixed score, so the same triangle is not picked twice in a row
+				if(i < 3) {
+					result.cache[i] = LAST_TRI_SCORE;
+				} else {
+					const float scaler = 1.0f / static_cast<float>(FORSYTH_CACHE_SIZE - 3);
+					result.cache[i] = std::pow(1.0f - static_cast<float>(i - 3) * scaler, CACHE_DECAY_POWER);
+				}
+			}
+
+			// Vertices with few triangles left are boosted, so lone triangles are not left behind
+			result.valence[0] = 0.0f;
+			for(uint32 i = 1; i < FORSYTH_MAX_VALENCE; i++) {
+				result.valence[i] = VALENCE_BOOST_SCALE * std::pow(static_cast<float>(i), -VALENCE_BOOST_POWER);
+			}
+			return result;
+		}();
+		return tables;
+	}
+
+	inline float vertex_score(const int32 cachepos, const uint32 remaining) noexcept {
+		if(remaining == 0) {
+			return -1.0f; // Not used anymore
+		}
+
+		const ScoreTables& tables = score_tables();
+		const float score = (cachepos >= 0) ? tables.cache[cachepos] : 0.0f;
+		return score + tables.valence[std::min(remaining, FORSYTH_MAX_VALENCE - 1)];
+	}
+
+	// Reorders triangles for the vertex cache.
+	// `clusters` receives the first triangle of each run that starts with a cache flush
+	std::vector<uint32> reorder_for_cache(const std::vector<uint32>& indices, const size_t vertex_count, std::vector<uint32>& clusters) {
+		const size_t tricount = indices.size() / 3;
+
+		// Triangles using each vertex (CSR), emitted triangles are removed by swapping with the last one
+		std::vector<uint32> remaining(vertex_count, 0);
+		for(const uint32 index : indices) {
+			remaining[index]++;
+		}
+
+		std::vector<uint32> offsets(vertex_count + 1, 0);
+		for(size_t v = 0; v < vertex_count; v++) {
+			offsets[v + 1] = offsets[v] + remaining[v];
+		}
+
+		std::vector<uint32> adjacency(indices.size());
+		{
+			std::vector<uint32> cursor(offsets.begin(), offsets.end() - 1);
+			for(size_t i = 0; i < indices.size(); i++) {
+				adjacency[cursor[indices[i]]++] = static_cast<uint32>(i / 3);
+			}
+		}
+
+		std::vector<int32> cachepos(vertex_count, -1);
+		std::vector<float> score(vertex_count);
+		for(size_t v = 0; v < vertex_count; v++) {
+			score[v] = vertex_score(-1, remaining[v]);
+		}
+
+		std::vector<uint8> emitted(tricount, 0);
+		std::vector<uint32> cache;
+		std::vector<uint32> newcache;
+		cache.reserve(FORSYTH_CACHE_SIZE + 3);
+		newcache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+		std::vector<uint32> output;
+		output.reserve(indices.size());
+
+		int64 best   = -1;
+		size_t next  = 0; // Used when no triangle in cache is left
+		for(size_t n = 0; n < tricount; n++) {
+			if(best < 0) {
+				while(emitted[next]) {
+					next++;
+				}
+				best = static_cast<int64>(next);
+				clusters.push_back(static_cast<uint32>(n));
+			}
+
+			const size_t tri = static_cast<size_t>(best);
+			const uint32* corners = &indices[tri * 3];
+			emitted[tri] = 1;
+			output.insert(output.end(), corners, corners + 3);
+
+			// Remove the triangle from its vertices
+			for(size_t k = 0; k < 3; k++) {
+				const uint32 v = corners[k];
+				uint32* adj = &adjacency[offsets[v]];
+				for(uint32 i = 0; i < remaining[v]; i++) {
+					if(adj[i] == tri) {
+						adj[i] = adj[remaining[v] - 1];
+						break;
+					}
+				}
+				remaining[v]--;
+			}
+
+			// New cache is the triangle's vertices followed by the old cache
+			newcache.clear();
+			for(size_t k = 0; k < 3; k++) {
+				if(std::find(newcache.begin(), newcache.end(), corners[k]) == newcache.end()) {
+					newcache.push_back(corners[k]);
+				}
+			}
+			for(const uint32 v : cache) {
+				if(v != corners[0] && v != corners[1] && v != corners[2]) {
+					newcache.push_back(v);
+				}
+			}
+
+			// Evicted
+			for(size_t i = FORSYTH_CACHE_SIZE; i < newcache.size(); i++) {
+				const uint32 v = newcache[i];
+				cachepos[v] = -1;
+				score[v]    = vertex_score(-1, remaining[v]);
+			}
+			if(newcache.size() > FORSYTH_CACHE_SIZE) {
+				newcache.resize(FORSYTH_CACHE_SIZE);
+			}
+
+			for(size_t i = 0; i < newcache.size(); i++) {
+				const uint32 v = newcache[i];
+				cachepos[v] = static_cast<int32>(i);
+				score[v]    = vertex_score(cachepos[v], remaining[v]);
+			}
+
+			// Next triangle is the best one using a vertex in cache
+			best = -1;
+			float bestscore = -1.0f;
+			for(const uint32 v : newcache) {
+				const uint32* adj = &adjacency[offsets[v]];
+				for(uint32 i = 0; i < remaining[v]; i++) {
+					const uint32* tv = &indices[(size_t)adj[i] * 3];
+					const float triscore = score[tv[0]] + score[tv[1]] + score[tv[2]];
+					if(triscore > bestscore) {
+						bestscore = triscore;
+						best = adj[i];
+					}
+				}
+			}
+
+			std::swap(cache, newcache);
+		}
+
+		return output;
+	}
+
+	// FIFO cache simulated using timestamps
+	struct CacheSimulator {
+		std::vector<uint32> timestamps;
+		uint32 cache_size;
+		uint32 time;
+
+		CacheSimulator(const size_t vertex_count, const uint32 cache_size)
+			: timestamps(vertex_count, 0), cache_size(cache_size), time(cache_size + 1) {}
+
+		// Returns how many vertices of the triangle were not in cache
+		inline uint32 triangle(const uint32* corners) noexcept {
+			uint32 misses = 0;
+			for(size_t k = 0; k < 3; k++) {
+				if(this->time - this->timestamps[corners[k]] > this->cache_size) {
+					this->timestamps[corners[k]] = this->time++;
+					misses++;
+				}
+			}
+			return misses;
+		}
+
+		// Empties the cache
+		inline void flush() noexcept {
+			this->time += this->cache_size + 1;
+		}
+	};
+
+	// Splits the ranges started by cache flushes in smaller clusters where it doesn't hurt the cache much
+	std::vector<uint32> split_clusters(const std::vector<uint32>& indices, const size_t vertex_count, const std::vector<uint32>& hard) {
+		const uint32 tricount = static_cast<uint32>(indices.size() / 3);
+		std::vector<uint32> clusters;
+		CacheSimulator cache(vertex_count, CLUSTER_CACHE_SIZE);
+
+		for(size_t c = 0; c < hard.size(); c++) {
+			const uint32 begin = hard[c];
+			const uint32 end   = (c + 1 < hard.size()) ? hard[c + 1] : tricount;
+
+			cache.flush();
+			uint32 misses = 0;
+			for(uint32 t = begin; t < end; t++) {
+				misses += cache.triangle(&indices[(size_t)t * 3]);
+			}
+			const float threshold = CLUSTER_THRESHOLD * static_cast<float>(misses) / static_cast<float>(end - begin);
+
+			cache.flush();
+			clusters.push_back(begin);
+			uint32 start = begin;
+			misses = 0;
+			for(uint32 t = begin; t < end; t++) {
+				misses += cache.triangle(&indices[(size_t)t * 3]);
+				if(t + 1 < end && static_cast<float>(misses) / static_cast<float>(t + 1 - start) <= threshold) {
+					cache.flush();
+					clusters.push_back(t + 1);
+					start  = t + 1;
+					misses = 0;
+				}
+			}
+		}
+
+		return clusters;
+	}
+
+	// Sorts clusters so the ones facing away from the mesh center are drawn first
+	std::vector<uint32> sort_clusters(const std::vector<uint32>& indices, const std::vector<Vertex>& vertices, const std::vector<uint32>& clusters) {
+		const size_t tricount = indices.size() / 3;
+
+		vec3<float> meshcenter = vec3<float>(0.0f);
+		for(const uint32 index : indices) {
+			meshcenter += vertices[index].position;
+		}
+		meshcenter /= static_cast<float>(indices.size());
+
+		std::vector<float> keys(clusters.size());
+		for(size_t c = 0; c < clusters.size(); c++) {
+			const size_t begin = clusters[c];
+			const size_t end   = (c + 1 < clusters.size()) ? clusters[c + 1] : tricount;
+
+			// Area weighted center and normal
+			vec3<float> center = vec3<float>(0.0f);
+			vec3<float> normal = vec3<float>(0.0f);
+			float area = 0.0f;
+			for(size_t t = begin; t < end; t++) {
+				const vec3<float>& p0 = vertices[indices[t * 3]].position;
+				const vec3<float>& p1 = vertices[indices[t * 3 + 1]].position;
+				const vec3<float>& p2 = vertices[indices[t * 3 + 2]].position;
+
+				const vec3<float> cross = glm::cross(p1 - p0, p2 - p0);
+				const float triarea = glm::length(cross);
+				center += (p0 + p1 + p2) * (triarea / 3.0f);
+				normal += cross;
+				area   += triarea;
+			}
+
+			const float normallen = glm::length(normal);
+			if(area > 0.0f && normallen > 0.0f) {
+				keys[c] = glm::dot(center / area - meshcenter, normal / normallen);
+			} else {
+				keys[c] = 0.0f;
+			}
+		}
+
+		std::vector<uint32> order(clusters.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&keys](const uint32 a, const uint32 b) {
+			return keys[a] > keys[b];
+		});
+
+		std::vector<uint32> output;
+		output.reserve(indices.size());
+		for(const uint32 c : order) {
+			const size_t begin = clusters[c];
+			const size_t end   = (c + 1 < clusters.size()) ? clusters[c + 1] : tricount;
+			output.insert(output.end(), indices.begin() + (std::ptrdiff_t)(begin * 3), indices.begin() + (std::ptrdiff_t)(end * 3));
+		}
+		return output;
+	}
+}
+
+
+ScarabModel::CacheStats ScarabModel::analyze_vertex_cache(const std::vector<uint32>& indices, const size_t vertex_count, const uint32 cache_size) {
+	ScarabModel::CacheStats stats;
+	const size_t tricount = indices.size() / 3;
+	if(tricount == 0 || cache_size == 0) {
+		return stats;
+	}
+
+	CacheSimulator cache(vertex_count, cache_size);
+	std::vector<uint8> used(vertex_count, 0);
+	size_t unique = 0;
+	size_t misses = 0;
+	for(size_t t = 0; t < tricount; t++) {
+		const uint32* corners = &indices[t * 3];
+		misses += cache.triangle(corners);
+		for(size_t k = 0; k < 3; k++) {
+			unique += (used[corners[k]] == 0);
+			used[corners[k]] = 1;
+		}
+	}
+
+	stats.acmr = static_cast<float>(misses) / static_cast<float>(tricount);
+	stats.atvr = static_cast<float>(misses) / static_cast<float>(unique);
+	return stats;
+}
+
+
+ScarabModel::OptimizeStats ScarabModel::optimize(std::vector<Vertex>& vertices, std::vector<uint32>& indices) {
+	if(indices.size() % 3 != 0) {
+		throw ScarabError("Index count (%zu) is not a triangle list", indices.size());
+	}
+
+	for(const uint32 index : indices) {
+		if(index >= vertices.size()) {
+			throw ScarabError("Index %u is out of range (%zu vertices)", index, vertices.size());
+		}
+	}
+
+	ScarabModel::OptimizeStats stats;
+	stats.before = ScarabModel::analyze_vertex_cache(indices, vertices.size());
+	if(indices.empty()) {
+		stats.after = stats.before;
+		return stats;
+	}
+
+	// -- VERTEX CACHE
+	std::vector<uint32> hard;
+	indices = reorder_for_cache(indices, vertices.size(), hard);
+
+	// -- OVERDRAW
+	indices = sort_clusters(indices, vertices, split_clusters(indices, vertices.size(), hard));
+
+	// -- VERTEX FETCH
+	// Vertices are stored in the order they are first used
+	constexpr uint32 UNUSED = ~0u;
+	std::vector<uint32> remap(vertices.size(), UNUSED);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+	for(uint32& index : indices) {
+		if(remap[index] == UNUSED) {
+			remap[index] = static_cast<uint32>(reordered.size());
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices = std::move(reordered);
+
+	stats.after = ScarabModel::analyze_vertex_cache(indices, vertices.size());
+	return stats;
+}
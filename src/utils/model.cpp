@@ -5,37 +5,39 @@
 #include "scarablib/proper/error.hpp"
 #include "scarablib/proper/log.hpp"
 #include "scarablib/utils/file.hpp"
+#include "scarablib/utils/flatmap.hpp"
+#include "scarablib/utils/hash.hpp"
+#include "scarablib/utils/quantize.hpp"
+#include "scarablib/utils/thread.hpp"
+#include "scarablib/utils/vfs.hpp"
+#include <algorithm>
+#include <cstring>
 #include <unordered_set>
 
+// #define SCARAB_DEBUG_MODEL_LOADER
+
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tinyobjloader/tiny_obj_loader.h>
 
 
-std::pair<std::vector<SubMesh>, std::shared_ptr<VertexArray>> ScarabModel::load_obj(const char* path) {
-	// Data containers
-	tinyobj::attrib_t attrib;                   // Mesh information
-	std::vector<tinyobj::shape_t> shapes;       // Mesh shapes
-	std::vector<tinyobj::material_t> materials; // Mesh materials
+ScarabModel::ModelData ScarabModel::load_obj(const char* path, const bool use_cache, const VertexFormat format) {
+	return ScarabModel::upload_obj(ScarabModel::read_obj(path, use_cache), format);
+}
 
-	std::string err;
-	std::filesystem::path modeldir = (ScarabFile::parent_dir(path).string() + "/");
+ScarabModel::ObjSource ScarabModel::read_obj(const char* path, const bool use_cache) {
+	const std::filesystem::path cachepath = std::string(path) + ".smesh";
+	ScarabModel::ObjSource output;
 
-	// Load obj
-	if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &err,
-		path, // File
-		modeldir.c_str(), // Base dir
-		true // Triangulate
-	)) {
-		throw ScarabError("Failed to load/parse (%s) file: %s", path, err.c_str());
-	}
-
-	if(!err.empty()) {
-		LOG_WARNING(err.c_str());
+	// -- BINARY CACHE
+	if(use_cache && ScarabModel::read_smesh(cachepath, path, output)) {
+		return output;
 	}
 
+	const ScarabModel::ObjData obj = ScarabModel::parse_obj(path);
+	const std::filesystem::path modeldir = (ScarabFile::parent_dir(path).string() + "/");
 	// Collect unique texture names to avoid checking the same file multiple times
 	std::unordered_set<std::string> required_textures;
-	for(const tinyobj::material_t& mat : materials) {
+	for(const ScarabModel::ObjMaterial& mat : obj.materials) {
 		if(!mat.diffuse_texname.empty()) {
 			required_textures.insert(mat.diffuse_texname);
 		}
@@ -57,7 +59,7 @@ std::pair<std::vector<SubMesh>, std::shared_ptr<VertexArray>> ScarabModel::load_
 	for(const std::string& texname : required_textures) {
 		std::filesystem::path texpath = modeldir / ScarabModel::treat_texname(texname);
 
-		if(!ScarabFile::file_exists(texpath)) {
+		if(!ScarabVFS::exists(texpath)) {
 			throw ScarabError(
 				"Missing texture '%s' referenced by model '%s'",
 				texpath.c_str(),
@@ -66,80 +68,253 @@ std::pair<std::vector<SubMesh>, std::shared_ptr<VertexArray>> ScarabModel::load_
 		}
 	}
 
-	// Temporary storage to group data by material index before flattening
-	struct RawSubMesh {
-		std::vector<Vertex> vertices;
-		std::vector<uint32> indices;
-		std::unordered_map<Vertex, uint32> uniq_verts;
+	output.mesh = ScarabModel::build_obj(obj);
+	output.hash = ScarabModel::source_hash(path, obj.mtllibs);
+
+	// Models inside archives can't have their cache written next to them
+	const bool write_cache = use_cache && ScarabFile::file_exists(path);
+	if(write_cache && !ScarabModel::save_smesh(cachepath, output.mesh, output.hash, obj.mtllibs)) {
+		LOG_WARNING("Failed to write mesh cache '%s'", cachepath.c_str());
+	}
+
+	const ScarabModel::MeshData& mesh = output.mesh;
+	output.submeshes = mesh.submeshes;
+	output.texpaths.reserve(mesh.texnames.size());
+	for(const std::string& texname : mesh.texnames) {
+		output.texpaths.push_back(texname.empty() ? std::string() : (modeldir / texname).string());
+	}
+
+	output.vertices     = mesh.vertices.data();
+	output.vertex_count = mesh.vertices.size();
+	output.indices      = mesh.indices.data();
+	output.index_count  = mesh.indices.size();
+	output.index_size   = sizeof(uint32);
+	output.min          = mesh.min;
+	output.max          = mesh.max;
+	return output;
+}
+
+ScarabModel::ModelData ScarabModel::upload_obj(const ScarabModel::ObjSource& source, const VertexFormat format) {
+	ScarabModel::ModelData output;
+
+	// -- TEXTURES
+	output.submeshes.reserve(source.submeshes.size());
+	for(size_t i = 0; i < source.submeshes.size(); i++) {
+		SubMesh submesh = source.submeshes[i];
+		if(!source.texpaths[i].empty()) {
+			// Submeshes only store the ID, the texture must be owned by someone
+			std::shared_ptr<Texture> texture = Assets::load(source.texpaths[i].c_str());
+			submesh.textureid = texture->get_id();
+			output.textures.push_back(std::move(texture));
+		}
+		output.submeshes.push_back(submesh);
+	}
+
+	output.min = source.min;
+	output.max = source.max;
+
+	// -- UPLOAD
+	// The source hash identifies the geometry, no need to hash every vertex.
+	// Geometry pools are only used by the OpenGL thread
+	ScarabOpenGL::run_sync([&]() {
+		ScarabModel::upload_mesh(output, source.vertices, source.vertex_count,
+			source.indices, source.index_count, source.index_size, format, source.hash);
+	});
+	return output;
+}
+
+std::vector<MeshTriangle> ScarabModel::make_triangles(const ScarabModel::ObjSource& source, const glm::mat4& transform) {
+	// Indices may be narrowed by the binary mesh cache
+	const auto index_at = [&source](const size_t i) -> size_t {
+		switch(source.index_size) {
+			case sizeof(uint8):  return static_cast<const uint8*>(source.indices)[i];
+			case sizeof(uint16): return static_cast<const uint16*>(source.indices)[i];
+			default:             return static_cast<const uint32*>(source.indices)[i];
+		}
 	};
 
-	// Used to group same matid
-	// int because tinyobj uses -1 for "no material"
-	std::unordered_map<int, RawSubMesh> material_groups;
-	for(const tinyobj::shape_t& shape : shapes) {
-		size_t indexoffset = 0;
+	std::vector<MeshTriangle> triangles;
+	triangles.resize(source.index_count / 3);
+	ScarabThread::parallel_for(triangles.size(), [&](const size_t begin, const size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			MeshTriangle& tri = triangles[i];
+			tri.v0 = vec3<float>(transform * vec4<float>(source.vertices[index_at(i * 3 + 0)].position, 1.0f));
+			tri.v1 = vec3<float>(transform * vec4<float>(source.vertices[index_at(i * 3 + 1)].position, 1.0f));
+			tri.v2 = vec3<float>(transform * vec4<float>(source.vertices[index_at(i * 3 + 2)].position, 1.0f));
+
+			// Degenerated triangles have no normal
+			const vec3<float> normal = glm::cross(tri.v1 - tri.v0, tri.v2 - tri.v0);
+			const float length = glm::length(normal);
+			tri.normal = (length > 0.0f) ? normal / length : vec3<float>(0.0f);
+		}
+	}, 4096);
+	return triangles;
+}
 
-		// OBJ assigns materials per face
-		for(size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
-			int matid = shape.mesh.material_ids[f];      // Which material this face uses
-			int fv    = shape.mesh.num_face_vertices[f]; // Number of vertices in this face
+void ScarabModel::upload_mesh(ScarabModel::ModelData& out, const Vertex* vertices, const size_t vertex_count,
+		const void* indices, const size_t index_count, const uint32 index_size,
+		VertexFormat format, const size_t hash) {
+
+	// Packed formats store TexUV as unorm16, tiled TexUV would be clamped and look smeared
+	if(format != VertexFormat::Float) {
+		const bool tiled = std::any_of(vertices, vertices + vertex_count, [](const Vertex& vertex) {
+			return vertex.texuv.x < 0.0f || vertex.texuv.x > 1.0f || vertex.texuv.y < 0.0f || vertex.texuv.y > 1.0f;
+		});
+		if(tiled) {
+			LOG_WARNING("Model has TexUV outside [0, 1], its vertices are stored as Float instead of packed");
+			format = VertexFormat::Float;
+		}
+	}
+	out.format = format;
 
-			// Group all faces using matid
-			// matid is -1 if no material is found, use as default bucket
-			RawSubMesh& group = material_groups[matid];
+	// Same geometry in other format is another range
+	size_t rangehash = hash;
+	ScarabHash::hash_combine(rangehash, static_cast<uint8>(format));
 
-			for(int v = 0; v < fv; v++) {
-				// Iterate the vertices of the current face
-				const tinyobj::index_t& index =
-					shape.mesh.indices[indexoffset + v];
+	out.dequantize = (format == VertexFormat::Float)
+		? glm::mat4(1.0f)
+		: ScarabQuantize::dequantize_matrix(out.min, out.max);
 
-				Vertex vertex{};
+	// Already uploaded, skip narrowing and quantization
+	GeometryPool& pool = ResourcesManager::get_instance().geometry_pool(format);
+	out.geometry = pool.get_range(rangehash);
+	if(out.geometry != nullptr) {
+		return;
+	}
 
-				// Position
-				vertex.position = {
-						attrib.vertices[index.vertex_index * 3],
-						attrib.vertices[index.vertex_index * 3 + 1],
-						attrib.vertices[index.vertex_index * 3 + 2]
-				};
+	// Narrow indices if needed.
+	// Indices are relative to the mesh's base vertex, so the mesh size decides the type
+	std::vector<uint8> narrowed;
+	uint32 narrowsize = index_size;
+	if(index_size == sizeof(uint32) && ScarabOpenGL::narrowest_index_size(vertex_count) != sizeof(uint32)) {
+		const uint32* wide = static_cast<const uint32*>(indices);
+		narrowsize = ScarabOpenGL::narrowest_index_size(vertex_count);
+		narrowed.resize(index_count * narrowsize);
+		for(size_t i = 0; i < index_count; i++) {
+			if(narrowsize == sizeof(uint8)) {
+				narrowed[i] = static_cast<uint8>(wide[i]);
+			} else {
+				const uint16 value = static_cast<uint16>(wide[i]);
+				std::memcpy(narrowed.data() + i * sizeof(uint16), &value, sizeof(uint16));
+			}
+		}
+		indices = narrowed.data();
+	}
+
+	switch(format) {
+		case VertexFormat::Half: {
+			const std::vector<VertexPackedHalf> packed = ScarabQuantize::quantize_half(vertices, vertex_count, out.min, out.max);
+			out.geometry = pool.allocate(packed.data(), packed.size(), indices, index_count, narrowsize, rangehash);
+			break;
+		}
+
+		case VertexFormat::Snorm16: {
+			const std::vector<VertexPacked> packed = ScarabQuantize::quantize_snorm16(vertices, vertex_count, out.min, out.max);
+			out.geometry = pool.allocate(packed.data(), packed.size(), indices, index_count, narrowsize, rangehash);
+			break;
+		}
+
+		default:
+			out.geometry = pool.allocate(vertices, vertex_count, indices, index_count, narrowsize, rangehash);
+			break;
+	}
+}
+
+ScarabModel::MeshData ScarabModel::build_obj(const ScarabModel::ObjData& obj) {
+	// Temporary storage to group data by material index before flattening
+	struct RawSubMesh {
+		int matid;
+		std::vector<uint32> triangles;
+		std::vector<Vertex> vertices;
+		std::vector<uint32> indices;
+		ScarabModel::OptimizeStats stats;
+	};
 
-				// TexUV
-				if(index.texcoord_index >= 0) {
-					vertex.texuv = {
-						attrib.texcoords[index.texcoord_index * 2],
-						attrib.texcoords[index.texcoord_index * 2 + 1]
-						// 1.0f - attrib.texcoords[index.texcoord_index * 2 + 1] // Optimization: V-Flip
+	// Group all triangles using matid
+	// matid is -1 if no material is found, use as default bucket
+	FlatMap<int, size_t> groupslot;
+	std::vector<RawSubMesh> material_groups;
+	for(size_t t = 0; t < obj.material_ids.size(); t++) {
+		auto [it, inserted] = groupslot.try_emplace(obj.material_ids[t], material_groups.size());
+		if(inserted) {
+			material_groups.emplace_back();
+			material_groups.back().matid = obj.material_ids[t];
+		}
+		material_groups[it->second].triangles.push_back(static_cast<uint32>(t));
+	}
+	// Sorted by matid so the submeshes are always in material order, no matter which material the file uses first
+	std::sort(material_groups.begin(), material_groups.end(), [](const RawSubMesh& a, const RawSubMesh& b) {
+		return a.matid < b.matid;
+	});
+
+	// Deduplication scope is the material group, so each group is deduplicated in parallel
+	ScarabThread::parallel_for(material_groups.size(), [&](const size_t begin, const size_t end) {
+		for(size_t g = begin; g < end; g++) {
+			RawSubMesh& group = material_groups[g];
+			FlatMap<Vertex, uint32, VertexBitwiseHash, VertexBitwiseEqual> uniq_verts;
+			uniq_verts.reserve(group.triangles.size());
+			group.indices.reserve(group.triangles.size() * 3);
+
+			for(const uint32 t : group.triangles) {
+				for(size_t v = 0; v < 3; v++) {
+					const ScarabModel::ObjIndex& index = obj.indices[t * 3 + v];
+
+					Vertex vertex{};
+
+					// Position
+					vertex.position = {
+						obj.vertices[(size_t)index.vertex * 3],
+						obj.vertices[(size_t)index.vertex * 3 + 1],
+						obj.vertices[(size_t)index.vertex * 3 + 2]
 					};
-				}
 
-				// Deduplication scope is the material group
-				// Push unique vertices only
-				if(group.uniq_verts.find(vertex) == group.uniq_verts.end()) {
-					group.uniq_verts[vertex] = static_cast<uint32>(group.vertices.size());
-					group.vertices.push_back(vertex);
+					// TexUV
+					if(index.texcoord >= 0) {
+						vertex.texuv = {
+							obj.texcoords[(size_t)index.texcoord * 2],
+							obj.texcoords[(size_t)index.texcoord * 2 + 1]
+							// 1.0f - obj.texcoords[index.texcoord * 2 + 1] // Optimization: V-Flip
+						};
+					}
+
+					// Push unique vertices only
+					auto [it, inserted] = uniq_verts.try_emplace(vertex, static_cast<uint32>(group.vertices.size()));
+					if(inserted) {
+						group.vertices.push_back(vertex);
+					}
+					group.indices.push_back(it->second);
 				}
-				group.indices.push_back(group.uniq_verts[vertex]);
 			}
-			// Move to next face
-			indexoffset += fv;
+
+			// File order is rarely good for the GPU
+			group.stats = ScarabModel::optimize(group.vertices, group.indices);
 		}
+	});
+
+#if defined(SCARAB_DEBUG_MODEL_LOADER)
+	for(const RawSubMesh& group : material_groups) {
+		LOG_DEBUG("Material %d: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", group.matid,
+			group.stats.before.acmr, group.stats.after.acmr,
+			group.stats.before.atvr, group.stats.after.atvr);
 	}
+#endif
 
 	// -- FLATTERNING: Put everything into one big buffer
-	std::vector<Vertex> vertices;
-	std::vector<uint32> indices;
-	std::vector<SubMesh> output;
+	ScarabModel::MeshData mesh;
+	std::vector<Vertex>& vertices = mesh.vertices;
+	std::vector<uint32>& indices  = mesh.indices;
 
 	// Reserve memory to avoid reallocations
 	size_t rv = 0;
 	size_t ri = 0;
-	for(auto& [id, g] : material_groups) {
+	for(const RawSubMesh& g : material_groups) {
 		rv += g.vertices.size();
 		ri += g.indices.size();
 	}
 	vertices.reserve(rv);
 	indices.reserve(ri);
 
-	for(auto& [matid, group] : material_groups) {
+	for(const RawSubMesh& group : material_groups) {
 		SubMesh submesh;
 
 		// Set up drawing parameters
@@ -147,14 +322,10 @@ std::pair<std::vector<SubMesh>, std::shared_ptr<VertexArray>> ScarabModel::load_
 		submesh.indices_count = static_cast<uint32>(group.indices.size());
 		uint32 vertex_offset  = static_cast<uint32>(vertices.size());
 
-		// Load textures
-		if(matid >= 0 && matid < (int)materials.size()) {
-			const tinyobj::material_t& mat = materials[matid];
-			if(!mat.diffuse_texname.empty()) {
-				submesh.textureid = Assets::load(
-					(modeldir / ScarabModel::treat_texname(mat.diffuse_texname)).c_str()
-				)->get_id();
-			}
+		// Textures are loaded when uploading
+		std::string texname;
+		if(group.matid >= 0 && group.matid < (int)obj.materials.size()) {
+			texname = ScarabModel::treat_texname(obj.materials[(size_t)group.matid].diffuse_texname).string();
 		}
 
 		// Append indices
@@ -162,21 +333,19 @@ std::pair<std::vector<SubMesh>, std::shared_ptr<VertexArray>> ScarabModel::load_
 		for(uint32 idx : group.indices) {
 			indices.push_back(vertex_offset + idx);
 		}
-		output.push_back(submesh);
+		mesh.submeshes.push_back(submesh);
+		mesh.texnames.push_back(std::move(texname));
 	}
 
-	std::shared_ptr<VertexArray> vertexarray = ResourcesManager::get_instance()
-		.acquire_vertexarray(vertices, indices);
-	// Position and TexUV
-	vertexarray->add_attribute<float>(3, false);
-	vertexarray->add_attribute<float>(2, false);
+	for(const Vertex& vertex : vertices) {
+		mesh.min = glm::min(mesh.min, vertex.position);
+		mesh.max = glm::max(mesh.max, vertex.position);
+	}
 
-	return {
-		output,
-		vertexarray
-	};
+	return mesh;
 }
 
+
 std::pair<std::vector<Vertex>, std::vector<uint32>> ScarabModel::load_obj_old(const char* path) {
 	// Data containers
 	tinyobj::attrib_t attrib;                   // Mesh information
@@ -209,7 +378,7 @@ std::pair<std::vector<Vertex>, std::vector<uint32>> ScarabModel::load_obj_old(co
 	indices.reserve(total_indices);
 
 	// Decompress
-	std::unordered_map<Vertex, uint32_t> uniq_vertices;
+	FlatMap<Vertex, uint32, VertexBitwiseHash, VertexBitwiseEqual> uniq_vertices;
 	for(const tinyobj::shape_t& shape : shapes) {
 		for(const tinyobj::index_t& index : shape.mesh.indices) {
 			// Check if vertex is not negative and is not out of bounds
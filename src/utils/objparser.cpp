@@ -0,0 +1,430 @@
+#include "scarablib/utils/model.hpp"
+#include "scarablib/proper/error.hpp"
+#include "scarablib/proper/log.hpp"
+#include "scarablib/utils/file.hpp"
+#include "scarablib/utils/thread.hpp"
+#include "scarablib/utils/vfs.hpp"
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+// Smaller chunks than this are not worth a thread
+#define OBJ_MIN_CHUNK_SIZE (1 << 20) // 1 MB
+
+namespace {
+	// Everything found inside a chunk of the file.
+	// Absolute indices are already converted to 0-based global indices,
+	// relative (negative) indices are converted to chunk-local indices and fixed when merging
+	struct ObjChunk {
+		std::vector<float> vertices;
+		std::vector<float> texcoords;
+		std::vector<float> normals;
+		std::vector<ScarabModel::ObjIndex> indices;
+
+		// Index position and which attributes of it are chunk-local.
+		// Bit 0: vertex, Bit 1: texcoord, Bit 2: normal
+		std::vector<std::pair<size_t, uint8>> relative;
+
+		// One per triangle. Index inside `usemtl` or -1 if is using the material from the previous chunk
+		std::vector<int32> material_slots;
+		std::vector<std::string> usemtl;
+		std::vector<std::string> mtllibs;
+	};
+
+	inline bool is_space(const char c) noexcept {
+		return c == ' ' || c == '\t';
+	}
+
+	inline bool is_digit(const char c) noexcept {
+		return c >= '0' && c <= '9';
+	}
+
+	inline void skip_spaces(const char*& p, const char* end) noexcept {
+		while(p < end && is_space(*p)) {
+			p++;
+		}
+	}
+
+	inline void skip_line(const char*& p, const char* end) noexcept {
+		const void* eol = std::memchr(p, '\n', (size_t)(end - p));
+		p = (eol != nullptr) ? static_cast<const char*>(eol) + 1 : end;
+	}
+
+	// Returns the text until the end of the line, without trailing spaces
+	inline std::string read_name(const char*& p, const char* end) {
+		skip_spaces(p, end);
+		const char* begin = p;
+		while(p < end && *p != '\n' && *p != '\r') {
+			p++;
+		}
+		const char* last = p;
+		while(last > begin && is_space(*(last - 1))) {
+			last--;
+		}
+		return std::string(begin, last);
+	}
+
+	// Exact powers of ten that a double can represent
+	constexpr double POW10[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	// Fast float parser for the formats found in OBJ files (e.g. "-1.5", "2e-3").
+	// Does not handle "nan" or "inf"
+	inline float parse_float(const char*& p, const char* end) noexcept {
+		skip_spaces(p, end);
+
+		bool negative = false;
+		if(p < end && (*p == '-' || *p == '+')) {
+			negative = (*p == '-');
+			p++;
+		}
+
+		// 19 digits always fit in uint64
+		uint64 mantissa = 0;
+		int32 exponent  = 0;
+		int32 digits    = 0;
+		while(p < end && is_digit(*p)) {
+			if(digits < 19) {
+				mantissa = mantissa * 10 + (uint64)(*p - '0');
+				digits += (mantissa != 0);
+			} else {
+				exponent++;
+			}
+			p++;
+		}
+
+		if(p < end && *p == '.') {
+			p++;
+			while(p < end && is_digit(*p)) {
+				if(digits < 19) {
+					mantissa = mantissa * 10 + (uint64)(*p - '0');
+					digits += (mantissa != 0);
+					exponent--;
+				}
+				p++;
+			}
+		}
+
+		if(p < end && (*p == 'e' || *p == 'E')) {
+			p++;
+			bool expnegative = false;
+			if(p < end && (*p == '-' || *p == '+')) {
+				expnegative = (*p == '-');
+				p++;
+			}
+			int32 exp = 0;
+			while(p < end && is_digit(*p)) {
+				if(exp < 10000) {
+					exp = exp * 10 + (*p - '0');
+				}
+				p++;
+			}
+			exponent += (expnegative) ? -exp : exp;
+		}
+
+		double value = (double)mantissa;
+		if(exponent != 0 && mantissa != 0) {
+			if(exponent > 0 && exponent <= 22) {
+				value *= POW10[exponent];
+			} else if(exponent < 0 && exponent >= -22) {
+				value /= POW10[-exponent];
+			} else {
+				value *= std::pow(10.0, (double)exponent);
+			}
+		}
+
+		return static_cast<float>((negative) ? -value : value);
+	}
+
+	// Parses an OBJ index. Returns 0 if there is no number
+	inline int32 parse_index(const char*& p, const char* end) noexcept {
+		bool negative = false;
+		if(p < end && *p == '-') {
+			negative = true;
+			p++;
+		}
+
+		int32 value = 0;
+		while(p < end && is_digit(*p)) {
+			value = value * 10 + (*p - '0');
+			p++;
+		}
+		return (negative) ? -value : value;
+	}
+
+	// Converts an OBJ index (1-based or negative) to 0-based.
+	// Relative indices are kept local to the chunk and flagged
+	inline int32 resolve_index(const int32 raw, const size_t localcount, uint8& relative, const uint8 bit) noexcept {
+		if(raw > 0) {
+			return raw - 1;
+		}
+		if(raw < 0) {
+			relative |= bit;
+			return (int32)localcount + raw;
+		}
+		return -1; // Not present
+	}
+
+	// Parses a "v/vt/vn" face corner
+	inline ScarabModel::ObjIndex parse_corner(const char*& p, const char* end, const ObjChunk& chunk, uint8& relative) noexcept {
+		ScarabModel::ObjIndex index;
+		index.vertex = resolve_index(parse_index(p, end), chunk.vertices.size() / 3, relative, 1 << 0);
+
+		if(p < end && *p == '/') {
+			p++;
+			// "v//vn" has no texcoord
+			if(p < end && *p != '/') {
+				index.texcoord = resolve_index(parse_index(p, end), chunk.texcoords.size() / 2, relative, 1 << 1);
+			}
+			if(p < end && *p == '/') {
+				p++;
+				index.normal = resolve_index(parse_index(p, end), chunk.normals.size() / 3, relative, 1 << 2);
+			}
+		}
+		return index;
+	}
+
+	void parse_chunk(const char* p, const char* end, ObjChunk& chunk) {
+		// Material being used inside this chunk
+		int32 curslot = -1;
+
+		// Reused for each face
+		std::vector<std::pair<ScarabModel::ObjIndex, uint8>> face;
+
+		while(p < end) {
+			skip_spaces(p, end);
+			if(p >= end) {
+				break;
+			}
+
+			const char c = *p;
+			if(c == 'v') {
+				p++;
+				if(p < end && is_space(*p)) {
+					chunk.vertices.push_back(parse_float(p, end));
+					chunk.vertices.push_back(parse_float(p, end));
+					chunk.vertices.push_back(parse_float(p, end));
+				} else if(p < end && *p == 't') {
+					p++;
+					chunk.texcoords.push_back(parse_float(p, end));
+					chunk.texcoords.push_back(parse_float(p, end));
+				} else if(p < end && *p == 'n') {
+					p++;
+					chunk.normals.push_back(parse_float(p, end));
+					chunk.normals.push_back(parse_float(p, end));
+					chunk.normals.push_back(parse_float(p, end));
+				}
+
+			} else if(c == 'f' && p + 1 < end && is_space(p[1])) {
+				p++;
+				face.clear();
+				while(true) {
+					skip_spaces(p, end);
+					if(p >= end || !(is_digit(*p) || *p == '-')) {
+						break;
+					}
+					uint8 relative = 0;
+					ScarabModel::ObjIndex index = parse_corner(p, end, chunk, relative);
+					face.emplace_back(index, relative);
+					// Ignore anything left in this corner
+					while(p < end && !is_space(*p) && *p != '\n' && *p != '\r') {
+						p++;
+					}
+				}
+
+				// Triangulate as a fan
+				for(size_t i = 2; i < face.size(); i++) {
+					for(const size_t corner : { size_t(0), i - 1, i }) {
+						if(face[corner].second != 0) {
+							chunk.relative.emplace_back(chunk.indices.size(), face[corner].second);
+						}
+						chunk.indices.push_back(face[corner].first);
+					}
+					chunk.material_slots.push_back(curslot);
+				}
+
+			} else if(c == 'u' && (size_t)(end - p) > 7 && std::strncmp(p, "usemtl", 6) == 0 && is_space(p[6])) {
+				p += 6;
+				chunk.usemtl.push_back(read_name(p, end));
+				curslot = (int32)chunk.usemtl.size() - 1;
+
+			} else if(c == 'm' && (size_t)(end - p) > 7 && std::strncmp(p, "mtllib", 6) == 0 && is_space(p[6])) {
+				p += 6;
+				chunk.mtllibs.push_back(read_name(p, end));
+			}
+
+			skip_line(p, end);
+		}
+	}
+}
+
+
+std::vector<ScarabModel::ObjMaterial> ScarabModel::parse_mtl(const std::filesystem::path& path) {
+	std::vector<ScarabModel::ObjMaterial> materials;
+
+	const ScarabVFS::File file = ScarabVFS::open(path, ScarabFile::Access::Sequential);
+	const std::string_view content = file.text();
+	const char* p   = content.data();
+	const char* end = content.data() + content.size();
+
+	while(p < end) {
+		skip_spaces(p, end);
+		if(p >= end) {
+			break;
+		}
+
+		// Read keyword
+		const char* keyword = p;
+		while(p < end && !is_space(*p) && *p != '\n' && *p != '\r') {
+			p++;
+		}
+		const std::string_view key = std::string_view(keyword, (size_t)(p - keyword));
+
+		if(key == "newmtl") {
+			materials.emplace_back();
+			materials.back().name = read_name(p, end);
+		} else if(!materials.empty()) {
+			ScarabModel::ObjMaterial& mat = materials.back();
+			if(key == "map_Kd") {
+				mat.diffuse_texname = read_name(p, end);
+			} else if(key == "map_Ks") {
+				mat.specular_texname = read_name(p, end);
+			} else if(key == "map_Bump" || key == "map_bump" || key == "bump") {
+				mat.bump_texname = read_name(p, end);
+			} else if(key == "norm" || key == "map_Kn") {
+				mat.normal_texname = read_name(p, end);
+			}
+		}
+
+		skip_line(p, end);
+	}
+
+	return materials;
+}
+
+
+ScarabModel::ObjData ScarabModel::parse_obj(const char* path) {
+	// Chunks are parsed at the same time, so all of it is needed at once
+	const ScarabVFS::File file = ScarabVFS::open(path, ScarabFile::Access::WillNeed);
+	if(!file.is_open()) {
+		throw ScarabError("Failed to load/parse (%s) file: file not found or empty", path);
+	}
+	const char* filedata = reinterpret_cast<const char*>(file.data());
+
+	// -- SPLIT IN LINE-ALIGNED CHUNKS
+	const size_t nchunks = std::clamp<size_t>(file.size() / OBJ_MIN_CHUNK_SIZE, 1, ScarabThread::worker_count());
+
+	std::vector<const char*> bounds(nchunks + 1);
+	bounds[0]       = filedata;
+	bounds[nchunks] = filedata + file.size();
+	for(size_t i = 1; i < nchunks; i++) {
+		const char* p = std::max(filedata + (file.size() * i / nchunks), bounds[i - 1]);
+		skip_line(p, bounds[nchunks]); // Start after the next line break
+		bounds[i] = p;
+	}
+
+	// -- PARSE IN PARALLEL
+	std::vector<ObjChunk> chunks(nchunks);
+	ScarabThread::parallel_for(nchunks, [&](const size_t begin, const size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			parse_chunk(bounds[i], bounds[i + 1], chunks[i]);
+		}
+	});
+
+	// -- MATERIALS
+	ScarabModel::ObjData data;
+	const std::filesystem::path modeldir = ScarabFile::parent_dir(path);
+	for(const ObjChunk& chunk : chunks) {
+		for(const std::string& lib : chunk.mtllibs) {
+			const std::filesystem::path libpath = modeldir / ScarabModel::treat_texname(lib);
+			data.mtllibs.push_back(libpath.string());
+			if(!ScarabVFS::exists(libpath)) {
+				LOG_WARNING("Material file '%s' referenced by model '%s' was not found", libpath.c_str(), path);
+				continue;
+			}
+			std::vector<ScarabModel::ObjMaterial> mats = ScarabModel::parse_mtl(libpath);
+			data.materials.insert(data.materials.end(),
+				std::make_move_iterator(mats.begin()), std::make_move_iterator(mats.end()));
+		}
+	}
+
+	// First material with the name wins
+	std::unordered_map<std::string_view, int32> matlookup;
+	for(size_t i = 0; i < data.materials.size(); i++) {
+		matlookup.emplace(data.materials[i].name, (int32)i);
+	}
+
+	// -- MERGE IN FILE ORDER
+	size_t nvertices  = 0;
+	size_t ntexcoords = 0;
+	size_t nnormals   = 0;
+	size_t nindices   = 0;
+	for(const ObjChunk& chunk : chunks) {
+		nvertices  += chunk.vertices.size();
+		ntexcoords += chunk.texcoords.size();
+		nnormals   += chunk.normals.size();
+		nindices   += chunk.indices.size();
+	}
+	data.vertices.reserve(nvertices);
+	data.texcoords.reserve(ntexcoords);
+	data.normals.reserve(nnormals);
+	data.indices.reserve(nindices);
+	data.material_ids.reserve(nindices / 3);
+
+	int32 curmatid = -1; // Material being used at the end of the previous chunk
+	for(ObjChunk& chunk : chunks) {
+		// Fix relative indices with the amount of elements before this chunk
+		const int32 voffset  = (int32)(data.vertices.size() / 3);
+		const int32 vtoffset = (int32)(data.texcoords.size() / 2);
+		const int32 vnoffset = (int32)(data.normals.size() / 3);
+		for(const auto& [pos, mask] : chunk.relative) {
+			ScarabModel::ObjIndex& index = chunk.indices[pos];
+			if(mask & (1 << 0)) index.vertex   += voffset;
+			if(mask & (1 << 1)) index.texcoord += vtoffset;
+			if(mask & (1 << 2)) index.normal   += vnoffset;
+		}
+
+		data.vertices.insert(data.vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+		data.texcoords.insert(data.texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+		data.normals.insert(data.normals.end(), chunk.normals.begin(), chunk.normals.end());
+		data.indices.insert(data.indices.end(), chunk.indices.begin(), chunk.indices.end());
+
+		// Resolve chunk material slots to material ids
+		std::vector<int32> slotids(chunk.usemtl.size());
+		for(size_t i = 0; i < chunk.usemtl.size(); i++) {
+			auto it = matlookup.find(chunk.usemtl[i]);
+			if(it == matlookup.end()) {
+				LOG_WARNING("Material '%s' not found in model '%s'", chunk.usemtl[i].c_str(), path);
+				slotids[i] = -1;
+			} else {
+				slotids[i] = it->second;
+			}
+		}
+		for(const int32 slot : chunk.material_slots) {
+			data.material_ids.push_back((slot < 0) ? curmatid : slotids[(size_t)slot]);
+		}
+		if(!slotids.empty()) {
+			curmatid = slotids.back();
+		}
+
+		// Free memory as soon as possible, big files have big chunks
+		chunk = ObjChunk();
+	}
+
+	// -- VALIDATE
+	const int32 maxv  = (int32)(data.vertices.size() / 3);
+	const int32 maxvt = (int32)(data.texcoords.size() / 2);
+	const int32 maxvn = (int32)(data.normals.size() / 3);
+	for(const ScarabModel::ObjIndex& index : data.indices) {
+		if(index.vertex < 0 || index.vertex >= maxv) {
+			throw ScarabError("Failed to load/parse (%s) file: invalid vertex index (%d)", path, index.vertex + 1);
+		}
+		if(index.texcoord < -1 || index.texcoord >= maxvt || index.normal < -1 || index.normal >= maxvn) {
+			throw ScarabError("Failed to load/parse (%s) file: index out of range", path);
+		}
+	}
+
+	return data;
+}
@@ -1,5 +1,15 @@
 #include "scarablib/utils/opengl.hpp"
+#include <atomic>
 #include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace {
+	// No id until Window sets it, so every thread runs OpenGL calls directly
+	std::atomic<std::thread::id> context_thread;
+	std::mutex queue_mutex;
+	std::vector<std::function<void()>> queue;
+}
 
 void ScarabOpenGL::check_gl_error(const char* file, const int line) {
 	GLenum error;
@@ -7,3 +17,39 @@ void ScarabOpenGL::check_gl_error(const char* file, const int line) {
 		std::cerr << "OpenGL Error " << error << " at " << file << ":" << line << std::endl;
 	}
 }
+
+void ScarabOpenGL::set_context_thread() noexcept {
+	context_thread.store(std::this_thread::get_id(), std::memory_order_release);
+}
+
+bool ScarabOpenGL::is_context_thread() noexcept {
+	const std::thread::id id = context_thread.load(std::memory_order_acquire);
+	return id == std::thread::id() || id == std::this_thread::get_id();
+}
+
+void ScarabOpenGL::submit(std::function<void()> command) {
+	if(ScarabOpenGL::is_context_thread()) {
+		command();
+		return;
+	}
+	std::lock_guard<std::mutex> lock(queue_mutex);
+	queue.emplace_back(std::move(command));
+}
+
+size_t ScarabOpenGL::run_commands() noexcept {
+	// Taken out of the queue, so other threads can keep queueing while these run
+	std::vector<std::function<void()>> commands;
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		if(queue.empty()) {
+			return 0;
+		}
+		std::swap(queue, commands);
+	}
+
+	// Commands submitted by these run right away, this is the context thread
+	for(std::function<void()>& command : commands) {
+		command();
+	}
+	return commands.size();
+}
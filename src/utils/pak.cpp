@@ -0,0 +1,237 @@
+#include "scarablib/utils/pak.hpp"
+#include "scarablib/proper/error.hpp"
+#include "scarablib/utils/hash.hpp"
+#include "scarablib/utils/lz4.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	// Header: magic, version, entry count, alignment, directory offset and names offset and size
+	constexpr uint32 PAK_MAGIC       = 0x4B415053; // "SPAK"
+	constexpr uint32 PAK_VERSION     = 1;
+	constexpr size_t PAK_HEADER_SIZE = 64;
+
+	// Compressed files must be at least this smaller, otherwise decompressing is a waste
+	constexpr size_t MIN_SAVING_RATIO = 16; // 1/16 (6.25%)
+
+	template <typename T>
+	inline T read(const uint8* data) noexcept {
+		T value;
+		std::memcpy(&value, data, sizeof(T));
+		return value;
+	}
+
+	inline uint64 name_hash(const std::string_view name) noexcept {
+		return ScarabHash::hash_bytes(name.data(), name.size());
+	}
+
+	inline bool entry_less(const ScarabPak::Entry& entry, const uint64 hash) noexcept {
+		return entry.hash < hash;
+	}
+}
+
+
+std::string ScarabPak::normalize(const std::string_view path) {
+	std::string name = std::string(path);
+	std::replace(name.begin(), name.end(), '\\', '/');
+	name = std::filesystem::path(name).lexically_normal().generic_string();
+	while(name.starts_with("./")) {
+		name.erase(0, 2);
+	}
+	return name;
+}
+
+
+ScarabPak::Archive::Archive(const std::filesystem::path& path) {
+	// Entries are read in any order
+	this->file = ScarabFile::MappedFile(path, ScarabFile::Access::Random);
+	if(!this->file.is_open()) {
+		throw ScarabError("Archive (%s) was not found", path.string().c_str());
+	}
+
+	const uint8* data = this->file.data();
+	const size_t size = this->file.size();
+	if(size < PAK_HEADER_SIZE || read<uint32>(data) != PAK_MAGIC) {
+		throw ScarabError("Archive (%s) is not a scarabpak file", path.string().c_str());
+	}
+	if(read<uint32>(data + 4) != PAK_VERSION) {
+		throw ScarabError("Archive (%s) has unsupported version %u", path.string().c_str(), read<uint32>(data + 4));
+	}
+
+	const uint32 count      = read<uint32>(data + 8);
+	const uint64 dir_offset = read<uint64>(data + 16);
+	const uint64 names_offset = read<uint64>(data + 24);
+	const uint64 names_size   = read<uint64>(data + 32);
+	if(dir_offset > size || (size - dir_offset) / sizeof(Entry) < count
+		|| names_offset > size || size - names_offset < names_size) {
+		throw ScarabError("Archive (%s) has an invalid directory", path.string().c_str());
+	}
+
+	// Copied, so entries don't need to be aligned inside the file
+	this->entries.resize(count);
+	std::memcpy(this->entries.data(), data + dir_offset, count * sizeof(Entry));
+	this->names      = reinterpret_cast<const char*>(data + names_offset);
+	this->names_size = names_size;
+
+	for(const Entry& entry : this->entries) {
+		if(entry.offset > size || size - entry.offset < entry.size
+			|| static_cast<uint64>(entry.name_offset) + entry.name_length > names_size
+			|| (entry.method == Method::Stored && entry.size != entry.original_size)
+			|| entry.method > Method::LZ4) {
+			throw ScarabError("Archive (%s) has an invalid entry", path.string().c_str());
+		}
+	}
+}
+
+const ScarabPak::Entry* ScarabPak::Archive::find(const std::string_view name) const noexcept {
+	const uint64 hash = name_hash(name);
+	auto it = std::lower_bound(this->entries.begin(), this->entries.end(), hash, entry_less);
+	// Different names may have the same hash
+	for(; it != this->entries.end() && it->hash == hash; it++) {
+		if(this->get_name(*it) == name) {
+			return &(*it);
+		}
+	}
+	return nullptr;
+}
+
+std::string_view ScarabPak::Archive::get_name(const Entry& entry) const noexcept {
+	return std::string_view(this->names + entry.name_offset, entry.name_length);
+}
+
+bool ScarabPak::Archive::extract(const Entry& entry, uint8* dst) const noexcept {
+	switch(entry.method) {
+		case Method::Stored:
+			std::memcpy(dst, this->stored_data(entry), entry.size);
+			return true;
+		case Method::LZ4:
+			return ScarabLZ4::decompress(this->stored_data(entry), entry.size, dst, entry.original_size);
+	}
+	return false;
+}
+
+
+void ScarabPak::write(const std::filesystem::path& output, const std::vector<Source>& files, const bool compress) {
+	std::vector<Entry> entries;
+	entries.reserve(files.size());
+	std::string names;
+
+	// Written to a temporary file and renamed, so a half written archive is never read
+	const bool written = ScarabFile::write_atomic(output, [&](std::ostream& file) {
+		const auto pad_to = [&file](const size_t alignment) {
+			const size_t position = static_cast<size_t>(file.tellp());
+			const size_t padding  = (alignment - position % alignment) % alignment;
+			static const char zeros[ALIGNMENT] = {};
+			file.write(zeros, static_cast<std::streamsize>(padding));
+		};
+
+		// Header is written at the end, when offsets are known
+		const uint8 empty[PAK_HEADER_SIZE] = {};
+		file.write(reinterpret_cast<const char*>(empty), sizeof(empty));
+
+		for(const Source& source : files) {
+			const std::string name = ScarabPak::normalize(source.name);
+			if(name.empty() || name.size() > UINT16_MAX) {
+				throw ScarabError("Invalid archive name (%s)", source.name.c_str());
+			}
+
+			Entry entry = {};
+			entry.hash        = name_hash(name);
+			entry.name_offset = static_cast<uint32>(names.size());
+			entry.name_length = static_cast<uint16>(name.size());
+			entry.method      = Method::Stored;
+
+			// Stored files are copied in chunks, so big files are never fully in memory
+			if(!compress) {
+				ScarabFile::FileReader reader = ScarabFile::FileReader(source.path);
+				if(!reader.is_open()) {
+					throw ScarabError("File (%s) was not found", source.path.string().c_str());
+				}
+
+				pad_to(ALIGNMENT);
+				entry.offset = static_cast<uint64>(file.tellp());
+				for(std::span<const uint8> chunk = reader.next(); !chunk.empty(); chunk = reader.next()) {
+					file.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+				}
+				if(reader.position() != reader.size()) {
+					throw ScarabError("Could not read file (%s)", source.path.string().c_str());
+				}
+				entry.size          = reader.size();
+				entry.original_size = reader.size();
+
+				names += name;
+				entries.push_back(entry);
+				continue;
+			}
+
+			const ScarabFile::MappedFile content = ScarabFile::MappedFile(source.path, ScarabFile::Access::Sequential);
+			if(!content.is_open() && !ScarabFile::file_exists(source.path)) {
+				throw ScarabError("File (%s) was not found", source.path.string().c_str());
+			}
+			entry.original_size = content.size();
+
+			std::vector<uint8> compressed;
+			if(content.size() > 0) {
+				compressed = ScarabLZ4::compress(content.data(), content.size());
+				if(compressed.size() <= content.size() - content.size() / MIN_SAVING_RATIO) {
+					entry.method = Method::LZ4;
+				}
+			}
+
+			pad_to(ALIGNMENT);
+			entry.offset = static_cast<uint64>(file.tellp());
+			if(entry.method == Method::LZ4) {
+				entry.size = compressed.size();
+				file.write(reinterpret_cast<const char*>(compressed.data()), static_cast<std::streamsize>(compressed.size()));
+			} else {
+				entry.size = content.size();
+				file.write(reinterpret_cast<const char*>(content.data()), static_cast<std::streamsize>(content.size()));
+			}
+
+			names += name;
+			entries.push_back(entry);
+		}
+
+		// Sorted by hash for binary search, then by name so the output is always the same
+		std::sort(entries.begin(), entries.end(), [&names](const Entry& a, const Entry& b) {
+			if(a.hash != b.hash) {
+				return a.hash < b.hash;
+			}
+			return std::string_view(names).substr(a.name_offset, a.name_length)
+				< std::string_view(names).substr(b.name_offset, b.name_length);
+		});
+		for(size_t i = 1; i < entries.size(); i++) {
+			const std::string_view previous = std::string_view(names).substr(entries[i - 1].name_offset, entries[i - 1].name_length);
+			if(entries[i].hash == entries[i - 1].hash && std::string_view(names).substr(entries[i].name_offset, entries[i].name_length) == previous) {
+				throw ScarabError("Archive has two files named (%s)", std::string(previous).c_str());
+			}
+		}
+
+		pad_to(alignof(Entry));
+		const uint64 dir_offset = static_cast<uint64>(file.tellp());
+		file.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(Entry)));
+		const uint64 names_offset = static_cast<uint64>(file.tellp());
+		file.write(names.data(), static_cast<std::streamsize>(names.size()));
+
+		uint8 header[PAK_HEADER_SIZE] = {};
+		const auto write32 = [&header](const size_t offset, const uint32 value) {
+			std::memcpy(header + offset, &value, sizeof(uint32));
+		};
+		const auto write64 = [&header](const size_t offset, const uint64 value) {
+			std::memcpy(header + offset, &value, sizeof(uint64));
+		};
+		write32(0, PAK_MAGIC);
+		write32(4, PAK_VERSION);
+		write32(8, static_cast<uint32>(entries.size()));
+		write32(12, static_cast<uint32>(ALIGNMENT));
+		write64(16, dir_offset);
+		write64(24, names_offset);
+		write64(32, names.size());
+		file.seekp(0);
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	});
+
+	if(!written) {
+		throw ScarabError("Could not write archive (%s)", output.string().c_str());
+	}
+}
@@ -0,0 +1,276 @@
+#include "scarablib/utils/quantize.hpp"
+#include "scarablib/utils/thread.hpp"
+#include <glm/ext/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define SCARAB_QUANTIZE_SSE2
+	#include <emmintrin.h>
+#endif
+
+#if defined(__F16C__)
+	#define SCARAB_QUANTIZE_F16C
+	#include <immintrin.h>
+#endif
+
+namespace {
+	// Vertices per job when quantizing in parallel
+	constexpr size_t QUANTIZE_MIN_BATCH = 1 << 16;
+
+	// Values used to move positions to [-1, 1]
+	struct Bounds {
+		vec3<float> center;
+		vec3<float> inverse_extent;
+
+		Bounds(const vec3<float>& min, const vec3<float>& max) noexcept {
+			const vec3<float> extent = (max - min) * 0.5f;
+			this->center = (max + min) * 0.5f;
+			// Flat axes are stored as 0
+			for(uint32 i = 0; i < 3; i++) {
+				this->inverse_extent[i] = (extent[i] > 0.0f) ? 1.0f / extent[i] : 0.0f;
+			}
+		}
+	};
+
+#if defined(SCARAB_QUANTIZE_SSE2)
+	// Rounds half away from zero like std::lround, _mm_cvtps_epi32 rounds half to even.
+	// Adds the float just below 0.5, so values just below a half do not round up when added
+	inline __m128i round_away(const __m128 value) noexcept {
+		const __m128 half = _mm_or_ps(_mm_set1_ps(0x1.fffffep-2f), _mm_and_ps(value, _mm_set1_ps(-0.0f)));
+		return _mm_cvttps_epi32(_mm_add_ps(value, half));
+	}
+#endif
+
+	// Both paths give the same output
+	inline vec2<uint16> pack_texuv(const vec2<float>& texuv) noexcept {
+	#if defined(SCARAB_QUANTIZE_SSE2)
+		__m128 uv = _mm_setr_ps(texuv.x, texuv.y, 0.0f, 0.0f);
+		uv = _mm_min_ps(_mm_max_ps(uv, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		__m128i packed = round_away(_mm_mul_ps(uv, _mm_set1_ps(65535.0f)));
+		// SSE2 has no unsigned pack, move to signed range and back
+		packed = _mm_sub_epi32(packed, _mm_set1_epi32(32768));
+		packed = _mm_packs_epi32(packed, packed);
+		packed = _mm_xor_si128(packed, _mm_set1_epi16(static_cast<short>(0x8000)));
+
+		const int32 bits = _mm_cvtsi128_si32(packed);
+		vec2<uint16> output;
+		std::memcpy(&output, &bits, sizeof(output));
+		return output;
+	#else
+		return vec2<uint16>(
+			static_cast<uint16>(std::lround(std::clamp(texuv.x, 0.0f, 1.0f) * 65535.0f)),
+			static_cast<uint16>(std::lround(std::clamp(texuv.y, 0.0f, 1.0f) * 65535.0f))
+		);
+	#endif
+	}
+
+	// Both paths give the same output
+	inline vec4<int16> pack_snorm16(const vec3<float>& position, const Bounds& bounds) noexcept {
+	#if defined(SCARAB_QUANTIZE_SSE2)
+		const __m128 value  = _mm_setr_ps(position.x, position.y, position.z, 0.0f);
+		const __m128 center = _mm_setr_ps(bounds.center.x, bounds.center.y, bounds.center.z, 0.0f);
+		const __m128 scale  = _mm_setr_ps(bounds.inverse_extent.x, bounds.inverse_extent.y, bounds.inverse_extent.z, 0.0f);
+
+		// Same operations and order as the scalar path
+		__m128 normalized = _mm_mul_ps(_mm_sub_ps(value, center), scale);
+		normalized = _mm_min_ps(_mm_max_ps(normalized, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+		__m128i packed = round_away(_mm_mul_ps(normalized, _mm_set1_ps(32767.0f)));
+		packed = _mm_packs_epi32(packed, packed);
+
+		vec4<int16> output;
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(&output), packed);
+		return output;
+	#else
+		vec4<int16> output(0);
+		for(uint32 i = 0; i < 3; i++) {
+			const float value = std::clamp((position[i] - bounds.center[i]) * bounds.inverse_extent[i], -1.0f, 1.0f);
+			output[i] = static_cast<int16>(std::lround(value * 32767.0f));
+		}
+		return output;
+	#endif
+	}
+
+	inline vec4<uint16> pack_half(const vec3<float>& position, const Bounds& bounds) noexcept {
+		const vec3<float> value = (position - bounds.center) * bounds.inverse_extent;
+	#if defined(SCARAB_QUANTIZE_F16C)
+		const __m128i packed = _mm_cvtps_ph(_mm_setr_ps(value.x, value.y, value.z, 0.0f), _MM_FROUND_TO_NEAREST_INT);
+		vec4<uint16> output;
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(&output), packed);
+		return output;
+	#else
+		return vec4<uint16>(
+			ScarabQuantize::float_to_half(value.x),
+			ScarabQuantize::float_to_half(value.y),
+			ScarabQuantize::float_to_half(value.z),
+			0
+		);
+	#endif
+	}
+}
+
+
+uint16 ScarabQuantize::float_to_half(const float value) noexcept {
+	uint32 bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	const uint32 sign = (bits >> 16) & 0x8000;
+	const uint32 abs  = bits & 0x7FFFFFFF;
+
+	// Inf or NaN
+	if(abs >= 0x7F800000) {
+		return static_cast<uint16>(sign | 0x7C00 | ((abs > 0x7F800000) ? 0x200 : 0));
+	}
+
+	// Rounds to Inf (>= 65520)
+	if(abs >= 0x477FF000) {
+		return static_cast<uint16>(sign | 0x7C00);
+	}
+
+	// Subnormal half (< 2^-14)
+	if(abs < 0x38800000) {
+		// Rounds to zero (<= 2^-25)
+		if(abs <= 0x33000000) {
+			return static_cast<uint16>(sign);
+		}
+
+		const uint32 mantissa = (abs & 0x7FFFFF) | 0x800000;
+		const uint32 shift    = 126 - (abs >> 23);
+		uint32 result         = mantissa >> shift;
+		const uint32 rest     = mantissa & ((1u << shift) - 1);
+		const uint32 halfway  = 1u << (shift - 1);
+		if(rest > halfway || (rest == halfway && (result & 1))) {
+			result++;
+		}
+		return static_cast<uint16>(sign | result);
+	}
+
+	// Normal, rebias exponent from 127 to 15
+	uint32 result     = (abs >> 13) - (112 << 10);
+	const uint32 rest = abs & 0x1FFF;
+	if(rest > 0x1000 || (rest == 0x1000 && (result & 1))) {
+		result++; // May carry to the exponent, that is fine
+	}
+	return static_cast<uint16>(sign | result);
+}
+
+
+float ScarabQuantize::half_to_float(const uint16 value) noexcept {
+	const uint32 sign     = static_cast<uint32>(value & 0x8000) << 16;
+	const uint32 exponent = (value >> 10) & 0x1F;
+	uint32 mantissa       = value & 0x3FF;
+
+	uint32 bits;
+	if(exponent == 0x1F) { // Inf or NaN
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	} else if(exponent != 0) { // Normal
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	} else if(mantissa == 0) { // Zero
+		bits = sign;
+	} else { // Subnormal, normalize it
+		uint32 shift = 0;
+		while((mantissa & 0x400) == 0) {
+			mantissa <<= 1;
+			shift++;
+		}
+		bits = sign | ((113 - shift) << 23) | ((mantissa & 0x3FF) << 13);
+	}
+
+	float output;
+	std::memcpy(&output, &bits, sizeof(output));
+	return output;
+}
+
+
+vec2<int16> ScarabQuantize::encode_octahedral(const vec3<float>& normal) noexcept {
+	const float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	if(length == 0.0f) {
+		return vec2<int16>(0);
+	}
+
+	vec2<float> encoded = vec2<float>(normal.x, normal.y) / length;
+	// Lower hemisphere is folded over the diagonals
+	if(normal.z < 0.0f) {
+		encoded = vec2<float>(
+			(1.0f - std::abs(encoded.y)) * ((encoded.x >= 0.0f) ? 1.0f : -1.0f),
+			(1.0f - std::abs(encoded.x)) * ((encoded.y >= 0.0f) ? 1.0f : -1.0f)
+		);
+	}
+
+	return vec2<int16>(
+		static_cast<int16>(std::lround(std::clamp(encoded.x, -1.0f, 1.0f) * 32767.0f)),
+		static_cast<int16>(std::lround(std::clamp(encoded.y, -1.0f, 1.0f) * 32767.0f))
+	);
+}
+
+
+vec3<float> ScarabQuantize::decode_octahedral(const vec2<int16>& encoded) noexcept {
+	const vec2<float> value = glm::max(vec2<float>(encoded) / 32767.0f, vec2<float>(-1.0f));
+
+	vec3<float> normal = vec3<float>(value.x, value.y, 1.0f - std::abs(value.x) - std::abs(value.y));
+	const float fold = std::max(-normal.z, 0.0f);
+	normal.x += (normal.x >= 0.0f) ? -fold : fold;
+	normal.y += (normal.y >= 0.0f) ? -fold : fold;
+	return glm::normalize(normal);
+}
+
+
+glm::mat4 ScarabQuantize::dequantize_matrix(const vec3<float>& min, const vec3<float>& max) noexcept {
+	vec3<float> extent = (max - min) * 0.5f;
+	// Flat axes are stored as 0, any scale works. 1 keeps the matrix invertible
+	for(uint32 i = 0; i < 3; i++) {
+		if(extent[i] <= 0.0f) {
+			extent[i] = 1.0f;
+		}
+	}
+
+	glm::mat4 matrix = glm::translate(glm::mat4(1.0f), (max + min) * 0.5f);
+	return glm::scale(matrix, extent);
+}
+
+
+std::vector<VertexPacked> ScarabQuantize::quantize_snorm16(const Vertex* vertices, const size_t count,
+		const vec3<float>& min, const vec3<float>& max) {
+
+	const Bounds bounds = Bounds(min, max);
+	std::vector<VertexPacked> output(count);
+	ScarabThread::parallel_for(count, [&](const size_t begin, const size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			output[i].position = pack_snorm16(vertices[i].position, bounds);
+			output[i].texuv    = pack_texuv(vertices[i].texuv);
+		}
+	}, QUANTIZE_MIN_BATCH);
+	return output;
+}
+
+
+std::vector<VertexPackedHalf> ScarabQuantize::quantize_half(const Vertex* vertices, const size_t count,
+		const vec3<float>& min, const vec3<float>& max) {
+
+	const Bounds bounds = Bounds(min, max);
+	std::vector<VertexPackedHalf> output(count);
+	ScarabThread::parallel_for(count, [&](const size_t begin, const size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			output[i].position = pack_half(vertices[i].position, bounds);
+			output[i].texuv    = pack_texuv(vertices[i].texuv);
+		}
+	}, QUANTIZE_MIN_BATCH);
+	return output;
+}
+
+
+std::vector<VertexPackedNormal> ScarabQuantize::quantize_snorm16(const Vertex* vertices, const vec3<float>* normals,
+		const size_t count, const vec3<float>& min, const vec3<float>& max) {
+
+	const Bounds bounds = Bounds(min, max);
+	std::vector<VertexPackedNormal> output(count);
+	ScarabThread::parallel_for(count, [&](const size_t begin, const size_t end) {
+		for(size_t i = begin; i < end; i++) {
+			output[i].position = pack_snorm16(vertices[i].position, bounds);
+			output[i].texuv    = pack_texuv(vertices[i].texuv);
+			output[i].normal   = ScarabQuantize::encode_octahedral(normals[i]);
+		}
+	}, QUANTIZE_MIN_BATCH);
+	return output;
+}
@@ -17,6 +17,48 @@ std::string StringHelper::file_extension(const std::string& filename) noexcept {
 	return ext;
 }
 
+uint32 StringHelper::next_codepoint(std::string_view text, size_t& index) noexcept {
+	const uint8 first = static_cast<uint8>(text[index++]);
+	if(first < 0x80) {
+		return first;
+	}
+
+	// Number of continuation bytes and the bits of the first byte
+	uint32 count, codepoint;
+	if((first & 0xE0) == 0xC0) {
+		count = 1;
+		codepoint = first & 0x1F;
+	} else if((first & 0xF0) == 0xE0) {
+		count = 2;
+		codepoint = first & 0x0F;
+	} else if((first & 0xF8) == 0xF0) {
+		count = 3;
+		codepoint = first & 0x07;
+	} else {
+		return StringHelper::INVALID_CODEPOINT;
+	}
+
+	if(index + count > text.size()) {
+		return StringHelper::INVALID_CODEPOINT;
+	}
+	for(uint32 i = 0; i < count; i++) {
+		const uint8 byte = static_cast<uint8>(text[index + i]);
+		if((byte & 0xC0) != 0x80) {
+			return StringHelper::INVALID_CODEPOINT;
+		}
+		codepoint = (codepoint << 6) | (byte & 0x3F);
+	}
+
+	// Overlong encodings, surrogates and values past the last codepoint
+	constexpr uint32 MIN_VALUE[] = { 0, 0x80, 0x800, 0x10000 };
+	if(codepoint < MIN_VALUE[count] || (codepoint >= 0xD800 && codepoint <= 0xDFFF) || codepoint > 0x10FFFF) {
+		return StringHelper::INVALID_CODEPOINT;
+	}
+
+	index += count;
+	return codepoint;
+}
+
 
 // std::string StringHelper::base_dir(const std::string& path) noexcept {
 // 	// Find the last position of '.' in filename
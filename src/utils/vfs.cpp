@@ -0,0 +1,145 @@
+#include "scarablib/utils/vfs.hpp"
+#include "scarablib/proper/log.hpp"
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+namespace {
+	struct Mount {
+		std::filesystem::path path;
+		// Normalized, empty if mounted at the root
+		std::string prefix;
+		std::shared_ptr<const ScarabPak::Archive> archive;
+	};
+
+	std::shared_mutex mutex;
+	std::vector<Mount> mounts;
+	// Skips normalizing paths when nothing is mounted
+	std::atomic<size_t> mount_count = 0;
+
+	// Finds a file in the mounted archives, the last mounted first
+	bool find(const std::filesystem::path& path, std::shared_ptr<const ScarabPak::Archive>& archive, const ScarabPak::Entry*& entry) {
+		if(mount_count.load(std::memory_order_acquire) == 0) {
+			return false;
+		}
+
+		const std::string name = ScarabPak::normalize(path.string());
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		for(auto it = mounts.rbegin(); it != mounts.rend(); it++) {
+			std::string_view relative = name;
+			if(!it->prefix.empty()) {
+				if(relative.size() <= it->prefix.size() || !relative.starts_with(it->prefix) || relative[it->prefix.size()] != '/') {
+					continue;
+				}
+				relative.remove_prefix(it->prefix.size() + 1);
+			}
+
+			const ScarabPak::Entry* found = it->archive->find(relative);
+			if(found != nullptr) {
+				archive = it->archive;
+				entry   = found;
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+
+void ScarabVFS::mount(const std::filesystem::path& path, const std::string& prefix) {
+	auto archive = std::make_shared<const ScarabPak::Archive>(path);
+
+	std::string normalized = (prefix.empty()) ? std::string() : ScarabPak::normalize(prefix);
+	while(!normalized.empty() && normalized.back() == '/') {
+		normalized.pop_back();
+	}
+	if(normalized == ".") {
+		normalized.clear();
+	}
+
+	std::unique_lock<std::shared_mutex> lock(mutex);
+	mounts.push_back(Mount { path, std::move(normalized), std::move(archive) });
+	mount_count.store(mounts.size(), std::memory_order_release);
+}
+
+bool ScarabVFS::unmount(const std::filesystem::path& path) noexcept {
+	std::unique_lock<std::shared_mutex> lock(mutex);
+	for(auto it = mounts.begin(); it != mounts.end(); it++) {
+		if(it->path == path) {
+			mounts.erase(it);
+			mount_count.store(mounts.size(), std::memory_order_release);
+			return true;
+		}
+	}
+	return false;
+}
+
+void ScarabVFS::unmount_all() noexcept {
+	std::unique_lock<std::shared_mutex> lock(mutex);
+	mounts.clear();
+	mount_count.store(0, std::memory_order_release);
+}
+
+bool ScarabVFS::exists(const std::filesystem::path& path) noexcept {
+	return ScarabVFS::in_archive(path) || ScarabFile::file_exists(path);
+}
+
+bool ScarabVFS::in_archive(const std::filesystem::path& path) noexcept {
+	std::shared_ptr<const ScarabPak::Archive> archive;
+	const ScarabPak::Entry* entry = nullptr;
+	try {
+		return find(path, archive, entry);
+	} catch(...) {
+		return false;
+	}
+}
+
+ScarabVFS::File ScarabVFS::open(const std::filesystem::path& path, const ScarabFile::Access access) noexcept {
+	File result;
+
+	std::shared_ptr<const ScarabPak::Archive> archive;
+	const ScarabPak::Entry* entry = nullptr;
+	bool found = false;
+	try {
+		found = find(path, archive, entry);
+	} catch(...) {
+		found = false;
+	}
+
+	if(found) {
+		if(entry->original_size == 0) {
+			return result;
+		}
+
+		// Compressed entries are read once by the decompressor
+		archive->advise(*entry, (entry->method == ScarabPak::Method::Stored) ? access : ScarabFile::Access::Sequential);
+
+		if(entry->method == ScarabPak::Method::Stored) {
+			result.bytes   = archive->stored_data(*entry);
+			result.length  = entry->size;
+			result.archive = std::move(archive);
+			return result;
+		}
+
+		try {
+			result.buffer.resize(entry->original_size);
+		} catch(...) {
+			LOG_WARNING("Not enough memory to decompress (%s)", path.string().c_str());
+			return result;
+		}
+		if(!archive->extract(*entry, result.buffer.data())) {
+			LOG_WARNING("File (%s) is corrupted inside its archive", path.string().c_str());
+			result.buffer.clear();
+			return result;
+		}
+		result.bytes  = result.buffer.data();
+		result.length = result.buffer.size();
+		return result;
+	}
+
+	result.file   = ScarabFile::MappedFile(path, access);
+	result.bytes  = result.file.data();
+	result.length = result.file.size();
+	return result;
+}
@@ -1,8 +1,11 @@
 #include "scarablib/window/window.hpp"
+#include "scarablib/geometry/modelasset.hpp"
+#include "scarablib/opengl/assets.hpp"
 #include "scarablib/opengl/resourcesmanager.hpp"
 #include "scarablib/proper/error.hpp"
 #include "scarablib/proper/log.hpp"
 #include "scarablib/typedef.hpp"
+#include "scarablib/utils/opengl.hpp"
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_timer.h>
@@ -62,6 +65,8 @@ Window::Window(const Window::Config& config)
 		this->cleanup();
 		throw ScarabError("Failed to initialize GLAD");
 	}
+	// Other threads send their OpenGL calls to this one
+	ScarabOpenGL::set_context_thread();
 
 	// Configure OpenGL
 	glViewport(0, 0, (GLsizei)config.width, (GLsizei)config.height);
@@ -108,9 +113,17 @@ Window::~Window() noexcept {
 		return;
 	}
 
+	// Deletes queued by other threads
+	ScarabOpenGL::run_commands();
+
 	// Clean up OpenGL Buffers
+	// Models first, they hold textures and geometry ranges
+	ModelAsset::cleanup();
+	// Textures and Texture Arrays
+	Assets::cleanup();
 	// Vertex Arrays, Shaders, Shader Programs and Uniform Buffers
 	ResourcesManager::get_instance().cleanup();
+	ScarabOpenGL::run_commands();
 	this->cleanup();
 }
 
@@ -137,6 +150,17 @@ void Window::cleanup() noexcept {
 void Window::swap_buffers() noexcept {
 	// Make operations that need to happen at the end of each frame
 	this->frame_events.clear(); // Clear events
+	// Resources created and deleted by other threads
+	ScarabOpenGL::run_commands();
+	// Caches only notice released resources when trimmed, once per second is enough for their grace period
+	const uint32 now = SDL_GetTicks();
+	if(now - this->last_trim >= 1000) {
+		this->last_trim = now;
+		// Models first, they hold textures
+		ModelAsset::get_cache().trim();
+		Assets::trim();
+		ResourcesManager::get_instance().trim();
+	}
 	SDL_GL_SwapWindow(this->window);
 }
 
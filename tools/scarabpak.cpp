@@ -0,0 +1,58 @@
+// Packs directories into a `.scarabpak` archive, loaded with `ScarabVFS::mount`.
+// Usage: scarabpak [--store] <output.scarabpak> <directory>...
+// Files are named relative to their directory (e.g., `resources/textures/wall.png` -> `textures/wall.png`).
+// --store: Does not compress files
+
+#include "scarablib/utils/pak.hpp"
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <vector>
+
+int main(int argc, char** argv) {
+	bool compress = true;
+	int arg = 1;
+	if(arg < argc && std::strcmp(argv[arg], "--store") == 0) {
+		compress = false;
+		arg++;
+	}
+
+	if(argc - arg < 2) {
+		std::fprintf(stderr, "Usage: %s [--store] <output.scarabpak> <directory>...\n", argv[0]);
+		return 1;
+	}
+
+	const std::filesystem::path output = argv[arg++];
+
+	try {
+		std::vector<ScarabPak::Source> files;
+		for(; arg < argc; arg++) {
+			const std::filesystem::path directory = argv[arg];
+			if(!std::filesystem::is_directory(directory)) {
+				std::fprintf(stderr, "Directory (%s) was not found\n", argv[arg]);
+				return 1;
+			}
+
+			for(const auto& entry : std::filesystem::recursive_directory_iterator(directory)) {
+				// Skips unfinished cache files
+				if(!entry.is_regular_file() || entry.path().extension() == ".tmp") {
+					continue;
+				}
+				files.push_back(ScarabPak::Source {
+					.path = entry.path(),
+					.name = std::filesystem::relative(entry.path(), directory).generic_string()
+				});
+			}
+		}
+
+		ScarabPak::write(output, files, compress);
+		std::printf("Packed %zu files into %s\n", files.size(), output.string().c_str());
+
+	} catch(const std::exception& err) {
+		std::fprintf(stderr, "%s\n", err.what());
+		return 1;
+	}
+
+	return 0;
+}